@@ -41,8 +41,10 @@ static const test_t tests[] =
   { "hash",       hash_test       },
   { "list",       list_test       },
   { "ntree",      ntree_test      },
+  { "ringbuf",    ringbuf_test    },
   { "vector",     vector_test     },
 
+  { "filenamedb", filenamedb_test },
   { "pickle",     pickle_test     },
   { "tagdb",      tagdb_test      },
 
@@ -53,8 +55,10 @@ static const test_t tests[] =
   { "layout",     layout_test     },
   { "packer",     packer_test     },
 
+  { "sink",       sink_test       },
   { "stream",     stream_test     },
 
+  { "arena",      arena_test      },
   { "array",      array_test      },
   { "bsearch",    bsearch_test    },
 };
@@ -0,0 +1,41 @@
+/* atomic.h -- minimal atomic operations */
+
+/**
+ * \file atomic.h
+ *
+ * The few atomic operations needed by DPTLib's lock-free structures.
+ *
+ * Loads and stores of naturally aligned words with acquire, release or
+ * relaxed ordering. With GCC or clang these use the __atomic builtins.
+ * Elsewhere they degrade to plain accesses which is only correct where
+ * there are no threads, as on RISC OS, so building with such a compiler and
+ * DPTLIB_THREADS defined is an error.
+ */
+
+#ifndef BASE_ATOMIC_H
+#define BASE_ATOMIC_H
+
+/** Assumed size of a cache line, for separating shared counters. */
+#define CACHELINE_SIZE 64
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define ATOMIC_LOAD_ACQUIRE(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_LOAD_RELAXED(p)      __atomic_load_n((p), __ATOMIC_RELAXED)
+#define ATOMIC_STORE_RELEASE(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_STORE_RELAXED(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+#else
+
+#ifdef DPTLIB_THREADS
+#error No atomic operations for this compiler. Build without DPTLIB_THREADS.
+#endif
+
+#define ATOMIC_LOAD_ACQUIRE(p)      (*(p))
+#define ATOMIC_LOAD_RELAXED(p)      (*(p))
+#define ATOMIC_STORE_RELEASE(p, v)  (*(p) = (v))
+#define ATOMIC_STORE_RELAXED(p, v)  (*(p) = (v))
+
+#endif
+
+#endif /* BASE_ATOMIC_H */
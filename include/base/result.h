@@ -19,6 +19,8 @@ typedef int result_t;
 #define result_BASE_PACKER                      0x0800
 #define result_BASE_LAYOUT                      0x0900
 #define result_BASE_BITFIFO                     0x0A00
+#define result_BASE_SINK                        0x0B00
+#define result_BASE_CACHE                       0x0C00
 
 /* Non-DPTLib bases */
 #define result_BASE_MMPLAYER                    0x4000
@@ -49,6 +51,8 @@ typedef int result_t;
 
 /* Stream result codes are in io/stream.h */
 
+/* Sink result codes are in io/sink.h */
+
 /* Atom result codes are in datastruct/atom.h */
 
 /* Hash result codes are in datastruct/hash.h */
@@ -49,6 +49,13 @@ void filenamedb_fin(void);
 typedef struct filenamedb T;
 
 result_t filenamedb_open(const char *filename, T **db);
+
+/**
+ * As filenamedb_open, but parse the file using multiple threads.
+ *
+ * \param nthreads Number of threads to use, or zero for one per processor.
+ */
+result_t filenamedb_open_parallel(const char *filename, int nthreads, T **db);
 void filenamedb_close(T *db);
 
 /**
@@ -62,16 +69,60 @@ result_t filenamedb_add(T          *db,
                         const char *id,
                         const char *filename);
 
+/**
+ * Retrieve the filename for an id.
+ *
+ * Filenames are stored split into their directory components, so the full
+ * path is rebuilt on every call.
+ *
+ * \return The filename, or NULL if unknown or out of memory. The string is
+ * valid until the next call to filenamedb_get.
+ */
 const char *filenamedb_get(T          *db,
                            const char *id);
 
+/**
+ * Retrieve the id for a filename.
+ *
+ * \return The id, or NULL if unknown. Where several ids share a filename
+ * any one of them may be returned.
+ */
+const char *filenamedb_get_id(T          *db,
+                              const char *filename);
+
+/**
+ * Enumerate the ids of files which lie within a directory, at any depth.
+ *
+ * Set the continuation value to zero to begin with, it will return zero
+ * when no more ids are available.
+ *
+ * \param dirname Directory name, with or without a trailing separator.
+ * \param buf     Buffer to receive the id. Must hold at least
+ *                digestdb_DIGESTSZ bytes.
+ */
+result_t filenamedb_enumerate_ids_in_dir(T          *db,
+                                         const char *dirname,
+                                         int        *continuation,
+                                         char       *buf,
+                                         size_t      bufsz);
+
 /* ----------------------------------------------------------------------- */
 
 /**
  * Delete knowledge of filenames which don't exist on disc.
+ *
+ * Entries are grouped by directory. Each directory holding several entries
+ * is listed once rather than checking each file individually.
  */
 result_t filenamedb_prune(T *db);
 
+/**
+ * As filenamedb_prune, but check the directories using multiple threads.
+ *
+ * \param nthreads Number of threads to use, or zero for one per processor.
+ */
+result_t filenamedb_prune_parallel(T *db, int nthreads);
+
 /* ----------------------------------------------------------------------- */
 
 #undef T
@@ -16,14 +16,24 @@
  * When serialising, keys and values are read from through an abstract
  * pickle_reader_methods interface. They are then transformed into savable
  * strings using the methods given in the pickle_format_methods interface.
+ * The strings are formatted directly into the buffer of an output sink, so
+ * keys and values may be of any length.
  *
  * For deserialising, the reverse is true.
+ *
+ * pickle_pickle_binary() and pickle_unpickle_binary() use a binary variant
+ * instead: a header, then each key and value prefixed by its length, then a
+ * footer holding a record count and checksum. The same methods drive both
+ * variants (the split strings are unused by the binary one) but no line
+ * splitting or escaping is needed, so loading is cheaper.
+ *
+ * pickle_pickle_filtered() passes either variant through a chain of stream
+ * codecs, naming them in a header. pickle_unpickle() and
+ * pickle_unpickle_mapped() recognise every variant and undo any codecs in
+ * memory as they load. Filtering is not streamed: the whole unfiltered
+ * pickle is held in memory alongside the filtered one, in both directions.
  */
 
-// FUTURE
-//
-// * Use streams for output.
-
 #ifndef DATABASES_PICKLE_H
 #define DATABASES_PICKLE_H
 
@@ -35,6 +45,7 @@ extern "C"
 #include <stdlib.h>
 
 #include "base/result.h"
+#include "io/sink.h"
 
 /* ----------------------------------------------------------------------- */
 
@@ -43,6 +54,8 @@ extern "C"
 #define result_PICKLE_INCOMPATIBLE      (result_BASE_PICKLE + 2)
 #define result_PICKLE_COULDNT_OPEN_FILE (result_BASE_PICKLE + 3)
 #define result_PICKLE_SYNTAX_ERROR      (result_BASE_PICKLE + 4)
+#define result_PICKLE_BUFFER_FULL       (result_BASE_PICKLE + 5)
+#define result_PICKLE_BAD_CHECKSUM      (result_BASE_PICKLE + 6)
 
 /* ----------------------------------------------------------------------- */
 
@@ -101,33 +114,49 @@ pickle_reader_methods_t;
 /**
  * Interface used by pickle to format a key into text.
  *
+ * The text need not be terminated.
+ *
  * \param[in]   key       Key pointer as returned from pickle_reader_next.
  * \param[in]   buf       Buffer to write into.
  * \param[in]   len       Length of buffer.
+ * \param[out]  used      Number of bytes written. Or, if the buffer was too
+ *                        small, the number of bytes required, or zero if
+ *                        that's unknown.
  * \param[in]   opaque    The opaque pointer passed into pickle_pickle().
  *
  * \return result_OK if entry returned.
  * \return result_PICKLE_SKIP if this key:value pair ought to be skipped.
+ * \return result_PICKLE_BUFFER_FULL if the buffer was too small. The call
+ * will be repeated with a larger buffer.
  */
 typedef result_t (pickle_format_key_t)(const void *key,
                                        char       *buf,
                                        size_t      len,
+                                       size_t     *used,
                                        void       *opaque);
 
 /**
  * Interface used by pickle to format a value into text.
  *
+ * The text need not be terminated.
+ *
  * \param[in]   value     Value pointer as returned from pickle_reader_next.
  * \param[in]   buf       Buffer to write into.
  * \param[in]   len       Length of buffer.
+ * \param[out]  used      Number of bytes written. Or, if the buffer was too
+ *                        small, the number of bytes required, or zero if
+ *                        that's unknown.
  * \param[in]   opaque    The opaque pointer passed into pickle_pickle().
  *
  * \return result_OK if entry returned.
  * \return result_PICKLE_SKIP if this key:value pair ought to be skipped.
+ * \return result_PICKLE_BUFFER_FULL if the buffer was too small. The call
+ * will be repeated with a larger buffer.
  */
 typedef result_t (pickle_format_value_t)(const void *value,
                                          char       *buf,
                                          size_t      len,
+                                         size_t     *used,
                                          void       *opaque);
 
 /**
@@ -200,8 +229,11 @@ pickle_writer_methods_t;
 /**
  * Interface used by pickle_unpickle to parse a key from the file.
  *
+ * The buffer may be a read-only slice of the file: it is not terminated and
+ * must not be modified.
+ *
  * \param[in]   buf       Buffer to parse.
- * \param[in]   len       Length of buffer.
+ * \param[in]   len       Length of buffer, excluding any terminator.
  * \param[out]  key       Pointer to parsed key data.
  * \param[in]   opaque    The opaque pointer passed into pickle_unpickle().
  *
@@ -215,8 +247,11 @@ typedef result_t (*pickle_unformat_key_t)(const char *buf,
 /**
  * Interface used by pickle_unpickle to parse a value from the file.
  *
+ * The buffer may be a read-only slice of the file: it is not terminated and
+ * must not be modified.
+ *
  * \param[in]   buf       Buffer to parse.
- * \param[in]   len       Length of buffer.
+ * \param[in]   len       Length of buffer, excluding any terminator.
  * \param[out]  value     Pointer to parsed value data.
  * \param[in]   opaque    The opaque pointer passed into pickle_unpickle().
  *
@@ -241,6 +276,118 @@ pickle_unformat_methods_t;
 
 /* ----------------------------------------------------------------------- */
 
+/**
+ * Interface used by pickle_unpickle_parallel to create per-chunk state.
+ *
+ * Each chunk of the file is parsed by one worker thread. Chunk state lets
+ * the parser build thread-local structures (such as dictionaries) which are
+ * then consulted when its records are merged.
+ *
+ * \param[in]   opaque    The opaque pointer passed into
+ *                        pickle_unpickle_parallel().
+ * \param[out]  state     Pointer to hold chunk state.
+ *
+ * \return Error indication.
+ */
+typedef result_t (*pickle_chunk_start_t)(void  *opaque,
+                                         void **state);
+
+/**
+ * Interface used by pickle_unpickle_parallel to destroy per-chunk state.
+ *
+ * \param[in]   state     Chunk state.
+ * \param[in]   opaque    The opaque pointer passed into
+ *                        pickle_unpickle_parallel().
+ */
+typedef void (*pickle_chunk_stop_t)(void *state, void *opaque);
+
+/**
+ * Interface used by pickle_unpickle_parallel to parse a key and value from
+ * the file into a record.
+ *
+ * This is called on worker threads so must touch only its chunk state and
+ * record. The key and value buffers are read-only slices of the file: they
+ * are not terminated and must not be modified. They remain valid until the
+ * records are merged, so the record may point into them.
+ *
+ * \param[in]   key       Key buffer to parse.
+ * \param[in]   keylen    Length of key buffer, excluding any terminator.
+ * \param[in]   value     Value buffer to parse.
+ * \param[in]   valuelen  Length of value buffer, excluding any terminator.
+ * \param[in]   state     Chunk state.
+ * \param[out]  record    Record to fill in (recordsz bytes).
+ * \param[in]   opaque    The opaque pointer passed into
+ *                        pickle_unpickle_parallel().
+ *
+ * \return result_OK if the record was parsed.
+ */
+typedef result_t (*pickle_parse_t)(const char *key,
+                                   size_t      keylen,
+                                   const char *value,
+                                   size_t      valuelen,
+                                   void       *state,
+                                   void       *record,
+                                   void       *opaque);
+
+/**
+ * Interface used by pickle_unpickle_parallel to turn a parsed record into a
+ * key and value ready for insertion.
+ *
+ * This is called on the calling thread, once per record, in file order.
+ *
+ * \param[in]   state     Chunk state of the chunk the record came from.
+ * \param[in]   record    Record filled in by pickle_parse_t.
+ * \param[out]  key       Pointer to key data.
+ * \param[out]  value     Pointer to value data.
+ * \param[in]   opaque    The opaque pointer passed into
+ *                        pickle_unpickle_parallel().
+ *
+ * \return result_OK if entry returned.
+ */
+typedef result_t (*pickle_merge_t)(void  *state,
+                                   void  *record,
+                                   void **key,
+                                   void **value,
+                                   void  *opaque);
+
+/**
+ * Interfaces used by pickle_unpickle_parallel to parse input keys and
+ * values.
+ *
+ * Chunk start and stop pointers may be NULL if not required.
+ */
+typedef struct pickle_parallel_methods
+{
+  const char           *split;    /**< Separator used between key and value. */
+  size_t                splitlen; /**< Length of above. */
+  size_t                recordsz; /**< Size of a parsed record, in bytes. */
+  pickle_chunk_start_t  start;
+  pickle_chunk_stop_t   stop;
+  pickle_parse_t        parse;
+  pickle_merge_t        merge;
+}
+pickle_parallel_methods_t;
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Stream codecs which a pickle can be passed through.
+ */
+typedef enum pickle_codec
+{
+  pickle_CODEC_PACKBITS = 'P', /**< PackBits run length encoding. */
+  pickle_CODEC_MTF      = 'M'  /**< "Move to front" adaptive compression. */
+}
+pickle_codec_t;
+
+/** Maximum length of a codec chain. */
+#define pickle_MAXCODECS 8
+
+/** Flags for pickle_pickle_filtered. */
+#define pickle_FLAG_BINARY (1u << 0) /**< Filter the binary variant. */
+
+/* ----------------------------------------------------------------------- */
+
 /**
  * Serialise associative array 'assocarr' to the file 'filename'. Interpret
  * the contents of the associative array using the methods in 'reader'.
@@ -260,6 +407,25 @@ result_t pickle_pickle(const char                    *filename,
                        const pickle_format_methods_t *format,
                        void                          *opaque);
 
+/**
+ * As pickle_pickle, but write to the sink 'sink'.
+ *
+ * The sink is flushed but not destroyed.
+ *
+ * \param[in]   sink        Sink to write to.
+ * \param[in]   assocarr    Associative array to pickle.
+ * \param[in]   reader      Interfaces for reading from the associative array.
+ * \param[in]   format      Interfaces for formatting the retrieved values.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ */
+result_t pickle_pickle_sink(sink_t                        *sink,
+                            void                          *assocarr,
+                            const pickle_reader_methods_t *reader,
+                            const pickle_format_methods_t *format,
+                            void                          *opaque);
+
 /**
  * Populate associative array 'assocarr' from the file 'filename'. Insert
  * into the associative array using the methods in 'writer'. Parse
@@ -279,6 +445,141 @@ result_t pickle_unpickle(const char                      *filename,
                          const pickle_unformat_methods_t *unformat,
                          void                            *opaque);
 
+/**
+ * As pickle_unpickle, but map the file into memory and parse it in place.
+ *
+ * The unformat methods are handed slices of the mapping so no lines are
+ * copied and there's no limit on line length. Where mapping isn't available
+ * the file is read into memory in one go instead.
+ *
+ * \param[in]   filename    Filename to read from.
+ * \param[in]   assocarr    Associative array to populate.
+ * \param[in]   writer      Interfaces for writing to the associative array.
+ * \param[in]   unformat    Interfaces for parsing the retrieved values.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ */
+result_t pickle_unpickle_mapped(const char                      *filename,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque);
+
+/**
+ * Populate associative array 'assocarr' from the file 'filename' using
+ * multiple threads.
+ *
+ * The file is split into newline-aligned chunks which are parsed on worker
+ * threads using 'parallel->parse'. The resulting records are then merged on
+ * the calling thread, in file order, using 'parallel->merge' and inserted
+ * using the methods in 'writer'. The result is identical to a serial load.
+ *
+ * The file is mapped rather than read, as for pickle_unpickle_mapped.
+ * Without thread support this runs all the chunks on the calling thread.
+ * Only the text variant can be loaded this way.
+ *
+ * \param[in]   filename    Filename to read from.
+ * \param[in]   assocarr    Associative array to populate.
+ * \param[in]   writer      Interfaces for writing to the associative array.
+ * \param[in]   parallel    Interfaces for parsing and merging records.
+ * \param[in]   nthreads    Number of worker threads, or zero to use one per
+ *                          online processor.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ */
+result_t pickle_unpickle_parallel(const char                      *filename,
+                                  void                            *assocarr,
+                                  const pickle_writer_methods_t   *writer,
+                                  const pickle_parallel_methods_t *parallel,
+                                  int                              nthreads,
+                                  void                            *opaque);
+
+/**
+ * As pickle_pickle, but write the binary variant.
+ *
+ * \param[in]   filename    Filename to save to.
+ * \param[in]   assocarr    Associative array to pickle.
+ * \param[in]   reader      Interfaces for reading from the associative array.
+ * \param[in]   format      Interfaces for formatting the retrieved values.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ */
+result_t pickle_pickle_binary(const char                    *filename,
+                              void                          *assocarr,
+                              const pickle_reader_methods_t *reader,
+                              const pickle_format_methods_t *format,
+                              void                          *opaque);
+
+/**
+ * As pickle_pickle_sink, but write the binary variant.
+ */
+result_t pickle_pickle_binary_sink(sink_t                        *sink,
+                                   void                          *assocarr,
+                                   const pickle_reader_methods_t *reader,
+                                   const pickle_format_methods_t *format,
+                                   void                          *opaque);
+
+/**
+ * As pickle_pickle, but pass the output through a chain of stream codecs.
+ *
+ * The codecs are applied in array order and are named in the file's header
+ * so that the unpickling functions can undo them.
+ *
+ * \note The codecs are pull streams, so the whole pickle is first built in
+ * memory and then drawn through them into the file. Loading likewise
+ * decodes the whole payload into memory before parsing it. Peak memory is
+ * therefore about the size of the unfiltered pickle plus the filtered one.
+ *
+ * \param[in]   filename    Filename to save to.
+ * \param[in]   assocarr    Associative array to pickle.
+ * \param[in]   reader      Interfaces for reading from the associative array.
+ * \param[in]   format      Interfaces for formatting the retrieved values.
+ * \param[in]   codecs      Codecs to apply.
+ * \param[in]   ncodecs     Number of codecs, up to pickle_MAXCODECS.
+ * \param[in]   flags       pickle_FLAG_BINARY to filter the binary variant
+ *                          instead of the text one.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ */
+result_t pickle_pickle_filtered(const char                    *filename,
+                                void                          *assocarr,
+                                const pickle_reader_methods_t *reader,
+                                const pickle_format_methods_t *format,
+                                const pickle_codec_t          *codecs,
+                                int                            ncodecs,
+                                unsigned int                   flags,
+                                void                          *opaque);
+
+/**
+ * Populate associative array 'assocarr' from the binary pickle file
+ * 'filename'.
+ *
+ * The whole file is checksummed before anything is inserted. The file is
+ * mapped and the unformat methods are handed slices of it.
+ *
+ * pickle_unpickle_mapped() also accepts binary files.
+ *
+ * \param[in]   filename    Filename to read from.
+ * \param[in]   assocarr    Associative array to populate.
+ * \param[in]   writer      Interfaces for writing to the associative array.
+ * \param[in]   unformat    Interfaces for parsing the retrieved values.
+ * \param[in]   opaque      Opaque pointer passed into interfaces.
+ *
+ * \return Error indication.
+ * \return result_PICKLE_INCOMPATIBLE if not a binary pickle of a known
+ * version.
+ * \return result_PICKLE_BAD_CHECKSUM if the file is damaged.
+ */
+result_t pickle_unpickle_binary(const char                      *filename,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque);
+
 /**
  * Delete the pickle file 'filename'.
  *
@@ -291,6 +592,15 @@ void pickle_delete(const char *filename);
 /* FIXME: This ought to be in a private impl.h header file. */
 #define PICKLE_SIGNATURE "1"
 
+/* Binary variant identification. The version is bumped whenever the layout
+ * changes. */
+#define PICKLE_BINARY_MAGIC   "\x89PKL"
+#define PICKLE_BINARY_VERSION 1
+
+/* Filtered variant identification. */
+#define PICKLE_FILTERED_MAGIC   "\x89PKZ"
+#define PICKLE_FILTERED_VERSION 1
+
 /* ----------------------------------------------------------------------- */
 
 #ifdef __cplusplus
@@ -35,6 +35,7 @@ extern "C"
 #define result_TAGDB_UNKNOWN_ID        (result_BASE_TAGDB + 3)
 #define result_TAGDB_BUFF_OVERFLOW     (result_BASE_TAGDB + 4)
 #define result_TAGDB_UNKNOWN_TAG       (result_BASE_TAGDB + 5)
+#define result_TAGDB_NOT_INDEXED       (result_BASE_TAGDB + 6)
 
 /* ----------------------------------------------------------------------- */
 
@@ -54,6 +55,10 @@ void tagdb_fin(void);
 typedef struct tagdb T;
 
 result_t tagdb_open(const char *filename, T **db);
+
+/* as tagdb_open, but parse the file using 'nthreads' threads (zero picks
+ * one per processor) */
+result_t tagdb_open_parallel(const char *filename, int nthreads, T **db);
 void tagdb_close(T *db);
 
 /* force any pending changes to disc */
@@ -82,6 +87,12 @@ result_t tagdb_enumerate_tags(T           *db,
                               tagdb_tag_t *tag,
                               int         *count);
 
+/* enumerate tags whose names begin with 'prefix', in name order */
+result_t tagdb_tags_with_prefix(T                   *db,
+                                const unsigned char *prefix,
+                                int                 *continuation,
+                                tagdb_tag_t         *tag);
+
 /* convert a tag to a name */
 /* 'buf' may be NULL if bufsz is 0 */
 result_t tagdb_tagtoname(tagdb_t       *db,
@@ -133,6 +144,26 @@ result_t tagdb_enumerate_ids_by_tags(T                 *db,
 
 /* ----------------------------------------------------------------------- */
 
+/* similarity */
+
+/* build a MinHash index over the tag sets of all ids, and keep it up to
+ * date as ids are tagged, untagged and forgotten */
+result_t tagdb_enable_similarity(T *db);
+
+/* find up to 'k' ids whose tag sets are most like that of 'id', in order
+ * of decreasing estimated Jaccard similarity. 'buf' must have room for 'k'
+ * ids. 'similarity' may be NULL. returns result_TAGDB_NOT_INDEXED unless
+ * tagdb_enable_similarity has been called. */
+result_t tagdb_similar_ids(T                   *db,
+                           const unsigned char *id,
+                           int                  k,
+                           unsigned char       *buf,
+                           size_t               bufsz,
+                           float               *similarity,
+                           int                 *nfound);
+
+/* ----------------------------------------------------------------------- */
+
 /* delete knowledge of id */
 void tagdb_forget(T *db, const unsigned char *id);
 
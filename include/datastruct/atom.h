@@ -29,6 +29,7 @@ extern "C"
 #include <stddef.h>
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 /* ----------------------------------------------------------------------- */
 
@@ -71,6 +72,22 @@ atom_set_t *atom_create(void);
  */
 atom_set_t *atom_create_tuned(size_t locpoolsz, size_t blkpoolsz);
 
+/**
+ * Create a new atom set which takes its memory from an arena.
+ *
+ * The atom set may be released by destroying the arena instead of calling
+ * atom_destroy.
+ *
+ * \param arena     Arena to allocate from, or NULL for the heap.
+ * \param locpoolsz Size of a location pool, or zero for the default.
+ * \param blkpoolsz Size of a block pool, or zero for the default.
+ *
+ * \return New atom set, or NULL if out of memory.
+ */
+atom_set_t *atom_create_in_arena(arena_t *arena,
+                                 size_t   locpoolsz,
+                                 size_t   blkpoolsz);
+
 /**
  * Destroy an existing atom set.
  *
@@ -104,6 +121,26 @@ result_t atom_new(atom_set_t          *set,
                   size_t               length,
                   atom_t              *atom);
 
+/**
+ * Create a new atom from a data block which is known not to be in the set.
+ *
+ * This skips the search for an existing copy of the block made by atom_new,
+ * and only tries the most recent block pool for room, so it takes constant
+ * time however large the set grows. Inserting a block which is already
+ * present creates a second atom for it.
+ *
+ * \param      set    Atom set.
+ * \param      block  Data block to insert.
+ * \param      length Length of data block, in bytes.
+ * \param[out] atom   New atom.
+ *
+ * \return Error indication.
+ */
+result_t atom_new_unique(atom_set_t          *set,
+                         const unsigned char *block,
+                         size_t               length,
+                         atom_t              *atom);
+
 /**
  * Delete an existing atom.
  *
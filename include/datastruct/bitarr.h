@@ -141,6 +141,60 @@ struct bitarr
  */
 int bitarr_count(const T *arr, size_t bytelen);
 
+/**
+ * Set a range of bits.
+ *
+ * \param arr     Bit array.
+ * \param first   First bit to set.
+ * \param nbits   Number of bits to set.
+ */
+void bitarr_set_range(T *arr, int first, int nbits);
+
+/**
+ * Clear a range of bits.
+ *
+ * \param arr     Bit array.
+ * \param first   First bit to clear.
+ * \param nbits   Number of bits to clear.
+ */
+void bitarr_clear_range(T *arr, int first, int nbits);
+
+/**
+ * Find the first set bit at or after the specified bit.
+ *
+ * \param arr     Bit array.
+ * \param bytelen Byte length of the bit array.
+ * \param from    Bit to start searching from.
+ *
+ * \return Number of the set bit, or -1 if none was found.
+ */
+int bitarr_find_first_set(const T *arr, size_t bytelen, int from);
+
+/**
+ * Find the first clear bit at or after the specified bit.
+ *
+ * \param arr     Bit array.
+ * \param bytelen Byte length of the bit array.
+ * \param from    Bit to start searching from.
+ *
+ * \return Number of the clear bit, or -1 if none was found.
+ */
+int bitarr_find_first_clear(const T *arr, size_t bytelen, int from);
+
+/**
+ * Find the first run of clear bits of at least the specified length,
+ * starting at or after the specified bit. This suits bit arrays used as
+ * allocation bitmaps.
+ *
+ * \param arr     Bit array.
+ * \param bytelen Byte length of the bit array.
+ * \param from    Bit to start searching from.
+ * \param nbits   Length of run required.
+ *
+ * \return Number of the first bit of the run, or -1 if none was found.
+ */
+int bitarr_find_clear_run(const T *arr, size_t bytelen, int from, int nbits);
+
 #undef T
 
 #ifdef __cplusplus
@@ -4,6 +4,11 @@
  * \file bitfifo.h
  *
  * A fifo which stores bits.
+ *
+ * Bits are numbered from the least significant bit of each word upwards.
+ * Bulk operations move arrays of words. bitfifo_put, bitfifo_get and
+ * bitfifo_peek_bits move up to BITFIFO_MAX_BITS bits held in an integer,
+ * for building bit-level coders.
  */
 
 #ifndef DATASTRUCT_BITFIFO_H
@@ -15,6 +20,7 @@ extern "C"
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "base/result.h"
 
@@ -26,6 +32,11 @@ extern "C"
 
 /* ----------------------------------------------------------------------- */
 
+/** The most bits bitfifo_put and bitfifo_get can transfer at once. */
+#define BITFIFO_MAX_BITS 64
+
+/* ----------------------------------------------------------------------- */
+
 #define T bitfifo_t
 
 /**
@@ -65,6 +76,43 @@ result_t bitfifo_dequeue(T            *fifo,
                          unsigned int *outbits,
                          size_t        noutbits);
 
+/* as bitfifo_dequeue but leaves the bits in the fifo */
+result_t bitfifo_peek(const T      *fifo,
+                      unsigned int *outbits,
+                      size_t        noutbits);
+
+/* discards bits from 'tail' onwards */
+result_t bitfifo_skip(T *fifo, size_t nbits);
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Write the low 'nbits' bits of 'bits' into the fifo.
+ *
+ * \param fifo  Fifo.
+ * \param bits  Bits to write. Bits above 'nbits' are ignored.
+ * \param nbits Number of bits to write, up to BITFIFO_MAX_BITS.
+ *
+ * \return result_BITFIFO_FULL if there's no space.
+ */
+result_t bitfifo_put(T *fifo, uint64_t bits, int nbits);
+
+/**
+ * Read 'nbits' bits from the fifo.
+ *
+ * \param fifo  Fifo.
+ * \param nbits Number of bits to read, up to BITFIFO_MAX_BITS.
+ * \param bits  Returned bits, in the low 'nbits' bits.
+ *
+ * \return result_BITFIFO_INSUFFICIENT if too few bits are available.
+ */
+result_t bitfifo_get(T *fifo, int nbits, uint64_t *bits);
+
+/**
+ * As bitfifo_get but leaves the bits in the fifo.
+ */
+result_t bitfifo_peek_bits(const T *fifo, int nbits, uint64_t *bits);
+
 /* ----------------------------------------------------------------------- */
 
 /* empty the specified fifo */
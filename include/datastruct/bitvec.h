@@ -29,6 +29,8 @@ typedef struct bitvec T;
 
 typedef unsigned int bitvec_index_t;
 
+typedef struct bitvecrank bitvecrank_t;
+
 /* Creates a bit vector big enough to hold 'length' bits.
  * All bits are zero after creation. */
 T *bitvec_create(unsigned int length);
@@ -50,14 +52,53 @@ unsigned int bitvec_count(const T *v);
 /* -1 should be the initial value (bits are numbered 0..) */
 int bitvec_next(const T *v, int n);
 
+/* Stores the numbers of up to 'max' set bits after 'n' into 'indices'.
+ * Returns the number stored. Pass the last index stored as 'n' to continue.
+ * -1 should be the initial value. */
+unsigned int bitvec_next_many(const T        *v,
+                              int             n,
+                              bitvec_index_t *indices,
+                              unsigned int    max);
+
 int bitvec_eq(const T *a, const T *b);
 
 result_t bitvec_and(const T *a, const T *b, T **c);
 result_t bitvec_or(const T *a, const T *b, T **c);
 
+/* In-place variants: 'a' receives the result. */
+void bitvec_and_into(T *a, const T *b);
+result_t bitvec_or_into(T *a, const T *b);
+
+/* AND or OR together 'n' vectors, storing the result in 'c'. 'c' may be
+ * one of the inputs. bitvec_and_many requires at least one input. */
+result_t bitvec_and_many(T *c, const T *const *v, int n);
+result_t bitvec_or_many(T *c, const T *const *v, int n);
+
+/* Returns non-zero if every bit set in 'a' is also set in 'b'.
+ * Equivalent to bitvec_eq(a AND b, a) but needs no allocation. */
+int bitvec_is_subset(const T *a, const T *b);
+
+/* Returns non-zero if 'a' and 'b' have any set bit in common. */
+int bitvec_intersects(const T *a, const T *b);
+
 void bitvec_set_all(T *v);
 void bitvec_clear_all(T *v);
 
+/* Builds an index over 'v' for bitvec_rank and bitvec_select. The index
+ * refers to 'v' and is invalid once 'v' is modified or destroyed. It costs
+ * around one word per 512 bits of 'v'. */
+result_t bitvec_rank_create(const T *v, bitvecrank_t **rank);
+void bitvec_rank_destroy(bitvecrank_t *rank);
+
+/* Returns the number of bits set below 'bit'. Constant time: at most one
+ * superblock of words is counted. */
+unsigned int bitvec_rank(const bitvecrank_t *rank, bitvec_index_t bit);
+
+/* Returns the number of the k'th set bit (from zero), or -1 if fewer bits
+ * are set. Constant time unless set bits are very sparse, when it is
+ * logarithmic in the gap between them. */
+int bitvec_select(const bitvecrank_t *rank, unsigned int k);
+
 #undef T
 
 #ifdef __cplusplus
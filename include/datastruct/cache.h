@@ -10,7 +10,16 @@
  * (an unsigned int).
  *
  * Items larger than the remaining capacity in the cache's store will cause
- * older entries to be evicted. The eviction policy is oldest first.
+ * older entries to be evicted. Which entries go is decided by the cache's
+ * replacement policy, chosen at creation time. The default policy evicts
+ * the least recently used entry first: both cache_get and cache_put count
+ * as a use.
+ *
+ * Pointers returned by cache_get and cache_put are only valid until the
+ * next cache_put, which may evict their entries. Pin an entry to keep its
+ * data in place for longer.
+ *
+ * A cache is not thread safe. See shardcache.h for one which is.
  */
 
 #ifndef DATASTRUCT_CACHE_H
@@ -27,20 +36,52 @@ extern "C"
 
 /* ----------------------------------------------------------------------- */
 
+#define result_CACHE_FULL   (result_BASE_CACHE + 0) /* Every entry is pinned */
+#define result_CACHE_PINNED (result_BASE_CACHE + 1) /* Some entries are pinned */
+
+/* ----------------------------------------------------------------------- */
+
 /** An opaque cache handle. */
 typedef struct cache cache_t;
 
+/** Replacement policies. */
+typedef enum cachepolicy
+{
+  /** Least recently used. Scans will flush the cache. */
+  cachepolicy_LRU,
+
+  /** CLOCK (second chance). Approximates LRU but a hit only sets a
+   * reference bit rather than reordering entries. */
+  cachepolicy_CLOCK,
+
+  /** S3-FIFO. New entries enter a small probationary FIFO and only those
+   * used again there are promoted to the main FIFO. Keys evicted from the
+   * small FIFO are remembered so that they are promoted directly if they
+   * return. Resists scans. */
+  cachepolicy_S3FIFO,
+
+  /** Adaptive Replacement Cache. Balances recency and frequency lists,
+   * using remembered keys of evicted entries to adapt the balance. Resists
+   * scans. */
+  cachepolicy_ARC
+}
+cachepolicy_t;
+
 /** A structure which holds configuration values. */
 typedef struct cacheconfig
 {
-  int hash_chain_length;   /**< length of hash chains to aim for */
-  int nentries_percentage; /**< percentage of cache to allocate for entries */
+  int           hash_chain_length;   /**< length of hash chains to aim for */
+  int           nentries_percentage; /**< percentage of cache to allocate for entries */
+  cachepolicy_t policy;              /**< replacement policy */
 }
 cacheconfig_t;
 
 /** A cache entry key. */
 typedef unsigned int cachekey_t;
 
+/** A pin held on a cache entry. */
+typedef struct cacheentry *cachepin_t;
+
 /* ----------------------------------------------------------------------- */
 
 /**
@@ -60,6 +101,8 @@ result_t cache_create(const cacheconfig_t *config,
 /**
  * Destroy a cache.
  *
+ * A file backed cache is written back and closed, ready to be reopened.
+ *
  * \param[in] doomed    Pointer to the cache to destroy.
  */
 void cache_destroy(cache_t *doomed);
@@ -80,6 +123,55 @@ result_t cache_construct(const cacheconfig_t *config,
                          size_t               length,
                          cache_t            **cache);
 
+/**
+ * Open a cache backed by a memory-mapped file, creating it if need be.
+ *
+ * If the file holds a cache which was closed cleanly and has the same
+ * length and configuration its contents are kept, so the cache starts
+ * warm. Otherwise, such as after a crash, it starts empty.
+ *
+ * Close with cache_destroy. Not available on RISC OS.
+ *
+ * \param[in]  config   Pointer to cache parameters, or NULL for default
+ *                      cache parameters.
+ * \param[in]  filename Name of the file to use.
+ * \param[in]  length   Byte length of the file.
+ * \param[out] cache    Returned pointer to the opened cache.
+ *
+ * \return Error indication.
+ */
+result_t cache_open_file(const cacheconfig_t *config,
+                         const char          *filename,
+                         size_t               length,
+                         cache_t            **cache);
+
+/**
+ * Resize a cache.
+ *
+ * The cache is rebuilt at the new length and its entries move across in
+ * their replacement order, so that when it shrinks the entries which go
+ * are those the policy would have evicted next. Entries too big for the new
+ * store are dropped and counted as evictions. The statistics carry over.
+ * Entries can't be pinned while this happens, and previously returned
+ * pointers become invalid.
+ *
+ * With a NULL configuration the existing one is kept, except that the
+ * entry percentage is rebalanced to suit the mean size of the entries
+ * stored so far.
+ *
+ * Only caches made by cache_create can be resized.
+ *
+ * \param[in,out] cache  Pointer to the cache handle, updated on success.
+ * \param[in]     config Pointer to new cache parameters, or NULL to
+ *                       rebalance the existing ones.
+ * \param[in]     length New byte length of the cache.
+ *
+ * \return Error indication. On failure the cache is unchanged.
+ */
+result_t cache_resize(cache_t            **cache,
+                      const cacheconfig_t *config,
+                      size_t               length);
+
 /**
  * Empty a cache.
  *
@@ -108,7 +200,8 @@ void *cache_get(cache_t *cache, cachekey_t key);
  *                       not wanted. This valid until the next cache_put
  *                       operation.
  *
- * \return Error indication.
+ * \return Error indication. result_CACHE_FULL if space could not be made
+ * because the remaining entries are pinned.
  */
 result_t cache_put(cache_t    *cache,
                    cachekey_t  key,
@@ -116,6 +209,53 @@ result_t cache_put(cache_t    *cache,
                    size_t      length,
                    void      **inserted);
 
+/**
+ * Find a cached entry and pin it.
+ *
+ * A pinned entry is never evicted, so its data stays valid until the pin
+ * is released with cache_unpin. Pins nest. Release all pins before calling
+ * cache_empty.
+ *
+ * \param[in]  cache     Cache handle.
+ * \param[in]  key       Key.
+ * \param[out] pinned    Returned pin, or NULL if not found.
+ *
+ * \return Pointer to cached entry, or NULL if not found.
+ */
+void *cache_pin(cache_t *cache, cachekey_t key, cachepin_t *pinned);
+
+/**
+ * Insert an entry into the cache and pin it.
+ *
+ * As cache_put, but the inserted data stays valid until the pin is
+ * released with cache_unpin.
+ *
+ * \param[in]  cache     Cache handle.
+ * \param[in]  key       Key.
+ * \param[in]  data      Pointer to data to store.
+ * \param[in]  length    Length of data.
+ * \param[out] inserted  Returned pointer to the inserted data, or NULL if
+ *                       not wanted.
+ * \param[out] pinned    Returned pin.
+ *
+ * \return Error indication. result_CACHE_FULL if space could not be made
+ * because the remaining entries are pinned.
+ */
+result_t cache_put_pinned(cache_t    *cache,
+                          cachekey_t  key,
+                          void       *data,
+                          size_t      length,
+                          void      **inserted,
+                          cachepin_t *pinned);
+
+/**
+ * Release a pin taken by cache_pin or cache_put_pinned.
+ *
+ * \param[in] cache     Cache handle.
+ * \param[in] pinned    Pin to release.
+ */
+void cache_unpin(cache_t *cache, cachepin_t pinned);
+
 /**
  * Print cache statistics to stdout.
  *
@@ -124,10 +264,74 @@ result_t cache_put(cache_t    *cache,
  */
 void cache_stats(cache_t *cache, int reset);
 
+/**
+ * Reset the cache statistics, including the latency histograms.
+ *
+ * \param[in] cache     Cache handle.
+ */
+void cache_reset_stats(cache_t *cache);
+
+/** The number of buckets in a latency histogram. */
+#define CACHE_LATENCY_BUCKETS 32
+
+/** A structure in which cache statistics are returned. */
+typedef struct cachestats
+{
+  unsigned long hits;         /**< Lookups which found their key. */
+  unsigned long misses;       /**< Lookups which didn't. */
+  unsigned long evictions;    /**< Entries evicted to make room. */
+  size_t        hitbytes;     /**< Bytes returned by hits. */
+
+  size_t        storelength;  /**< Capacity of the store in bytes. */
+  size_t        bytesstored;  /**< Bytes of the store in use. */
+  size_t        largestfree;  /**< Largest free block. With bytesstored
+                                   this shows fragmentation. */
+
+  int           nentries;     /**< Entries available. */
+  int           nentriesused; /**< Entries holding data. */
+  int           nghosts;      /**< Entries remembering evicted keys. */
+  int           npinned;      /**< Entries pinned. */
+  int           nbins;        /**< Hash bins. Entries and ghosts over
+                                   bins gives the mean chain length. */
+
+  /** Sampled lookup times. Bucket k counts lookups which took from 2^k to
+   * 2^(k+1) - 1 nanoseconds. Empty unless cache_sample_latency is on. */
+  unsigned int  hitlatency[CACHE_LATENCY_BUCKETS];
+  unsigned int  misslatency[CACHE_LATENCY_BUCKETS];
+}
+cachestats_t;
+
+/**
+ * Return cache statistics.
+ *
+ * This is cheap enough to call periodically in production. The counters
+ * accumulate from creation, or from the last reset.
+ *
+ * \param[in]  cache    Cache handle.
+ * \param[out] stats    Structure to receive the statistics.
+ */
+void cache_get_stats(const cache_t *cache, cachestats_t *stats);
+
+/**
+ * Sample lookup latency into the histograms.
+ *
+ * The histograms are allocated separately from the cache's block. Stop
+ * sampling before discarding a cache made with cache_construct, to free
+ * them.
+ *
+ * \param[in] cache     Cache handle.
+ * \param[in] interval  Time every Nth cache_get or cache_pin, or zero to
+ *                      stop sampling.
+ *
+ * \return Error indication.
+ */
+result_t cache_sample_latency(cache_t *cache, unsigned int interval);
+
 /** A structure in which cache info is returned. */
 typedef struct cacheinfo
 {
-  size_t maxlength; /**< Largest storable block length. */
+  size_t       maxlength;  /**< Largest storable block length. */
+  unsigned int generation; /**< File backed: number of times opened. */
 }
 cacheinfo_t;
 
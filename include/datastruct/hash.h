@@ -18,6 +18,7 @@ extern "C"
 #endif
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 /* ----------------------------------------------------------------------- */
 
@@ -83,6 +84,33 @@ result_t hash_create(const void            *default_value,
                      hash_destroy_value_t  *destroy_value,
                      T                    **hash);
 
+/**
+ * Create a hash which takes its memory from an arena.
+ *
+ * Removed nodes are recycled by later insertions. The hash may be released
+ * by destroying the arena, though hash_destroy must still be called first
+ * if the keys or values need destroying.
+ *
+ * \param      arena         Arena to allocate from, or NULL for the heap.
+ * \param      default_value Value to return for failed lookups.
+ * \param      nbins         Suggested number of hash bins to allocate.
+ * \param      fn            Function to hash keys.
+ * \param      compare       Function to compare keys.
+ * \param      destroy_key   Function to destroy a key.
+ * \param      destroy_value Function to destroy a value.
+ * \param[out] hash          Created hash.
+ *
+ * \return Error indication.
+ */
+result_t hash_create_in_arena(arena_t               *arena,
+                              const void            *default_value,
+                              int                    nbins,
+                              hash_fn_t             *fn,
+                              hash_compare_t        *compare,
+                              hash_destroy_key_t    *destroy_key,
+                              hash_destroy_value_t  *destroy_value,
+                              T                    **hash);
+
 /**
  * Destroy a hash.
  *
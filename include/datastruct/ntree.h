@@ -15,6 +15,7 @@ extern "C"
 #endif
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 #define T ntree_t
 
@@ -24,6 +25,11 @@ typedef struct ntree T;
 
 result_t ntree_new(T **t);
 
+/* Creates a node whose memory comes from 'arena'. Copies of the node are
+ * made in the same arena. Nodes freed with ntree_free are released along
+ * with the arena. */
+result_t ntree_new_in_arena(arena_t *arena, T **t);
+
 /* Unlinks the specified node from the tree. */
 void ntree_unlink(T *t);
 
@@ -0,0 +1,90 @@
+/* ringbuf.h -- lock-free single-producer single-consumer byte ring */
+
+/**
+ * \file ringbuf.h
+ *
+ * A ring buffer of bytes which one thread may write while another reads,
+ * without locks.
+ *
+ * Exactly one thread may call ringbuf_write and exactly one thread may call
+ * ringbuf_read at any time. The head and tail counters live on separate
+ * cache lines and each side caches the other's counter, so in the steady
+ * state neither thread writes to a line the other is reading.
+ */
+
+#ifndef DATASTRUCT_RINGBUF_H
+#define DATASTRUCT_RINGBUF_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+/* ----------------------------------------------------------------------- */
+
+#define T ringbuf_t
+
+/**
+ * A ring buffer's type.
+ */
+typedef struct ringbuf T;
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Create a ring buffer.
+ *
+ * \param size Number of bytes the ring buffer should store.
+ *
+ * \return New ring buffer or NULL if OOM.
+ */
+T *ringbuf_create(size_t size);
+
+/**
+ * Destroy a ring buffer.
+ *
+ * \param doomed Ring buffer to destroy.
+ */
+void ringbuf_destroy(T *doomed);
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Write as much data as there is space for. Producer only.
+ *
+ * \param ring   Ring buffer.
+ * \param data   Data to write.
+ * \param length Length of data.
+ *
+ * \return Number of bytes written.
+ */
+size_t ringbuf_write(T *ring, const void *data, size_t length);
+
+/**
+ * Read as much data as is available. Consumer only.
+ *
+ * \param ring   Ring buffer.
+ * \param data   Buffer to receive data.
+ * \param length Length of buffer.
+ *
+ * \return Number of bytes read.
+ */
+size_t ringbuf_read(T *ring, void *data, size_t length);
+
+/**
+ * Return the number of bytes stored. When called while the other thread
+ * is active the result may already be stale.
+ */
+size_t ringbuf_used(const T *ring);
+
+/* ----------------------------------------------------------------------- */
+
+#undef T
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DATASTRUCT_RINGBUF_H */
@@ -0,0 +1,180 @@
+/* shardcache.h -- thread safe sharded cache */
+
+/**
+ * \file shardcache.h
+ *
+ * Thread safe sharded cache.
+ *
+ * A shardcache divides its memory between a number of single-block caches
+ * (see cache.h), each guarded by its own lock. Keys are spread across the
+ * shards by hashing so that threads working on different keys rarely
+ * contend.
+ *
+ * Data is handed out pinned: it can't be evicted by other threads until
+ * the caller releases it with shardcache_release.
+ *
+ * shardcache_get_or_load fetches an entry, calling a loader on a miss. When
+ * several threads miss on the same key at once only one runs the loader
+ * and the others wait for its result.
+ *
+ * Without DPTLIB_THREADS there's no locking and loads are not shared.
+ */
+
+#ifndef DATASTRUCT_SHARDCACHE_H
+#define DATASTRUCT_SHARDCACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#include "base/result.h"
+#include "datastruct/cache.h"
+
+/* ----------------------------------------------------------------------- */
+
+/** An opaque sharded cache handle. */
+typedef struct shardcache shardcache_t;
+
+/** A pin held on a shardcache entry. Treat as opaque. */
+typedef struct shardcachepin
+{
+  int        shard;
+  cachepin_t pin;
+}
+shardcachepin_t;
+
+/**
+ * A function which produces the data for a key.
+ *
+ * \param[in]  key       Key which missed.
+ * \param[in]  opaque    Opaque pointer passed to shardcache_get_or_load.
+ * \param[out] data      Returned pointer to the data, allocated with
+ *                       malloc. The shardcache frees it once copied.
+ * \param[out] length    Returned length of the data.
+ *
+ * \return Error indication. An error is passed to every waiting caller.
+ */
+typedef result_t (shardcache_loader_t)(cachekey_t   key,
+                                       void        *opaque,
+                                       void       **data,
+                                       size_t      *length);
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Create a sharded cache.
+ *
+ * \param[in]  config   Pointer to cache parameters applied to every shard,
+ *                      or NULL for default cache parameters.
+ * \param[in]  length   Byte length of the cache to allocate. Each shard
+ *                      receives an equal part.
+ * \param[in]  nshards  Number of shards. Rounded up to a power of two.
+ * \param[out] cache    Returned pointer to the created cache.
+ *
+ * \return Error indication.
+ */
+result_t shardcache_create(const cacheconfig_t *config,
+                           size_t               length,
+                           int                  nshards,
+                           shardcache_t       **cache);
+
+/**
+ * Destroy a sharded cache.
+ *
+ * \param[in] doomed    Pointer to the cache to destroy.
+ */
+void shardcache_destroy(shardcache_t *doomed);
+
+/**
+ * Find a cached entry and pin it.
+ *
+ * \param[in]  cache     Cache handle.
+ * \param[in]  key       Key.
+ * \param[out] pinned    Returned pin, if found.
+ *
+ * \return Pointer to cached entry, or NULL if not found.
+ */
+void *shardcache_get(shardcache_t    *cache,
+                     cachekey_t       key,
+                     shardcachepin_t *pinned);
+
+/**
+ * Insert an entry into the cache.
+ *
+ * \param[in]  cache     Cache handle.
+ * \param[in]  key       Key.
+ * \param[in]  data      Pointer to data to store.
+ * \param[in]  length    Length of data.
+ * \param[out] inserted  Returned pointer to the inserted data, or NULL if
+ *                       not wanted. The data is pinned when this is
+ *                       non-NULL.
+ * \param[out] pinned    Returned pin, or NULL if 'inserted' is NULL.
+ *
+ * \return Error indication.
+ */
+result_t shardcache_put(shardcache_t    *cache,
+                        cachekey_t       key,
+                        void            *data,
+                        size_t           length,
+                        void           **inserted,
+                        shardcachepin_t *pinned);
+
+/**
+ * Find a cached entry, loading it on a miss, and pin it.
+ *
+ * \param[in]  cache     Cache handle.
+ * \param[in]  key       Key.
+ * \param[in]  loader    Function to produce the data on a miss.
+ * \param[in]  opaque    Opaque pointer passed to the loader.
+ * \param[out] data      Returned pointer to the cached data.
+ * \param[out] pinned    Returned pin.
+ *
+ * \return Error indication.
+ */
+result_t shardcache_get_or_load(shardcache_t        *cache,
+                                cachekey_t           key,
+                                shardcache_loader_t *loader,
+                                void                *opaque,
+                                void               **data,
+                                shardcachepin_t     *pinned);
+
+/**
+ * Release a pin taken by shardcache_get, shardcache_put or
+ * shardcache_get_or_load.
+ *
+ * \param[in] cache     Cache handle.
+ * \param[in] pinned    Pin to release.
+ */
+void shardcache_release(shardcache_t *cache, const shardcachepin_t *pinned);
+
+/**
+ * Return statistics summed over every shard.
+ *
+ * Counts and histograms are totals. largestfree is the largest free block
+ * in any shard.
+ *
+ * \param[in]  cache    Cache handle.
+ * \param[out] stats    Structure to receive the statistics.
+ */
+void shardcache_get_stats(shardcache_t *cache, cachestats_t *stats);
+
+/**
+ * Sample lookup latency in every shard. See cache_sample_latency.
+ *
+ * \param[in] cache     Cache handle.
+ * \param[in] interval  Time every Nth lookup, or zero to stop sampling.
+ *
+ * \return Error indication.
+ */
+result_t shardcache_sample_latency(shardcache_t *cache, unsigned int interval);
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DATASTRUCT_SHARDCACHE_H */
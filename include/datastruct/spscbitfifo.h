@@ -0,0 +1,102 @@
+/* spscbitfifo.h -- lock-free single-producer single-consumer bit fifo */
+
+/**
+ * \file spscbitfifo.h
+ *
+ * A fifo of bits which one thread may write while another reads, without
+ * locks. Useful for handing a bitstream from a decoder thread to its
+ * consumer.
+ *
+ * It stores bits in the same order as bitfifo (see bitfifo.h) and returns
+ * the same errors. Exactly one thread may call the producer functions and
+ * exactly one thread may call the consumer functions at any time.
+ */
+
+#ifndef DATASTRUCT_SPSCBITFIFO_H
+#define DATASTRUCT_SPSCBITFIFO_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base/result.h"
+#include "datastruct/bitfifo.h"
+
+/* ----------------------------------------------------------------------- */
+
+#define T spscbitfifo_t
+
+/**
+ * An SPSC bit fifo's type.
+ */
+typedef struct spscbitfifo T;
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Create an SPSC bit fifo.
+ *
+ * \param nbits Number of bits that the fifo should store.
+ *
+ * \return New fifo or NULL if OOM.
+ */
+T *spscbitfifo_create(int nbits);
+
+/**
+ * Destroy an SPSC bit fifo.
+ *
+ * \param doomed Fifo to destroy.
+ */
+void spscbitfifo_destroy(T *doomed);
+
+/* ----------------------------------------------------------------------- */
+
+/* Producer functions. */
+
+/* as bitfifo_put */
+result_t spscbitfifo_put(T *fifo, uint64_t bits, int nbits);
+
+/* as bitfifo_enqueue */
+result_t spscbitfifo_enqueue(T                  *fifo,
+                             const unsigned int *newbits,
+                             unsigned int        newbitsoffset,
+                             size_t              nnewbits);
+
+/* ----------------------------------------------------------------------- */
+
+/* Consumer functions. These return result_BITFIFO_INSUFFICIENT if the
+ * producer has not yet supplied enough bits. */
+
+/* as bitfifo_get */
+result_t spscbitfifo_get(T *fifo, int nbits, uint64_t *bits);
+
+/* as bitfifo_peek_bits */
+result_t spscbitfifo_peek_bits(T *fifo, int nbits, uint64_t *bits);
+
+/* as bitfifo_dequeue */
+result_t spscbitfifo_dequeue(T            *fifo,
+                             unsigned int *outbits,
+                             size_t        noutbits);
+
+/* as bitfifo_skip */
+result_t spscbitfifo_skip(T *fifo, size_t nbits);
+
+/* ----------------------------------------------------------------------- */
+
+/* returns number of used bits in the fifo. this may be stale by the time
+ * it's returned. */
+size_t spscbitfifo_used(const T *fifo);
+
+/* ----------------------------------------------------------------------- */
+
+#undef T
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DATASTRUCT_SPSCBITFIFO_H */
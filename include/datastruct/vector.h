@@ -24,6 +24,7 @@ extern "C"
 #include <stddef.h>
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 /**
  * A vector.
@@ -41,6 +42,20 @@ typedef struct vector vector_t;
  */
 vector_t *vector_create(size_t width);
 
+/**
+ * Create a new vector which takes its memory from an arena.
+ *
+ * The vector may be released by destroying the arena instead of calling
+ * vector_destroy. Blocks outgrown by the vector are not reclaimed until
+ * then, so its capacity grows geometrically.
+ *
+ * \param[in] arena Arena to allocate from, or NULL for the heap.
+ * \param[in] width Byte width of each element.
+ *
+ * \return New vector, or NULL if out of memory.
+ */
+vector_t *vector_create_in_arena(arena_t *arena, size_t width);
+
 /**
  * Destroy an existing vector.
  *
@@ -0,0 +1,29 @@
+/* sink-mem.h -- growable memory block sink implementation */
+
+#ifndef SINK_MEM_H
+#define SINK_MEM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#include "base/result.h"
+
+#include "io/sink.h"
+
+/* use 0 for a sensible default initial size */
+
+result_t sink_mem_create(size_t initial, sink_t **s);
+
+/* returns the bytes written so far. the block is owned by the sink. */
+
+const unsigned char *sink_mem_get(sink_t *s, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SINK_MEM_H */
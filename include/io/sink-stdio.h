@@ -0,0 +1,26 @@
+/* sink-stdio.h -- C standard IO sink implementation */
+
+#ifndef SINK_STDIO_H
+#define SINK_STDIO_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdio.h>
+
+#include "base/result.h"
+
+#include "io/sink.h"
+
+/* use 0 for a sensible default buffer size */
+/* the file is closed when the sink is destroyed */
+
+result_t sink_stdio_create(FILE *f, size_t bufsz, sink_t **s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SINK_STDIO_H */
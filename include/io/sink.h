@@ -0,0 +1,83 @@
+/* sink.h -- sink system */
+
+/**
+ * \file Sink (interface).
+ *
+ * A sink is the write-side counterpart of a stream: a generic interface
+ * which can be used to wrap destinations of bytes.
+ *
+ * Writers place bytes directly into the sink's buffer, advancing the
+ * buffer pointer as they go. When the buffer fills the sink drains it.
+ * Single byte writes are efficient: implemented as a macro.
+ */
+
+#ifndef SINK_H
+#define SINK_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#include "base/result.h"
+
+/* ----------------------------------------------------------------------- */
+
+#define result_SINK_WRITE_FAILED (result_BASE_SINK + 0)
+
+/* ----------------------------------------------------------------------- */
+
+typedef struct sink sink_t;
+
+/*
+ * Interfaces
+ */
+
+/* Drain all buffered bytes then ensure there's room for 'need' more. */
+typedef result_t sink_flush_t(sink_t *s, size_t need);
+typedef void     sink_destroy_t(sink_t *doomed);
+
+/* This is exposed for efficiency - don't use these directly! */
+struct sink
+{
+  unsigned char  *buf;     /**< Current buffer pointer. */
+  unsigned char  *end;     /**< End of buffer pointer (exclusive - points to the char after buffer end). */
+
+  result_t        last;    /**< Last error. */
+
+  sink_flush_t   *flush;
+  sink_destroy_t *destroy;
+};
+
+/*
+ * User entry points
+ */
+
+/** Ensure there's room for at least 'need' bytes in the buffer, draining
+ * it if required. */
+result_t sink_reserve(sink_t *s, size_t need);
+
+/** Write a block of bytes. */
+result_t sink_write(sink_t *s, const void *block, size_t length);
+
+/** Drain all buffered bytes. */
+result_t sink_flush(sink_t *s);
+
+/** Destroy the sink. Buffered bytes are discarded: flush first. */
+sink_destroy_t sink_destroy;
+
+/** Put a byte to a sink. Returns zero if it couldn't be written. */
+#define sink_putc(s, c) \
+  (((s)->buf != (s)->end || sink_reserve((s), 1) == result_OK) ? \
+   (*(s)->buf++ = (unsigned char) (c), 1) : 0)
+
+/** Returns the number of bytes of space remaining in the current buffer. */
+#define sink_remaining(s) ((size_t) ((s)->end - (s)->buf))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SINK_H */
@@ -16,10 +16,12 @@ extern testfn_t atom_test,
                 hash_test,
                 list_test,
                 ntree_test,
+                ringbuf_test,
                 vector_test;
 
 /* database */
-extern testfn_t pickle_test,
+extern testfn_t filenamedb_test,
+                pickle_test,
                 tagdb_test;
 
 /* framebuf */
@@ -32,10 +34,12 @@ extern testfn_t box_test,
                 packer_test;
 
 /* io */
-extern testfn_t stream_test;
+extern testfn_t sink_test,
+                stream_test;
 
 /* utils */
-extern testfn_t array_test,
+extern testfn_t arena_test,
+                array_test,
                 bsearch_test;
 
 #endif /* TESTS_ALL_TESTS_H */
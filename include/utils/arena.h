@@ -0,0 +1,127 @@
+/* arena.h -- region allocator */
+
+/**
+ * \file arena.h
+ *
+ * Arena is a region allocator. Memory is handed out by bumping a pointer
+ * through large chunks obtained from malloc. Individual allocations are
+ * never freed: instead the whole arena is reset or destroyed at once, at a
+ * cost proportional to the number of chunks rather than the number of
+ * allocations.
+ *
+ * Containers which accept an arena at creation (hash, ntree, vector and
+ * atom) take all of their memory from it. Such a container can be released
+ * by destroying its arena without destroying the container itself.
+ */
+
+#ifndef UTILS_ARENA_H
+#define UTILS_ARENA_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+
+#include "base/result.h"
+
+/**
+ * An arena.
+ */
+typedef struct arena arena_t;
+
+/**
+ * The alignment of every block returned by the arena.
+ */
+#define ARENA_ALIGN 16
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Create a new arena.
+ *
+ * \param[in]  chunksize Bytes to request from the system at a time, or zero
+ *                       for a default size.
+ * \param[out] arena     Created arena.
+ *
+ * \return Error indication.
+ */
+result_t arena_create(size_t chunksize, arena_t **arena);
+
+/**
+ * Destroy an arena, releasing every block allocated from it.
+ *
+ * \param[in] doomed Arena to destroy.
+ */
+void arena_destroy(arena_t *doomed);
+
+/**
+ * Release every block allocated from an arena, but retain one chunk for
+ * reuse.
+ *
+ * \param[in] arena Arena to reset.
+ */
+void arena_reset(arena_t *arena);
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Allocate a block from an arena.
+ *
+ * \param[in] arena Arena.
+ * \param[in] size  Size of block required, in bytes.
+ *
+ * \return Pointer to block, or NULL if out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Allocate a zeroed array from an arena.
+ *
+ * \param[in] arena  Arena.
+ * \param[in] nelems Number of elements.
+ * \param[in] size   Size of each element, in bytes.
+ *
+ * \return Pointer to block, or NULL if out of memory.
+ */
+void *arena_calloc(arena_t *arena, size_t nelems, size_t size);
+
+/**
+ * Resize a block allocated from an arena.
+ *
+ * The most recently allocated block is resized in place when there is
+ * room. Otherwise a new block is allocated and the contents copied; the
+ * old block is not reclaimed until the arena is reset or destroyed.
+ *
+ * \param[in] arena   Arena.
+ * \param[in] block   Existing block, or NULL.
+ * \param[in] oldsize Current size of block, in bytes.
+ * \param[in] newsize Size of block required, in bytes.
+ *
+ * \return Pointer to block, or NULL if out of memory (in which case the
+ * existing block is untouched).
+ */
+void *arena_realloc(arena_t *arena,
+                    void    *block,
+                    size_t   oldsize,
+                    size_t   newsize);
+
+/* ----------------------------------------------------------------------- */
+
+/**
+ * Return the number of bytes obtained from the system by an arena.
+ *
+ * \param[in] arena Arena.
+ *
+ * \return Number of bytes.
+ */
+size_t arena_footprint(const arena_t *arena);
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTILS_ARENA_H */
@@ -9,6 +9,7 @@ extern "C"
 #endif
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* ----------------------------------------------------------------------- */
@@ -112,6 +113,22 @@ BARITH_INLINE uint64_t reversebits_64(uint64_t);
 
 /* ----------------------------------------------------------------------- */
 
+/* Operations on blocks of bits. These accept any byte length and alignment
+ * but are fastest on whole, aligned words. Vector instructions are used
+ * where the CPU supports them. The output block may be an input block. */
+
+/* Returns the number of bits set in the block. */
+size_t countbits_block(const void *block, size_t nbytes);
+
+/* dst = a AND b, and dst = a OR b. */
+void and_block(void *dst, const void *a, const void *b, size_t nbytes);
+void or_block(void *dst, const void *a, const void *b, size_t nbytes);
+
+/* Returns non-zero if no bits are set in the block. */
+int iszero_block(const void *block, size_t nbytes);
+
+/* ----------------------------------------------------------------------- */
+
 /* Spread the most significant set bit downwards so it fills all lower bits.
  */
 #define SPREADMSB_32(x) \
@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,9 +20,15 @@
 #include "oslib/osfscontrol.h"
 #include "oslib/osgbpb.h"
 #else
+#include <dirent.h>
+#include <errno.h>
 #include <unistd.h>
 #endif
 
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#endif
+
 #include "base/utils.h"
 #include "base/result.h"
 //#include "base/strings.h"
@@ -40,14 +47,34 @@
 /* Hash bins. */
 #define HASHSIZE 97
 
+/* Hash bins for the node and reverse indexes. */
+#define INDEXHASHSIZE 16381
+
 /* Long enough to hold any database line. */
 #define READBUFSZ 1024
 
 /* Size of pools used for atom storage. */
 #define ATOMBUFSZ 32768
 
-/* Estimated filename length. */
-#define ESTATOMLEN 80
+/* Estimated node length (parent atom plus leafname). */
+#define ESTATOMLEN 20
+
+/* Directory separator. */
+#ifdef __riscos
+#define DIRSEP '.'
+#else
+#define DIRSEP '/'
+#endif
+
+/* Minimum size of the path buffers. */
+#define MINBUFSZ 256
+
+/* Prune lists a directory once it holds at least this many candidates,
+ * otherwise it checks each file individually. */
+#define PRUNEDIRMIN 4
+
+/* Upper limit on the number of prune threads. */
+#define PRUNEMAXTHREADS 64
 
 /* ----------------------------------------------------------------------- */
 
@@ -86,16 +113,408 @@ void filenamedb_fin(void)
 
 /* ----------------------------------------------------------------------- */
 
+/* Filenames are stored as a tree of nodes held in an atom set. Each node
+ * holds the atom of its parent directory followed by its own terminated
+ * name, so a directory's name is stored only once however many files it
+ * holds. Nodes without a parent hold atom_NOT_FOUND. The hash maps ids to
+ * nodes. Full paths are rebuilt on demand.
+ *
+ * 'nodehash' indexes the nodes by content so that paths can be resolved
+ * without scanning the atom set, and 'reverse' maps nodes back to ids.
+ * Several ids may share a node so each reverse entry is a list of owners,
+ * most recently added first. The head of a list stays put while its node
+ * is indexed so the hash need not be updated as owners come and go. */
+
+typedef struct filenamedb_owner
+{
+  const unsigned char     *key;
+  struct filenamedb_owner *next;
+}
+filenamedb_owner_t;
+
 struct filenamedb
 {
   char       *filename;
 
-  atom_set_t *filenames;
+  atom_set_t *nodes;
   hash_t     *hash;
+  hash_t     *nodehash; /* maps nodes to their atom + 1 */
+  hash_t     *reverse;  /* maps nodes to lists of ids */
+
+  char       *scratch; /* node under construction */
+  size_t      scratchsz;
+
+  char       *path; /* last path returned by filenamedb_get */
+  size_t      pathsz;
 };
 
 /* ----------------------------------------------------------------------- */
 
+static atom_t filenamedb__parent(const unsigned char *node)
+{
+  atom_t parent;
+
+  memcpy(&parent, node, sizeof(parent)); /* nodes may be unaligned */
+
+  return parent;
+}
+
+static const char *filenamedb__name(const unsigned char *node)
+{
+  return (const char *) node + sizeof(atom_t);
+}
+
+/* Ensure that the growable buffer '*pbuf' holds at least 'need' bytes. */
+static result_t filenamedb__ensure(char **pbuf, size_t *pbufsz, size_t need)
+{
+  size_t  n;
+  char   *buf;
+
+  if (need <= *pbufsz)
+    return result_OK;
+
+  n = MAX(*pbufsz * 2, MINBUFSZ);
+  if (n < need)
+    n = need;
+
+  buf = realloc(*pbuf, n);
+  if (buf == NULL)
+    return result_OOM;
+
+  *pbuf   = buf;
+  *pbufsz = n;
+
+  return result_OK;
+}
+
+static unsigned int node_hash(const void *a)
+{
+  const unsigned char *p = a;
+  const unsigned char *end;
+  unsigned int         h;
+
+  /* FNV-1 over the parent atom and the name */
+
+  h   = 0x811c9dc5;
+  end = p + sizeof(atom_t);
+  while (p < end || *p)
+  {
+    h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+    h ^= *p++;
+  }
+
+  return h;
+}
+
+static int node_compare(const void *a, const void *b)
+{
+  if (filenamedb__parent(a) != filenamedb__parent(b))
+    return 1;
+
+  return strcmp(filenamedb__name(a), filenamedb__name(b));
+}
+
+static unsigned int node_ptr_hash(const void *a)
+{
+  return (unsigned int) ((uintptr_t) a >> 2);
+}
+
+static int node_ptr_compare(const void *a, const void *b)
+{
+  return a != b;
+}
+
+static void owners_destroy(void *value)
+{
+  filenamedb_owner_t *o;
+  filenamedb_owner_t *next;
+
+  for (o = value; o; o = next)
+  {
+    next = o->next;
+    free(o);
+  }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Record that 'key' maps to 'node'. */
+static result_t filenamedb__index(hash_t     *reverse,
+                                  const void *key,
+                                  const void *node)
+{
+  result_t            err;
+  filenamedb_owner_t *head;
+  filenamedb_owner_t *o;
+
+  o = malloc(sizeof(*o));
+  if (o == NULL)
+    return result_OOM;
+
+  head = (filenamedb_owner_t *) hash_lookup(reverse, node);
+  if (head)
+  {
+    /* push the new key in at the head while keeping the head in place */
+    o->key     = head->key;
+    o->next    = head->next;
+    head->key  = key;
+    head->next = o;
+    return result_OK;
+  }
+
+  o->key  = key;
+  o->next = NULL;
+
+  err = hash_insert(reverse, node, o);
+  if (err)
+    free(o);
+
+  return err;
+}
+
+/* Forget that 'key' maps to 'node'. Other keys sharing 'node' remain. */
+static void filenamedb__unindex(hash_t     *reverse,
+                                const void *key,
+                                const void *node)
+{
+  filenamedb_owner_t  *head;
+  filenamedb_owner_t **po;
+  filenamedb_owner_t  *doomed;
+
+  head = (filenamedb_owner_t *) hash_lookup(reverse, node);
+  if (head == NULL)
+    return;
+
+  if (head->key == key)
+  {
+    if (head->next == NULL)
+    {
+      hash_remove(reverse, node); /* frees the head */
+      return;
+    }
+
+    /* pull the second owner up into the head */
+    doomed     = head->next;
+    head->key  = doomed->key;
+    head->next = doomed->next;
+    free(doomed);
+    return;
+  }
+
+  for (po = &head->next; *po; po = &(*po)->next)
+    if ((*po)->key == key)
+    {
+      doomed = *po;
+      *po    = doomed->next;
+      free(doomed);
+      return;
+    }
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Form the node for 'leaf' within 'parent' in the scratch buffer. */
+static result_t filenamedb__make_node(filenamedb_t *db,
+                                      atom_t        parent,
+                                      const char   *leaf,
+                                      size_t        leaflen,
+                                      size_t       *nodelen)
+{
+  result_t err;
+
+  err = filenamedb__ensure(&db->scratch,
+                           &db->scratchsz,
+                            sizeof(parent) + leaflen + 1);
+  if (err)
+    return err;
+
+  memcpy(db->scratch, &parent, sizeof(parent));
+  memcpy(db->scratch + sizeof(parent), leaf, leaflen);
+  db->scratch[sizeof(parent) + leaflen] = '\0';
+
+  *nodelen = sizeof(parent) + leaflen + 1;
+
+  return result_OK;
+}
+
+/* Return the final separator-delimited component of the 'len' byte path. */
+static const char *filenamedb__leaf(const char *path, size_t len)
+{
+  const char *leaf;
+
+  for (leaf = path + len; leaf > path && leaf[-1] != DIRSEP; leaf--)
+    ;
+
+  return leaf;
+}
+
+/* Intern the 'len' byte path 'path', returning the atom of its node. */
+static result_t filenamedb__intern(filenamedb_t *db,
+                                   const char   *path,
+                                   size_t        len,
+                                   atom_t       *patom)
+{
+  result_t    err;
+  const char *leaf;
+  atom_t      parent;
+  size_t      nodelen;
+  const void *found;
+  atom_t      atom;
+
+  /* split at the final separator, interning the directory first */
+
+  leaf = filenamedb__leaf(path, len);
+  if (leaf > path)
+  {
+    err = filenamedb__intern(db, path, leaf - 1 - path, &parent);
+    if (err)
+      return err;
+  }
+  else
+  {
+    parent = atom_NOT_FOUND;
+  }
+
+  err = filenamedb__make_node(db, parent, leaf, path + len - leaf, &nodelen);
+  if (err)
+    return err;
+
+  found = hash_lookup(db->nodehash, db->scratch);
+  if (found)
+  {
+    *patom = (atom_t) ((intptr_t) found - 1);
+    return result_OK;
+  }
+
+  /* nodehash has shown the node to be absent */
+  err = atom_new_unique(db->nodes,
+                        (const unsigned char *) db->scratch,
+                        nodelen,
+                        &atom);
+  if (err)
+    return err;
+
+  err = hash_insert(db->nodehash,
+                    atom_get(db->nodes, atom, NULL),
+                    (void *) ((intptr_t) atom + 1));
+  if (err)
+    return err;
+
+  *patom = atom;
+
+  return result_OK;
+}
+
+/* Find the node for the 'len' byte path 'path' without creating it.
+ * Returns atom_NOT_FOUND if the path is unknown. */
+static atom_t filenamedb__find(filenamedb_t *db,
+                               const char   *path,
+                               size_t        len)
+{
+  const char *leaf;
+  atom_t      parent;
+  size_t      nodelen;
+  const void *found;
+
+  leaf = filenamedb__leaf(path, len);
+  if (leaf > path)
+  {
+    parent = filenamedb__find(db, path, leaf - 1 - path);
+    if (parent == atom_NOT_FOUND)
+      return atom_NOT_FOUND;
+  }
+  else
+  {
+    parent = atom_NOT_FOUND;
+  }
+
+  if (filenamedb__make_node(db, parent, leaf, path + len - leaf, &nodelen))
+    return atom_NOT_FOUND;
+
+  found = hash_lookup(db->nodehash, db->scratch);
+  if (found == NULL)
+    return atom_NOT_FOUND;
+
+  return (atom_t) ((intptr_t) found - 1);
+}
+
+/* Intern 'path' returning a pointer to its node for use as a hash value. */
+static result_t filenamedb__intern_value(filenamedb_t  *db,
+                                         const char    *path,
+                                         size_t         len,
+                                         void         **value)
+{
+  result_t err;
+  atom_t   atom;
+
+  err = filenamedb__intern(db, path, len, &atom);
+  if (err)
+    return err;
+
+  *value = (void *) atom_get(db->nodes, atom, NULL); // casting away const
+
+  return result_OK;
+}
+
+/* Rebuild the path for 'node' into 'buf'. Returns the length of the path
+ * excluding its terminator. Nothing is written unless it fits in 'bufsz'. */
+static size_t filenamedb__build(filenamedb_t        *db,
+                                const unsigned char *node,
+                                char                *buf,
+                                size_t               bufsz)
+{
+  const unsigned char *n;
+  size_t               total;
+  size_t               pos;
+
+  /* measure */
+
+  total = 0;
+  for (n = node; ; )
+  {
+    atom_t parent;
+
+    total += strlen(filenamedb__name(n));
+
+    parent = filenamedb__parent(n);
+    if (parent == atom_NOT_FOUND)
+      break;
+
+    total++; /* separator */
+    n = atom_get(db->nodes, parent, NULL);
+  }
+
+  if (total + 1 > bufsz)
+    return total;
+
+  /* fill in from the end */
+
+  pos = total;
+  buf[pos] = '\0';
+  for (n = node; ; )
+  {
+    const char *name;
+    size_t      l;
+    atom_t      parent;
+
+    name = filenamedb__name(n);
+    l    = strlen(name);
+    pos -= l;
+    memcpy(buf + pos, name, l);
+
+    parent = filenamedb__parent(n);
+    if (parent == atom_NOT_FOUND)
+      break;
+
+    buf[--pos] = DIRSEP;
+    n = atom_get(db->nodes, parent, NULL);
+  }
+
+  return total;
+}
+
+/* ----------------------------------------------------------------------- */
+
 /* This is identical to tagdb.c's unformat_key... */
 static result_t unformat_key(const char *buf,
                              size_t      len,
@@ -106,10 +525,10 @@ static result_t unformat_key(const char *buf,
   unsigned char hash[digestdb_DIGESTSZ];
   int           kindex;
 
-  NOT_USED(len);
   NOT_USED(opaque);
 
-  // if (len != 32) then complain
+  if (len != digestdb_DIGESTSZ * 2)
+    return result_FILENAMEDB_SYNTAX_ERROR;
 
   /* convert ID from ASCII hex to binary */
   err = digestdb_decode(hash, buf);
@@ -130,41 +549,121 @@ static result_t unformat_value(const char *buf,
                                void      **value,
                                void       *opaque)
 {
-  result_t         err;
   filenamedb_t *db = opaque;
-  atom_t        vindex;
 
-  NOT_USED(len);
+  return filenamedb__intern_value(db, buf, len, value);
+}
+
+static const pickle_unformat_methods_t unformat_methods =
+{
+  " ", /* split string */
+  1,   /* split string length */
+  unformat_key,
+  unformat_value
+};
+
+/* ----------------------------------------------------------------------- */
+
+/* Parallel loading: digests are decoded on worker threads and the filenames
+ * are interned when merging. */
+
+typedef struct filenamedb_record
+{
+  unsigned char  digest[digestdb_DIGESTSZ];
+  const char    *filename;
+  size_t         len;
+}
+filenamedb_record_t;
+
+static result_t parse_record(const char *key,
+                             size_t      keylen,
+                             const char *value,
+                             size_t      valuelen,
+                             void       *state,
+                             void       *vrecord,
+                             void       *opaque)
+{
+  filenamedb_record_t *record = vrecord;
+
+  NOT_USED(state);
+  NOT_USED(opaque);
+
+  if (keylen != digestdb_DIGESTSZ * 2)
+    return result_FILENAMEDB_SYNTAX_ERROR;
+
+  record->filename = value;
+  record->len      = valuelen;
+
+  /* convert ID from ASCII hex to binary */
+  return digestdb_decode(record->digest, key);
+}
+
+static result_t merge_record(void  *state,
+                             void  *vrecord,
+                             void **key,
+                             void **value,
+                             void  *opaque)
+{
+  result_t             err;
+  filenamedb_record_t *record = vrecord;
+  filenamedb_t        *db     = opaque;
+  int                  kindex;
+
+  NOT_USED(state);
 
-  err = atom_new(db->filenames,
-                 (const unsigned char *) buf,
-                 strlen(buf) + 1, // use 'len'?
-                 &vindex);
-  if (err && err != result_ATOM_NAME_EXISTS)
+  err = digestdb_add(record->digest, &kindex);
+  if (err)
     return err;
 
-  *value = (void *) atom_get(db->filenames, vindex, NULL); // casting away const
+  err = filenamedb__intern_value(db, record->filename, record->len, value);
+  if (err)
+    return err;
+
+  *key = (void *) digestdb_get(kindex); /* must cast away const */
 
   return result_OK;
 }
 
-static const pickle_unformat_methods_t unformat_methods =
+static const pickle_parallel_methods_t parallel_methods =
 {
   " ", /* split string */
   1,   /* split string length */
-  unformat_key,
-  unformat_value
+  sizeof(filenamedb_record_t),
+  NULL,
+  NULL,
+  parse_record,
+  merge_record
 };
 
 /* ----------------------------------------------------------------------- */
 
-result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
+struct build_reverse_state
+{
+  hash_t   *reverse;
+  result_t  err;
+};
+
+static int build_reverse_cb(const void *key, const void *value, void *opaque)
+{
+  struct build_reverse_state *state = opaque;
+
+  state->err = filenamedb__index(state->reverse, key, value);
+
+  return state->err ? -1 : 0; /* stop the walk on error */
+}
+
+static result_t filenamedb__open(const char    *filename,
+                                 int            nthreads,
+                                 filenamedb_t **pdb)
 {
   result_t         err;
   char         *filenamecopy = NULL;
-  atom_set_t   *filenames    = NULL;
+  atom_set_t   *nodes        = NULL;
   hash_t       *hash         = NULL;
+  hash_t       *nodehash     = NULL;
+  hash_t       *reverse      = NULL;
   filenamedb_t *db           = NULL;
+  struct build_reverse_state state;
 
   assert(filename);
   assert(pdb);
@@ -176,8 +675,8 @@ result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
     goto Failure;
   }
 
-  filenames = atom_create_tuned(ATOMBUFSZ / ESTATOMLEN, ATOMBUFSZ);
-  if (filenames == NULL)
+  nodes = atom_create_tuned(ATOMBUFSZ / ESTATOMLEN, ATOMBUFSZ);
+  if (nodes == NULL)
   {
     err = result_OOM;
     goto Failure;
@@ -193,6 +692,26 @@ result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
   if (err)
     goto Failure;
 
+  err = hash_create(NULL,
+                    INDEXHASHSIZE,
+                    node_hash,
+                    node_compare,
+                    hash_no_destroy_key,
+                    hash_no_destroy_value,
+                    &nodehash);
+  if (err)
+    goto Failure;
+
+  err = hash_create(NULL,
+                    INDEXHASHSIZE,
+                    node_ptr_hash,
+                    node_ptr_compare,
+                    hash_no_destroy_key,
+                    owners_destroy,
+                    &reverse);
+  if (err)
+    goto Failure;
+
   db = malloc(sizeof(*db));
   if (db == NULL)
   {
@@ -201,18 +720,42 @@ result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
   }
 
   db->filename    = filenamecopy;
-  db->filenames   = filenames;
+  db->nodes       = nodes;
   db->hash        = hash;
+  db->nodehash    = nodehash;
+  db->reverse     = reverse;
+  db->scratch     = NULL;
+  db->scratchsz   = 0;
+  db->path        = NULL;
+  db->pathsz      = 0;
 
   /* read the database in */
-  err = pickle_unpickle(filename,
-                        db->hash,
-                        &pickle_writer_hash,
-                        &unformat_methods,
-                        db);
+  if (nthreads < 0)
+    err = pickle_unpickle_mapped(filename,
+                                 db->hash,
+                                 &pickle_writer_hash,
+                                 &unformat_methods,
+                                 db);
+  else
+    err = pickle_unpickle_parallel(filename,
+                                   db->hash,
+                                   &pickle_writer_hash,
+                                   &parallel_methods,
+                                   nthreads,
+                                   db);
   if (err && err != result_PICKLE_COULDNT_OPEN_FILE)
     goto Failure;
 
+  /* index the filenames we've read */
+  state.reverse = reverse;
+  state.err     = result_OK;
+  hash_walk(db->hash, build_reverse_cb, &state);
+  if (state.err)
+  {
+    err = state.err;
+    goto Failure;
+  }
+
   *pdb = db;
 
   return result_OK;
@@ -220,14 +763,33 @@ result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
 
 Failure:
 
+  if (db)
+    free(db->scratch);
   free(db);
+  hash_destroy(reverse);
+  hash_destroy(nodehash);
   hash_destroy(hash);
-  atom_destroy(filenames);
+  atom_destroy(nodes);
   free(filenamecopy);
 
   return err;
 }
 
+result_t filenamedb_open(const char *filename, filenamedb_t **pdb)
+{
+  return filenamedb__open(filename, -1, pdb);
+}
+
+result_t filenamedb_open_parallel(const char    *filename,
+                                  int            nthreads,
+                                  filenamedb_t **pdb)
+{
+  if (nthreads < 0)
+    nthreads = 0;
+
+  return filenamedb__open(filename, nthreads, pdb);
+}
+
 void filenamedb_close(filenamedb_t *db)
 {
   if (db == NULL)
@@ -235,9 +797,13 @@ void filenamedb_close(filenamedb_t *db)
 
   filenamedb_commit(db);
 
+  hash_destroy(db->reverse);
+  hash_destroy(db->nodehash);
   hash_destroy(db->hash);
-  atom_destroy(db->filenames);
+  atom_destroy(db->nodes);
 
+  free(db->path);
+  free(db->scratch);
   free(db->filename);
 
   free(db);
@@ -248,15 +814,17 @@ void filenamedb_close(filenamedb_t *db)
 static result_t format_key(const void *vkey,
                            char       *buf,
                            size_t      len,
+                           size_t     *used,
                            void       *opaque)
 {
   NOT_USED(opaque);
 
-  if (len < digestdb_DIGESTSZ * 2 + 1)
-    return result_FILENAMEDB_BUFF_OVERFLOW;
+  *used = digestdb_DIGESTSZ * 2;
+
+  if (len < digestdb_DIGESTSZ * 2)
+    return result_PICKLE_BUFFER_FULL;
 
   digestdb_encode(buf, vkey);
-  buf[digestdb_DIGESTSZ * 2] = '\0';
 
   return result_OK;
 }
@@ -264,12 +832,20 @@ static result_t format_key(const void *vkey,
 static result_t format_value(const void *vvalue,
                              char       *buf,
                              size_t      len,
+                             size_t     *used,
                              void       *opaque)
 {
-  NOT_USED(len);
-  NOT_USED(opaque);
+  filenamedb_t *db = opaque;
+  size_t        l;
 
-  strcpy(buf, vvalue);
+  l = filenamedb__build(db, vvalue, buf, len);
+  if (l + 1 > len)
+  {
+    *used = l + 1; /* room for the terminator too */
+    return result_PICKLE_BUFFER_FULL;
+  }
+
+  *used = l;
 
   return result_OK;
 }
@@ -309,9 +885,9 @@ result_t filenamedb_add(filenamedb_t *db,
 {
   result_t                err;
   int                  kindex;
-  atom_t               vindex;
   const unsigned char *key;
-  const char          *value;
+  void                *value;
+  const void          *old;
 
   err = digestdb_add((const unsigned char *) id, &kindex);
   if (err)
@@ -319,18 +895,21 @@ result_t filenamedb_add(filenamedb_t *db,
 
   key = digestdb_get(kindex);
 
-  err = atom_new(db->filenames, (const unsigned char *) filename,
-                 strlen(filename) + 1, &vindex);
-  if (err && err != result_ATOM_NAME_EXISTS)
+  err = filenamedb__intern_value(db, filename, strlen(filename), &value);
+  if (err)
     return err;
 
-  value = (const char *) atom_get(db->filenames, vindex, NULL);
+  old = hash_lookup(db->hash, key);
+  if (old)
+    filenamedb__unindex(db->reverse, key, old);
 
   /* this will update the value if the key is already present */
 
-  hash_insert(db->hash, (unsigned char *) key, (char *) value);
+  err = hash_insert(db->hash, (unsigned char *) key, value);
+  if (err)
+    return err;
 
-  return result_OK;
+  return filenamedb__index(db->reverse, key, value);
 }
 
 /* ----------------------------------------------------------------------- */
@@ -338,35 +917,484 @@ result_t filenamedb_add(filenamedb_t *db,
 const char *filenamedb_get(filenamedb_t *db,
                            const char   *id)
 {
-  return hash_lookup(db->hash, id);
+  const unsigned char *node;
+  size_t               len;
+
+  node = hash_lookup(db->hash, id);
+  if (node == NULL)
+    return NULL;
+
+  len = filenamedb__build(db, node, db->path, db->pathsz);
+  if (len + 1 > db->pathsz)
+  {
+    if (filenamedb__ensure(&db->path, &db->pathsz, len + 1))
+      return NULL;
+
+    filenamedb__build(db, node, db->path, db->pathsz);
+  }
+
+  return db->path;
 }
 
 /* ----------------------------------------------------------------------- */
 
-static int prune_cb(const void *key, const void *value, void *opaque)
+const char *filenamedb_get_id(filenamedb_t *db,
+                              const char   *filename)
 {
-  filenamedb_t           *db = opaque;
-#ifdef __riscos
-  fileswitch_object_type  object_type;
+  atom_t                    atom;
+  const filenamedb_owner_t *owners;
+
+  assert(db);
+  assert(filename);
+
+  atom = filenamedb__find(db, filename, strlen(filename));
+  if (atom == atom_NOT_FOUND)
+    return NULL;
+
+  owners = hash_lookup(db->reverse, atom_get(db->nodes, atom, NULL));
+  if (owners == NULL)
+    return NULL;
+
+  return (const char *) owners->key;
+}
+
+/* Returns non-zero if 'node' lies anywhere beneath directory 'dir'. */
+static int filenamedb__within(filenamedb_t        *db,
+                              const unsigned char *node,
+                              atom_t               dir)
+{
+  atom_t parent;
 
-  /* does the file exist? */
-  object_type = osfile_read_no_path(value, NULL, NULL, NULL, NULL);
-  if (object_type == fileswitch_NOT_FOUND)
+  for (;;)
   {
-    /* if not, delete it */
-    hash_remove(db->hash, key);
+    parent = filenamedb__parent(node);
+    if (parent == atom_NOT_FOUND)
+      return 0;
+    if (parent == dir)
+      return 1;
+
+    node = atom_get(db->nodes, parent, NULL);
   }
-#else
-  if (access(value, F_OK) != -1)
-    hash_remove(db->hash, key);
+}
+
+result_t filenamedb_enumerate_ids_in_dir(filenamedb_t *db,
+                                         const char   *dirname,
+                                         int          *continuation,
+                                         char         *buf,
+                                         size_t        bufsz)
+{
+  result_t    err;
+  size_t      len;
+  atom_t      dir;
+  int         cont;
+  const void *key;
+  const void *value;
+
+  assert(db);
+  assert(dirname);
+  assert(continuation);
+  assert(buf);
+
+  if (bufsz < digestdb_DIGESTSZ)
+    return result_FILENAMEDB_BUFF_OVERFLOW;
+
+  /* ignore any trailing separator. the root directory "/" becomes the
+   * empty name which is how it's stored. */
+  len = strlen(dirname);
+  if (len > 0 && dirname[len - 1] == DIRSEP)
+    len--;
+
+  dir = filenamedb__find(db, dirname, len);
+  if (dir == atom_NOT_FOUND)
+  {
+    *continuation = 0; /* no such directory */
+    return result_OK;
+  }
+
+  /* hash continuations use -1 to mean 'after the last element' */
+
+  for (cont = *continuation; ; )
+  {
+    err = hash_walk_continuation(db->hash, cont, &cont, &key, &value);
+    if (err == result_HASH_END)
+    {
+      *continuation = 0;
+      return result_OK;
+    }
+    if (err)
+      return err;
+
+    if (filenamedb__within(db, value, dir))
+      break;
+  }
+
+  memcpy(buf, key, digestdb_DIGESTSZ);
+  *continuation = cont;
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Pruning gathers every entry, sorts them by directory, then checks each
+ * directory's entries as a group. Groups are shared out amongst worker
+ * threads. Removals are applied once all the checks are done. */
+
+typedef struct prune_candidate
+{
+  const void          *key;
+  const unsigned char *node;
+  atom_t               parent;
+  int                  missing;
+}
+prune_candidate_t;
+
+typedef struct prune_job
+{
+  filenamedb_t      *db;
+  prune_candidate_t *cands;
+  size_t            *groups; /* start of each group, plus an end marker */
+  size_t             ngroups;
+  size_t             next; /* next group to check */
+  result_t           err;  /* first failure */
+#ifdef DPTLIB_THREADS
+  pthread_mutex_t    lock;
 #endif
+}
+prune_job_t;
+
+static int prune_candidate_compare(const void *va, const void *vb)
+{
+  const prune_candidate_t *a = va;
+  const prune_candidate_t *b = vb;
+
+  if (a->parent != b->parent)
+    return (a->parent < b->parent) ? -1 : 1;
+
+  return strcmp(filenamedb__name(a->node), filenamedb__name(b->node));
+}
+
+struct prune_gather_state
+{
+  prune_candidate_t *cands;
+  size_t             n;
+};
+
+static int prune_gather_cb(const void *key, const void *value, void *opaque)
+{
+  struct prune_gather_state *state = opaque;
+  prune_candidate_t         *c     = &state->cands[state->n++];
+
+  c->key     = key;
+  c->node    = value;
+  c->parent  = filenamedb__parent(value);
+  c->missing = 0;
 
   return 0;
 }
 
-result_t filenamedb_prune(filenamedb_t *db)
+/* Returns non-zero if 'path' definitely doesn't exist. Other failures
+ * (e.g. permission errors) are treated as the file existing. */
+static int filenamedb__missing(const char *path)
+{
+#ifdef __riscos
+  return osfile_read_no_path(path, NULL, NULL, NULL, NULL) ==
+         fileswitch_NOT_FOUND;
+#else
+  return access(path, F_OK) == -1 && (errno == ENOENT || errno == ENOTDIR);
+#endif
+}
+
+/* Check each candidate in [c, end) individually. On failure the candidates
+ * which couldn't be checked are marked present. */
+static result_t prune__check_each(prune_job_t       *job,
+                                  prune_candidate_t *c,
+                                  prune_candidate_t *end,
+                                  char             **pbuf,
+                                  size_t            *pbufsz)
+{
+  for (; c < end; c++)
+  {
+    size_t len;
+
+    len = filenamedb__build(job->db, c->node, *pbuf, *pbufsz);
+    if (len + 1 > *pbufsz)
+    {
+      if (filenamedb__ensure(pbuf, pbufsz, len + 1))
+      {
+        for (; c < end; c++)
+          c->missing = 0;
+
+        return result_OOM;
+      }
+
+      filenamedb__build(job->db, c->node, *pbuf, *pbufsz);
+    }
+
+    c->missing = filenamedb__missing(*pbuf);
+  }
+
+  return result_OK;
+}
+
+#ifndef __riscos
+/* Mark every candidate in [c, end) which matches 'name' as present. The
+ * candidates are sorted by name. */
+static void prune__mark_present(prune_candidate_t *c,
+                                prune_candidate_t *end,
+                                const char        *name)
+{
+  size_t lo, hi;
+
+  lo = 0;
+  hi = end - c;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+
+    if (strcmp(filenamedb__name(c[mid].node), name) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* several ids may share a node */
+  for (c += lo; c < end && strcmp(filenamedb__name(c->node), name) == 0; c++)
+    c->missing = 0;
+}
+#endif
+
+/* Check one group of candidates which share a parent directory. The
+ * directory listing is only a fast path for finding the candidates which
+ * are present: any it doesn't find are checked individually before being
+ * marked missing, since a filesystem may fold the case or normalise the
+ * Unicode of names. On failure the candidates which couldn't be checked are
+ * marked present. */
+static result_t prune__check_group(prune_job_t       *job,
+                                   prune_candidate_t *c,
+                                   prune_candidate_t *end,
+                                   char             **pbuf,
+                                   size_t            *pbufsz)
 {
-  hash_walk(db->hash, prune_cb, db);
+#ifdef __riscos
+  return prune__check_each(job, c, end, pbuf, pbufsz);
+#else
+  const unsigned char *dirnode;
+  size_t               len;
+  DIR                 *dir;
+  struct dirent       *entry;
+  prune_candidate_t   *d;
+
+  if (c->parent == atom_NOT_FOUND || end - c < PRUNEDIRMIN)
+    return prune__check_each(job, c, end, pbuf, pbufsz);
+
+  /* list the directory */
+
+  dirnode = atom_get(job->db->nodes, c->parent, NULL);
+
+  len = filenamedb__build(job->db, dirnode, *pbuf, *pbufsz);
+  if (len + 1 > *pbufsz)
+  {
+    if (filenamedb__ensure(pbuf, pbufsz, len + 1))
+      return result_OOM;
+
+    filenamedb__build(job->db, dirnode, *pbuf, *pbufsz);
+  }
+
+  dir = opendir(len ? *pbuf : "/"); /* the root is stored as "" */
+  if (dir == NULL)
+    return prune__check_each(job, c, end, pbuf, pbufsz);
+
+  for (d = c; d < end; d++)
+    d->missing = 1;
+
+  while ((entry = readdir(dir)) != NULL)
+    prune__mark_present(c, end, entry->d_name);
+
+  closedir(dir);
+
+  /* confirm the rest. this includes any empty leafname (a trailing
+   * separator) which never appears in a listing. */
+  for (d = c; d < end; d++)
+  {
+    result_t err;
+
+    if (!d->missing)
+      continue;
+
+    err = prune__check_each(job, d, d + 1, pbuf, pbufsz);
+    if (err)
+    {
+      for (; d < end; d++)
+        d->missing = 0;
+
+      return err;
+    }
+  }
 
   return result_OK;
+#endif
+}
+
+/* Check groups until none remain. Runs on a worker thread. */
+static void *prune__worker(void *vjob)
+{
+  prune_job_t *job    = vjob;
+  result_t     err;
+  char        *buf    = NULL;
+  size_t       bufsz  = 0;
+
+  for (;;)
+  {
+    size_t g;
+
+#ifdef DPTLIB_THREADS
+    pthread_mutex_lock(&job->lock);
+#endif
+    g = job->next++;
+#ifdef DPTLIB_THREADS
+    pthread_mutex_unlock(&job->lock);
+#endif
+
+    if (g >= job->ngroups)
+      break;
+
+    /* on failure the group's unchecked entries are left alone */
+    err = prune__check_group(job,
+                             job->cands + job->groups[g],
+                             job->cands + job->groups[g + 1],
+                            &buf,
+                            &bufsz);
+    if (err)
+    {
+#ifdef DPTLIB_THREADS
+      pthread_mutex_lock(&job->lock);
+#endif
+      if (job->err == result_OK)
+        job->err = err;
+#ifdef DPTLIB_THREADS
+      pthread_mutex_unlock(&job->lock);
+#endif
+    }
+  }
+
+  free(buf);
+
+  return NULL;
+}
+
+result_t filenamedb_prune_parallel(filenamedb_t *db, int nthreads)
+{
+  result_t                  err;
+  size_t                    n;
+  struct prune_gather_state gather;
+  size_t                   *groups = NULL;
+  size_t                    ngroups;
+  size_t                    i;
+  prune_job_t               job;
+
+  assert(db);
+
+  n = hash_count(db->hash);
+  if (n == 0)
+    return result_OK;
+
+  /* gather and sort */
+
+  gather.cands = malloc(n * sizeof(*gather.cands));
+  if (gather.cands == NULL)
+    return result_OOM;
+
+  gather.n = 0;
+  hash_walk(db->hash, prune_gather_cb, &gather);
+
+  qsort(gather.cands, n, sizeof(*gather.cands), prune_candidate_compare);
+
+  /* find where each directory's group starts */
+
+  groups = malloc((n + 1) * sizeof(*groups));
+  if (groups == NULL)
+  {
+    err = result_OOM;
+    goto Failure;
+  }
+
+  ngroups = 0;
+  for (i = 0; i < n; i++)
+    if (i == 0 || gather.cands[i].parent != gather.cands[i - 1].parent)
+      groups[ngroups++] = i;
+  groups[ngroups] = n;
+
+  /* check */
+
+  job.db      = db;
+  job.cands   = gather.cands;
+  job.groups  = groups;
+  job.ngroups = ngroups;
+  job.next    = 0;
+  job.err     = result_OK;
+
+  if (nthreads <= 0)
+  {
+#if defined(DPTLIB_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (nthreads <= 0)
+      nthreads = 1;
+  }
+  nthreads = (int) MIN((size_t) nthreads, ngroups);
+  nthreads = MIN(nthreads, PRUNEMAXTHREADS);
+
+#ifdef DPTLIB_THREADS
+  {
+    pthread_t threads[PRUNEMAXTHREADS];
+    int       spawned;
+
+    pthread_mutex_init(&job.lock, NULL);
+
+    /* the calling thread works too */
+    for (spawned = 0; spawned < nthreads - 1; spawned++)
+      if (pthread_create(&threads[spawned], NULL, prune__worker, &job))
+        break;
+
+    prune__worker(&job);
+
+    while (spawned--)
+      pthread_join(threads[spawned], NULL);
+
+    pthread_mutex_destroy(&job.lock);
+  }
+#else
+  prune__worker(&job);
+#endif
+
+  /* apply the removals. entries which couldn't be checked are marked
+   * present, so these are safe to make even if a check failed. */
+
+  for (i = 0; i < n; i++)
+  {
+    prune_candidate_t *c = &gather.cands[i];
+
+    if (!c->missing)
+      continue;
+
+    filenamedb__unindex(db->reverse, c->key, c->node);
+    hash_remove(db->hash, c->key);
+  }
+
+  err = job.err;
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  free(groups);
+  free(gather.cands);
+
+  return err;
+}
+
+result_t filenamedb_prune(filenamedb_t *db)
+{
+  return filenamedb_prune_parallel(db, 1);
 }
@@ -0,0 +1,609 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __riscos
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+
+#include "databases/digest-db.h"
+#include "databases/filename-db.h"
+
+#include "test/all-tests.h"
+
+/* ----------------------------------------------------------------------- */
+
+#define FILENAME "test-filename-db"
+
+/* ----------------------------------------------------------------------- */
+
+static const char *filenames[] =
+{
+  "/home/marty/pictures/1955/clocktower.jpg",
+  "/home/marty/pictures/1955/delorean.jpg",
+  "/home/marty/pictures/1985/twin-pines-mall.jpg",
+  "/home/marty/pictures/2015/hoverboard.png",
+  "/home/emmett/notes/flux-capacitor.txt",
+  "/home/emmett/notes/",   /* trailing separator */
+  "/home//biff/almanac",   /* empty component */
+  "relative/path.txt",
+  "leafonly",
+  "/rootfile",
+  "/home/marty/pictures/1955/clocktower.jpg", /* duplicate filename */
+};
+
+/* ----------------------------------------------------------------------- */
+
+static void makeid(int i, char id[digestdb_DIGESTSZ])
+{
+  memset(id, 0, digestdb_DIGESTSZ);
+  id[digestdb_DIGESTSZ - 1] = (char) (i + 1);
+}
+
+static result_t check_all(filenamedb_t *db)
+{
+  int i;
+
+  for (i = 0; i < NELEMS(filenames); i++)
+  {
+    char        id[digestdb_DIGESTSZ];
+    const char *got;
+
+    makeid(i, id);
+
+    got = filenamedb_get(db, id);
+    if (got == NULL || strcmp(got, filenames[i]) != 0)
+    {
+      printf("expected '%s', got '%s'\n",
+             filenames[i], got ? got : "(null)");
+      return result_TEST_FAILED;
+    }
+  }
+
+  return result_OK;
+}
+
+static result_t check_get_id(filenamedb_t *db)
+{
+  static const struct
+  {
+    const char *filename;
+    int         id; /* -1 if none expected */
+  }
+  expected[] =
+  {
+    { "/home/marty/pictures/1955/delorean.jpg",    1 },
+    { "/home/marty/pictures/2015/hoverboard.png",  3 },
+    { "/home/emmett/notes/",                       5 },
+    { "/home//biff/almanac",                       6 },
+    { "relative/path.txt",                         7 },
+    { "leafonly",                                  8 },
+    { "/rootfile",                                 9 },
+    { "/home/marty/pictures",                     -1 }, /* directory */
+    { "/home/marty/pictures/1955/enchantment.jpg", -1 }, /* moved away */
+    { "/home/biff/almanac",                       -1 },
+    { "rootfile",                                 -1 },
+    { "",                                         -1 },
+  };
+
+  int i;
+
+  for (i = 0; i < NELEMS(expected); i++)
+  {
+    const char *got;
+    char        id[digestdb_DIGESTSZ];
+
+    got = filenamedb_get_id(db, expected[i].filename);
+    if (expected[i].id < 0)
+    {
+      if (got != NULL)
+      {
+        printf("'%s' should be unknown\n", expected[i].filename);
+        return result_TEST_FAILED;
+      }
+    }
+    else
+    {
+      makeid(expected[i].id, id);
+      if (got == NULL || memcmp(got, id, digestdb_DIGESTSZ) != 0)
+      {
+        printf("'%s' has the wrong id\n", expected[i].filename);
+        return result_TEST_FAILED;
+      }
+    }
+  }
+
+  return result_OK;
+}
+
+static result_t check_enumerate_dir(filenamedb_t *db)
+{
+  static const struct
+  {
+    const char *dirname;
+    int         count;
+  }
+  expected[] =
+  {
+    { "/home/marty",               5 },
+    { "/home/marty/",              5 },
+    { "/home/marty/pictures/1955", 3 },
+    { "/home/mart",                0 },
+    { "/home/emmett/notes",        2 },
+    { "/",                         9 },
+    { "relative",                  1 },
+    { "nowhere",                   0 },
+  };
+
+  result_t err;
+  int      i;
+
+  for (i = 0; i < NELEMS(expected); i++)
+  {
+    int  cont;
+    int  count;
+    char id[digestdb_DIGESTSZ];
+
+    count = 0;
+    cont  = 0;
+    do
+    {
+      err = filenamedb_enumerate_ids_in_dir(db, expected[i].dirname, &cont,
+                                            id, sizeof(id));
+      if (err)
+        return err;
+
+      if (cont)
+      {
+        const char *filename;
+
+        filename = filenamedb_get(db, id);
+        if (filename == NULL ||
+            strncmp(filename,
+                    expected[i].dirname,
+                    strlen(expected[i].dirname)) != 0)
+          return result_TEST_FAILED;
+
+        count++;
+      }
+    }
+    while (cont);
+
+    printf("%d ids within '%s'\n", count, expected[i].dirname);
+
+    if (count != expected[i].count)
+      return result_TEST_FAILED;
+  }
+
+  return result_OK;
+}
+
+static result_t test_add_get(void)
+{
+  result_t      err;
+  filenamedb_t *db;
+  int           i;
+  char          id[digestdb_DIGESTSZ];
+
+  printf("test: add and get\n");
+
+  err = filenamedb_open(FILENAME, &db);
+  if (err)
+    return err;
+
+  for (i = 0; i < NELEMS(filenames); i++)
+  {
+    makeid(i, id);
+
+    err = filenamedb_add(db, id, filenames[i]);
+    if (err)
+      goto Failure;
+  }
+
+  err = check_all(db);
+  if (err)
+    goto Failure;
+
+  /* unknown ids give NULL */
+  makeid(NELEMS(filenames), id);
+  if (filenamedb_get(db, id) != NULL)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  /* re-adding an id replaces its filename */
+  makeid(0, id);
+  err = filenamedb_add(db, id, "/home/marty/pictures/1955/enchantment.jpg");
+  if (err)
+    goto Failure;
+
+  if (strcmp(filenamedb_get(db, id),
+             "/home/marty/pictures/1955/enchantment.jpg") != 0)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  err = filenamedb_add(db, id, filenames[0]);
+  if (err)
+    goto Failure;
+
+  /* the most recent addition of a duplicate filename wins */
+  if (memcmp(filenamedb_get_id(db, filenames[0]), id, digestdb_DIGESTSZ) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  err = check_get_id(db);
+  if (err)
+    goto Failure;
+
+  err = check_enumerate_dir(db);
+  if (err)
+    goto Failure;
+
+  filenamedb_close(db); /* commits */
+
+  return result_OK;
+
+
+Failure:
+
+  filenamedb_close(db);
+
+  return err;
+}
+
+static result_t test_reopen(void)
+{
+  result_t      err;
+  filenamedb_t *db;
+  int           nthreads;
+
+  printf("test: reopen\n");
+
+  err = filenamedb_open(FILENAME, &db);
+  if (err)
+    return err;
+
+  err = check_all(db);
+  if (err == result_OK)
+    err = check_get_id(db);
+  if (err == result_OK)
+    err = check_enumerate_dir(db);
+
+  filenamedb_close(db);
+
+  if (err)
+    return err;
+
+  for (nthreads = 1; nthreads <= 3; nthreads++)
+  {
+    printf("test: reopen using %d threads\n", nthreads);
+
+    err = filenamedb_open_parallel(FILENAME, nthreads, &db);
+    if (err)
+      return err;
+
+    err = check_all(db);
+    if (err == result_OK)
+      err = check_get_id(db);
+
+    filenamedb_close(db);
+
+    if (err)
+      return err;
+  }
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+#define SHARED "/home/marty/pictures/1955/clocktower.jpg"
+
+/* Returns non-zero if 'filename' maps back to id 'i'. */
+static int has_id(filenamedb_t *db, const char *filename, int i)
+{
+  const char *got;
+  char        id[digestdb_DIGESTSZ];
+
+  makeid(i, id);
+
+  got = filenamedb_get_id(db, filename);
+
+  return got && memcmp(got, id, digestdb_DIGESTSZ) == 0;
+}
+
+static result_t test_shared(void)
+{
+  result_t      err;
+  filenamedb_t *db;
+  int           pass;
+  char          id[digestdb_DIGESTSZ];
+
+  printf("test: ids sharing a filename\n");
+
+  for (pass = 0; pass < 2; pass++)
+  {
+    /* ids 0 and 1 share a filename. on the second pass they are read back
+     * from disc, when either may be returned. */
+
+    err = filenamedb_open(FILENAME "-shared", &db);
+    if (err)
+      return err;
+
+    if (pass == 0)
+    {
+      makeid(0, id);
+      err = filenamedb_add(db, id, SHARED);
+      if (err)
+        goto Failure;
+
+      makeid(1, id);
+      err = filenamedb_add(db, id, SHARED);
+      if (err)
+        goto Failure;
+
+      if (!has_id(db, SHARED, 1))
+      {
+        printf("most recently added id not returned\n");
+        err = result_TEST_FAILED;
+        goto Failure;
+      }
+    }
+    else if (!has_id(db, SHARED, 0) && !has_id(db, SHARED, 1))
+    {
+      printf("shared filename lost on reopen\n");
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    /* moving either id away leaves the filename with the other */
+
+    makeid(pass, id);
+    err = filenamedb_add(db, id, "/home/marty/pictures/1955/delorean.jpg");
+    if (err)
+      goto Failure;
+
+    if (!has_id(db, SHARED, !pass) ||
+        !has_id(db, "/home/marty/pictures/1955/delorean.jpg", pass))
+    {
+      printf("filename lost its remaining id\n");
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    /* put it back for the next pass. closing commits. */
+
+    if (pass == 0)
+    {
+      err = filenamedb_add(db, id, SHARED);
+      if (err)
+        goto Failure;
+    }
+
+    filenamedb_close(db);
+  }
+
+  filenamedb_delete(FILENAME "-shared");
+
+  return result_OK;
+
+
+Failure:
+
+  filenamedb_close(db);
+  filenamedb_delete(FILENAME "-shared");
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef __riscos
+
+#define PRUNEDIR "test-prune"
+
+static const struct
+{
+  const char *filename;
+  int         create; /* create on disc */
+  int         keep;   /* expected to survive pruning */
+}
+prunefiles[] =
+{
+  { PRUNEDIR "/many/0",      1, 1 },
+  { PRUNEDIR "/many/1",      1, 1 },
+  { PRUNEDIR "/many/2",      0, 0 },
+  { PRUNEDIR "/many/3",      1, 1 },
+  { PRUNEDIR "/many/4",      0, 0 },
+  { PRUNEDIR "/many/5",      1, 1 },
+  { PRUNEDIR "/many/",       0, 1 }, /* the directory itself */
+  { PRUNEDIR "/few/0",       1, 1 },
+  { PRUNEDIR "/few/1",       0, 0 },
+  { PRUNEDIR "/gone/0",      0, 0 },
+  { PRUNEDIR "/gone/1",      0, 0 },
+  { PRUNEDIR "/gone/2",      0, 0 },
+  { PRUNEDIR "/gone/3",      0, 0 },
+  { PRUNEDIR "/gone/4",      0, 0 },
+  { PRUNEDIR "/top",         1, 1 },
+  { PRUNEDIR "/few/0",       0, 1 }, /* shares a present file */
+  { PRUNEDIR "/few/1",       0, 0 }, /* shares a missing file */
+  { "test-prune-no-such-file", 0, 0 },
+};
+
+static void prune_cleanup(void)
+{
+  int i;
+
+  for (i = 0; i < NELEMS(prunefiles); i++)
+    if (prunefiles[i].create)
+      remove(prunefiles[i].filename);
+
+  rmdir(PRUNEDIR "/many");
+  rmdir(PRUNEDIR "/few");
+  rmdir(PRUNEDIR);
+}
+
+static result_t test_prune_one(int nthreads)
+{
+  result_t      err;
+  filenamedb_t *db;
+  int           i;
+  char          id[digestdb_DIGESTSZ];
+
+  printf("test: prune using %d threads\n", nthreads);
+
+  err = filenamedb_open(FILENAME "-prune", &db);
+  if (err)
+    return err;
+
+  for (i = 0; i < NELEMS(prunefiles); i++)
+  {
+    makeid(i, id);
+
+    err = filenamedb_add(db, id, prunefiles[i].filename);
+    if (err)
+      goto Failure;
+  }
+
+  err = filenamedb_prune_parallel(db, nthreads);
+  if (err)
+    goto Failure;
+
+  for (i = 0; i < NELEMS(prunefiles); i++)
+  {
+    int have;
+
+    makeid(i, id);
+
+    have = filenamedb_get(db, id) != NULL;
+    if (have != prunefiles[i].keep ||
+        (filenamedb_get_id(db, prunefiles[i].filename) != NULL) != have)
+    {
+      printf("'%s' was %spruned\n",
+             prunefiles[i].filename, have ? "not " : "");
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+  }
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  filenamedb_close(db);
+  filenamedb_delete(FILENAME "-prune");
+
+  return err;
+}
+
+static result_t test_prune(void)
+{
+  result_t err;
+  int      i;
+
+  prune_cleanup();
+
+  if (mkdir(PRUNEDIR, 0777) ||
+      mkdir(PRUNEDIR "/many", 0777) ||
+      mkdir(PRUNEDIR "/few", 0777))
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  for (i = 0; i < NELEMS(prunefiles); i++)
+  {
+    FILE *f;
+
+    if (!prunefiles[i].create)
+      continue;
+
+    f = fopen(prunefiles[i].filename, "w");
+    if (f == NULL)
+    {
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    fclose(f);
+  }
+
+  err = test_prune_one(1);
+  if (err == result_OK)
+    err = test_prune_one(3);
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  prune_cleanup();
+
+  return err;
+}
+
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+result_t filenamedb_test(const char *resources)
+{
+  result_t err;
+
+  NOT_USED(resources);
+
+  printf("test: init\n");
+
+  err = filenamedb_init();
+  if (err)
+    goto Failure;
+
+  err = test_add_get();
+  if (err)
+    goto Failure;
+
+  err = test_reopen();
+  if (err)
+    goto Failure;
+
+  err = test_shared();
+  if (err)
+    goto Failure;
+
+#ifndef __riscos
+  err = test_prune();
+  if (err)
+    goto Failure;
+#endif
+
+  filenamedb_delete(FILENAME);
+
+  filenamedb_fin();
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  filenamedb_delete(FILENAME);
+
+  filenamedb_fin();
+
+  return result_TEST_FAILED;
+}
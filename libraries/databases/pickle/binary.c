@@ -0,0 +1,548 @@
+/* binary.c -- binary (de-)serialisation of associative arrays */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+#include "io/sink.h"
+#include "io/sink-stdio.h"
+
+#include "databases/pickle.h"
+
+#include "impl.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* The binary format is:
+ *
+ *   magic     4 bytes: PICKLE_BINARY_MAGIC
+ *   version   1 byte:  PICKLE_BINARY_VERSION
+ *   flags     1 byte:  zero (reserved)
+ *   comments  varint length, then bytes
+ *   records   varint (key length + 1), key bytes,
+ *             varint value length, value bytes  (zero or more)
+ *   end       1 byte:  zero
+ *   count     varint number of records
+ *   checksum  4 bytes: Adler-32 of all preceding bytes, little endian
+ *
+ * Varints are unsigned LEB128: seven bits per byte, least significant
+ * group first, top bit set on all but the final byte. */
+
+#define MAGICLEN   4
+#define HEADERLEN  (MAGICLEN + 2)
+#define FOOTERLEN  4
+
+/* Maximum bytes in a varint encoding of a size_t. */
+#define MAXVARINT  ((sizeof(size_t) * 8 + 6) / 7)
+
+/* Buffer space requested for a record when the formatters can't say how
+ * much they need. It's doubled on every failure. */
+#define MINRECORDSZ 256
+
+/* ----------------------------------------------------------------------- */
+
+typedef struct adler32
+{
+  uint32_t a, b;
+}
+adler32_t;
+
+#define ADLER_MOD  65521
+#define ADLER_NMAX 5552 /* max bytes before the sums can overflow */
+
+static void adler32_init(adler32_t *c)
+{
+  c->a = 1;
+  c->b = 0;
+}
+
+static void adler32_update(adler32_t *c, const void *vbuf, size_t len)
+{
+  const unsigned char *buf = vbuf;
+  uint32_t             a   = c->a;
+  uint32_t             b   = c->b;
+
+  while (len > 0)
+  {
+    size_t n;
+
+    n = MIN(len, ADLER_NMAX);
+    len -= n;
+
+    while (n--)
+    {
+      a += *buf++;
+      b += a;
+    }
+
+    a %= ADLER_MOD;
+    b %= ADLER_MOD;
+  }
+
+  c->a = a;
+  c->b = b;
+}
+
+static uint32_t adler32_final(const adler32_t *c)
+{
+  return (c->b << 16) | c->a;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static size_t varint_length(size_t v)
+{
+  size_t n;
+
+  for (n = 1; v >= 0x80; n++)
+    v >>= 7;
+
+  return n;
+}
+
+static unsigned char *varint_encode(unsigned char *p, size_t v)
+{
+  while (v >= 0x80)
+  {
+    *p++ = (unsigned char) (v | 0x80);
+    v >>= 7;
+  }
+
+  *p++ = (unsigned char) v;
+
+  return p;
+}
+
+/* returns NULL if the varint is truncated or too large */
+static const unsigned char *varint_decode(const unsigned char *p,
+                                          const unsigned char *end,
+                                          size_t              *pv)
+{
+  size_t       v;
+  unsigned int shift;
+
+  v = 0;
+  for (shift = 0; p < end && shift < sizeof(size_t) * 8; shift += 7)
+  {
+    unsigned char c = *p++;
+
+    v |= (size_t) (c & 0x7F) << shift;
+    if ((c & 0x80) == 0)
+    {
+      *pv = v;
+      return p;
+    }
+  }
+
+  return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static const unsigned char magic[MAGICLEN + 1] = PICKLE_BINARY_MAGIC;
+
+/* write bytes to the sink, including them in the checksum */
+static result_t pickle__binary_put(sink_t     *sink,
+                                   adler32_t  *cksum,
+                                   const void *block,
+                                   size_t      len)
+{
+  adler32_update(cksum, block, len);
+  return sink_write(sink, block, len);
+}
+
+static result_t pickle__binary_put_varint(sink_t    *sink,
+                                          adler32_t *cksum,
+                                          size_t     v)
+{
+  unsigned char buf[MAXVARINT];
+
+  return pickle__binary_put(sink, cksum, buf, varint_encode(buf, v) - buf);
+}
+
+/* work out how much buffer to ask for after running out of room */
+static size_t pickle__binary_grow(size_t avail, size_t prefix, size_t need)
+{
+  size_t want;
+
+  if (need)
+    want = prefix + need + 2 * MAXVARINT;
+  else
+    want = avail * 2;
+
+  if (want <= avail) /* ensure progress */
+    want = avail * 2;
+
+  if (want < MINRECORDSZ)
+    want = MINRECORDSZ;
+
+  return want;
+}
+
+/* format a record straight into the sink's buffer. each field is formatted
+ * after a one byte gap for its length, then moved up if the length needs
+ * more bytes than that. */
+static result_t pickle__binary_record(sink_t                        *sink,
+                                      adler32_t                     *cksum,
+                                      const void                    *key,
+                                      const void                    *value,
+                                      const pickle_format_methods_t *format,
+                                      void                          *opaque)
+{
+  result_t err;
+  size_t   want;
+
+  want = 0;
+  for (;;)
+  {
+    unsigned char *p;
+    size_t         avail;
+    size_t         keylen;
+    size_t         valuelen;
+    size_t         n;
+    size_t         used;
+    unsigned char *q;
+
+    if (want)
+    {
+      err = sink_reserve(sink, want);
+      if (err)
+        return err;
+    }
+
+    p     = sink->buf;
+    avail = sink_remaining(sink);
+
+    if (avail < 2 * MAXVARINT)
+    {
+      want = pickle__binary_grow(avail, 0, 0);
+      continue;
+    }
+
+    /* key */
+
+    used = 0;
+    err = format->key(key, (char *) p + 1, avail - 2 * MAXVARINT, &used, opaque);
+    if (err == result_PICKLE_BUFFER_FULL)
+    {
+      want = pickle__binary_grow(avail, 0, used);
+      continue;
+    }
+    else if (err)
+    {
+      return err;
+    }
+
+    keylen = used;
+
+    n = varint_length(keylen + 1);
+    if (n > 1)
+      memmove(p + n, p + 1, keylen);
+    varint_encode(p, keylen + 1);
+
+    q = p + n + keylen; /* value length goes here */
+
+    /* value */
+
+    used = 0;
+    err = format->value(value,
+                        (char *) q + 1,
+                        avail - (q - p) - MAXVARINT,
+                        &used,
+                        opaque);
+    if (err == result_PICKLE_BUFFER_FULL)
+    {
+      want = pickle__binary_grow(avail, q - p, used);
+      continue;
+    }
+    else if (err)
+    {
+      return err;
+    }
+
+    valuelen = used;
+
+    n = varint_length(valuelen);
+    if (n > 1)
+      memmove(q + n, q + 1, valuelen);
+    varint_encode(q, valuelen);
+
+    q += n + valuelen;
+
+    adler32_update(cksum, p, q - p);
+    sink->buf = q;
+
+    return result_OK;
+  }
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t pickle_pickle_binary_sink(sink_t                        *sink,
+                                   void                          *assocarr,
+                                   const pickle_reader_methods_t *reader,
+                                   const pickle_format_methods_t *format,
+                                   void                          *opaque)
+{
+  static const unsigned char header[2] = { PICKLE_BINARY_VERSION, 0 };
+
+  result_t      err;
+  adler32_t     cksum;
+  void         *state = NULL;
+  const void   *key;
+  const void   *value;
+  size_t        count;
+  uint32_t      sum;
+  unsigned char footer[FOOTERLEN];
+
+  assert(sink);
+  assert(assocarr);
+  assert(reader);
+  assert(format);
+
+  assert(reader->next); /* start and stop can be NULL, but we need next */
+
+  adler32_init(&cksum);
+
+  err = pickle__binary_put(sink, &cksum, magic, MAGICLEN);
+  if (!err)
+    err = pickle__binary_put(sink, &cksum, header, sizeof(header));
+  if (!err)
+    err = pickle__binary_put_varint(sink, &cksum, format->commentslen);
+  if (!err)
+    err = pickle__binary_put(sink, &cksum, format->comments, format->commentslen);
+  if (err)
+    return err;
+
+  if (reader->start)
+  {
+    err = reader->start(assocarr, opaque, &state);
+    if (err)
+      return err;
+  }
+
+  count = 0;
+  while ((err = reader->next(state, &key, &value, opaque)) == result_OK)
+  {
+    err = pickle__binary_record(sink, &cksum, key, value, format, opaque);
+    if (err == result_PICKLE_SKIP)
+      continue;
+    else if (err)
+      break;
+
+    count++;
+  }
+
+  if (reader->stop)
+    reader->stop(state, opaque);
+
+  if (err != result_PICKLE_END)
+    return err;
+
+  err = pickle__binary_put(sink, &cksum, "", 1); /* end marker */
+  if (!err)
+    err = pickle__binary_put_varint(sink, &cksum, count);
+  if (err)
+    return err;
+
+  sum = adler32_final(&cksum);
+  footer[0] = (unsigned char) (sum >>  0);
+  footer[1] = (unsigned char) (sum >>  8);
+  footer[2] = (unsigned char) (sum >> 16);
+  footer[3] = (unsigned char) (sum >> 24);
+
+  err = sink_write(sink, footer, FOOTERLEN);
+  if (err)
+    return err;
+
+  return sink_flush(sink);
+}
+
+result_t pickle_pickle_binary(const char                    *filename,
+                              void                          *assocarr,
+                              const pickle_reader_methods_t *reader,
+                              const pickle_format_methods_t *format,
+                              void                          *opaque)
+{
+  result_t err;
+  FILE    *f;
+  sink_t  *sink;
+
+  assert(filename);
+
+  f = fopen(filename, "wb");
+  if (f == NULL)
+    return result_PICKLE_COULDNT_OPEN_FILE;
+
+  err = sink_stdio_create(f, 0, &sink);
+  if (err)
+  {
+    fclose(f);
+    return err;
+  }
+
+  err = pickle_pickle_binary_sink(sink, assocarr, reader, format, opaque);
+
+  sink_destroy(sink); /* closes the file */
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int pickle__is_binary(const char *buf, size_t length)
+{
+  return length >= MAGICLEN && memcmp(buf, magic, MAGICLEN) == 0;
+}
+
+result_t pickle__unpickle_binary(const char                      *buf,
+                                 size_t                           length,
+                                 void                            *assocarr,
+                                 const pickle_writer_methods_t   *writer,
+                                 const pickle_unformat_methods_t *unformat,
+                                 void                            *opaque)
+{
+  result_t             err;
+  const unsigned char *p;
+  const unsigned char *end;
+  adler32_t            cksum;
+  uint32_t             sum;
+  size_t               commentslen;
+  size_t               count;
+  size_t               n;
+  void                *wstate = NULL;
+
+  if (length < HEADERLEN + FOOTERLEN || !pickle__is_binary(buf, length))
+    return result_PICKLE_INCOMPATIBLE;
+
+  p   = (const unsigned char *) buf;
+  end = p + length - FOOTERLEN;
+
+  if (p[MAGICLEN] != PICKLE_BINARY_VERSION || p[MAGICLEN + 1] != 0)
+    return result_PICKLE_INCOMPATIBLE;
+
+  /* check the whole file before inserting anything */
+
+  adler32_init(&cksum);
+  adler32_update(&cksum, p, end - p);
+  sum = (uint32_t) end[0]         | ((uint32_t) end[1] << 8) |
+        ((uint32_t) end[2] << 16) | ((uint32_t) end[3] << 24);
+  if (adler32_final(&cksum) != sum)
+    return result_PICKLE_BAD_CHECKSUM;
+
+  p += HEADERLEN;
+
+  p = varint_decode(p, end, &commentslen);
+  if (p == NULL || commentslen > (size_t) (end - p))
+    return result_PICKLE_SYNTAX_ERROR;
+
+  p += commentslen;
+
+  if (writer->start)
+  {
+    err = writer->start(assocarr, &wstate, opaque);
+    if (err)
+      return err;
+  }
+
+  for (n = 0; ; n++)
+  {
+    size_t               keylen;
+    size_t               valuelen;
+    const unsigned char *key;
+    void                *fmtkey;
+    void                *fmtvalue;
+
+    p = varint_decode(p, end, &keylen);
+    if (p == NULL)
+    {
+      err = result_PICKLE_SYNTAX_ERROR;
+      goto Failure;
+    }
+
+    if (keylen-- == 0)
+      break; /* end marker */
+
+    if (keylen > (size_t) (end - p))
+    {
+      err = result_PICKLE_SYNTAX_ERROR;
+      goto Failure;
+    }
+
+    key = p;
+    p += keylen;
+
+    p = varint_decode(p, end, &valuelen);
+    if (p == NULL || valuelen > (size_t) (end - p))
+    {
+      err = result_PICKLE_SYNTAX_ERROR;
+      goto Failure;
+    }
+
+    err = unformat->key((const char *) key, keylen, &fmtkey, opaque);
+    if (err)
+      goto Failure;
+
+    err = unformat->value((const char *) p, valuelen, &fmtvalue, opaque);
+    if (err)
+      goto Failure; // no result_t cleanup
+
+    p += valuelen;
+
+    err = writer->next(wstate, fmtkey, fmtvalue, opaque);
+    if (err)
+      goto Failure; // no result_t cleanup
+  }
+
+  p = varint_decode(p, end, &count);
+  if (p != end || count != n)
+    err = result_PICKLE_SYNTAX_ERROR;
+  else
+    err = result_OK;
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  if (writer->stop)
+    writer->stop(wstate, opaque);
+
+  return err;
+}
+
+result_t pickle_unpickle_binary(const char                      *filename,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque)
+{
+  result_t      err;
+  pickle__map_t map;
+
+  assert(filename);
+  assert(writer);
+  assert(unformat);
+
+  err = pickle__map_file(filename, &map);
+  if (err)
+    return err;
+
+  err = pickle__unpickle_binary(map.base,
+                                map.length,
+                                assocarr,
+                                writer,
+                                unformat,
+                                opaque);
+
+  pickle__unmap_file(&map);
+
+  return err;
+}
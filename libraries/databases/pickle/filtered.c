@@ -0,0 +1,311 @@
+/* filtered.c -- pickles passed through stream codecs */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+#include "io/sink.h"
+#include "io/sink-mem.h"
+#include "io/sink-stdio.h"
+#include "io/stream.h"
+#include "io/stream-mem.h"
+#include "io/stream-mtfcomp.h"
+#include "io/stream-packbits.h"
+
+#include "databases/pickle.h"
+
+#include "impl.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* A filtered pickle is:
+ *
+ *   magic     4 bytes: PICKLE_FILTERED_MAGIC
+ *   version   1 byte:  PICKLE_FILTERED_VERSION
+ *   ncodecs   1 byte
+ *   codecs    ncodecs bytes: pickle_codec_t values in the order applied
+ *   payload   a text or binary pickle passed through the codecs
+ */
+
+#define MAGICLEN  4
+#define HEADERLEN (MAGICLEN + 2)
+
+/* ----------------------------------------------------------------------- */
+
+static const unsigned char magic[MAGICLEN + 1] = PICKLE_FILTERED_MAGIC;
+
+/* Build a chain of codec streams on top of 'input'. When decompressing the
+ * codecs are undone in reverse order. 'chain' receives the streams created,
+ * the last of which is the output. */
+static result_t pickle__make_chain(stream_t            *input,
+                                   const unsigned char *codecs,
+                                   int                  ncodecs,
+                                   int                  compress,
+                                   stream_t            *chain[])
+{
+  result_t err;
+  int      i;
+
+  for (i = 0; i < ncodecs; i++)
+  {
+    unsigned char codec;
+    stream_t     *in;
+
+    codec = compress ? codecs[i] : codecs[ncodecs - 1 - i];
+    in    = (i == 0) ? input : chain[i - 1];
+
+    switch (codec)
+    {
+    case pickle_CODEC_PACKBITS:
+      err = compress ? stream_packbitscomp_create(in, 0, &chain[i])
+                     : stream_packbitsdecomp_create(in, 0, &chain[i]);
+      break;
+
+    case pickle_CODEC_MTF:
+      err = compress ? stream_mtfcomp_create(in, 0, &chain[i])
+                     : stream_mtfdecomp_create(in, 0, &chain[i]);
+      break;
+
+    default:
+      err = result_PICKLE_INCOMPATIBLE;
+      break;
+    }
+
+    if (err)
+    {
+      while (i--)
+        stream_destroy(chain[i]);
+      return err;
+    }
+  }
+
+  return result_OK;
+}
+
+/* copy everything from stream 's' into 'sink' */
+static result_t pickle__drain(stream_t *s, sink_t *sink)
+{
+  for (;;)
+  {
+    int           c;
+    stream_size_t n;
+    result_t      err;
+
+    c = stream_getc(s);
+    if (c == EOF)
+      break;
+
+    if (!sink_putc(sink, c))
+      return sink->last;
+
+    /* take the rest of the buffer in one go */
+    n = stream_remaining(s);
+    if (n)
+    {
+      err = sink_write(sink, s->buf, n);
+      if (err)
+        return err;
+
+      s->buf += n;
+    }
+  }
+
+  return result_OK;
+}
+
+/* pass the 'length' byte block 'buf' through the codecs into 'sink' */
+static result_t pickle__filter(const unsigned char *buf,
+                               size_t               length,
+                               const unsigned char *codecs,
+                               int                  ncodecs,
+                               int                  compress,
+                               sink_t              *sink)
+{
+  result_t  err;
+  stream_t *input;
+  stream_t *chain[pickle_MAXCODECS];
+  int       i;
+
+  assert(ncodecs <= pickle_MAXCODECS);
+
+  err = stream_mem_create(buf, length, &input);
+  if (err)
+    return err;
+
+  err = pickle__make_chain(input, codecs, ncodecs, compress, chain);
+  if (err)
+  {
+    stream_destroy(input);
+    return err;
+  }
+
+  err = pickle__drain(ncodecs ? chain[ncodecs - 1] : input, sink);
+
+  for (i = ncodecs - 1; i >= 0; i--)
+    stream_destroy(chain[i]);
+  stream_destroy(input);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t pickle_pickle_filtered(const char                    *filename,
+                                void                          *assocarr,
+                                const pickle_reader_methods_t *reader,
+                                const pickle_format_methods_t *format,
+                                const pickle_codec_t          *codecs,
+                                int                            ncodecs,
+                                unsigned int                   flags,
+                                void                          *opaque)
+{
+  result_t             err;
+  sink_t              *mem  = NULL;
+  sink_t              *file = NULL;
+  FILE                *f;
+  unsigned char        header[HEADERLEN + pickle_MAXCODECS];
+  int                  i;
+  const unsigned char *block;
+  size_t               length;
+
+  assert(filename);
+  assert(codecs || ncodecs == 0);
+
+  if (ncodecs < 0 || ncodecs > pickle_MAXCODECS)
+    return result_BAD_ARG;
+
+  memcpy(header, magic, MAGICLEN);
+  header[MAGICLEN]     = PICKLE_FILTERED_VERSION;
+  header[MAGICLEN + 1] = (unsigned char) ncodecs;
+  for (i = 0; i < ncodecs; i++)
+    header[HEADERLEN + i] = (unsigned char) codecs[i];
+
+  /* pickle into memory, then run that through the codecs into the file.
+   * the codecs only exist as pull streams so the output can't be pushed
+   * through them as it's produced. */
+
+  err = sink_mem_create(0, &mem);
+  if (err)
+    return err;
+
+  if (flags & pickle_FLAG_BINARY)
+    err = pickle_pickle_binary_sink(mem, assocarr, reader, format, opaque);
+  else
+    err = pickle_pickle_sink(mem, assocarr, reader, format, opaque);
+  if (err)
+    goto Failure;
+
+  f = fopen(filename, "wb");
+  if (f == NULL)
+  {
+    err = result_PICKLE_COULDNT_OPEN_FILE;
+    goto Failure;
+  }
+
+  err = sink_stdio_create(f, 0, &file);
+  if (err)
+  {
+    fclose(f);
+    goto Failure;
+  }
+
+  err = sink_write(file, header, HEADERLEN + ncodecs);
+  if (err)
+    goto Failure;
+
+  block = sink_mem_get(mem, &length);
+
+  err = pickle__filter(block, length, header + HEADERLEN, ncodecs, 1, file);
+  if (err)
+    goto Failure;
+
+  err = sink_flush(file);
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  sink_destroy(file); /* closes the file */
+  sink_destroy(mem);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int pickle__is_filtered(const char *buf, size_t length)
+{
+  return length >= MAGICLEN && memcmp(buf, magic, MAGICLEN) == 0;
+}
+
+result_t pickle__unpickle_filtered(const char                      *buf,
+                                   size_t                           length,
+                                   void                            *assocarr,
+                                   const pickle_writer_methods_t   *writer,
+                                   const pickle_unformat_methods_t *unformat,
+                                   void                            *opaque)
+{
+  result_t             err;
+  const unsigned char *p = (const unsigned char *) buf;
+  int                  ncodecs;
+  sink_t              *mem;
+  const unsigned char *block;
+  size_t               blocklen;
+
+  if (length < HEADERLEN || !pickle__is_filtered(buf, length))
+    return result_PICKLE_INCOMPATIBLE;
+
+  if (p[MAGICLEN] != PICKLE_FILTERED_VERSION)
+    return result_PICKLE_INCOMPATIBLE;
+
+  ncodecs = p[MAGICLEN + 1];
+  if (ncodecs > pickle_MAXCODECS || length < (size_t) HEADERLEN + ncodecs)
+    return result_PICKLE_INCOMPATIBLE;
+
+  /* decode into memory then parse whatever variant was inside. the binary
+   * variant is checksummed as a whole and the parsers take a block, so the
+   * payload isn't parsed as it's decoded. */
+
+  err = sink_mem_create(length * 2, &mem);
+  if (err)
+    return err;
+
+  err = pickle__filter(p + HEADERLEN + ncodecs,
+                       length - HEADERLEN - ncodecs,
+                       p + HEADERLEN,
+                       ncodecs,
+                       0,
+                       mem);
+  if (err)
+    goto Failure;
+
+  block = sink_mem_get(mem, &blocklen);
+
+  if (pickle__is_filtered((const char *) block, blocklen))
+  {
+    err = result_PICKLE_INCOMPATIBLE; /* no nesting */
+    goto Failure;
+  }
+
+  err = pickle__unpickle_block((const char *) block,
+                               blocklen,
+                               assocarr,
+                               writer,
+                               unformat,
+                               opaque);
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  sink_destroy(mem);
+
+  return err;
+}
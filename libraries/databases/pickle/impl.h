@@ -0,0 +1,79 @@
+/* impl.h -- pickle internals */
+
+#ifndef PICKLE_IMPL_H
+#define PICKLE_IMPL_H
+
+#include <stddef.h>
+
+#include "base/result.h"
+
+#include "databases/pickle.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* A read-only view of a whole file. */
+typedef struct pickle__map
+{
+  const char *base;
+  size_t      length;
+  int         mapped; /* non-zero if 'base' is a mapping, else a heap block */
+}
+pickle__map_t;
+
+/* map 'filename' read-only. where mapping isn't available the file is read
+ * into memory instead. */
+result_t pickle__map_file(const char *filename, pickle__map_t *map);
+
+void pickle__unmap_file(pickle__map_t *map);
+
+/* ----------------------------------------------------------------------- */
+
+/* skip leading comments and validate the signature line. returns a pointer
+ * to the first body line, or NULL if the signature is bad. a file holding
+ * only comments is accepted as empty. */
+const char *pickle__skip_header(const char *p, const char *end);
+
+/* find the first occurrence of 'split' in [p,end), or NULL. */
+const char *pickle__find_split(const char *p,
+                               const char *end,
+                               const char *split,
+                               size_t      splitlen);
+
+/* ----------------------------------------------------------------------- */
+
+/* returns non-zero if the 'length' byte block starts like a binary pickle */
+int pickle__is_binary(const char *buf, size_t length);
+
+/* unpickle a binary pickle held in memory */
+result_t pickle__unpickle_binary(const char                      *buf,
+                                 size_t                           length,
+                                 void                            *assocarr,
+                                 const pickle_writer_methods_t   *writer,
+                                 const pickle_unformat_methods_t *unformat,
+                                 void                            *opaque);
+
+/* returns non-zero if the 'length' byte block starts like a filtered
+ * pickle */
+int pickle__is_filtered(const char *buf, size_t length);
+
+/* unpickle a filtered pickle held in memory */
+result_t pickle__unpickle_filtered(const char                      *buf,
+                                   size_t                           length,
+                                   void                            *assocarr,
+                                   const pickle_writer_methods_t   *writer,
+                                   const pickle_unformat_methods_t *unformat,
+                                   void                            *opaque);
+
+/* ----------------------------------------------------------------------- */
+
+/* unpickle a pickle of any variant held in memory */
+result_t pickle__unpickle_block(const char                      *buf,
+                                size_t                           length,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque);
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* PICKLE_IMPL_H */
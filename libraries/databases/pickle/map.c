@@ -0,0 +1,200 @@
+/* map.c -- read-only whole file access for unpickling */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __riscos
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "databases/pickle.h"
+
+#include "impl.h"
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef __riscos
+
+result_t pickle__map_file(const char *filename, pickle__map_t *map)
+{
+  int         fd;
+  struct stat st;
+  void       *base;
+
+  assert(filename);
+  assert(map);
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return result_PICKLE_COULDNT_OPEN_FILE;
+
+  if (fstat(fd, &st) < 0)
+  {
+    close(fd);
+    return result_PICKLE_COULDNT_OPEN_FILE;
+  }
+
+  if (st.st_size == 0)
+  {
+    /* zero length mappings aren't allowed */
+    close(fd);
+    map->base   = "";
+    map->length = 0;
+    map->mapped = 0;
+    return result_OK;
+  }
+
+  base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd); /* the mapping persists */
+
+  if (base == MAP_FAILED)
+    return result_PICKLE_COULDNT_OPEN_FILE;
+
+  map->base   = base;
+  map->length = (size_t) st.st_size;
+  map->mapped = 1;
+
+  return result_OK;
+}
+
+void pickle__unmap_file(pickle__map_t *map)
+{
+  if (map->mapped)
+    munmap((void *) map->base, map->length);
+  else if (map->length)
+    free((void *) map->base);
+}
+
+#else
+
+result_t pickle__map_file(const char *filename, pickle__map_t *map)
+{
+  result_t err;
+  FILE    *f;
+  long     length;
+  char    *buf = NULL;
+
+  assert(filename);
+  assert(map);
+
+  f = fopen(filename, "rb");
+  if (f == NULL)
+    return result_PICKLE_COULDNT_OPEN_FILE;
+
+  if (fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) < 0)
+  {
+    err = result_PICKLE_COULDNT_OPEN_FILE;
+    goto Failure;
+  }
+
+  rewind(f);
+
+  if (length == 0)
+  {
+    fclose(f);
+    map->base   = "";
+    map->length = 0;
+    map->mapped = 0;
+    return result_OK;
+  }
+
+  buf = malloc((size_t) length);
+  if (buf == NULL)
+  {
+    err = result_OOM;
+    goto Failure;
+  }
+
+  if (fread(buf, 1, (size_t) length, f) != (size_t) length)
+  {
+    err = result_PICKLE_COULDNT_OPEN_FILE;
+    goto Failure;
+  }
+
+  fclose(f);
+
+  map->base   = buf;
+  map->length = (size_t) length;
+  map->mapped = 0;
+
+  return result_OK;
+
+
+Failure:
+
+  free(buf);
+  fclose(f);
+
+  return err;
+}
+
+void pickle__unmap_file(pickle__map_t *map)
+{
+  if (map->length)
+    free((void *) map->base);
+}
+
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+const char *pickle__skip_header(const char *p, const char *end)
+{
+  static const char signature[] = PICKLE_SIGNATURE;
+
+  while (p < end)
+  {
+    const char *nl;
+
+    nl = memchr(p, '\n', end - p);
+    if (nl == NULL)
+      nl = end;
+
+    if (*p != '#')
+    {
+      if ((size_t)(nl - p) != sizeof(signature) - 1 ||
+          memcmp(p, signature, sizeof(signature) - 1) != 0)
+        return NULL;
+
+      return (nl < end) ? nl + 1 : end;
+    }
+
+    p = nl + 1;
+  }
+
+  return end;
+}
+
+const char *pickle__find_split(const char *p,
+                               const char *end,
+                               const char *split,
+                               size_t      splitlen)
+{
+  assert(splitlen > 0);
+
+  while ((size_t) (end - p) >= splitlen)
+  {
+    p = memchr(p, split[0], end - p - splitlen + 1);
+    if (p == NULL)
+      return NULL;
+
+    if (memcmp(p, split, splitlen) == 0)
+      return p;
+
+    p++;
+  }
+
+  return NULL;
+}
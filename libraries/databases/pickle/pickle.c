@@ -12,6 +12,8 @@
 
 #include "base/result.h"
 #include "base/utils.h"
+#include "io/sink.h"
+#include "io/sink-stdio.h"
 
 #include "databases/pickle.h"
 
@@ -19,28 +21,134 @@
 
 static const char signature[] = PICKLE_SIGNATURE;
 
+/* Buffer space requested for a record when the formatters can't say how
+ * much they need. It's doubled on every failure. */
+#define MINRECORDSZ 256
+
 /* ----------------------------------------------------------------------- */
 
 /* write out a version numbered header */
-static result_t pickle__write_header(FILE       *f,
+static result_t pickle__write_header(sink_t     *sink,
                                      const char *comments,
                                      size_t      commentslen)
 {
   static const char commentchar[] = "# ";
-  int rc;
+  result_t err;
+
+  err = sink_write(sink, commentchar, NELEMS(commentchar) - 1);
+  if (!err)
+    err = sink_write(sink, comments, commentslen);
+  if (!err)
+    err = sink_write(sink, "\n", 1);
+  if (!err)
+    err = sink_write(sink, signature, NELEMS(signature) - 1);
+  if (!err)
+    err = sink_write(sink, "\n", 1);
+
+  return err;
+}
+
+/* work out how much buffer to ask for after a formatter ran out of room */
+static size_t pickle__grow(size_t avail, size_t prefix, size_t need)
+{
+  size_t want;
+
+  if (need)
+    want = prefix + need + 1; /* newline */
+  else
+    want = avail * 2;
+
+  if (want <= avail) /* ensure progress */
+    want = avail * 2;
+
+  if (want < MINRECORDSZ)
+    want = MINRECORDSZ;
+
+  return want;
+}
+
+/* format a key:value record straight into the sink's buffer. the sink's
+ * pointer is advanced only once the record is complete, so the buffer can
+ * be drained or grown and the record reformatted from scratch. */
+static result_t pickle__write_record(sink_t                        *sink,
+                                     const void                    *key,
+                                     const void                    *value,
+                                     const pickle_format_methods_t *format,
+                                     void                          *opaque)
+{
+  result_t err;
+  size_t   want;
+
+  want = 0;
+  for (;;)
+  {
+    char  *p;
+    size_t avail;
+    size_t keylen;
+    size_t valuelen;
+    size_t used;
+
+    if (want)
+    {
+      err = sink_reserve(sink, want);
+      if (err)
+        return err;
+    }
+
+    p     = (char *) sink->buf;
+    avail = sink_remaining(sink);
+
+    used = 0;
+    err = format->key(key, p, avail, &used, opaque);
+    if (err == result_PICKLE_BUFFER_FULL)
+    {
+      want = pickle__grow(avail, format->splitlen, used);
+      continue;
+    }
+    else if (err)
+    {
+      return err;
+    }
+
+    keylen = used;
+
+    if (avail - keylen < format->splitlen)
+    {
+      want = pickle__grow(avail, 0, 0);
+      continue;
+    }
+
+    memcpy(p + keylen, format->split, format->splitlen);
+    keylen += format->splitlen;
+
+    used = 0;
+    err = format->value(value, p + keylen, avail - keylen, &used, opaque);
+    if (err == result_PICKLE_BUFFER_FULL)
+    {
+      want = pickle__grow(avail, keylen, used);
+      continue;
+    }
+    else if (err)
+    {
+      return err;
+    }
 
-  rc = fprintf(f, "%s%.*s\n%s\n",
-               commentchar,
-               (int) commentslen,
-               comments,
-               signature);
-  if (rc < 0)
-    return result_BUFFER_OVERFLOW; // FIXME hard coded error number (could use errno?)
+    valuelen = used;
 
-  return result_OK;
+    if (avail - keylen - valuelen < 1)
+    {
+      want = pickle__grow(avail, keylen + valuelen, 0);
+      continue;
+    }
+
+    p[keylen + valuelen] = '\n';
+    sink->buf += keylen + valuelen + 1;
+
+    return result_OK;
+  }
 }
 
-static result_t pickle__write_body(FILE                          *f,
+static result_t pickle__write_body(sink_t                        *sink,
                                    void                          *assocarr,
                                    const pickle_reader_methods_t *reader,
                                    const pickle_format_methods_t *format,
@@ -60,34 +168,11 @@ static result_t pickle__write_body(FILE                          *f,
 
   while ((err = reader->next(state, &key, &value, opaque)) == result_OK)
   {
-    char buffer1[256];
-    char buffer2[768];
-    int  rc;
-
-    // FIXME: get the format methods to pass back how much they used then we
-    //        can pack the entire lot into the output buffer as we go
-
-    err = format->key(key, buffer1, NELEMS(buffer1), opaque);
-    if (err == result_PICKLE_SKIP)
-      continue;
-    else if (err)
-      goto exit;
-
-    err = format->value(value, buffer2, NELEMS(buffer2), opaque);
+    err = pickle__write_record(sink, key, value, format, opaque);
     if (err == result_PICKLE_SKIP)
       continue;
     else if (err)
       goto exit;
-
-    rc = fprintf(f, "%s%.*s%s\n",
-                 buffer1,
-                 (int) format->splitlen, format->split,
-                 buffer2);
-    if (rc < 0)
-    {
-      err = result_BUFFER_OVERFLOW; // FIXME hard coded error number (could use errno?)
-      goto exit;
-    }
   }
 
   if (err == result_PICKLE_END)
@@ -103,6 +188,32 @@ exit:
 
 /* ----------------------------------------------------------------------- */
 
+result_t pickle_pickle_sink(sink_t                        *sink,
+                            void                          *assocarr,
+                            const pickle_reader_methods_t *reader,
+                            const pickle_format_methods_t *format,
+                            void                          *opaque)
+{
+  result_t err;
+
+  assert(sink);
+  assert(assocarr);
+  assert(reader);
+  assert(format);
+
+  assert(reader->next); /* start and stop can be NULL, but we need next */
+
+  err = pickle__write_header(sink, format->comments, format->commentslen);
+  if (err)
+    return err;
+
+  err = pickle__write_body(sink, assocarr, reader, format, opaque);
+  if (err)
+    return err;
+
+  return sink_flush(sink);
+}
+
 result_t pickle_pickle(const char                    *filename,
                        void                          *assocarr,
                        const pickle_reader_methods_t *reader,
@@ -111,34 +222,24 @@ result_t pickle_pickle(const char                    *filename,
 {
   result_t err;
   FILE    *f;
+  sink_t  *sink;
 
   assert(filename);
-  assert(assocarr);
-  assert(reader);
-  assert(format);
-
-  assert(reader->next); /* start and stop can be NULL, but we need next */
 
   f = fopen(filename, "wb");
   if (f == NULL)
     return result_PICKLE_COULDNT_OPEN_FILE;
 
-  err = pickle__write_header(f, format->comments, format->commentslen);
-  if (err)
-    goto failure;
-
-  err = pickle__write_body(f, assocarr, reader, format, opaque);
+  err = sink_stdio_create(f, 0, &sink);
   if (err)
-    goto failure;
-
-  fclose(f);
-
-  return result_OK;
-
+  {
+    fclose(f);
+    return err;
+  }
 
-failure:
+  err = pickle_pickle_sink(sink, assocarr, reader, format, opaque);
 
-  fclose(f);
+  sink_destroy(sink); /* closes the file */
 
   return err;
 }
@@ -17,6 +17,8 @@
 #include "databases/pickle.h"
 #include "databases/pickle-reader-hash.h"
 #include "databases/pickle-writer-hash.h"
+#include "io/sink.h"
+#include "io/sink-mem.h"
 
 #include "test/all-tests.h"
 
@@ -38,26 +40,50 @@ static char *my_strdup(const char *s)
   return d;
 }
 
+static char *my_strndup(const char *s, size_t l)
+{
+  char *d;
+
+  d = malloc(l + 1);
+  if (d == NULL)
+    return NULL;
+
+  memcpy(d, s, l);
+  d[l] = '\0';
+
+  return d;
+}
+
 /* ----------------------------------------------------------------------- */
 
-static result_t test1_format_key(const void *key, char *buf, size_t len, void *opaque)
+static result_t test1_format_string(const char *s, char *buf, size_t len, size_t *used)
 {
-  NOT_USED(len);
-  NOT_USED(opaque);
+  size_t l;
+
+  l = strlen(s);
+
+  *used = l;
 
-  strcpy(buf, key);
+  if (l > len)
+    return result_PICKLE_BUFFER_FULL;
+
+  memcpy(buf, s, l);
 
   return result_OK;
 }
 
-static result_t test1_format_value(const void *key, char *buf, size_t len, void *opaque)
+static result_t test1_format_key(const void *key, char *buf, size_t len, size_t *used, void *opaque)
 {
-  NOT_USED(len);
   NOT_USED(opaque);
 
-  strcpy(buf, key);
+  return test1_format_string(key, buf, len, used);
+}
 
-  return result_OK;
+static result_t test1_format_value(const void *value, char *buf, size_t len, size_t *used, void *opaque)
+{
+  NOT_USED(opaque);
+
+  return test1_format_string(value, buf, len, used);
 }
 
 static const pickle_format_methods_t formatters =
@@ -70,6 +96,28 @@ static const pickle_format_methods_t formatters =
   test1_format_value
 };
 
+static result_t test1_unformat_string(const char *buf,
+                                      size_t      len,
+                                      void      **pstring,
+                                      void       *opaque)
+{
+  NOT_USED(opaque);
+
+  *pstring = my_strndup(buf, len);
+  if (*pstring == NULL)
+    return result_OOM;
+
+  return result_OK;
+}
+
+static const pickle_unformat_methods_t unformatters =
+{
+  ": ",
+  2,
+  test1_unformat_string,
+  test1_unformat_string
+};
+
 /* ----------------------------------------------------------------------- */
 
 static result_t pickle__test1_write(void)
@@ -320,33 +368,41 @@ cheese_value_t;
 
 /* ----------------------------------------------------------------------- */
 
-static result_t cheese_format_key(const void *vkey, char *buf, size_t len, void *opaque)
+static result_t cheese_format_key(const void *vkey, char *buf, size_t len, size_t *used, void *opaque)
 {
   const cheese_key_t *key = vkey;
 
   NOT_USED(opaque);
 
-  strncpy(buf, key->name, len);
-  buf[len - 1] = '\0';
-
-  return result_OK;
+  return test1_format_string(key->name, buf, len, used);
 }
 
-static result_t cheese_format_value(const void *vvalue, char *buf, size_t len, void *opaque)
+static result_t cheese_format_value(const void *vvalue, char *buf, size_t len, size_t *used, void *opaque)
 {
   const cheese_value_t *value = vvalue;
+  int                   rc;
 
   NOT_USED(opaque);
 
-  sprintf(buf,
-         "%s %s %s %s %s %d",
-          cheese_country_to_string(value->country),
-          cheese_region_to_string(value->region),
-          cheese_source_to_string(value->source1),
-          cheese_source_to_string(value->source2),
-          cheese_pasteurised_to_string(value->pasteurised),
-          value->age);
-  buf[len - 1] = '\0';
+  rc = snprintf(buf,
+                len,
+               "%s %s %s %s %s %d",
+                cheese_country_to_string(value->country),
+                cheese_region_to_string(value->region),
+                cheese_source_to_string(value->source1),
+                cheese_source_to_string(value->source2),
+                cheese_pasteurised_to_string(value->pasteurised),
+                value->age);
+  if (rc < 0)
+    return result_BAD_ARG;
+
+  if ((size_t) rc >= len)
+  {
+    *used = rc + 1; /* snprintf wants room for a terminator */
+    return result_PICKLE_BUFFER_FULL;
+  }
+
+  *used = rc;
 
   return result_OK;
 }
@@ -368,10 +424,9 @@ static result_t cheese_unformat_key(const char *buf,
                                     void      **key,
                                     void       *opaque)
 {
-  NOT_USED(len);
   NOT_USED(opaque);
 
-  *key = my_strdup(buf);
+  *key = my_strndup(buf, len);
   if (*key == NULL)
     return result_OOM;
 
@@ -385,6 +440,7 @@ static result_t cheese_unformat_value(const char *buf,
 {
   cheese_value_t *value;
   int             rc;
+  char            line[256];
   char            country[100];
   char            region[100];
   char            source1[100];
@@ -392,14 +448,20 @@ static result_t cheese_unformat_value(const char *buf,
   char            pasteurised[100];
   int             age;
 
-  NOT_USED(len);
   NOT_USED(opaque);
 
+  /* the buffer isn't terminated */
+  if (len >= sizeof(line))
+    return result_BAD_ARG;
+
+  memcpy(line, buf, len);
+  line[len] = '\0';
+
   value = malloc(sizeof(cheese_value_t));
   if (value == NULL)
     return result_OOM;
 
-  rc = sscanf(buf,
+  rc = sscanf(line,
              "%s %s %s %s %s %d",
               country,
               region,
@@ -535,15 +597,18 @@ Failure:
 
 static int my_walk_fn(const void *key, const void *value, void *opaque)
 {
-  char kbuf[256];
-  char vbuf[256];
+  char   kbuf[256];
+  char   vbuf[256];
+  size_t klen;
+  size_t vlen;
 
   NOT_USED(opaque);
 
-  cheese_format_key(key, kbuf, sizeof(kbuf), NULL);
-  cheese_format_value(value, vbuf, sizeof(vbuf), NULL);
+  if (cheese_format_key(key, kbuf, sizeof(kbuf), &klen, NULL) ||
+      cheese_format_value(value, vbuf, sizeof(vbuf), &vlen, NULL))
+    return -1;
 
-  printf("walk '%s':'%s'...\n", kbuf, vbuf);
+  printf("walk '%.*s':'%.*s'...\n", (int) klen, kbuf, (int) vlen, vbuf);
 
   return 0;
 }
@@ -575,6 +640,40 @@ static result_t pickle__test2_read(void)
   if (err)
     goto Failure;
 
+  if (hash_count(d) != NELEMS(cheeses))
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  hash_destroy(d);
+
+  printf("test: unpickle mapped\n");
+
+  err = hash_create(NULL,
+                    0,
+                    NULL,
+                    NULL,
+                    cheese_key_destroy,
+                    cheese_value_destroy,
+                   &d);
+  if (err)
+    goto Failure;
+
+  err = pickle_unpickle_mapped(FILENAME,
+                               d,
+                              &pickle_writer_hash,
+                              &unformat_cheese_methods,
+                               NULL);
+  if (err)
+    goto Failure;
+
+  if (hash_count(d) != NELEMS(cheeses))
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
   printf("test: iterate\n");
 
   hash_walk(d, my_walk_fn, NULL);
@@ -595,6 +694,660 @@ Failure:
 
 /* ----------------------------------------------------------------------- */
 
+typedef struct cheese_record
+{
+  const char *key;
+  size_t      keylen;
+  const char *value;
+  size_t      valuelen;
+}
+cheese_record_t;
+
+static result_t cheese_parse(const char *key,
+                             size_t      keylen,
+                             const char *value,
+                             size_t      valuelen,
+                             void       *state,
+                             void       *vrecord,
+                             void       *opaque)
+{
+  cheese_record_t *record = vrecord;
+
+  NOT_USED(state);
+  NOT_USED(opaque);
+
+  record->key      = key;
+  record->keylen   = keylen;
+  record->value    = value;
+  record->valuelen = valuelen;
+
+  return result_OK;
+}
+
+static result_t cheese_merge(void  *state,
+                             void  *vrecord,
+                             void **key,
+                             void **value,
+                             void  *opaque)
+{
+  result_t         err;
+  cheese_record_t *record = vrecord;
+
+  NOT_USED(state);
+
+  err = cheese_unformat_key(record->key, record->keylen, key, opaque);
+  if (err)
+    return err;
+
+  err = cheese_unformat_value(record->value, record->valuelen, value, opaque);
+  if (err)
+  {
+    free(*key);
+    return err;
+  }
+
+  return result_OK;
+}
+
+static const pickle_parallel_methods_t parallel_cheese_methods =
+{
+  " -*- ",
+  5,
+  sizeof(cheese_record_t),
+  NULL,
+  NULL,
+  cheese_parse,
+  cheese_merge
+};
+
+static result_t pickle__test2_read_parallel(void)
+{
+  result_t err;
+  hash_t  *d;
+  int      nthreads;
+
+  for (nthreads = 1; nthreads <= 8; nthreads++)
+  {
+    printf("test: create hash\n");
+
+    err = hash_create(NULL,
+                      0,
+                      NULL,
+                      NULL,
+                      cheese_key_destroy,
+                      cheese_value_destroy,
+                     &d);
+    if (err)
+      goto Failure;
+
+    printf("test: unpickle using %d threads\n", nthreads);
+
+    err = pickle_unpickle_parallel(FILENAME,
+                                   d,
+                                  &pickle_writer_hash,
+                                  &parallel_cheese_methods,
+                                   nthreads,
+                                   NULL);
+    if (err)
+      goto Failure;
+
+    if (hash_count(d) != NELEMS(cheeses))
+    {
+      printf("test: expected %d entries, got %d\n",
+             NELEMS(cheeses), hash_count(d));
+      hash_destroy(d);
+      return result_TEST_FAILED;
+    }
+
+    printf("test: iterate\n");
+
+    hash_walk(d, my_walk_fn, NULL);
+
+    printf("test: destroy hash\n");
+
+    hash_destroy(d);
+  }
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* values far longer than any fixed record buffer */
+static const size_t long_lengths[] = { 1, 2, 255, 256, 769, 5000, 70000 };
+
+static result_t long_values_create(hash_t **pd)
+{
+  result_t err;
+  hash_t  *d;
+  int      i;
+
+  err = hash_create(NULL, 20, NULL, NULL, NULL, NULL, &d);
+  if (err)
+    return err;
+
+  for (i = 0; i < NELEMS(long_lengths); i++)
+  {
+    char  *k;
+    char  *v;
+    size_t j;
+
+    k = malloc(16);
+    v = malloc(long_lengths[i] + 1);
+    if (!k || !v)
+    {
+      free(k);
+      free(v);
+      err = result_OOM;
+      goto Failure;
+    }
+
+    sprintf(k, "long%d", i);
+    for (j = 0; j < long_lengths[i]; j++)
+      v[j] = 'a' + (char) (j % 26);
+    v[j] = '\0';
+
+    err = hash_insert(d, k, v);
+    if (err)
+    {
+      free(k);
+      free(v);
+      goto Failure;
+    }
+  }
+
+  *pd = d;
+
+  return result_OK;
+
+
+Failure:
+
+  hash_destroy(d);
+
+  return err;
+}
+
+/* returns non-zero if 'e' doesn't hold exactly the long values */
+static int long_values_differ(hash_t *d, hash_t *e)
+{
+  int i;
+
+  if (hash_count(e) != NELEMS(long_lengths))
+    return 1;
+
+  for (i = 0; i < NELEMS(long_lengths); i++)
+  {
+    char        key[16];
+    const char *want;
+    const char *got;
+
+    sprintf(key, "long%d", i);
+    want = hash_lookup(d, key);
+    got  = hash_lookup(e, key);
+    if (got == NULL || strcmp(want, got) != 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static result_t pickle__test3_long(void)
+{
+  static const char header[] = "# test comment\n" PICKLE_SIGNATURE "\n";
+
+  result_t             err;
+  hash_t              *d = NULL;
+  sink_t              *sink = NULL;
+  int                  i;
+  size_t               expected;
+  const unsigned char *out;
+  size_t               outlen;
+  const char          *p;
+  const char          *end;
+  int                  pass;
+
+  printf("test: long values\n");
+
+  err = long_values_create(&d);
+  if (err)
+    goto Failure;
+
+  expected = NELEMS(header) - 1;
+  for (i = 0; i < NELEMS(long_lengths); i++)
+    expected += strlen("longN") + 2 + long_lengths[i] + 1;
+
+  /* start with a tiny buffer so that every record has to grow it */
+  err = sink_mem_create(16, &sink);
+  if (err)
+    goto Failure;
+
+  err = pickle_pickle_sink(sink, d, &pickle_reader_hash, &formatters, NULL);
+  if (err)
+    goto Failure;
+
+  out = sink_mem_get(sink, &outlen);
+
+  printf("test: pickled %lu bytes\n", (unsigned long) outlen);
+
+  if (outlen != expected ||
+      memcmp(out, header, NELEMS(header) - 1) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  /* every record must match its source exactly */
+
+  p   = (const char *) out + NELEMS(header) - 1;
+  end = (const char *) out + outlen;
+  for (i = 0; p < end; i++)
+  {
+    const char *nl;
+    const char *sep;
+    char        key[16];
+    const char *value;
+
+    nl  = memchr(p, '\n', end - p);
+    sep = memchr(p, ':', nl ? nl - p : 0);
+    if (nl == NULL || sep == NULL || sep - p >= (long) sizeof(key))
+    {
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    memcpy(key, p, sep - p);
+    key[sep - p] = '\0';
+
+    value = hash_lookup(d, key);
+    if (value == NULL ||
+        strlen(value) != (size_t) (nl - sep - 2) ||
+        memcmp(value, sep + 2, nl - sep - 2) != 0)
+    {
+      printf("test: record '%s' mismatch\n", key);
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    p = nl + 1;
+  }
+
+  if (i != NELEMS(long_lengths))
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  /* round trip through a file using both unpickling paths */
+
+  err = pickle_pickle("testpickle3", d, &pickle_reader_hash, &formatters, NULL);
+  if (err)
+    goto Failure;
+
+  for (pass = 0; pass < 2; pass++)
+  {
+    hash_t *e;
+    int     different;
+
+    printf("test: unpickle long values %s\n", pass ? "mapped" : "buffered");
+
+    err = hash_create(NULL, 20, NULL, NULL, NULL, NULL, &e);
+    if (err)
+      goto Failure;
+
+    if (pass == 0)
+      err = pickle_unpickle("testpickle3", e,
+                            &pickle_writer_hash, &unformatters, NULL);
+    else
+      err = pickle_unpickle_mapped("testpickle3", e,
+                                   &pickle_writer_hash, &unformatters, NULL);
+
+    different = long_values_differ(d, e);
+
+    hash_destroy(e);
+
+    if (err)
+      goto Failure;
+
+    if (different)
+    {
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+  }
+
+  pickle_delete("testpickle3");
+
+  sink_destroy(sink);
+  hash_destroy(d);
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  sink_destroy(sink);
+  if (d)
+    hash_destroy(d);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t pickle__test4_binary(void)
+{
+  result_t err;
+  hash_t  *d = NULL;
+  hash_t  *e = NULL;
+  int      pass;
+  FILE    *f;
+  long     length;
+
+  printf("test: binary\n");
+
+  err = long_values_create(&d);
+  if (err)
+    goto Failure;
+
+  err = pickle_pickle_binary("testpickle4", d, &pickle_reader_hash, &formatters, NULL);
+  if (err)
+    goto Failure;
+
+  for (pass = 0; pass < 2; pass++)
+  {
+    printf("test: unpickle binary %s\n", pass ? "via mapped" : "directly");
+
+    err = hash_create(NULL, 20, NULL, NULL, NULL, NULL, &e);
+    if (err)
+      goto Failure;
+
+    if (pass == 0)
+      err = pickle_unpickle_binary("testpickle4", e,
+                                   &pickle_writer_hash, &unformatters, NULL);
+    else
+      err = pickle_unpickle_mapped("testpickle4", e,
+                                   &pickle_writer_hash, &unformatters, NULL);
+    if (err)
+      goto Failure;
+
+    if (long_values_differ(d, e))
+    {
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    hash_destroy(e);
+    e = NULL;
+  }
+
+  /* the text variant isn't binary */
+
+  err = hash_create(NULL, 20, NULL, NULL, NULL, NULL, &e);
+  if (err)
+    goto Failure;
+
+  err = pickle_pickle("testpickle4t", d, &pickle_reader_hash, &formatters, NULL);
+  if (err)
+    goto Failure;
+
+  err = pickle_unpickle_binary("testpickle4t", e,
+                               &pickle_writer_hash, &unformatters, NULL);
+  pickle_delete("testpickle4t");
+  if (err != result_PICKLE_INCOMPATIBLE)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  /* damage a byte in the middle: nothing should be inserted */
+
+  printf("test: unpickle damaged binary\n");
+
+  f = fopen("testpickle4", "r+b");
+  if (f == NULL ||
+      fseek(f, 0, SEEK_END) != 0 ||
+      (length = ftell(f)) < 0 ||
+      fseek(f, length / 2, SEEK_SET) != 0 ||
+      fputc('!', f) == EOF)
+  {
+    if (f)
+      fclose(f);
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  fclose(f);
+
+  err = pickle_unpickle_binary("testpickle4", e,
+                               &pickle_writer_hash, &unformatters, NULL);
+  if (err != result_PICKLE_BAD_CHECKSUM || hash_count(e) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  pickle_delete("testpickle4");
+
+  hash_destroy(e);
+  hash_destroy(d);
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  pickle_delete("testpickle4");
+
+  if (e)
+    hash_destroy(e);
+  if (d)
+    hash_destroy(d);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t pickle__test5_filtered(void)
+{
+  static const struct
+  {
+    pickle_codec_t codecs[2];
+    int            ncodecs;
+    unsigned int   flags;
+  }
+  chains[] =
+  {
+    { { pickle_CODEC_PACKBITS },                   1, 0                  },
+    { { pickle_CODEC_MTF },                        1, pickle_FLAG_BINARY },
+    { { pickle_CODEC_MTF, pickle_CODEC_PACKBITS }, 2, 0                  },
+    { { pickle_CODEC_PACKBITS },                   0, pickle_FLAG_BINARY },
+  };
+
+  result_t err;
+  hash_t  *d = NULL;
+  hash_t  *e = NULL;
+  int      i;
+  int      pass;
+
+  printf("test: filtered\n");
+
+  err = long_values_create(&d);
+  if (err)
+    goto Failure;
+
+  for (i = 0; i < NELEMS(chains); i++)
+  {
+    err = pickle_pickle_filtered("testpickle5",
+                                 d,
+                                 &pickle_reader_hash,
+                                 &formatters,
+                                 chains[i].codecs,
+                                 chains[i].ncodecs,
+                                 chains[i].flags,
+                                 NULL);
+    if (err)
+      goto Failure;
+
+    for (pass = 0; pass < 2; pass++)
+    {
+      printf("test: unpickle chain %d %s\n", i, pass ? "mapped" : "buffered");
+
+      err = hash_create(NULL, 20, NULL, NULL, NULL, NULL, &e);
+      if (err)
+        goto Failure;
+
+      if (pass == 0)
+        err = pickle_unpickle("testpickle5", e,
+                              &pickle_writer_hash, &unformatters, NULL);
+      else
+        err = pickle_unpickle_mapped("testpickle5", e,
+                                     &pickle_writer_hash, &unformatters, NULL);
+      if (err)
+        goto Failure;
+
+      if (long_values_differ(d, e))
+      {
+        err = result_TEST_FAILED;
+        goto Failure;
+      }
+
+      hash_destroy(e);
+      e = NULL;
+    }
+  }
+
+  pickle_delete("testpickle5");
+
+  hash_destroy(d);
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  pickle_delete("testpickle5");
+
+  if (e)
+    hash_destroy(e);
+  if (d)
+    hash_destroy(d);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Every loader must read a final record which lacks its newline. */
+static result_t pickle__test6_unterminated(void)
+{
+  result_t err;
+  hash_t  *d = NULL;
+  FILE    *in;
+  FILE    *out;
+  long     length;
+  long     i;
+  int      loader;
+
+  printf("test: unterminated final line\n");
+
+  /* copy test 2's file less its final newline */
+
+  in  = fopen(FILENAME, "rb");
+  out = fopen("testpickle6", "wb");
+  if (in == NULL || out == NULL ||
+      fseek(in, 0, SEEK_END) != 0 ||
+      (length = ftell(in)) < 1 ||
+      fseek(in, 0, SEEK_SET) != 0)
+  {
+    if (in)
+      fclose(in);
+    if (out)
+      fclose(out);
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  for (i = 0; i < length - 1; i++)
+    fputc(fgetc(in), out);
+
+  fclose(in);
+  fclose(out);
+
+  for (loader = 0; loader < 3; loader++)
+  {
+    err = hash_create(NULL,
+                      0,
+                      NULL,
+                      NULL,
+                      cheese_key_destroy,
+                      cheese_value_destroy,
+                     &d);
+    if (err)
+      goto Failure;
+
+    switch (loader)
+    {
+    case 0:
+      err = pickle_unpickle("testpickle6", d, &pickle_writer_hash,
+                            &unformat_cheese_methods, NULL);
+      break;
+    case 1:
+      err = pickle_unpickle_mapped("testpickle6", d, &pickle_writer_hash,
+                                   &unformat_cheese_methods, NULL);
+      break;
+    default:
+      err = pickle_unpickle_parallel("testpickle6", d, &pickle_writer_hash,
+                                     &parallel_cheese_methods, 2, NULL);
+      break;
+    }
+    if (err)
+      goto Failure;
+
+    if (hash_count(d) != NELEMS(cheeses))
+    {
+      printf("test: loader %d got %d entries\n", loader, hash_count(d));
+      err = result_TEST_FAILED;
+      goto Failure;
+    }
+
+    hash_destroy(d);
+    d = NULL;
+  }
+
+  pickle_delete("testpickle6");
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  printf("\n\n*** Error %x\n", err);
+
+  pickle_delete("testpickle6");
+
+  if (d)
+    hash_destroy(d);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
 result_t pickle_test(const char *resources)
 {
   result_t rc;
@@ -617,5 +1370,33 @@ result_t pickle_test(const char *resources)
   if (rc != result_TEST_PASSED)
     return rc;
 
+  rc = pickle__test2_read_parallel();
+  if (rc != result_TEST_PASSED)
+    return rc;
+
+  printf("test: pickle test 3\n");
+
+  rc = pickle__test3_long();
+  if (rc != result_TEST_PASSED)
+    return rc;
+
+  printf("test: pickle test 4\n");
+
+  rc = pickle__test4_binary();
+  if (rc != result_TEST_PASSED)
+    return rc;
+
+  printf("test: pickle test 5\n");
+
+  rc = pickle__test5_filtered();
+  if (rc != result_TEST_PASSED)
+    return rc;
+
+  printf("test: pickle test 6\n");
+
+  rc = pickle__test6_unterminated();
+  if (rc != result_TEST_PASSED)
+    return rc;
+
   return result_TEST_PASSED;
 }
@@ -0,0 +1,140 @@
+/* unpickle-mapped.c -- deserialise an associative array from a mapped file */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+
+#include "databases/pickle.h"
+
+#include "impl.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* Parse every body line in [p,end), handing (pointer, length) slices of the
+ * file straight to the unformat methods. */
+static result_t unpickle__parse_lines(const char                      *p,
+                                      const char                      *end,
+                                      const pickle_writer_methods_t   *writer,
+                                      const pickle_unformat_methods_t *unformat,
+                                      void                            *wstate,
+                                      void                            *opaque)
+{
+  result_t    err;
+  const char *nl;
+
+  for (; p < end; p = nl + 1)
+  {
+    const char *keyend;
+    const char *value;
+    void       *fmtkey;
+    void       *fmtvalue;
+
+    nl = memchr(p, '\n', end - p);
+    if (nl == NULL)
+      nl = end; /* final line lacks a newline */
+
+    if (*p == '#') /* skip comments */
+      continue;
+
+    keyend = pickle__find_split(p, nl, unformat->split, unformat->splitlen);
+    if (keyend == NULL)
+      return result_PICKLE_SYNTAX_ERROR;
+
+    value = keyend + unformat->splitlen;
+    if (value == nl)
+      return result_PICKLE_SYNTAX_ERROR; /* no value */
+
+    err = unformat->key(p, keyend - p, &fmtkey, opaque);
+    if (err)
+      return err;
+
+    err = unformat->value(value, nl - value, &fmtvalue, opaque);
+    if (err)
+      return err; // no result_t cleanup
+
+    err = writer->next(wstate, fmtkey, fmtvalue, opaque);
+    if (err)
+      return err; // no result_t cleanup
+  }
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t pickle__unpickle_block(const char                      *buf,
+                                size_t                           length,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque)
+{
+  result_t    err;
+  const char *body;
+  const char *end;
+  void       *wstate = NULL;
+
+  if (pickle__is_binary(buf, length))
+    return pickle__unpickle_binary(buf, length,
+                                   assocarr, writer, unformat, opaque);
+
+  if (pickle__is_filtered(buf, length))
+    return pickle__unpickle_filtered(buf, length,
+                                     assocarr, writer, unformat, opaque);
+
+  end = buf + length;
+
+  body = pickle__skip_header(buf, end);
+  if (body == NULL)
+    return result_PICKLE_INCOMPATIBLE;
+
+  if (writer->start)
+  {
+    err = writer->start(assocarr, &wstate, opaque);
+    if (err)
+      return err;
+  }
+
+  err = unpickle__parse_lines(body, end, writer, unformat, wstate, opaque);
+
+  if (writer->stop)
+    writer->stop(wstate, opaque);
+
+  return err;
+}
+
+result_t pickle_unpickle_mapped(const char                      *filename,
+                                void                            *assocarr,
+                                const pickle_writer_methods_t   *writer,
+                                const pickle_unformat_methods_t *unformat,
+                                void                            *opaque)
+{
+  result_t      err;
+  pickle__map_t map;
+
+  assert(filename);
+  assert(writer);
+  assert(unformat);
+
+  err = pickle__map_file(filename, &map);
+  if (err)
+    return err;
+
+  err = pickle__unpickle_block(map.base,
+                               map.length,
+                               assocarr,
+                               writer,
+                               unformat,
+                               opaque);
+
+  pickle__unmap_file(&map);
+
+  return err;
+}
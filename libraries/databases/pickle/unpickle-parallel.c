@@ -0,0 +1,324 @@
+/* unpickle-parallel.c -- deserialise an associative array using threads */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+
+#include "databases/pickle.h"
+
+#include "impl.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* Upper limit on the number of worker threads. */
+#define MAXTHREADS 64
+
+/* Minimum number of records to allocate space for per chunk. */
+#define MINRECORDS 64
+
+/* ----------------------------------------------------------------------- */
+
+/* A newline-aligned portion of the file and the records parsed from it. */
+typedef struct unpickle__chunk
+{
+  const char                      *start;
+  const char                      *end;
+
+  const pickle_parallel_methods_t *parallel;
+  void                            *opaque;
+  void                            *state; /* chunk state */
+
+  unsigned char                   *records;
+  size_t                           nrecords;
+  size_t                           allocated;
+
+  result_t                         err;
+}
+unpickle__chunk_t;
+
+/* ----------------------------------------------------------------------- */
+
+/* Return a pointer to space for one more record in the chunk. */
+static void *unpickle__new_record(unpickle__chunk_t *chunk)
+{
+  size_t recordsz = chunk->parallel->recordsz;
+
+  if (chunk->nrecords == chunk->allocated)
+  {
+    size_t         n;
+    unsigned char *records;
+
+    n = chunk->allocated * 2;
+    if (n < MINRECORDS)
+      n = MINRECORDS;
+
+    records = realloc(chunk->records, n * recordsz);
+    if (records == NULL)
+      return NULL;
+
+    chunk->records   = records;
+    chunk->allocated = n;
+  }
+
+  return chunk->records + chunk->nrecords++ * recordsz;
+}
+
+/* Parse every line in a chunk, handing (pointer, length) slices of the file
+ * to the parse method. Runs on a worker thread. */
+static void *unpickle__parse_chunk(void *vchunk)
+{
+  unpickle__chunk_t               *chunk    = vchunk;
+  const pickle_parallel_methods_t *parallel = chunk->parallel;
+  const char                      *line;
+  const char                      *nl;
+
+  for (line = chunk->start; line < chunk->end; line = nl + 1)
+  {
+    const char *keyend;
+    const char *value;
+    void       *record;
+
+    nl = memchr(line, '\n', chunk->end - line);
+    if (nl == NULL)
+      nl = chunk->end; /* final line lacks a newline */
+
+    if (*line == '#') /* skip comments */
+      continue;
+
+    keyend = pickle__find_split(line, nl, parallel->split, parallel->splitlen);
+    if (keyend == NULL)
+    {
+      chunk->err = result_PICKLE_SYNTAX_ERROR;
+      break;
+    }
+
+    value = keyend + parallel->splitlen;
+    if (value == nl)
+    {
+      chunk->err = result_PICKLE_SYNTAX_ERROR; /* no value */
+      break;
+    }
+
+    record = unpickle__new_record(chunk);
+    if (record == NULL)
+    {
+      chunk->err = result_OOM;
+      break;
+    }
+
+    chunk->err = parallel->parse(line, keyend - line,
+                                 value, nl - value,
+                                 chunk->state,
+                                 record,
+                                 chunk->opaque);
+    if (chunk->err)
+      break;
+  }
+
+  return NULL;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static int unpickle__nprocessors(void)
+{
+#if defined(DPTLIB_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+  long n;
+
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n >= 1)
+    return (int) n;
+#endif
+
+  return 1;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t pickle_unpickle_parallel(const char                      *filename,
+                                  void                            *assocarr,
+                                  const pickle_writer_methods_t   *writer,
+                                  const pickle_parallel_methods_t *parallel,
+                                  int                              nthreads,
+                                  void                            *opaque)
+{
+  result_t           err;
+  pickle__map_t      map;
+  const char        *body;
+  const char        *end;
+  unpickle__chunk_t  chunks[MAXTHREADS];
+  int                nchunks = 0;
+  int                i;
+  void              *wstate  = NULL;
+  int                started = 0;
+
+  assert(filename);
+  assert(writer);
+  assert(parallel);
+  assert(parallel->recordsz > 0);
+
+  err = pickle__map_file(filename, &map);
+  if (err)
+    return err;
+
+  end = map.base + map.length;
+
+  body = pickle__skip_header(map.base, end);
+  if (body == NULL)
+  {
+    err = result_PICKLE_INCOMPATIBLE;
+    goto Failure;
+  }
+
+  /* divide the body into newline-aligned chunks, one per thread */
+
+  if (nthreads <= 0)
+    nthreads = unpickle__nprocessors();
+  nthreads = CLAMP(nthreads, 1, MAXTHREADS);
+
+  while (body < end)
+  {
+    unpickle__chunk_t *chunk;
+    const char        *split;
+    const char        *nl;
+
+    chunk = &chunks[nchunks++];
+
+    if (nchunks == nthreads)
+    {
+      split = end; /* last chunk takes the remainder */
+    }
+    else
+    {
+      split = body + (end - body) / (nthreads - nchunks + 1);
+      nl = memchr(split, '\n', end - split);
+      split = nl ? nl + 1 : end;
+    }
+
+    chunk->start     = body;
+    chunk->end       = split;
+    chunk->parallel  = parallel;
+    chunk->opaque    = opaque;
+    chunk->state     = NULL;
+    chunk->records   = NULL;
+    chunk->nrecords  = 0;
+    chunk->allocated = 0;
+    chunk->err       = result_OK;
+
+    body = split;
+
+    if (parallel->start)
+    {
+      err = parallel->start(opaque, &chunk->state);
+      if (err)
+      {
+        nchunks--; /* no state to stop */
+        goto Failure;
+      }
+    }
+  }
+
+  /* parse the chunks */
+
+#ifdef DPTLIB_THREADS
+  {
+    pthread_t threads[MAXTHREADS];
+    int       spawned[MAXTHREADS];
+
+    /* the calling thread takes the first chunk itself */
+    for (i = 1; i < nchunks; i++)
+      spawned[i] = pthread_create(&threads[i],
+                                  NULL,
+                                  unpickle__parse_chunk,
+                                 &chunks[i]) == 0;
+
+    if (nchunks > 0)
+      unpickle__parse_chunk(&chunks[0]);
+
+    for (i = 1; i < nchunks; i++)
+    {
+      if (spawned[i])
+        pthread_join(threads[i], NULL);
+      else
+        unpickle__parse_chunk(&chunks[i]); /* couldn't spawn: do it here */
+    }
+  }
+#else
+  for (i = 0; i < nchunks; i++)
+    unpickle__parse_chunk(&chunks[i]);
+#endif
+
+  for (i = 0; i < nchunks; i++)
+  {
+    if (chunks[i].err)
+    {
+      err = chunks[i].err;
+      goto Failure;
+    }
+  }
+
+  /* merge the records in file order */
+
+  if (writer->start)
+  {
+    err = writer->start(assocarr, &wstate, opaque);
+    if (err)
+      goto Failure;
+  }
+
+  started = 1;
+
+  for (i = 0; i < nchunks; i++)
+  {
+    unsigned char *record;
+    unsigned char *recordend;
+
+    record    = chunks[i].records;
+    recordend = record + chunks[i].nrecords * parallel->recordsz;
+    for (; record < recordend; record += parallel->recordsz)
+    {
+      void *key;
+      void *value;
+
+      err = parallel->merge(chunks[i].state, record, &key, &value, opaque);
+      if (err)
+        goto Failure;
+
+      err = writer->next(wstate, key, value, opaque);
+      if (err)
+        goto Failure;
+    }
+  }
+
+  err = result_OK;
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  if (started && writer->stop)
+    writer->stop(wstate, opaque);
+
+  for (i = 0; i < nchunks; i++)
+  {
+    if (parallel->stop)
+      parallel->stop(chunks[i].state, opaque);
+    free(chunks[i].records);
+  }
+
+  pickle__unmap_file(&map);
+
+  return err;
+}
@@ -16,8 +16,11 @@
 
 #include "databases/pickle.h"
 
+#include "impl.h"
+
 /* ----------------------------------------------------------------------- */
 
+/* Initial buffer size. It's doubled whenever a line won't fit. */
 #define READBUFSZ 1024
 
 /* ----------------------------------------------------------------------- */
@@ -35,7 +38,8 @@ struct unpickle__state
 
   void                            *wstate; // writer state
 
-  char                             buffer[READBUFSZ];
+  char                            *buffer;
+  size_t                           bufsz;
 };
 
 /* ----------------------------------------------------------------------- */
@@ -77,13 +81,13 @@ static result_t unpickle__parse_line(unpickle__state_t *state,
   valueend = value + strlen(value) + 1;
 
 
-  /* return lengths inclusive of terminator */
+  /* return lengths exclusive of terminator */
 
-  err = state->unformat->key(key, keyend - key, &fmtkey, opaque);
+  err = state->unformat->key(key, keyend - 1 - key, &fmtkey, opaque);
   if (err)
     return err;
 
-  err = state->unformat->value(value, valueend - value, &fmtvalue, opaque);
+  err = state->unformat->value(value, valueend - 1 - value, &fmtvalue, opaque);
   if (err)
     return err; // no result_t cleanup
 
@@ -122,8 +126,6 @@ result_t pickle_unpickle(const char                      *filename,
                          const pickle_unformat_methods_t *unformat,
                          void                            *opaque)
 {
-  const size_t       bufsz = READBUFSZ;
-
   result_t           err;
   FILE              *f = NULL;
   unpickle__state_t *state;
@@ -135,6 +137,25 @@ result_t pickle_unpickle(const char                      *filename,
   if (f == NULL)
     return result_PICKLE_COULDNT_OPEN_FILE;
 
+  /* hand binary and filtered variants over to the in-memory loader */
+  {
+    char   magic[4];
+    size_t n;
+
+    n = fread(magic, 1, sizeof(magic), f);
+    if (pickle__is_binary(magic, n) || pickle__is_filtered(magic, n))
+    {
+      fclose(f);
+      return pickle_unpickle_mapped(filename,
+                                    assocarr,
+                                    writer,
+                                    unformat,
+                                    opaque);
+    }
+
+    rewind(f);
+  }
+
   state = malloc(sizeof(*state));
   if (state == NULL)
   {
@@ -142,6 +163,14 @@ result_t pickle_unpickle(const char                      *filename,
     goto EarlyFailure;
   }
 
+  state->bufsz  = READBUFSZ;
+  state->buffer = malloc(state->bufsz);
+  if (state->buffer == NULL)
+  {
+    err = result_OOM;
+    goto EarlyFailure;
+  }
+
   state->parse = unpickle__parse_first_line;
 
   if (writer->start)
@@ -164,9 +193,41 @@ result_t pickle_unpickle(const char                      *filename,
 
     /* try to fill buffer */
 
-    read = fread(state->buffer + occupied, 1, bufsz - occupied, f);
+    read = fread(state->buffer + occupied, 1, state->bufsz - occupied, f);
     if (read == 0 && feof(f))
-      break; /* nothing left */
+    {
+      /* nothing left. a final line lacking its newline is still parsed, as
+       * the mapped loader does. */
+
+      if (occupied > used)
+      {
+        if (occupied == state->bufsz)
+        {
+          char *buffer;
+
+          buffer = realloc(state->buffer, state->bufsz + 1);
+          if (buffer == NULL)
+          {
+            err = result_OOM;
+            goto Failure;
+          }
+
+          state->buffer = buffer;
+          state->bufsz += 1;
+        }
+
+        state->buffer[occupied] = '\0'; /* terminate */
+
+        if (state->buffer[used] != '#') /* skip comments */
+        {
+          err = state->parse(state, state->buffer + used, opaque);
+          if (err)
+            goto Failure;
+        }
+      }
+
+      break;
+    }
 
     occupied += read;
 
@@ -179,10 +240,25 @@ result_t pickle_unpickle(const char                      *filename,
       {
         if (used == 0)
         {
-          /* couldn't find a \n in the whole buffer - and used is 0, so we
-           * have the whole buffer in which to look */
-          err = result_PICKLE_SYNTAX_ERROR;
-          goto Failure;
+          char *buffer;
+
+          /* couldn't find a \n in the whole buffer - and used is 0, so the
+           * line is longer than the buffer. enlarge it. */
+
+          if (occupied < state->bufsz)
+            break; /* not full yet: need more bytes */
+
+          buffer = realloc(state->buffer, state->bufsz * 2);
+          if (buffer == NULL)
+          {
+            err = result_OOM;
+            goto Failure;
+          }
+
+          state->buffer = buffer;
+          state->bufsz *= 2;
+
+          break; /* need more bytes */
         }
         else
         {
@@ -224,6 +300,8 @@ EarlyFailure:
 
   fclose(f);
 
+  if (state)
+    free(state->buffer);
   free(state);
 
   return err;
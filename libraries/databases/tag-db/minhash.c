@@ -0,0 +1,422 @@
+/* minhash.c -- MinHash signature index */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "databases/digest-db.h"
+#include "datastruct/bitvec.h"
+
+#include "minhash.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* Signatures are NBANDS bands of NROWS values. Two ids become candidates
+ * when all rows of any band agree. The chance of that happening for ids
+ * with Jaccard similarity s is 1 - (1 - s^NROWS)^NBANDS, which passes 50%
+ * at around s = 0.46. */
+#define NBANDS  10
+#define NROWS   3
+#define NHASHES (NBANDS * NROWS)
+
+/* Entries are chained once per band and once more by id. */
+#define IDCHAIN NBANDS
+#define NCHAINS (NBANDS + 1)
+
+/* Initial number of buckets per chain. Must be a power of two. */
+#define MINBUCKETS 64
+
+/* ----------------------------------------------------------------------- */
+
+typedef struct minhash_entry
+{
+  struct minhash_entry *next[NCHAINS];
+  unsigned int          mark; /* last query which visited this entry */
+  uint32_t              sig[NHASHES];
+  unsigned char         id[digestdb_DIGESTSZ];
+}
+minhash_entry_t;
+
+struct minhash
+{
+  minhash_entry_t **buckets; /* NCHAINS tables of 'nbuckets' heads */
+  unsigned int      nbuckets;
+  unsigned int      count;
+  unsigned int      mark;
+  uint32_t          seeds[NHASHES];
+};
+
+/* ----------------------------------------------------------------------- */
+
+/* MurmurHash3's finaliser. */
+static uint32_t minhash__mix(uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85EBCA6BU;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35U;
+  h ^= h >> 16;
+  return h;
+}
+
+static uint32_t minhash__band_hash(const uint32_t *sig, int band)
+{
+  uint32_t h;
+  int      r;
+
+  h = band;
+  for (r = 0; r < NROWS; r++)
+    h = minhash__mix(h ^ sig[band * NROWS + r]);
+
+  return h;
+}
+
+static minhash_entry_t **minhash__bucket(minhash_t *mh,
+                                         int        chain,
+                                         uint32_t   h)
+{
+  return &mh->buckets[chain * mh->nbuckets + (h & (mh->nbuckets - 1))];
+}
+
+static minhash_entry_t **minhash__id_bucket(minhash_t           *mh,
+                                            const unsigned char *id)
+{
+  return minhash__bucket(mh, IDCHAIN, digestdb_hash(id));
+}
+
+/* ----------------------------------------------------------------------- */
+
+static void minhash__link_bands(minhash_t *mh, minhash_entry_t *e)
+{
+  int band;
+
+  for (band = 0; band < NBANDS; band++)
+  {
+    minhash_entry_t **head;
+
+    head = minhash__bucket(mh, band, minhash__band_hash(e->sig, band));
+    e->next[band] = *head;
+    *head = e;
+  }
+}
+
+static void minhash__unlink(minhash_entry_t **head,
+                            minhash_entry_t  *e,
+                            int               chain)
+{
+  while (*head != e)
+    head = &(*head)->next[chain];
+
+  *head = e->next[chain];
+}
+
+static void minhash__unlink_bands(minhash_t *mh, minhash_entry_t *e)
+{
+  int band;
+
+  for (band = 0; band < NBANDS; band++)
+    minhash__unlink(minhash__bucket(mh, band, minhash__band_hash(e->sig, band)),
+                    e,
+                    band);
+}
+
+static void minhash__link(minhash_t *mh, minhash_entry_t *e)
+{
+  minhash_entry_t **head;
+
+  minhash__link_bands(mh, e);
+
+  head = minhash__id_bucket(mh, e->id);
+  e->next[IDCHAIN] = *head;
+  *head = e;
+}
+
+/* Double the number of buckets and relink every entry. */
+static result_t minhash__grow(minhash_t *mh)
+{
+  minhash_entry_t **old;
+  unsigned int      oldn;
+  unsigned int      i;
+
+  old  = mh->buckets;
+  oldn = mh->nbuckets;
+
+  mh->buckets = calloc((size_t) oldn * 2 * NCHAINS, sizeof(*mh->buckets));
+  if (mh->buckets == NULL)
+  {
+    mh->buckets = old;
+    return result_OOM;
+  }
+
+  mh->nbuckets = oldn * 2;
+
+  for (i = 0; i < oldn; i++)
+  {
+    minhash_entry_t *e;
+    minhash_entry_t *next;
+
+    for (e = old[IDCHAIN * oldn + i]; e; e = next)
+    {
+      next = e->next[IDCHAIN];
+      minhash__link(mh, e);
+    }
+  }
+
+  free(old);
+
+  return result_OK;
+}
+
+static minhash_entry_t *minhash__find(minhash_t *mh, const unsigned char *id)
+{
+  minhash_entry_t *e;
+
+  for (e = *minhash__id_bucket(mh, id); e; e = e->next[IDCHAIN])
+    if (memcmp(e->id, id, digestdb_DIGESTSZ) == 0)
+      break;
+
+  return e;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t minhash_create(minhash_t **pmh)
+{
+  minhash_t *mh;
+  int        i;
+
+  assert(pmh);
+
+  mh = malloc(sizeof(*mh));
+  if (mh == NULL)
+    return result_OOM;
+
+  mh->buckets = calloc(MINBUCKETS * NCHAINS, sizeof(*mh->buckets));
+  if (mh->buckets == NULL)
+  {
+    free(mh);
+    return result_OOM;
+  }
+
+  mh->nbuckets = MINBUCKETS;
+  mh->count    = 0;
+  mh->mark     = 0;
+
+  /* one hash function per signature row, each seeded differently */
+  for (i = 0; i < NHASHES; i++)
+    mh->seeds[i] = minhash__mix(0x9E3779B9U * (i + 1));
+
+  *pmh = mh;
+
+  return result_OK;
+}
+
+void minhash_destroy(minhash_t *mh)
+{
+  unsigned int i;
+
+  if (mh == NULL)
+    return;
+
+  for (i = 0; i < mh->nbuckets; i++)
+  {
+    minhash_entry_t *e;
+    minhash_entry_t *next;
+
+    for (e = mh->buckets[IDCHAIN * mh->nbuckets + i]; e; e = next)
+    {
+      next = e->next[IDCHAIN];
+      free(e);
+    }
+  }
+
+  free(mh->buckets);
+  free(mh);
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t minhash_update(minhash_t           *mh,
+                        const unsigned char *id,
+                        const bitvec_t      *tags)
+{
+  uint32_t         sig[NHASHES];
+  int              tag;
+  int              i;
+  minhash_entry_t *e;
+
+  assert(mh);
+  assert(id);
+  assert(tags);
+
+  /* each signature row is the minimum hash of any tag in the set */
+
+  for (i = 0; i < NHASHES; i++)
+    sig[i] = UINT32_MAX;
+
+  tag = bitvec_next(tags, -1);
+  if (tag < 0)
+  {
+    minhash_remove(mh, id); /* no tags: nothing to compare */
+    return result_OK;
+  }
+
+  for (; tag >= 0; tag = bitvec_next(tags, tag))
+  {
+    for (i = 0; i < NHASHES; i++)
+    {
+      uint32_t h;
+
+      h = minhash__mix((uint32_t) tag ^ mh->seeds[i]);
+      if (h < sig[i])
+        sig[i] = h;
+    }
+  }
+
+  e = minhash__find(mh, id);
+  if (e)
+  {
+    if (memcmp(e->sig, sig, sizeof(sig)) == 0)
+      return result_OK; /* unchanged */
+
+    minhash__unlink_bands(mh, e);
+    memcpy(e->sig, sig, sizeof(sig));
+    minhash__link_bands(mh, e);
+
+    return result_OK;
+  }
+
+  if (mh->count >= mh->nbuckets)
+    (void) minhash__grow(mh); /* on failure the chains just get longer */
+
+  e = malloc(sizeof(*e));
+  if (e == NULL)
+    return result_OOM;
+
+  e->mark = mh->mark;
+  memcpy(e->sig, sig, sizeof(sig));
+  memcpy(e->id, id, digestdb_DIGESTSZ);
+
+  minhash__link(mh, e);
+
+  mh->count++;
+
+  return result_OK;
+}
+
+void minhash_remove(minhash_t *mh, const unsigned char *id)
+{
+  minhash_entry_t *e;
+
+  assert(mh);
+  assert(id);
+
+  e = minhash__find(mh, id);
+  if (e == NULL)
+    return;
+
+  minhash__unlink_bands(mh, e);
+  minhash__unlink(minhash__id_bucket(mh, id), e, IDCHAIN);
+
+  free(e);
+
+  mh->count--;
+}
+
+/* ----------------------------------------------------------------------- */
+
+int minhash_query(minhash_t            *mh,
+                  const unsigned char  *id,
+                  int                   k,
+                  const unsigned char **ids,
+                  float                *scores)
+{
+  minhash_entry_t *e;
+  int              n;
+  int              band;
+
+  assert(mh);
+  assert(id);
+  assert(k >= 0);
+  assert(ids);
+  assert(scores);
+
+  e = minhash__find(mh, id);
+  if (e == NULL || k == 0)
+    return 0;
+
+  /* marks let us skip candidates met in earlier bands. on wraparound clear
+   * them all so that stale marks can't match. */
+  if (++mh->mark == 0)
+  {
+    unsigned int i;
+
+    for (i = 0; i < mh->nbuckets; i++)
+    {
+      minhash_entry_t *f;
+
+      for (f = mh->buckets[IDCHAIN * mh->nbuckets + i]; f; f = f->next[IDCHAIN])
+        f->mark = 0;
+    }
+
+    mh->mark = 1;
+  }
+
+  e->mark = mh->mark; /* exclude the query itself */
+
+  n = 0;
+
+  for (band = 0; band < NBANDS; band++)
+  {
+    const uint32_t  *rows = &e->sig[band * NROWS];
+    minhash_entry_t *c;
+
+    for (c = *minhash__bucket(mh, band, minhash__band_hash(e->sig, band));
+         c;
+         c = c->next[band])
+    {
+      int   same;
+      int   i;
+      float score;
+      int   j;
+
+      if (c->mark == mh->mark)
+        continue; /* seen already */
+
+      if (memcmp(&c->sig[band * NROWS], rows, NROWS * sizeof(*rows)) != 0)
+        continue; /* bucket collision */
+
+      c->mark = mh->mark;
+
+      /* the fraction of agreeing rows estimates the Jaccard similarity */
+      same = 0;
+      for (i = 0; i < NHASHES; i++)
+        same += (c->sig[i] == e->sig[i]);
+
+      score = (float) same / NHASHES;
+
+      /* insertion into the top 'k' */
+
+      if (n == k && score <= scores[n - 1])
+        continue;
+
+      j = (n < k) ? n++ : n - 1;
+      for (; j > 0 && scores[j - 1] < score; j--)
+      {
+        ids[j]    = ids[j - 1];
+        scores[j] = scores[j - 1];
+      }
+
+      ids[j]    = c->id;
+      scores[j] = score;
+    }
+  }
+
+  return n;
+}
@@ -0,0 +1,40 @@
+/* minhash.h -- MinHash signature index (private to tag-db) */
+
+/* Each indexed id holds a MinHash signature derived from its set of tags.
+ * Signatures are divided into bands and every band is hashed into a bucket
+ * (locality-sensitive hashing) so that ids with alike tag sets can be found
+ * by inspecting only the ids which share a bucket with the query. */
+
+#ifndef TAGDB_MINHASH_H
+#define TAGDB_MINHASH_H
+
+#include "base/result.h"
+#include "datastruct/bitvec.h"
+
+#define T minhash_t
+
+typedef struct minhash T;
+
+result_t minhash_create(T **mh);
+void minhash_destroy(T *mh);
+
+/* (re)compute the signature for 'id' from 'tags'. an id with no tags is
+ * dropped from the index. */
+result_t minhash_update(T *mh, const unsigned char *id, const bitvec_t *tags);
+
+/* drop 'id' from the index, if present */
+void minhash_remove(T *mh, const unsigned char *id);
+
+/* find up to 'k' ids estimated to be most similar to 'id', most similar
+ * first. 'ids' receives pointers into the index which remain valid until
+ * it is next changed; 'scores' receives the estimated Jaccard similarity.
+ * returns the number found. */
+int minhash_query(T                    *mh,
+                  const unsigned char  *id,
+                  int                   k,
+                  const unsigned char **ids,
+                  float                *scores);
+
+#undef T
+
+#endif /* TAGDB_MINHASH_H */
@@ -7,6 +7,7 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +24,7 @@
 #include "databases/pickle-reader-hash.h"
 #include "databases/pickle-writer-hash.h"
 #include "databases/pickle.h"
+#include "utils/arena.h"
 #include "utils/array.h"
 #include "datastruct/atom.h"
 #include "datastruct/bitvec.h"
@@ -30,6 +32,8 @@
 
 #include "databases/tag-db.h"
 
+#include "minhash.h"
+
 /* ----------------------------------------------------------------------- */
 
 /* Hash bins. */
@@ -38,9 +42,6 @@
 /* Long enough to hold any identifier. */
 #define MAXIDLEN 16
 
-/* Maximum number of tokens we expect on a single line. */
-#define MAXTOKENS 64
-
 /* Size of pools used for atom storage. */
 #define ATOMBUFSZ 1536
 
@@ -94,9 +95,18 @@ struct tagdb
   unsigned int            c_used;
   unsigned int            c_allocated;
 
+  tagdb_tag_t            *byname; /* live tags sorted by name */
+  unsigned int            n_byname; /* (allocated alongside counts) */
+
   hash_t                 *hash; /* maps ids to bitvecs holding tag indices */
+
+  minhash_t              *similar; /* optional similarity index, or NULL */
 };
 
+static result_t tagdb__add(tagdb_t             *db,
+                           const unsigned char *name,
+                           size_t               len,
+                           tagdb_tag_t         *ptag);
 static void tagdb__taginc(tagdb_t *db, tagdb_tag_t tag);
 //static void tagdb__tagdec(tagdb_t *db, tagdb_tag tag);
 
@@ -111,10 +121,10 @@ static result_t unformat_key(const char *buf,
   unsigned char hash[digestdb_DIGESTSZ];
   int           kindex;
 
-  NOT_USED(len);
   NOT_USED(opaque);
 
-  // if (len != 32) then complain
+  if (len != digestdb_DIGESTSZ * 2)
+    return result_TAGDB_SYNTAX_ERROR;
 
   /* convert ID from ASCII hex to binary */
   err = digestdb_decode(hash, buf);
@@ -130,75 +140,392 @@ static result_t unformat_key(const char *buf,
   return result_OK;
 }
 
-static result_t unformat_value(const char *inbuf,
+static result_t unformat_value(const char *buf,
                                size_t      len,
                                void      **value,
                                void       *opaque)
 {
   result_t    err;
-  char        buf[1024];
-  char       *p;
-  int         t;
-  const char *tokens[MAXTOKENS];
+  const char *p;
+  const char *end;
   bitvec_t   *v;
-  int         i;
+  int         t;
   tagdb_t    *db = opaque;
 
-  /* copy the buffer so that we can terminate each token as it's found */
-  memcpy(buf, inbuf, len);
+  /* the buffer may be a read-only slice of the file so tokens are taken as
+   * (pointer, length) pairs rather than terminated in place */
 
-  p = buf;
+  v = bitvec_create(1);
+  if (v == NULL)
+    return result_OOM;
+
+  p   = buf;
+  end = buf + len;
 
-  for (t = 0; t < MAXTOKENS;)
+  /* every token is kept, as the parallel loader does */
+  for (t = 0; ; t++)
   {
+    const char *token;
+    tagdb_tag_t tag;
+
     /* skip initial spaces */
-    while (*p == ' ')
+    while (p < end && *p == ' ')
       p++;
 
-    if (*p == '\0')
+    if (p == end)
       break; /* hit end of string */
 
     /* token */
-    tokens[t++] = p;
+    token = p;
 
-    p = strchr(p, ' '); /* split at space */
+    p = memchr(p, ' ', end - p); /* split at space */
     if (p == NULL)
-      break; /* end of string */
+      p = end;
+
+    err = tagdb__add(db, (const unsigned char *) token, p - token, &tag);
+    if (err)
+      goto Failure;
 
-    *p++ = '\0'; /* terminate token */
+    err = bitvec_set(v, tag);
+    if (err)
+      goto Failure;
+
+    tagdb__taginc(db, tag);
   }
 
   if (t < 1)
+  {
+    err = result_TAGDB_SYNTAX_ERROR; /* no tokens found */
+    goto Failure;
+  }
+
+  *value = v;
+
+  return result_OK;
+
+
+Failure:
+
+  bitvec_destroy(v);
+
+  return err;
+}
+
+static const pickle_unformat_methods_t unformat_methods =
+{
+  " ", /* split string */
+  1,   /* split string length */
+  unformat_key,
+  unformat_value
+};
+
+/* ----------------------------------------------------------------------- */
+
+/* Parallel loading.
+ *
+ * Each chunk of the file is parsed on a worker thread. Tag names are
+ * interned into a dictionary local to the chunk, so a record only holds the
+ * chunk-local numbers of its tags. When merging, each chunk's dictionary is
+ * added to the database in order of first appearance, which assigns tag
+ * numbers exactly as a serial load would, then each record's local numbers
+ * are mapped to real tags.
+ */
+
+/* Bins for the chunk-local tag dictionary. */
+#define CHUNKHASHSIZE 1021
+
+typedef struct tagdb_chunk
+{
+  arena_t      *arena;     /* holds the dictionary and tag names */
+  hash_t       *dict;      /* maps tag names to local tag number + 1 */
+  const char  **names;     /* local tag number -> name */
+  char         *scratch;   /* terminated copy of the token being looked up */
+  size_t        scratchsz;
+  int           n_names;
+  int           n_names_allocated;
+
+  int          *tags;      /* local tag numbers of all records */
+  size_t        n_tags;
+  size_t        n_tags_allocated;
+
+  tagdb_tag_t  *map;       /* local tag number -> tag, built on merge */
+}
+tagdb_chunk_t;
+
+typedef struct tagdb_record
+{
+  unsigned char digest[digestdb_DIGESTSZ];
+  size_t        first;     /* index of first local tag number in 'tags' */
+  int           ntags;
+}
+tagdb_record_t;
+
+static result_t chunk_start(void *opaque, void **pstate)
+{
+  result_t       err;
+  tagdb_chunk_t *chunk;
+
+  NOT_USED(opaque);
+
+  chunk = calloc(1, sizeof(*chunk));
+  if (chunk == NULL)
+    return result_OOM;
+
+  err = arena_create(0, &chunk->arena);
+  if (err)
+  {
+    free(chunk);
+    return err;
+  }
+
+  err = hash_create_in_arena(chunk->arena,
+                             NULL,
+                             CHUNKHASHSIZE,
+                             NULL, /* string keys */
+                             NULL,
+                             hash_no_destroy_key,
+                             hash_no_destroy_value,
+                            &chunk->dict);
+  if (err)
+  {
+    arena_destroy(chunk->arena);
+    free(chunk);
+    return err;
+  }
+
+  *pstate = chunk;
+
+  return result_OK;
+}
+
+static void chunk_stop(void *state, void *opaque)
+{
+  tagdb_chunk_t *chunk = state;
+
+  NOT_USED(opaque);
+
+  if (chunk == NULL)
+    return;
+
+  /* the dictionary and the names it holds go with the arena */
+  arena_destroy(chunk->arena);
+  free(chunk->names);
+  free(chunk->scratch);
+  free(chunk->tags);
+  free(chunk->map);
+  free(chunk);
+}
+
+/* Return the chunk-local number for the 'len' byte tag 'token', assigning
+ * one if new. */
+static result_t chunk_intern(tagdb_chunk_t *chunk,
+                             const char    *token,
+                             size_t         len,
+                             int           *plocal)
+{
+  result_t err;
+  int      local;
+
+  /* the token isn't terminated so look it up using a terminated copy */
+
+  if (len + 1 > chunk->scratchsz)
+  {
+    char *scratch;
+
+    scratch = realloc(chunk->scratch, len + 1);
+    if (scratch == NULL)
+      return result_OOM;
+
+    chunk->scratch   = scratch;
+    chunk->scratchsz = len + 1;
+  }
+
+  memcpy(chunk->scratch, token, len);
+  chunk->scratch[len] = '\0';
+
+  local = (int) (intptr_t) hash_lookup(chunk->dict, chunk->scratch) - 1;
+  if (local < 0)
+  {
+    char *name;
+
+    if (array_grow((void **) &chunk->names,
+                   sizeof(*chunk->names),
+                   chunk->n_names,
+                  &chunk->n_names_allocated,
+                   1,
+                   8))
+      return result_OOM;
+
+    name = arena_alloc(chunk->arena, len + 1);
+    if (name == NULL)
+      return result_OOM;
+
+    memcpy(name, chunk->scratch, len + 1);
+
+    local = chunk->n_names;
+
+    err = hash_insert(chunk->dict, name, (void *) (intptr_t) (local + 1));
+    if (err)
+      return err;
+
+    chunk->names[chunk->n_names++] = name;
+  }
+
+  *plocal = local;
+
+  return result_OK;
+}
+
+static result_t parse_record(const char *key,
+                             size_t      keylen,
+                             const char *value,
+                             size_t      valuelen,
+                             void       *state,
+                             void       *vrecord,
+                             void       *opaque)
+{
+  result_t        err;
+  tagdb_chunk_t  *chunk  = state;
+  tagdb_record_t *record = vrecord;
+  const char     *p;
+  const char     *end;
+
+  NOT_USED(opaque);
+
+  if (keylen != digestdb_DIGESTSZ * 2)
+    return result_TAGDB_SYNTAX_ERROR;
+
+  /* convert ID from ASCII hex to binary */
+  err = digestdb_decode(record->digest, key);
+  if (err)
+    return err;
+
+  record->first = chunk->n_tags;
+  record->ntags = 0;
+
+  /* split the value at spaces */
+
+  p   = value;
+  end = value + valuelen;
+  for (;;)
+  {
+    const char *token;
+    int         local;
+
+    while (p < end && *p == ' ')
+      p++;
+
+    if (p == end)
+      break; /* hit end of string */
+
+    token = p;
+
+    p = memchr(p, ' ', end - p);
+    if (p == NULL)
+      p = end;
+
+    err = chunk_intern(chunk, token, p - token, &local);
+    if (err)
+      return err;
+
+    if (chunk->n_tags == chunk->n_tags_allocated)
+    {
+      size_t n;
+      int   *tags;
+
+      n = chunk->n_tags_allocated * 2;
+      if (n < 64)
+        n = 64;
+
+      tags = realloc(chunk->tags, n * sizeof(*chunk->tags));
+      if (tags == NULL)
+        return result_OOM;
+
+      chunk->tags             = tags;
+      chunk->n_tags_allocated = n;
+    }
+
+    chunk->tags[chunk->n_tags++] = local;
+    record->ntags++;
+  }
+
+  if (record->ntags < 1)
     return result_TAGDB_SYNTAX_ERROR; /* no tokens found */
 
+  return result_OK;
+}
+
+static result_t merge_record(void  *state,
+                             void  *vrecord,
+                             void **key,
+                             void **value,
+                             void  *opaque)
+{
+  result_t        err;
+  tagdb_chunk_t  *chunk  = state;
+  tagdb_record_t *record = vrecord;
+  tagdb_t        *db     = opaque;
+  int             kindex;
+  bitvec_t       *v;
+  int             i;
+
+  if (chunk->map == NULL)
+  {
+    /* first record from this chunk: add its tags to the database */
+
+    chunk->map = malloc((chunk->n_names + 1) * sizeof(*chunk->map));
+    if (chunk->map == NULL)
+      return result_OOM;
+
+    for (i = 0; i < chunk->n_names; i++)
+    {
+      err = tagdb_add(db,
+                      (const unsigned char *) chunk->names[i],
+                     &chunk->map[i]);
+      if (err)
+        return err;
+    }
+  }
+
+  err = digestdb_add(record->digest, &kindex);
+  if (err)
+    return err;
+
   v = bitvec_create(1);
   if (v == NULL)
     return result_OOM;
 
-  for (i = 0; i < t; i++)
+  for (i = 0; i < record->ntags; i++)
   {
     tagdb_tag_t tag;
 
-    err = tagdb_add(db, (const unsigned char *) tokens[i], &tag);
+    tag = chunk->map[chunk->tags[record->first + i]];
+
+    err = bitvec_set(v, tag);
     if (err)
+    {
+      bitvec_destroy(v);
       return err;
-
-    bitvec_set(v, tag);
+    }
 
     tagdb__taginc(db, tag);
   }
 
+  *key   = (void *) digestdb_get(kindex); /* must cast away const */
   *value = v;
 
   return result_OK;
 }
 
-static const pickle_unformat_methods_t unformat_methods =
+static const pickle_parallel_methods_t parallel_methods =
 {
   " ", /* split string */
   1,   /* split string length */
-  unformat_key,
-  unformat_value
+  sizeof(tagdb_record_t),
+  chunk_start,
+  chunk_stop,
+  parse_record,
+  merge_record
 };
 
 /* ----------------------------------------------------------------------- */
@@ -208,7 +535,9 @@ static void destroy_hash_value(void *value)
   bitvec_destroy(value);
 }
 
-result_t tagdb_open(const char *filename, tagdb_t **pdb)
+static result_t tagdb__open(const char *filename,
+                            int         nthreads,
+                            tagdb_t   **pdb)
 {
   result_t       err;
   char       *filenamecopy = NULL;
@@ -255,14 +584,25 @@ result_t tagdb_open(const char *filename, tagdb_t **pdb)
   db->counts      = NULL;
   db->c_used      = 0;
   db->c_allocated = 0;
+  db->byname      = NULL;
+  db->n_byname    = 0;
   db->hash        = hash;
+  db->similar     = NULL;
 
   /* read the database in */
-  err = pickle_unpickle(filename,
-                        db->hash,
-                       &pickle_writer_hash,
-                       &unformat_methods,
-                        db);
+  if (nthreads < 0)
+    err = pickle_unpickle_mapped(filename,
+                                 db->hash,
+                                &pickle_writer_hash,
+                                &unformat_methods,
+                                 db);
+  else
+    err = pickle_unpickle_parallel(filename,
+                                   db->hash,
+                                  &pickle_writer_hash,
+                                  &parallel_methods,
+                                   nthreads,
+                                   db);
   if (err && err != result_PICKLE_COULDNT_OPEN_FILE)
     goto Failure;
 
@@ -273,6 +613,11 @@ result_t tagdb_open(const char *filename, tagdb_t **pdb)
 
 Failure:
 
+  if (db)
+  {
+    free(db->byname);
+    free(db->counts);
+  }
   free(db);
   hash_destroy(hash);
   atom_destroy(tags);
@@ -281,6 +626,21 @@ Failure:
   return err;
 }
 
+result_t tagdb_open(const char *filename, tagdb_t **pdb)
+{
+  return tagdb__open(filename, -1, pdb);
+}
+
+result_t tagdb_open_parallel(const char *filename,
+                             int         nthreads,
+                             tagdb_t   **pdb)
+{
+  if (nthreads < 0)
+    nthreads = 0;
+
+  return tagdb__open(filename, nthreads, pdb);
+}
+
 void tagdb_close(tagdb_t *db)
 {
   if (db == NULL)
@@ -288,7 +648,9 @@ void tagdb_close(tagdb_t *db)
 
   tagdb_commit(db);
 
+  minhash_destroy(db->similar);
   hash_destroy(db->hash);
+  free(db->byname);
   free(db->counts);
   atom_destroy(db->tags);
 
@@ -302,15 +664,17 @@ void tagdb_close(tagdb_t *db)
 static result_t format_key(const void *vkey,
                            char       *buf,
                            size_t      len,
+                           size_t     *used,
                            void       *opaque)
 {
   NOT_USED(opaque);
 
-  if (len < digestdb_DIGESTSZ * 2 + 1)
-    return result_TAGDB_BUFF_OVERFLOW;
+  *used = digestdb_DIGESTSZ * 2;
+
+  if (len < digestdb_DIGESTSZ * 2)
+    return result_PICKLE_BUFFER_FULL;
 
   digestdb_encode(buf, vkey);
-  buf[digestdb_DIGESTSZ * 2] = '\0';
 
   return result_OK;
 }
@@ -318,17 +682,18 @@ static result_t format_key(const void *vkey,
 static result_t format_value(const void *vvalue,
                              char       *buf,
                              size_t      len,
+                             size_t     *used,
                              void       *opaque)
 {
   result_t        err;
   tagdb_t        *db = opaque;
   const bitvec_t *v  = vvalue;
-  int             c;
+  size_t          c;
+  int             full;
   int             index;
 
-  NOT_USED(len);
-
-  c = 0;
+  c    = 0;
+  full = 0;
 
   index = -1;
   for (;;)
@@ -339,28 +704,42 @@ static result_t format_value(const void *vvalue,
     if (index < 0)
       break;
 
+    /* once full carry on measuring so the caller knows how much to
+     * provide next time */
     err = tagdb_tagtoname(db,
                           index,
-                          (unsigned char *) (buf + c),
+                          full ? NULL : (unsigned char *) (buf + c),
                           &length,
-                          len - c);
-    if (err)
-      return -1;
+                          full ? 0 : len - c);
+    if (err == result_TAGDB_BUFF_OVERFLOW)
+      full = 1;
+    else if (err)
+      return err;
 
     // should quote any tags containing spaces (or quotes)
     // better if it prepared a list of quoted tags in advance outside of
     // this loop
 
     c += length - 1; /* account for terminator */
-    buf[c++] = ' ';
+    if (!full)
+      buf[c] = ' '; /* overwrites the terminator */
+    c++;
   }
 
-  if (c > 0)
-    buf[c - 1] = '\0'; /* overwrite final space */
-
   /* If no tokens were encoded then return result_PICKLE_SKIP to avoid writing
    * out this empty entry. */
-  return (c > 0) ? result_OK : result_PICKLE_SKIP;
+  if (c == 0)
+    return result_PICKLE_SKIP;
+
+  if (full)
+  {
+    *used = c;
+    return result_PICKLE_BUFFER_FULL;
+  }
+
+  *used = c - 1; /* drop the final space */
+
+  return result_OK;
 }
 
 static const pickle_format_methods_t format_methods =
@@ -399,36 +778,139 @@ typedef struct tagdb_tag_entry
 }
 tagdb_tag_entry_t;
 
-result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* The name index is an array of live tags kept sorted by name. It lets us
+ * find tags by name, or by name prefix, with a binary search rather than a
+ * scan of every tag. */
+
+static const unsigned char *tagdb__name(tagdb_t *db, tagdb_tag_t tag)
 {
-  result_t    err;
-  atom_t      index;
-  tagdb_tag_t i;
+  return atom_get(db->tags, db->counts[tag].index, NULL);
+}
 
-  assert(db);
-  assert(name);
+/* Compare a stored (terminated) name against the 'len' byte name 'name',
+ * which need not be terminated. */
+static int tagdb__namecmp(const unsigned char *stored,
+                          const unsigned char *name,
+                          size_t               len)
+{
+  int c;
 
-  err = atom_new(db->tags,
-                 name,
-                 strlen((const char *) name) + 1,
-                &index);
-  if (err == result_ATOM_NAME_EXISTS)
+  c = strncmp((const char *) stored, (const char *) name, len);
+  if (c)
+    return c;
+
+  return stored[len] != '\0'; /* stored name is longer */
+}
+
+/* Return the position of the first entry in the name index whose name is
+ * greater than or equal to the 'len' byte name 'name'. */
+static unsigned int tagdb__byname_lower_bound(tagdb_t             *db,
+                                              const unsigned char *name,
+                                              size_t               len)
+{
+  unsigned int lo, hi;
+
+  lo = 0;
+  hi = db->n_byname;
+  while (lo < hi)
   {
-    /* the name exists in the dict. we have to search to find out which
-     * entry we assigned it to. */
+    unsigned int mid;
 
-    for (i = 0; i < db->c_used; i++)
-      if (db->counts[i].index == index)
-        break;
+    mid = lo + (hi - lo) / 2;
+    if (tagdb__namecmp(tagdb__name(db, db->byname[mid]), name, len) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* Return the position of 'tag' in the name index. */
+static unsigned int tagdb__byname_find(tagdb_t *db, tagdb_tag_t tag)
+{
+  const unsigned char *name;
+  unsigned int         i;
 
-    assert(i < db->c_used);
+  name = tagdb__name(db, tag);
+  i = tagdb__byname_lower_bound(db, name, strlen((const char *) name));
+  assert(i < db->n_byname && db->byname[i] == tag);
+
+  return i;
+}
+
+/* Insert 'tag' into the name index. Space is allocated alongside 'counts'
+ * so this cannot fail. */
+static void tagdb__byname_insert(tagdb_t *db, tagdb_tag_t tag)
+{
+  const unsigned char *name;
+  unsigned int         i;
+
+  assert(db->n_byname < db->c_allocated);
+
+  name = tagdb__name(db, tag);
+  i = tagdb__byname_lower_bound(db, name, strlen((const char *) name));
+  memmove(&db->byname[i + 1],
+          &db->byname[i],
+          (db->n_byname - i) * sizeof(*db->byname));
+  db->byname[i] = tag;
+  db->n_byname++;
+}
+
+/* Delete the entry at position 'i' from the name index. */
+static void tagdb__byname_delete(tagdb_t *db, unsigned int i)
+{
+  array_delete_element(db->byname, sizeof(*db->byname), db->n_byname, i);
+  db->n_byname--;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+/* Add the 'len' byte name 'name', which need not be terminated. */
+static result_t tagdb__add(tagdb_t             *db,
+                           const unsigned char *name,
+                           size_t               len,
+                           tagdb_tag_t         *ptag)
+{
+  result_t       err;
+  atom_t         index;
+  tagdb_tag_t    i;
+  unsigned char  stackbuf[64];
+  unsigned char *termname;
 
+  assert(db);
+  assert(name);
+
+  /* if the name exists then the name index will find it without searching
+   * the dictionary */
+
+  i = tagdb__byname_lower_bound(db, name, len);
+  if (i < db->n_byname &&
+      tagdb__namecmp(tagdb__name(db, db->byname[i]), name, len) == 0)
+  {
     if (ptag)
-      *ptag = i;
+      *ptag = db->byname[i];
 
     return result_OK;
   }
-  else if (err)
+
+  /* names are stored terminated, so a new name needs copying */
+
+  termname = (len < sizeof(stackbuf)) ? stackbuf : malloc(len + 1);
+  if (termname == NULL)
+    return result_OOM;
+
+  memcpy(termname, name, len);
+  termname[len] = '\0';
+
+  err = atom_new(db->tags, termname, len + 1, &index);
+
+  if (termname != stackbuf)
+    free(termname);
+
+  if (err)
     return err;
 
   /* use up all the entries until we run out of space. when we run out then
@@ -445,7 +927,13 @@ result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
     {
       /* didn't find any empty entries - have to extend */
 
+      /* the name index is extended in step with the counts array */
+
+      void *newarr;
+
 #ifdef USE_ARRAY_GROW
+      unsigned int old_allocated = db->c_allocated;
+
       if (array_grow((void **) &db->counts,
                      sizeof(*db->counts),
                      db->c_used,
@@ -456,14 +944,32 @@ result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
         err = result_OOM;
         goto Failure;
       }
+
+      newarr = realloc(db->byname, db->c_allocated * sizeof(*db->byname));
+      if (newarr == NULL)
+      {
+        db->c_allocated = old_allocated; /* keep the arrays in step */
+        err = result_OOM;
+        goto Failure;
+      }
+
+      db->byname = newarr;
 #else
       size_t n;
-      void  *newarr;
 
       n = (size_t) power2gt(db->c_allocated);
       if (n < 8)
         n = 8;
 
+      newarr = realloc(db->byname, n * sizeof(*db->byname));
+      if (newarr == NULL)
+      {
+        err = result_OOM;
+        goto Failure;
+      }
+
+      db->byname = newarr;
+
       newarr = realloc(db->counts, n * sizeof(*db->counts));
       if (newarr == NULL)
       {
@@ -492,6 +998,8 @@ result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
   db->counts[i].index = index;
   db->counts[i].count = 0;
 
+  tagdb__byname_insert(db, i);
+
   if (ptag)
     *ptag = i;
 
@@ -500,9 +1008,18 @@ result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
 
 Failure:
 
+  atom_delete(db->tags, index);
+
   return err;
 }
 
+result_t tagdb_add(tagdb_t *db, const unsigned char *name, tagdb_tag_t *ptag)
+{
+  assert(name);
+
+  return tagdb__add(db, name, strlen((const char *) name), ptag);
+}
+
 void tagdb_remove(tagdb_t *db, tagdb_tag_t tag)
 {
   result_t err;
@@ -534,6 +1051,8 @@ void tagdb_remove(tagdb_t *db, tagdb_tag_t tag)
   /* remove from dictionary - do this after the tag is removed from all ids,
    * so that the tag validity tests don't trigger */
 
+  tagdb__byname_delete(db, tagdb__byname_find(db, tag));
+
   atom_delete(db->tags, db->counts[tag].index);
 
   db->counts[tag].index = -1;
@@ -552,14 +1071,27 @@ result_t tagdb_rename(tagdb_t             *db,
                       tagdb_tag_t          tag,
                       const unsigned char *name)
 {
+  result_t     err;
+  unsigned int i;
+
   assert(db);
   assert(tag < db->c_used && db->counts[tag].index != -1);
   assert(name);
 
-  return atom_set(db->tags,
-                  db->counts[tag].index,
-                  (const unsigned char *) name,
-                  strlen((char *) name) + 1);
+  /* find the tag's place in the name index before its old name goes */
+  i = tagdb__byname_find(db, tag);
+
+  err = atom_set(db->tags,
+                 db->counts[tag].index,
+                 (const unsigned char *) name,
+                 strlen((char *) name) + 1);
+  if (err)
+    return err;
+
+  tagdb__byname_delete(db, i);
+  tagdb__byname_insert(db, tag);
+
+  return result_OK;
 }
 
 result_t tagdb_enumerate_tags(tagdb_t     *db,
@@ -600,6 +1132,51 @@ result_t tagdb_enumerate_tags(tagdb_t     *db,
   return result_OK;
 }
 
+result_t tagdb_tags_with_prefix(tagdb_t             *db,
+                                const unsigned char *prefix,
+                                int                 *continuation,
+                                tagdb_tag_t         *tag)
+{
+  unsigned int index;
+  size_t       prefixlen;
+
+  assert(db);
+  assert(prefix);
+  assert(continuation);
+  assert(tag);
+
+  /* The continuation is one more than the position in the name index of
+   * the next candidate. Matching names are contiguous in the index so we
+   * only binary search on the initial call. */
+
+  prefixlen = strlen((const char *) prefix);
+
+  if (*continuation == 0)
+    index = tagdb__byname_lower_bound(db, prefix, prefixlen);
+  else
+    index = *continuation - 1;
+
+  if (index >= db->n_byname ||
+      strncmp((const char *) tagdb__name(db, db->byname[index]),
+              (const char *) prefix,
+              prefixlen) != 0)
+  {
+    /* ran out */
+
+    *tag          = 0;
+    *continuation = 0;
+  }
+  else
+  {
+    /* got one */
+
+    *tag          = db->byname[index];
+    *continuation = index + 2;
+  }
+
+  return result_OK;
+}
+
 result_t tagdb_tagtoname(tagdb_t       *db,
                          tagdb_tag_t    tag,
                          unsigned char *buf,
@@ -642,12 +1219,15 @@ static void tagdb__tagdec(tagdb_t *db, tagdb_tag_t tag)
   db->counts[tag].count--;
 }
 
-/* This tags and inserts. */
+/* This tags and inserts.
+ *
+ * The similarity index is brought up to date before the change is
+ * committed to the counts, and the change is undone if that fails, so an
+ * error always means that nothing changed. */
 result_t tagdb_tagid(tagdb_t *db, const unsigned char *id, tagdb_tag_t tag)
 {
   result_t  err;
   bitvec_t *val;
-  int       inc;
 
   assert(db);
   assert(id);
@@ -655,17 +1235,27 @@ result_t tagdb_tagid(tagdb_t *db, const unsigned char *id, tagdb_tag_t tag)
   if (tag >= db->c_used || db->counts[tag].index == -1)
     return result_TAGDB_UNKNOWN_TAG;
 
-  inc = 1; /* set this if it's a new tagging */
-
   val = (bitvec_t *) hash_lookup(db->hash, id);
   if (val)
   {
     /* update */
 
     if (bitvec_get(val, tag)) /* if already set, don't increment counter */
-      inc = 0;
-    else
-      bitvec_set(val, tag);
+      return result_OK;
+
+    err = bitvec_set(val, tag);
+    if (err)
+      return err;
+
+    if (db->similar)
+    {
+      err = minhash_update(db->similar, id, val);
+      if (err)
+      {
+        bitvec_clear(val, tag);
+        return err;
+      }
+    }
   }
   else
   {
@@ -684,20 +1274,43 @@ result_t tagdb_tagid(tagdb_t *db, const unsigned char *id, tagdb_tag_t tag)
     if (val == NULL)
       return result_OOM;
 
-    bitvec_set(val, tag);
+    err = bitvec_set(val, tag);
+    if (err)
+      goto Failure;
 
-    hash_insert(db->hash, (void *) key, val);
+    if (db->similar)
+    {
+      err = minhash_update(db->similar, key, val);
+      if (err)
+        goto Failure;
+    }
+
+    err = hash_insert(db->hash, (void *) key, val);
+    if (err)
+    {
+      if (db->similar)
+        minhash_remove(db->similar, key);
+      goto Failure;
+    }
   }
 
-  if (inc)
-    tagdb__taginc(db, tag);
+  tagdb__taginc(db, tag);
 
   return result_OK;
+
+
+Failure:
+
+  bitvec_destroy(val);
+
+  return err;
 }
 
 result_t tagdb_untagid(tagdb_t *db, const unsigned char *id, tagdb_tag_t tag)
 {
+  result_t  err;
   bitvec_t *val;
+  int       was;
 
   assert(db);
   assert(id);
@@ -709,8 +1322,21 @@ result_t tagdb_untagid(tagdb_t *db, const unsigned char *id, tagdb_tag_t tag)
   if (!val)
     return result_TAGDB_UNKNOWN_ID;
 
+  was = bitvec_get(val, tag);
+
   bitvec_clear(val, tag);
 
+  if (db->similar)
+  {
+    err = minhash_update(db->similar, id, val);
+    if (err)
+    {
+      if (was)
+        (void) bitvec_set(val, tag); /* was set, so has room */
+      return err;
+    }
+  }
+
   tagdb__tagdec(db, tag);
 
   return result_OK;
@@ -889,11 +1515,7 @@ result_t tagdb_enumerate_ids_by_tag(tagdb_t       *db,
 
 static int getidbytags_cb(const void *key, const void *value, void *opaque)
 {
-  result_t                   err;
   struct enumerate_state *state = opaque;
-  const bitvec_t         *v;
-  bitvec_t               *have;
-  int                     eq;
 
   /* work out where we are by counting callbacks (ugh) */
   if (state->count++ < state->start)
@@ -901,20 +1523,7 @@ static int getidbytags_cb(const void *key, const void *value, void *opaque)
 
   /* if ((want & value) == want) then return it; */
 
-  v = value;
-
-  err = bitvec_and(state->want, v, &have);
-  if (err)
-  {
-    state->err = err;
-    return -1; /* stop the walk now */
-  }
-
-  eq = bitvec_eq(have, state->want);
-
-  bitvec_destroy(have);
-
-  if (!eq)
+  if (!bitvec_is_subset(state->want, value))
     return 0; /* keep going */
 
   state->found = key;
@@ -962,17 +1571,11 @@ result_t tagdb_enumerate_ids_by_tags(tagdb_t           *db,
   state.count = 0;
   state.found = NULL;
   state.want  = want;
-  state.err   = result_OK;
 
   if (hash_walk(db->hash, getidbytags_cb, &state) < 0)
   {
     size_t l;
 
-    if (state.err)
-    {
-      err = state.err;
-      goto Failure;
-    }
     l = digestdb_DIGESTSZ;
 
     if (bufsz < l)
@@ -1003,10 +1606,118 @@ Failure:
 
 /* ----------------------------------------------------------------------- */
 
+struct enable_similarity_state
+{
+  minhash_t *similar;
+  result_t   err;
+};
+
+static int enable_similarity_cb(const void *key,
+                                const void *value,
+                                void       *opaque)
+{
+  struct enable_similarity_state *state = opaque;
+
+  state->err = minhash_update(state->similar, key, value);
+
+  return state->err ? -1 : 0; /* stop the walk on error */
+}
+
+result_t tagdb_enable_similarity(tagdb_t *db)
+{
+  result_t                       err;
+  struct enable_similarity_state state;
+
+  assert(db);
+
+  if (db->similar)
+    return result_OK; /* already enabled */
+
+  err = minhash_create(&state.similar);
+  if (err)
+    return err;
+
+  state.err = result_OK;
+  hash_walk(db->hash, enable_similarity_cb, &state);
+  if (state.err)
+  {
+    minhash_destroy(state.similar);
+    return state.err;
+  }
+
+  db->similar = state.similar;
+
+  return result_OK;
+}
+
+result_t tagdb_similar_ids(tagdb_t             *db,
+                           const unsigned char *id,
+                           int                  k,
+                           unsigned char       *buf,
+                           size_t               bufsz,
+                           float               *similarity,
+                           int                 *nfound)
+{
+  const unsigned char **found  = NULL;
+  float                *scores = NULL;
+  int                   n;
+  int                   i;
+
+  assert(db);
+  assert(id);
+  assert(k >= 0);
+  assert(buf);
+  assert(nfound);
+
+  *nfound = 0;
+
+  if (db->similar == NULL)
+    return result_TAGDB_NOT_INDEXED;
+
+  if (hash_lookup(db->hash, id) == NULL)
+    return result_TAGDB_UNKNOWN_ID;
+
+  if (bufsz < (size_t) k * digestdb_DIGESTSZ)
+    return result_TAGDB_BUFF_OVERFLOW;
+
+  if (k == 0)
+    return result_OK;
+
+  found  = malloc(k * sizeof(*found));
+  scores = malloc(k * sizeof(*scores));
+  if (found == NULL || scores == NULL)
+  {
+    free(found);
+    free(scores);
+    return result_OOM;
+  }
+
+  n = minhash_query(db->similar, id, k, found, scores);
+
+  for (i = 0; i < n; i++)
+  {
+    memcpy(buf + i * digestdb_DIGESTSZ, found[i], digestdb_DIGESTSZ);
+    if (similarity)
+      similarity[i] = scores[i];
+  }
+
+  *nfound = n;
+
+  free(found);
+  free(scores);
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
 void tagdb_forget(tagdb_t *db, const unsigned char *id)
 {
   assert(db);
   assert(id);
 
+  if (db->similar)
+    minhash_remove(db->similar, id);
+
   hash_remove(db->hash, id);
 }
@@ -197,6 +197,104 @@ static result_t test_enumerate_tags(State_t *state)
   return result_OK;
 
 
+Failure:
+
+  return err;
+}
+
+static result_t test_tags_with_prefix(State_t *state)
+{
+  static const char *prefixes[] =
+  {
+    "",
+    "e",
+    "george",
+    "george.mcfly",
+    "george.mcfly.",
+    "q"
+  };
+
+  result_t      err;
+  int           i;
+  unsigned char buf[256];
+  unsigned char prev[256];
+
+  for (i = 0; i < NELEMS(prefixes); i++)
+  {
+    size_t      prefixlen;
+    int         cont;
+    int         nfound;
+    int         nexpected;
+    tagdb_tag_t tag;
+    int         count;
+
+    prefixlen = strlen(prefixes[i]);
+
+    printf("tags with prefix '%s'...", prefixes[i]);
+
+    nfound = 0;
+    prev[0] = '\0';
+    cont = 0;
+    do
+    {
+      err = tagdb_tags_with_prefix(state->db,
+                                   (const unsigned char *) prefixes[i],
+                                   &cont,
+                                   &tag);
+      if (err)
+        goto Failure;
+
+      if (cont)
+      {
+        err = tagdb_tagtoname(state->db, tag, buf, NULL, sizeof(buf));
+        if (err)
+          goto Failure;
+
+        printf(" '%s'", buf);
+
+        if (strncmp((char *) buf, prefixes[i], prefixlen) != 0)
+          return result_TEST_FAILED; /* doesn't match */
+
+        if (nfound > 0 && strcmp((char *) prev, (char *) buf) >= 0)
+          return result_TEST_FAILED; /* out of order */
+
+        strcpy((char *) prev, (char *) buf);
+        nfound++;
+      }
+    }
+    while (cont);
+
+    printf("\n");
+
+    /* cross check against all tags */
+
+    nexpected = 0;
+    cont = 0;
+    do
+    {
+      err = tagdb_enumerate_tags(state->db, &cont, &tag, &count);
+      if (err)
+        goto Failure;
+
+      if (cont)
+      {
+        err = tagdb_tagtoname(state->db, tag, buf, NULL, sizeof(buf));
+        if (err)
+          goto Failure;
+
+        if (strncmp((char *) buf, prefixes[i], prefixlen) == 0)
+          nexpected++;
+      }
+    }
+    while (cont);
+
+    if (nfound != nexpected)
+      return result_TEST_FAILED;
+  }
+
+  return result_OK;
+
+
 Failure:
 
   return err;
@@ -400,6 +498,273 @@ Failure:
   return err;
 }
 
+static result_t test_similar_ids(State_t *state)
+{
+  static const unsigned char id5[] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,5 };
+
+  result_t      err;
+  unsigned char found[4 * digestdb_DIGESTSZ];
+  float         similarity[4];
+  int           nfound;
+  int           i;
+
+  err = tagdb_similar_ids(state->db, id0, 4, found, sizeof(found),
+                          similarity, &nfound);
+  if (err != result_TAGDB_NOT_INDEXED)
+    return result_TEST_FAILED;
+
+  err = tagdb_enable_similarity(state->db);
+  if (err)
+    return err;
+
+  /* give id5 the same tags as id0 */
+  err = tagdb_tagid(state->db, id5, state->tags[0]);
+  if (err == result_OK)
+    err = tagdb_tagid(state->db, id5, state->tags[1]);
+  if (err)
+    return err;
+
+  err = tagdb_similar_ids(state->db, id0, 4, found, sizeof(found),
+                          similarity, &nfound);
+  if (err)
+    return err;
+
+  for (i = 0; i < nfound; i++)
+  {
+    printdigest(&found[i * digestdb_DIGESTSZ]);
+    printf(" %.2f\n", similarity[i]);
+  }
+
+  if (nfound < 1 ||
+      memcmp(&found[0], id5, digestdb_DIGESTSZ) != 0 ||
+      similarity[0] != 1.0f)
+    return result_TEST_FAILED;
+
+  /* id5 now differs from id0 */
+  err = tagdb_untagid(state->db, id5, state->tags[1]);
+  if (err)
+    return err;
+
+  err = tagdb_similar_ids(state->db, id0, 4, found, sizeof(found),
+                          similarity, &nfound);
+  if (err)
+    return err;
+
+  for (i = 0; i < nfound; i++)
+    if (similarity[i] == 1.0f)
+      return result_TEST_FAILED;
+
+  /* once forgotten, id5 must not be found */
+  tagdb_forget(state->db, id5);
+
+  err = tagdb_similar_ids(state->db, id0, 4, found, sizeof(found),
+                          NULL, &nfound);
+  if (err)
+    return err;
+
+  for (i = 0; i < nfound; i++)
+    if (memcmp(&found[i * digestdb_DIGESTSZ], id5, digestdb_DIGESTSZ) == 0)
+      return result_TEST_FAILED;
+
+  err = tagdb_similar_ids(state->db, id0, 4, found, 1, NULL, &nfound);
+  if (err != result_TAGDB_BUFF_OVERFLOW)
+    return result_TEST_FAILED;
+
+  return result_OK;
+}
+
+/* Check that every id in 'a' has the same named tags in 'b'. */
+static result_t compare_dbs(tagdb_t *a, tagdb_t *b)
+{
+  result_t      err;
+  int           cont;
+  unsigned char id[256];
+  int           nids;
+
+  nids = 0;
+  cont = 0;
+  do
+  {
+    err = tagdb_enumerate_ids(a, &cont, id, sizeof(id));
+    if (err)
+      return err;
+
+    if (cont)
+    {
+      int           cont2;
+      tagdb_tag_t   tag;
+      unsigned char name[256];
+      int           ntags;
+
+      ntags = 0;
+      cont2 = 0;
+      do
+      {
+        err = tagdb_get_tags_for_id(a, id, &cont2, &tag);
+        if (err)
+          return err;
+
+        if (cont2)
+        {
+          int           cont3;
+          tagdb_tag_t   btag;
+          unsigned char bname[256];
+          int           found;
+
+          err = tagdb_tagtoname(a, tag, name, NULL, sizeof(name));
+          if (err)
+            return err;
+
+          /* find the same name amongst the id's tags in 'b' */
+          found = 0;
+          cont3 = 0;
+          do
+          {
+            err = tagdb_get_tags_for_id(b, id, &cont3, &btag);
+            if (err)
+              return err;
+
+            if (cont3)
+            {
+              err = tagdb_tagtoname(b, btag, bname, NULL, sizeof(bname));
+              if (err)
+                return err;
+
+              if (strcmp((char *) name, (char *) bname) == 0)
+                found = 1;
+            }
+          }
+          while (cont3);
+
+          if (!found)
+          {
+            printf("tag '%s' missing\n", name);
+            return result_TEST_FAILED;
+          }
+
+          ntags++;
+        }
+      }
+      while (cont2);
+
+      /* 'b' must have no extra tags */
+      cont2 = 0;
+      do
+      {
+        err = tagdb_get_tags_for_id(b, id, &cont2, &tag);
+        if (err)
+          return err;
+
+        if (cont2)
+          ntags--;
+      }
+      while (cont2);
+
+      if (ntags != 0)
+        return result_TEST_FAILED;
+
+      nids++;
+    }
+  }
+  while (cont);
+
+  printf("%d ids match\n", nids);
+
+  return result_OK;
+}
+
+static result_t test_open_parallel(State_t *state)
+{
+  result_t err;
+  int      nthreads;
+
+  for (nthreads = 1; nthreads <= 4; nthreads++)
+  {
+    tagdb_t *db;
+
+    printf("opening using %d threads... ", nthreads);
+
+    err = tagdb_open_parallel(FILENAME, nthreads, &db);
+    if (err)
+      return err;
+
+    err = compare_dbs(state->db, db);
+    if (err == result_OK)
+      err = compare_dbs(db, state->db);
+
+    tagdb_close(db);
+
+    if (err)
+      return err;
+  }
+
+  return result_OK;
+}
+
+/* A record with more tags than once fitted on a line must load the same
+ * serially and in parallel. */
+static result_t test_many_tags(State_t *state)
+{
+  result_t err;
+  tagdb_t *db;
+  int      i;
+  int      nthreads;
+
+  NOT_USED(state);
+
+  err = tagdb_open(FILENAME "-many", &db);
+  if (err)
+    return err;
+
+  for (i = 0; i < 100; i++)
+  {
+    char        name[16];
+    tagdb_tag_t tag;
+
+    sprintf(name, "many%d", i);
+
+    err = tagdb_add(db, (const unsigned char *) name, &tag);
+    if (!err)
+      err = tagdb_tagid(db, id0, tag);
+    if (err)
+      goto Failure;
+  }
+
+  err = tagdb_commit(db);
+  if (err)
+    goto Failure;
+
+  for (nthreads = -1; nthreads <= 2; nthreads++)
+  {
+    tagdb_t *db2;
+
+    if (nthreads < 0)
+      err = tagdb_open(FILENAME "-many", &db2);
+    else
+      err = tagdb_open_parallel(FILENAME "-many", nthreads, &db2);
+    if (err)
+      goto Failure;
+
+    err = compare_dbs(db, db2);
+    if (err == result_OK)
+      err = compare_dbs(db2, db);
+
+    tagdb_close(db2);
+
+    if (err)
+      goto Failure;
+  }
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  tagdb_close(db);
+  tagdb_delete(FILENAME "-many");
+
+  return err;
+}
+
 static result_t test_tag_remove(State_t *state)
 {
   int i;
@@ -570,6 +935,11 @@ static result_t test_bash(State_t *state)
   if (err)
     goto failure;
 
+  /* exercise the similarity index alongside the random changes */
+  err = tagdb_enable_similarity(state->db);
+  if (err)
+    goto failure;
+
   printf("bash: setup\n");
 
   for (i = 0; i < ntags; i++)
@@ -848,6 +1218,8 @@ result_t tagdb_test(const char *resources)
       "add tags" },
     { test_rename_tags,
       "rename tags" },
+    { test_tags_with_prefix,
+      "tags with prefix" },
     { test_tag_id,
       "tag id" },
     { test_enumerate_tags,
@@ -860,8 +1232,14 @@ result_t tagdb_test(const char *resources)
       "enumerate ids by tag" },
     { test_enumerate_ids_by_tags,
       "enumerate ids by tags" },
+    { test_similar_ids,
+      "similar ids" },
     { test_commit,
       "commit" },
+    { test_open_parallel,
+      "open parallel" },
+    { test_many_tags,
+      "many tags on one id" },
     { test_tag_remove,
       "remove all tags" },
     { test_get_tags_for_id,
@@ -6,6 +6,7 @@
 #include "fortify/fortify.h"
 #endif
 
+#include "utils/arena.h"
 #include "utils/barith.h"
 
 #include "datastruct/atom.h"
@@ -18,13 +19,22 @@ atom_set_t *atom_create(void)
 }
 
 atom_set_t *atom_create_tuned(size_t locpoolsz, size_t blkpoolsz)
+{
+  return atom_create_in_arena(NULL, locpoolsz, blkpoolsz);
+}
+
+atom_set_t *atom_create_in_arena(arena_t *arena,
+                                 size_t   locpoolsz,
+                                 size_t   blkpoolsz)
 {
   atom_set_t *s;
 
-  s = calloc(1, sizeof(*s));
+  s = arena ? arena_calloc(arena, 1, sizeof(*s)) : calloc(1, sizeof(*s));
   if (s == NULL)
     return NULL;
 
+  s->arena = arena;
+
   s->log2locpoolsz = locpoolsz ? ceillog2_size_t(locpoolsz) : LOG2LOCPOOLSZ;
   s->log2blkpoolsz = blkpoolsz ? ceillog2_size_t(blkpoolsz) : LOG2BLKPOOLSZ;
 
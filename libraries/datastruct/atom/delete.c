@@ -38,4 +38,6 @@ void atom_delete(atom_set_t *s, atom_t a)
 #endif
 
   *plength = -length;
+
+  s->ndeleted++;
 }
@@ -17,6 +17,10 @@ void atom_destroy(atom_set_t *s)
   if (s == NULL)
     return;
 
+  /* in an arena the memory is released along with the arena */
+  if (s->arena)
+    return;
+
   /* delete all location pools */
 
   for (i = 0; i < s->l_used; i++)
@@ -14,6 +14,8 @@
 
 #include <stdlib.h>
 
+#include "utils/arena.h"
+
 /* ----------------------------------------------------------------------- */
 
 #define LOG2LOCPOOLSZ 5 /* default: 32 locs per pool */
@@ -87,6 +89,10 @@ struct atom_set
   blkpool_t      *blkpools;      /* growable array of block pools */
   unsigned int    b_used;
   unsigned int    b_allocated;
+
+  unsigned int    ndeleted;      /* deleted locations awaiting reuse */
+
+  arena_t        *arena;         /* or NULL to use the heap */
 };
 
 /* ----------------------------------------------------------------------- */
@@ -8,6 +8,7 @@
 #include "fortify/fortify.h"
 #endif
 
+#include "utils/arena.h"
 #include "utils/array.h"
 #include "utils/barith.h"
 
@@ -17,6 +18,29 @@
 
 /* ----------------------------------------------------------------------- */
 
+/* Allocators which use the set's arena, if it has one. */
+
+static void *pool_realloc(atom_set_t *s,
+                          void       *block,
+                          size_t      oldsize,
+                          size_t      newsize)
+{
+  if (s->arena)
+    return arena_realloc(s->arena, block, oldsize, newsize);
+  else
+    return realloc(block, newsize);
+}
+
+static void *pool_alloc(atom_set_t *s, size_t size)
+{
+  if (s->arena)
+    return arena_alloc(s->arena, size);
+  else
+    return malloc(size);
+}
+
+/* ----------------------------------------------------------------------- */
+
 /* Ensure we have space for one more location struct. */
 result_t atom_ensure_loc_space(atom_set_t *s)
 {
@@ -58,7 +82,10 @@ result_t atom_ensure_loc_space(atom_set_t *s)
     /* subtract 1 to make it greater than or equal */
     newallocated = (size_t) power2gt(newallocated - 1);
 
-    newpools = realloc(s->locpools, newallocated * sizeof(*newpools));
+    newpools = pool_realloc(s,
+                            s->locpools,
+                            s->l_allocated * sizeof(*newpools),
+                            newallocated * sizeof(*newpools));
     if (newpools == NULL)
       return result_OOM;
 
@@ -69,7 +96,7 @@ result_t atom_ensure_loc_space(atom_set_t *s)
 
   /* allocate a new pool */
 
-  newpool = malloc(sizeof(*newpool) << s->log2locpoolsz);
+  newpool = pool_alloc(s, sizeof(*newpool) << s->log2locpoolsz);
   if (newpool == NULL)
     return result_OOM;
 
@@ -125,7 +152,10 @@ result_t atom_ensure_blk_space(atom_set_t *s, size_t length)
     /* subtract 1 to make it greater than or equal */
     newallocated = (size_t) power2gt(newallocated - 1);
 
-    newpools = realloc(s->blkpools, newallocated * sizeof(*newpools));
+    newpools = pool_realloc(s,
+                            s->blkpools,
+                            s->b_allocated * sizeof(*newpools),
+                            newallocated * sizeof(*newpools));
     if (newpools == NULL)
       return result_OOM;
 
@@ -136,7 +166,7 @@ result_t atom_ensure_blk_space(atom_set_t *s, size_t length)
 
   /* allocate a new pool */
 
-  newpool = malloc(sizeof(*newpool) << s->log2blkpoolsz);
+  newpool = pool_alloc(s, sizeof(*newpool) << s->log2blkpoolsz);
   if (newpool == NULL)
     return result_OOM;
 
@@ -151,47 +181,45 @@ result_t atom_ensure_blk_space(atom_set_t *s, size_t length)
 
 /* ----------------------------------------------------------------------- */
 
-result_t atom_new(atom_set_t          *s,
-                  const unsigned char *block,
-                  size_t               sizet_length,
-                  atom_t              *patom)
+/* Store a block known not to be present already. If 'searchpools' is set
+ * then every block pool is searched for room before a new one is made,
+ * otherwise only the last. */
+static result_t insert_block(atom_set_t          *s,
+                             const unsigned char *block,
+                             size_t               sizet_length,
+                             int                  searchpools,
+                             atom_t              *patom)
 {
   result_t      err;
-  atom_t        atom;
   int           length;
   locpool_t    *pend;
   locpool_t    *p;
   loc_t        *lend;
   loc_t        *l;
+  unsigned int  poolsz;
   unsigned int  i;
 
-  assert(s);
-  assert(block);
-  assert(sizet_length > 0);
-  assert(patom);
-
-  atom = atom_for_block(s, block, sizet_length);
-  if (atom != atom_NOT_FOUND) /* already present */
-  {
-    if (patom)
-      *patom = atom;
-    return result_ATOM_NAME_EXISTS;
-  }
-
   length = (int) sizet_length;
 
   /* Do we have a spare (previously deallocated) entry which can take this
    * data? It must be exactly the right size. Doing this mitigates part of
    * the delete-add-repeat unbounded growth problem but is work proportional
-   * to the number of allocated ptrs. */
+   * to the number of allocated ptrs, so is skipped when nothing has been
+   * deleted. */
 
-  pend = s->locpools + s->l_used;
-  for (p = s->locpools; p < pend; p++)
+  if (s->ndeleted > 0)
   {
-    lend = p->locs + p->used;
-    for (l = p->locs; l < lend; l++)
-      if (l->length == -length) /* careful to use signed length */
-        goto fillin;
+    pend = s->locpools + s->l_used;
+    for (p = s->locpools; p < pend; p++)
+    {
+      lend = p->locs + p->used;
+      for (l = p->locs; l < lend; l++)
+        if (l->length == -length) /* careful to use signed length */
+        {
+          s->ndeleted--;
+          goto fillin;
+        }
+    }
   }
 
   /* if we're here we didn't find a block which was exactly the right size */
@@ -203,14 +231,20 @@ result_t atom_new(atom_set_t          *s,
 
   /* now we need to find spare space in a pool */
 
-  /* We could just look at the tail end of the last-used block pool but it's
-   * possible that the earlier pools have a suitably-sized free area at the
-   * end of their allocated blocks so we'll scan through them all just in
+  /* The tail end of the last-used block pool is tried first. It's possible
+   * that the earlier pools have a suitably-sized free area at the end of
+   * their allocated blocks so, if asked, we'll scan through them all just in
    * case.
    */
-  for (i = 0; i < s->b_used; i++)
-    if ((1U << s->log2blkpoolsz) - s->blkpools[i].used >= sizet_length)
-      break;
+  poolsz = 1U << s->log2blkpoolsz;
+
+  i = s->b_used;
+  if (s->b_used > 0 && poolsz - s->blkpools[s->b_used - 1].used >= sizet_length)
+    i = s->b_used - 1;
+  else if (searchpools)
+    for (i = 0; i < s->b_used; i++)
+      if (poolsz - s->blkpools[i].used >= sizet_length)
+        break;
 
   if (i == s->b_used)
   {
@@ -245,3 +279,42 @@ fillin:
 
   return result_OK;
 }
+
+result_t atom_new(atom_set_t          *s,
+                  const unsigned char *block,
+                  size_t               sizet_length,
+                  atom_t              *patom)
+{
+  atom_t atom;
+
+  assert(s);
+  assert(block);
+  assert(sizet_length > 0);
+  assert(patom);
+
+  atom = atom_for_block(s, block, sizet_length);
+  if (atom != atom_NOT_FOUND) /* already present */
+  {
+    if (patom)
+      *patom = atom;
+    return result_ATOM_NAME_EXISTS;
+  }
+
+  return insert_block(s, block, sizet_length, 1, patom);
+}
+
+result_t atom_new_unique(atom_set_t          *s,
+                         const unsigned char *block,
+                         size_t               sizet_length,
+                         atom_t              *patom)
+{
+  assert(s);
+  assert(block);
+  assert(sizet_length > 0);
+  assert(patom);
+
+  /* the caller guarantees the block is absent so there's no duplicate scan,
+   * and only the last block pool is tried so the cost is independent of the
+   * size of the set */
+  return insert_block(s, block, sizet_length, 0, patom);
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef FORTIFY
 #include "fortify/fortify.h"
@@ -194,6 +195,73 @@ static result_t test_random(atom_set_t *d)
   return result_OK;
 }
 
+#define NUNIQUE 100000
+
+static result_t test_unique(void)
+{
+  result_t    err;
+  atom_set_t *d;
+  clock_t     start;
+  int         i;
+
+  printf("test: unique\n");
+
+  d = atom_create();
+  if (d == NULL)
+    return result_OOM;
+
+  start = clock();
+
+  for (i = 0; i < NUNIQUE; i++)
+  {
+    char   name[16];
+    atom_t idx;
+
+    sprintf(name, "u%d", i);
+
+    err = atom_new_unique(d, (const unsigned char *) name, strlen(name) + 1,
+                          &idx);
+    if (err)
+      goto Failure;
+
+    if (idx != i)
+    {
+      printf("atom %d assigned %d\n", i, idx);
+      goto Failure;
+    }
+  }
+
+  printf("%d atoms added in %.3fs\n",
+         NUNIQUE, (double) (clock() - start) / CLOCKS_PER_SEC);
+
+  for (i = 0; i < NUNIQUE; i += 997)
+  {
+    char        name[16];
+    const char *got;
+
+    sprintf(name, "u%d", i);
+
+    got = (const char *) atom_get(d, i, NULL);
+    if (strcmp(got, name) != 0 ||
+        atom_for_block(d, (const unsigned char *) name, strlen(name) + 1) != i)
+    {
+      printf("atom %d: got '%s'\n", i, got);
+      goto Failure;
+    }
+  }
+
+  atom_destroy(d);
+
+  return result_OK;
+
+
+Failure:
+
+  atom_destroy(d);
+
+  return result_TEST_FAILED;
+}
+
 result_t atom_test(const char *resources)
 {
   result_t   err;
@@ -251,6 +319,10 @@ result_t atom_test(const char *resources)
 
   atom_destroy(d);
 
+  err = test_unique();
+  if (err)
+    goto Failure;
+
   return result_TEST_PASSED;
 
 
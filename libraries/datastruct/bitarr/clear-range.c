@@ -0,0 +1,33 @@
+/* clear-range.c -- arrays of bits */
+
+#include <string.h>
+
+#include "datastruct/bitarr.h"
+
+void bitarr_clear_range(bitarr_t *arr, int first, int nbits)
+{
+  int           last;
+  int           fw, lw;
+  bitarr_elem_t fm, lm;
+
+  if (nbits <= 0)
+    return;
+
+  last = first + nbits - 1;
+
+  fw = first >> BITARR_SHIFT;
+  lw = last  >> BITARR_SHIFT;
+  fm = ~0u << (first & BITARR_MASK);
+  lm = ~0u >> (BITARR_MASK - (last & BITARR_MASK));
+
+  if (fw == lw)
+  {
+    arr->entries[fw] &= ~(fm & lm);
+    return;
+  }
+
+  arr->entries[fw] &= ~fm;
+  memset(&arr->entries[fw + 1], 0x00,
+         (lw - fw - 1) * sizeof(bitarr_elem_t));
+  arr->entries[lw] &= ~lm;
+}
@@ -7,16 +7,8 @@
 
 int bitarr_count(const bitarr_t *arr, size_t bytelen)
 {
-  const bitarr_elem_t *base;
-  const bitarr_elem_t *end;
-  int                  c;
+  // FIXME: This will round off any sub-word units...
+  bytelen &= ~(sizeof(bitarr_elem_t) - 1);
 
-  base = arr->entries;
-  end  = base + (bytelen >> (BITARR_SHIFT - 3)); // FIXME: This will round off any sub-word units...
-
-  c = 0;
-  while (base != end)
-    c += countbits(*base++);
-
-  return c;
+  return (int) countbits_block(arr->entries, bytelen);
 }
@@ -0,0 +1,95 @@
+/* find-clear-run.c -- arrays of bits */
+
+#include <stddef.h>
+
+#include "utils/barith.h"
+#include "datastruct/bitarr.h"
+
+int bitarr_find_clear_run(const bitarr_t *arr,
+                          size_t          bytelen,
+                          int             from,
+                          int             nbits)
+{
+  int nwords;
+  int i;
+  int runstart;
+  int runlen;
+
+  if (from < 0)
+    from = 0;
+
+  nwords = (int) (bytelen / sizeof(bitarr_elem_t));
+
+  if (nbits <= 0 || from + nbits > nwords << BITARR_SHIFT)
+    return -1;
+
+  /* A run may span words so its start and length are carried from word to
+   * word. Within a word ctz skips over whole runs of clear then set bits. */
+
+  runstart = from;
+  runlen   = 0;
+
+  for (i = from >> BITARR_SHIFT; i < nwords; i++)
+  {
+    bitarr_elem_t w;
+    int           base;
+    int           bit;
+
+    w    = arr->entries[i];
+    base = i << BITARR_SHIFT;
+
+    if (i == from >> BITARR_SHIFT) /* treat the bits below 'from' as set */
+      w |= (1u << (from & BITARR_MASK)) - 1;
+
+    if (w == 0) /* all clear: extend the run by a whole word */
+    {
+      if (runlen == 0)
+        runstart = base;
+      runlen += BITARR_BITS;
+      if (runlen >= nbits)
+        return runstart;
+      continue;
+    }
+
+    bit = 0;
+    while (bit < (int) BITARR_BITS)
+    {
+      bitarr_elem_t rest;
+      int           z;
+
+      rest = w >> bit;
+      if (rest == 0)
+      {
+        /* the top of the word is clear: carry the run into the next word */
+        if (runlen == 0)
+          runstart = base + bit;
+        runlen += BITARR_BITS - bit;
+        if (runlen >= nbits)
+          return runstart;
+        break;
+      }
+
+      /* clear bits up to the next set bit */
+      z = ctz(rest);
+      if (z > 0)
+      {
+        if (runlen == 0)
+          runstart = base + bit;
+        runlen += z;
+        if (runlen >= nbits)
+          return runstart;
+      }
+      runlen = 0;
+      bit += z;
+
+      /* skip the set bits. the zeroes shifted in from the top stop the
+       * count at the end of the word. */
+      rest = ~(w >> bit);
+      if (rest == 0)
+        break; /* set to the end of the word */
+      bit += ctz(rest);
+    }
+  }
+
+  return -1;
+}
@@ -0,0 +1,36 @@
+/* find-first-clear.c -- arrays of bits */
+
+#include <stddef.h>
+
+#include "utils/barith.h"
+#include "datastruct/bitarr.h"
+
+int bitarr_find_first_clear(const bitarr_t *arr, size_t bytelen, int from)
+{
+  int           nwords;
+  int           i;
+  bitarr_elem_t w;
+
+  if (from < 0)
+    from = 0;
+
+  nwords = (int) (bytelen / sizeof(bitarr_elem_t));
+
+  i = from >> BITARR_SHIFT;
+  if (i >= nwords)
+    return -1;
+
+  /* search the inverted words, ignoring the bits below 'from' */
+  w = ~arr->entries[i] & (~0u << (from & BITARR_MASK));
+
+  for (;;)
+  {
+    if (w)
+      return (i << BITARR_SHIFT) + ctz(w);
+
+    if (++i >= nwords)
+      return -1;
+
+    w = ~arr->entries[i];
+  }
+}
@@ -35,6 +35,120 @@ static void dumpbits(const testbits_t *arr, int nbits)
   printf("\n%d bits set\n", c);
 }
 
+#define NMAPBITS 1000
+
+typedef bitarr_ARRAY(NMAPBITS) mapbits_t;
+
+/* bit-at-a-time version of bitarr_find_clear_run */
+static int slow_find_clear_run(const mapbits_t *map, int from, int nbits)
+{
+  int i;
+  int run;
+
+  run = 0;
+  for (i = from; i < (int) (sizeof(*map) * 8); i++)
+  {
+    run = bitarr_get(map, i) ? 0 : run + 1;
+    if (run == nbits)
+      return i - nbits + 1;
+  }
+
+  return -1;
+}
+
+/* use the range and search operations as an allocator would, checking
+ * them against bit-at-a-time results */
+static result_t bitarr_range_test(void)
+{
+  const int end = (int) sizeof(mapbits_t) * 8; /* rounded up to words */
+  mapbits_t map;
+  int       i;
+  int       j;
+
+  printf("test: ranges\n");
+
+  bitarr_wipe(map, sizeof(map));
+
+  srand(1);
+  for (i = 0; i < 2000; i++)
+  {
+    int first;
+    int n;
+    int from;
+    int want;
+    int got;
+
+    first = rand() % NMAPBITS;
+    n     = rand() % (NMAPBITS - first + 1);
+    if (rand() & 1)
+      bitarr_set_range((bitarr_t *) &map, first, n);
+    else
+      bitarr_clear_range((bitarr_t *) &map, first, n);
+
+    from = rand() % NMAPBITS;
+
+    for (want = from; want < end && !bitarr_get(&map, want); want++)
+      ;
+    if (want == end)
+      want = -1;
+    got = bitarr_find_first_set((bitarr_t *) &map, sizeof(map), from);
+    if (got != want)
+    {
+      printf("find_first_set from %d: got %d, want %d\n", from, got, want);
+      return result_TEST_FAILED;
+    }
+
+    for (want = from; want < end && bitarr_get(&map, want); want++)
+      ;
+    if (want == end)
+      want = -1;
+    got = bitarr_find_first_clear((bitarr_t *) &map, sizeof(map), from);
+    if (got != want)
+    {
+      printf("find_first_clear from %d: got %d, want %d\n", from, got, want);
+      return result_TEST_FAILED;
+    }
+
+    for (j = 1; j < 200; j = j * 3 + 1)
+    {
+      want = slow_find_clear_run(&map, from, j);
+      got  = bitarr_find_clear_run((bitarr_t *) &map, sizeof(map), from, j);
+      if (got != want)
+      {
+        printf("find_clear_run of %d from %d: got %d, want %d\n",
+               j, from, got, want);
+        return result_TEST_FAILED;
+      }
+    }
+  }
+
+  /* allocate runs until full then check nothing overlapped */
+  bitarr_wipe(map, sizeof(map));
+  j = 0;
+  for (;;)
+  {
+    int n;
+
+    n = 1 + j % 70;
+    i = bitarr_find_clear_run((bitarr_t *) &map, sizeof(map), 0, n);
+    if (i < 0)
+      break;
+    bitarr_set_range((bitarr_t *) &map, i, n);
+    j += n;
+  }
+
+  if (bitarr_count((bitarr_t *) &map, sizeof(map)) != j)
+  {
+    printf("allocated %d bits but %d are set\n",
+           j, bitarr_count((bitarr_t *) &map, sizeof(map)));
+    return result_TEST_FAILED;
+  }
+
+  printf("allocated %d of %d bits\n", j, end);
+
+  return result_OK;
+}
+
 result_t bitarr_test(const char *resources)
 {
   testbits_t arr;
@@ -77,5 +191,9 @@ result_t bitarr_test(const char *resources)
   printf("%d bits set\n", bitarr_count((bitarr_t *) &arr, sizeof(arr)));
 
 
+  if (bitarr_range_test())
+    return result_TEST_FAILED;
+
+
   return result_TEST_PASSED;
 }
@@ -1,123 +1,112 @@
 /* bitfifo.c -- fifo which stores bits */
 
 #include <assert.h>
-#include <string.h>
 #include <limits.h>
-#include <stdlib.h>
 #include <stddef.h>
-#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
 
 #include "base/utils.h"
 
 #include "datastruct/bitfifo.h"
 
+/* ----------------------------------------------------------------------- */
+
+/* Bits are stored in a ring of 64-bit words. Bit n of the stream lives in
+ * bit (n % 64) of word (n / 64) modulo the ring size.
+ *
+ * 'head' and 'tail' count the bits ever enqueued and dequeued, so the
+ * number of bits in use is simply their difference. The ring holds a power
+ * of two words so positions reduce to words by masking.
+ *
+ * The ring is at least 64 bits larger than the capacity. Writes can then
+ * store whole words: the bits they clobber past the end of the new data
+ * are always free.
+ */
+
 /* A type to hold a chunk of bits. */
-typedef unsigned int bitfifo_T;
-
-#define BITFIFOT_WIDTH     (sizeof(unsigned int) * CHAR_BIT)
-#define BITFIFOT_1         1u
-#define BITFIFOT_LOG2WIDTH 5
-
-/* memcpy() for bit-sized regions */
-static void bitcpy(bitfifo_T       *dst,
-                   unsigned int     dstbitoff,
-                   const bitfifo_T *src,
-                   unsigned int     srcbitoff,
-                   size_t           nbits)
-{
-  size_t    nwords;
-  bitfifo_T mask;
+typedef uint64_t bitfifo_T;
 
-  if (nbits == 0)
-    return;
+#define BITFIFOT_WIDTH     64
+#define BITFIFOT_LOG2WIDTH 6
+#define BITFIFOT_MASK      (BITFIFOT_WIDTH - 1)
 
-  assert(dst);
-  assert(dstbitoff < BITFIFOT_WIDTH);
-  assert(src);
-  assert(srcbitoff < BITFIFOT_WIDTH);
+/* the low 'n' bits set, for n in 0..64 */
+#define LOWMASK(n) ((n) >= 64 ? ~(bitfifo_T) 0 : ((bitfifo_T) 1 << (n)) - 1)
 
-  if (dstbitoff == srcbitoff)
-  {
-    /* source and destination offsets are aligned: easy case */
+/* ----------------------------------------------------------------------- */
 
-    /* align to a word boundary */
-    if (dstbitoff)
-    {
-      mask = ~0u << dstbitoff;
-      *dst = (*dst & ~mask) | (*src & mask);
-      nbits -= dstbitoff;
-    }
+struct bitfifo
+{
+  size_t       head;      /* bits ever enqueued */
+  size_t       tail;      /* bits ever dequeued */
+  size_t       capacity;  /* bits which may be stored */
+  size_t       wordmask;  /* words in buffer less one */
+  bitfifo_T    buffer[1]; /* sized when allocated */
+};
 
-    /* copy whole words */
-    nwords = nbits >> BITFIFOT_LOG2WIDTH;
-    if (nwords)
-    {
-      memcpy(dst, src, nwords * sizeof(*src));
-      dst += nwords;
-      src += nwords;
-    }
+/* ----------------------------------------------------------------------- */
 
-    /* then copy trailing bits */
-    nbits &= BITFIFOT_WIDTH - 1;
-    if (nbits)
-    {
-      mask = (BITFIFOT_1 << nbits) - 1;
-      *dst = (*dst & ~mask) | (*src & mask);
-    }
-  }
-  else
-  {
-    /* source and destination offsets are not aligned: hard case */
+/* write 'n' bits (1..64) at stream position 'pos' */
+static void put_bits(bitfifo_t *fifo, size_t pos, bitfifo_T bits, int n)
+{
+  size_t word;
+  int    off;
 
-    /* this processes a single bit per iteration (slow) */
-    while (nbits--)
-    {
-      int          dstmask;
-      int          srcmask;
-      unsigned int dstbits;
-      unsigned int srcbits;
+  word = (pos >> BITFIFOT_LOG2WIDTH) & fifo->wordmask;
+  off  = pos & BITFIFOT_MASK;
 
-      dstmask = BITFIFOT_1 << dstbitoff;
-      srcmask = BITFIFOT_1 << srcbitoff;
+  bits &= LOWMASK(n);
 
-      dstbits = *dst & ~dstmask;
-      srcbits = *src & srcmask;
+  fifo->buffer[word] = (fifo->buffer[word] & LOWMASK(off)) | (bits << off);
+  if (off + n > BITFIFOT_WIDTH)
+    fifo->buffer[(word + 1) & fifo->wordmask] = bits >> (BITFIFOT_WIDTH - off);
+}
 
-      if (srcbitoff > dstbitoff)
-        *dst = dstbits | (srcbits >> (srcbitoff - dstbitoff));
-      else
-        *dst = dstbits | (srcbits << (dstbitoff - srcbitoff));
+/* read 'n' bits (1..64) from stream position 'pos' */
+static bitfifo_T get_bits(const bitfifo_t *fifo, size_t pos, int n)
+{
+  size_t    word;
+  int       off;
+  bitfifo_T bits;
 
-      dstbitoff = (dstbitoff + 1) & (BITFIFOT_WIDTH - 1); if (dstbitoff == 0) dst++;
-      srcbitoff = (srcbitoff + 1) & (BITFIFOT_WIDTH - 1); if (srcbitoff == 0) src++;
-    }
-  }
+  word = (pos >> BITFIFOT_LOG2WIDTH) & fifo->wordmask;
+  off  = pos & BITFIFOT_MASK;
+
+  bits = fifo->buffer[word] >> off;
+  if (off + n > BITFIFOT_WIDTH)
+    bits |= fifo->buffer[(word + 1) & fifo->wordmask] << (BITFIFOT_WIDTH - off);
+
+  return bits & LOWMASK(n);
 }
 
 /* ----------------------------------------------------------------------- */
 
-struct bitfifo
-{
-  unsigned int head;      /* where to put incoming bits; a bit offset */
-  unsigned int tail;      /* where to take outgoing bits from: a bit offset */
-  unsigned int nbits;     /* buffer size, in bits (capacity is one bit less) */
-  bitfifo_T    buffer[1]; /* sized when allocated */
-};
-
 bitfifo_t *bitfifo_create(int nbits)
 {
   bitfifo_t *fifo;
+  size_t     nwords;
+
+  if (nbits < 0)
+    return NULL;
 
-  /* allocate one more bit than requested so we can represent buffer full correctly */
-  nbits++;
+  /* a power of two number of words with a spare word (see above) */
+  nwords = 1;
+  while ((nwords << BITFIFOT_LOG2WIDTH) < (size_t) nbits + BITFIFOT_WIDTH)
+    nwords <<= 1;
 
-  fifo = malloc(offsetof(bitfifo_t, buffer) +
-                DIVIDE_ROUNDING_UP(nbits, BITFIFOT_WIDTH) * sizeof(fifo->buffer[0]));
+  fifo = calloc(1, offsetof(bitfifo_t, buffer) +
+                   nwords * sizeof(fifo->buffer[0]));
   if (fifo == NULL)
     return NULL;
 
-  fifo->head  = fifo->tail = 0;
-  fifo->nbits = nbits;
+  fifo->head     = fifo->tail = 0;
+  fifo->capacity = nbits;
+  fifo->wordmask = nwords - 1;
 
   return fifo;
 }
@@ -129,186 +118,180 @@ void bitfifo_destroy(bitfifo_t *doomed)
 
 /* ----------------------------------------------------------------------- */
 
-result_t bitfifo_enqueue(bitfifo_t       *fifo,
-                         const bitfifo_T *newbits,
-                         unsigned int     newbitsoffset,
-                         size_t           nnewbits)
+result_t bitfifo_enqueue(bitfifo_t          *fifo,
+                         const unsigned int *newbits,
+                         unsigned int        newbitsoffset,
+                         size_t              nnewbits)
 {
+  size_t head;
+
   if (bitfifo_full(fifo))
     return result_BITFIFO_FULL;
 
-  if (fifo->head < fifo->tail)
-  {
-    /* when head < tail then there's a single free contiguous gap somewhere
-     * in the buffer that we can target:
-     * e.g. -> head      tail ->
-     *             \    /
-     *      [######......######]
-     */
-
-    /* is the free gap large enough?
-     * note: ensure one unused bit before tail */
-    if (fifo->tail - 1 - fifo->head < nnewbits)
-      return result_BITFIFO_FULL;
-
-    bitcpy(&fifo->buffer[fifo->head >> BITFIFOT_LOG2WIDTH],
-           fifo->head & (BITFIFOT_WIDTH - 1),
-           newbits,
-           newbitsoffset,
-           nnewbits);
-
-    fifo->head += nnewbits;
-  }
-  else
-  {
-    size_t spareahead;
-    size_t sparebehind;
-    size_t totalcopied;
-
-    /* when head >= tail then the bits wrap around at the end of the buffer.
-     * there can be up to two gaps: one at either end of the buffer:
-     * e.g.  tail ---> head
-     *           \    /
-     *    [......######......]
-     * to fill we may have to wrap around at the end of the buffer.
-     */
-
-    spareahead  = fifo->nbits - fifo->head;
-    sparebehind = fifo->tail - 1; /* ensure one unused bit before tail */
+  if (nnewbits > fifo->capacity - bitfifo_used(fifo))
+    return result_BITFIFO_FULL;
 
-    if (spareahead + sparebehind < nnewbits)
-      return result_BITFIFO_FULL;
+  newbits       += newbitsoffset / 32;
+  newbitsoffset %= 32;
 
-    totalcopied = 0;
+  head = fifo->head;
 
-    /* fill from head all the way to the end of the buffer, if needed */
-    if (spareahead > 0)
+  /* fast path: when both sides are word aligned move 64 bits at a time */
+  if (newbitsoffset == 0 && (head & BITFIFOT_MASK) == 0)
+  {
+    for (; nnewbits >= BITFIFOT_WIDTH; nnewbits -= BITFIFOT_WIDTH)
     {
-      size_t copy = MIN(nnewbits, spareahead);
-
-      bitcpy(&fifo->buffer[fifo->head >> BITFIFOT_LOG2WIDTH],
-             fifo->head & (BITFIFOT_WIDTH - 1),
-             newbits,
-             newbitsoffset,
-             copy);
-      nnewbits -= copy;
-
-      newbits += copy >> BITFIFOT_LOG2WIDTH;
-      newbitsoffset += copy & (BITFIFOT_WIDTH - 1);
-      if (newbitsoffset >= BITFIFOT_WIDTH) /* carried */
-      {
-        newbitsoffset -= BITFIFOT_WIDTH;
-        newbits++;
-      }
-
-      totalcopied += copy;
+      fifo->buffer[(head >> BITFIFOT_LOG2WIDTH) & fifo->wordmask] =
+        (bitfifo_T) (uint32_t) newbits[0] |
+        (bitfifo_T) (uint32_t) newbits[1] << 32;
+      newbits += 2;
+      head    += BITFIFOT_WIDTH;
     }
+  }
 
-    /* fill from the start of the buffer, if needed */
-    if (nnewbits > 0)
-    {
-      assert(sparebehind >= nnewbits);
+  /* otherwise up to 32 bits at a time */
+  while (nnewbits > 0)
+  {
+    bitfifo_T bits;
+    int       n;
 
-      bitcpy(&fifo->buffer[0], 0, newbits, newbitsoffset, nnewbits);
+    n = (int) MIN(nnewbits, 32);
 
-      totalcopied += nnewbits;
-    }
+    bits = (uint32_t) newbits[0] >> newbitsoffset;
+    if (newbitsoffset + n > 32)
+      bits |= (bitfifo_T) (uint32_t) (newbits[1] << (32 - newbitsoffset));
 
-    fifo->head = (fifo->head + totalcopied) % fifo->nbits;
+    put_bits(fifo, head, bits, n);
+
+    newbits++; /* the offset is unchanged after taking 32 bits */
+    head     += n;
+    nnewbits -= n;
   }
 
+  fifo->head = head;
+
   return result_OK;
 }
 
-result_t bitfifo_dequeue(bitfifo_t *fifo,
-                         bitfifo_T *outbits,
-                         size_t     noutbits)
+result_t bitfifo_peek(const bitfifo_t *fifo,
+                      unsigned int    *outbits,
+                      size_t           noutbits)
 {
+  size_t tail;
+
   if (bitfifo_empty(fifo))
     return result_BITFIFO_EMPTY;
 
-  if (fifo->head < fifo->tail)
-  {
-    size_t availabletail;
-    size_t availablehead;
-    size_t totalcopied;
-    int    outbitsoffset = 0;
+  if (noutbits > bitfifo_used(fifo))
+    return result_BITFIFO_INSUFFICIENT;
 
-    /* when head < tail there's two blocks to read from:
-     * e.g. -> head      tail ->
-     *             \    /
-     *      [######......######]
-     */
+  tail = fifo->tail;
 
-    /* shouldn't need to compensate for the unused bit */
-    availabletail = fifo->nbits - fifo->tail;
-    availablehead = fifo->head;
+  /* fast path: when word aligned move 64 bits at a time */
+  if ((tail & BITFIFOT_MASK) == 0)
+  {
+    for (; noutbits >= BITFIFOT_WIDTH; noutbits -= BITFIFOT_WIDTH)
+    {
+      bitfifo_T bits;
 
-    if (availabletail + availablehead < noutbits)
-      return result_BITFIFO_INSUFFICIENT;
+      bits = fifo->buffer[(tail >> BITFIFOT_LOG2WIDTH) & fifo->wordmask];
+      outbits[0] = (unsigned int) (uint32_t) bits;
+      outbits[1] = (unsigned int) (uint32_t) (bits >> 32);
+      outbits += 2;
+      tail    += BITFIFOT_WIDTH;
+    }
+  }
 
-    totalcopied = 0;
+  for (; noutbits >= 32; noutbits -= 32)
+  {
+    *outbits++ = (unsigned int) get_bits(fifo, tail, 32);
+    tail += 32;
+  }
 
-    if (availabletail > 0)
-    {
-      size_t copy = MIN(noutbits, availabletail);
+  /* leave the bits beyond the end of the output untouched */
+  if (noutbits > 0)
+  {
+    unsigned int mask;
 
-      bitcpy(outbits,
-             0,
-             &fifo->buffer[fifo->tail >> BITFIFOT_LOG2WIDTH],
-             fifo->tail & (BITFIFOT_WIDTH - 1),
-             copy);
-      noutbits -= copy;
+    mask = (1u << noutbits) - 1;
+    *outbits = (*outbits & ~mask) |
+               (unsigned int) get_bits(fifo, tail, (int) noutbits);
+  }
 
-      outbits += copy >> BITFIFOT_LOG2WIDTH;
-      outbitsoffset = copy & (BITFIFOT_WIDTH - 1);
+  return result_OK;
+}
 
-      totalcopied += copy;
-    }
+result_t bitfifo_dequeue(bitfifo_t    *fifo,
+                         unsigned int *outbits,
+                         size_t        noutbits)
+{
+  result_t err;
 
-    if (noutbits > 0)
-    {
-      assert(availablehead >= noutbits);
+  err = bitfifo_peek(fifo, outbits, noutbits);
+  if (err)
+    return err;
 
-      bitcpy(outbits,
-             outbitsoffset,
-             &fifo->buffer[fifo->tail >> BITFIFOT_LOG2WIDTH],
-             fifo->tail & (BITFIFOT_WIDTH - 1),
-             noutbits);
+  return bitfifo_skip(fifo, noutbits);
+}
 
-      totalcopied += noutbits;
-    }
+result_t bitfifo_skip(bitfifo_t *fifo, size_t nbits)
+{
+  if (nbits > bitfifo_used(fifo))
+    return result_BITFIFO_INSUFFICIENT;
 
-    fifo->tail = (fifo->tail + totalcopied) % fifo->nbits;
-  }
-  else
-  {
-    /* when head >= tail there's a single contiguous block to read from
-     * e.g.  tail ---> head
-     *           \    /
-     *    [......######......]
-     */
-
-    if (noutbits > fifo->head - fifo->tail)
-      return result_BITFIFO_INSUFFICIENT;
-
-    bitcpy(outbits,
-           0,
-           &fifo->buffer[fifo->tail >> BITFIFOT_LOG2WIDTH],
-           fifo->tail & (BITFIFOT_WIDTH - 1),
-           noutbits);
-
-    fifo->tail += noutbits;
-  }
+  fifo->tail += nbits;
 
   /* if the buffer is completely emptied then reset the head and tail offsets
-   * to their initial values */
+   * to their initial values. this keeps the fast paths aligned. */
   if (fifo->tail == fifo->head)
     fifo->head = fifo->tail = 0;
 
   return result_OK;
 }
 
+/* ----------------------------------------------------------------------- */
+
+result_t bitfifo_put(bitfifo_t *fifo, uint64_t bits, int nbits)
+{
+  assert(nbits >= 0 && nbits <= BITFIFO_MAX_BITS);
+
+  if ((size_t) nbits > fifo->capacity - bitfifo_used(fifo))
+    return result_BITFIFO_FULL;
+
+  if (nbits == 0)
+    return result_OK;
+
+  put_bits(fifo, fifo->head, bits, nbits);
+  fifo->head += nbits;
+
+  return result_OK;
+}
+
+result_t bitfifo_peek_bits(const bitfifo_t *fifo, int nbits, uint64_t *bits)
+{
+  assert(nbits >= 0 && nbits <= BITFIFO_MAX_BITS);
+
+  if ((size_t) nbits > bitfifo_used(fifo))
+    return result_BITFIFO_INSUFFICIENT;
+
+  *bits = (nbits == 0) ? 0 : get_bits(fifo, fifo->tail, nbits);
+
+  return result_OK;
+}
+
+result_t bitfifo_get(bitfifo_t *fifo, int nbits, uint64_t *bits)
+{
+  result_t err;
+
+  err = bitfifo_peek_bits(fifo, nbits, bits);
+  if (err)
+    return err;
+
+  return bitfifo_skip(fifo, nbits);
+}
+
+/* ----------------------------------------------------------------------- */
+
 void bitfifo_clear(bitfifo_t *fifo)
 {
   fifo->head = fifo->tail = 0;
@@ -318,16 +301,12 @@ void bitfifo_clear(bitfifo_t *fifo)
 
 size_t bitfifo_used(const bitfifo_t *fifo)
 {
-  if (fifo->head >= fifo->tail)
-    return fifo->head - fifo->tail;
-  else
-    return fifo->head + fifo->nbits - fifo->tail;
+  return fifo->head - fifo->tail;
 }
 
 int bitfifo_full(const bitfifo_t *fifo)
 {
-  /* the fifo is full if (head + 1) == tail */
-  return (fifo->head + 1) % fifo->nbits == fifo->tail;
+  return bitfifo_used(fifo) == fifo->capacity;
 }
 
 int bitfifo_empty(const bitfifo_t *fifo)
@@ -0,0 +1,311 @@
+/* spscbitfifo.c -- lock-free single-producer single-consumer bit fifo */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/atomic.h"
+#include "base/utils.h"
+
+#include "datastruct/bitfifo.h"
+#include "datastruct/spscbitfifo.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* The storage matches bitfifo.c: a power of two ring of 64-bit words at
+ * least one word larger than the capacity, indexed by free-running bit
+ * counters.
+ *
+ * Only the producer stores to 'head' and only the consumer stores to
+ * 'tail'. Each publishes its counter with a release store and the other
+ * reads it with an acquire load. Each side keeps a private copy of the
+ * other's counter, refreshed only when the copy says there's not enough
+ * room (or data), and the fields owned by each side are padded onto
+ * separate cache lines.
+ *
+ * The producer's read-modify-write of the word holding 'head' may race
+ * with the consumer reading the completed bits in that word. The producer
+ * rewrites those bits unchanged and the consumer never writes, so this is
+ * safe so long as the accesses are atomic, which is why words are accessed
+ * with relaxed atomics. On 64-bit machines these are ordinary loads and
+ * stores.
+ */
+
+typedef uint64_t word_t;
+
+#define WIDTH     64
+#define LOG2WIDTH 6
+#define MASK      (WIDTH - 1)
+
+/* the low 'n' bits set, for n in 0..64 */
+#define LOWMASK(n) ((n) >= 64 ? ~(word_t) 0 : ((word_t) 1 << (n)) - 1)
+
+struct spscbitfifo
+{
+  /* read-only after creation */
+  size_t  capacity;       /* bits which may be stored */
+  size_t  wordmask;       /* words in buffer less one */
+  word_t *buffer;
+  char    pad0[CACHELINE_SIZE];
+
+  /* producer's */
+  size_t  head;           /* bits ever enqueued */
+  size_t  cachedtail;
+  char    pad1[CACHELINE_SIZE];
+
+  /* consumer's */
+  size_t  tail;           /* bits ever dequeued */
+  size_t  cachedhead;
+  char    pad2[CACHELINE_SIZE];
+};
+
+/* ----------------------------------------------------------------------- */
+
+/* write 'n' bits (1..64) at stream position 'pos' */
+static void put_bits(spscbitfifo_t *fifo, size_t pos, word_t bits, int n)
+{
+  word_t *p;
+  size_t  word;
+  int     off;
+
+  word = (pos >> LOG2WIDTH) & fifo->wordmask;
+  off  = pos & MASK;
+
+  bits &= LOWMASK(n);
+
+  p = &fifo->buffer[word];
+  ATOMIC_STORE_RELAXED(p, (ATOMIC_LOAD_RELAXED(p) & LOWMASK(off)) |
+                          (bits << off));
+  if (off + n > WIDTH)
+    ATOMIC_STORE_RELAXED(&fifo->buffer[(word + 1) & fifo->wordmask],
+                         bits >> (WIDTH - off));
+}
+
+/* read 'n' bits (1..64) from stream position 'pos' */
+static word_t get_bits(const spscbitfifo_t *fifo, size_t pos, int n)
+{
+  size_t word;
+  int    off;
+  word_t bits;
+
+  word = (pos >> LOG2WIDTH) & fifo->wordmask;
+  off  = pos & MASK;
+
+  bits = ATOMIC_LOAD_RELAXED(&fifo->buffer[word]) >> off;
+  if (off + n > WIDTH)
+    bits |= ATOMIC_LOAD_RELAXED(&fifo->buffer[(word + 1) & fifo->wordmask])
+              << (WIDTH - off);
+
+  return bits & LOWMASK(n);
+}
+
+/* returns non-zero if the producer has room for 'nbits' */
+static int have_space(spscbitfifo_t *fifo, size_t nbits)
+{
+  if (nbits <= fifo->capacity - (fifo->head - fifo->cachedtail))
+    return 1;
+
+  fifo->cachedtail = ATOMIC_LOAD_ACQUIRE(&fifo->tail);
+
+  return nbits <= fifo->capacity - (fifo->head - fifo->cachedtail);
+}
+
+/* returns non-zero if the consumer has 'nbits' available */
+static int have_data(spscbitfifo_t *fifo, size_t nbits)
+{
+  if (nbits <= fifo->cachedhead - fifo->tail)
+    return 1;
+
+  fifo->cachedhead = ATOMIC_LOAD_ACQUIRE(&fifo->head);
+
+  return nbits <= fifo->cachedhead - fifo->tail;
+}
+
+/* ----------------------------------------------------------------------- */
+
+spscbitfifo_t *spscbitfifo_create(int nbits)
+{
+  spscbitfifo_t *fifo;
+  size_t         nwords;
+
+  if (nbits < 0)
+    return NULL;
+
+  nwords = 1;
+  while ((nwords << LOG2WIDTH) < (size_t) nbits + WIDTH)
+    nwords <<= 1;
+
+  fifo = malloc(sizeof(*fifo));
+  if (fifo == NULL)
+    return NULL;
+
+  fifo->buffer = calloc(nwords, sizeof(*fifo->buffer));
+  if (fifo->buffer == NULL)
+  {
+    free(fifo);
+    return NULL;
+  }
+
+  fifo->capacity   = nbits;
+  fifo->wordmask   = nwords - 1;
+  fifo->head       = 0;
+  fifo->cachedtail = 0;
+  fifo->tail       = 0;
+  fifo->cachedhead = 0;
+
+  return fifo;
+}
+
+void spscbitfifo_destroy(spscbitfifo_t *doomed)
+{
+  if (doomed == NULL)
+    return;
+
+  free(doomed->buffer);
+  free(doomed);
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t spscbitfifo_put(spscbitfifo_t *fifo, uint64_t bits, int nbits)
+{
+  assert(nbits >= 0 && nbits <= BITFIFO_MAX_BITS);
+
+  if (!have_space(fifo, nbits))
+    return result_BITFIFO_FULL;
+
+  if (nbits == 0)
+    return result_OK;
+
+  put_bits(fifo, fifo->head, bits, nbits);
+  ATOMIC_STORE_RELEASE(&fifo->head, fifo->head + nbits);
+
+  return result_OK;
+}
+
+result_t spscbitfifo_enqueue(spscbitfifo_t      *fifo,
+                             const unsigned int *newbits,
+                             unsigned int        newbitsoffset,
+                             size_t              nnewbits)
+{
+  size_t head;
+
+  if (!have_space(fifo, nnewbits))
+    return result_BITFIFO_FULL;
+
+  newbits       += newbitsoffset / 32;
+  newbitsoffset %= 32;
+
+  head = fifo->head;
+
+  while (nnewbits > 0)
+  {
+    word_t bits;
+    int    n;
+
+    n = (int) MIN(nnewbits, 32);
+
+    bits = (uint32_t) newbits[0] >> newbitsoffset;
+    if (newbitsoffset + n > 32)
+      bits |= (word_t) (uint32_t) (newbits[1] << (32 - newbitsoffset));
+
+    put_bits(fifo, head, bits, n);
+
+    newbits++;
+    head     += n;
+    nnewbits -= n;
+  }
+
+  /* publish all of the bits at once */
+  ATOMIC_STORE_RELEASE(&fifo->head, head);
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t spscbitfifo_peek_bits(spscbitfifo_t *fifo, int nbits, uint64_t *bits)
+{
+  assert(nbits >= 0 && nbits <= BITFIFO_MAX_BITS);
+
+  if (!have_data(fifo, nbits))
+    return result_BITFIFO_INSUFFICIENT;
+
+  *bits = (nbits == 0) ? 0 : get_bits(fifo, fifo->tail, nbits);
+
+  return result_OK;
+}
+
+result_t spscbitfifo_get(spscbitfifo_t *fifo, int nbits, uint64_t *bits)
+{
+  result_t err;
+
+  err = spscbitfifo_peek_bits(fifo, nbits, bits);
+  if (err)
+    return err;
+
+  ATOMIC_STORE_RELEASE(&fifo->tail, fifo->tail + nbits);
+
+  return result_OK;
+}
+
+result_t spscbitfifo_dequeue(spscbitfifo_t *fifo,
+                             unsigned int  *outbits,
+                             size_t         noutbits)
+{
+  size_t tail;
+
+  if (!have_data(fifo, noutbits))
+    return fifo->cachedhead == fifo->tail ? result_BITFIFO_EMPTY
+                                          : result_BITFIFO_INSUFFICIENT;
+
+  tail = fifo->tail;
+
+  for (; noutbits >= 32; noutbits -= 32)
+  {
+    *outbits++ = (unsigned int) get_bits(fifo, tail, 32);
+    tail += 32;
+  }
+
+  /* leave the bits beyond the end of the output untouched */
+  if (noutbits > 0)
+  {
+    unsigned int mask;
+
+    mask = (1u << noutbits) - 1;
+    *outbits = (*outbits & ~mask) |
+               (unsigned int) get_bits(fifo, tail, (int) noutbits);
+    tail += noutbits;
+  }
+
+  ATOMIC_STORE_RELEASE(&fifo->tail, tail);
+
+  return result_OK;
+}
+
+result_t spscbitfifo_skip(spscbitfifo_t *fifo, size_t nbits)
+{
+  if (!have_data(fifo, nbits))
+    return result_BITFIFO_INSUFFICIENT;
+
+  ATOMIC_STORE_RELEASE(&fifo->tail, fifo->tail + nbits);
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+size_t spscbitfifo_used(const spscbitfifo_t *fifo)
+{
+  size_t tail;
+
+  /* load tail first: head can only move further ahead of it */
+  tail = ATOMIC_LOAD_ACQUIRE(&fifo->tail);
+
+  return ATOMIC_LOAD_ACQUIRE(&fifo->head) - tail;
+}
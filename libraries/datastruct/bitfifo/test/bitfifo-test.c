@@ -3,6 +3,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #ifdef FORTIFY
 #include "fortify/fortify.h"
@@ -11,6 +17,7 @@
 #include "base/result.h"
 #include "base/utils.h"
 #include "datastruct/bitfifo.h"
+#include "datastruct/spscbitfifo.h"
 
 #include "test/all-tests.h"
 
@@ -60,6 +67,394 @@ static void dump(const bitfifo_t *fifo)
   previous_empty = empty;
 }
 
+/* ----------------------------------------------------------------------- */
+
+#define NMODELBITS 1000    /* capacity of the fifo in the model test */
+#define NSYMBOLS   2000000 /* symbols moved in the throughput test */
+
+/* a bit at a time model of the fifo's contents */
+static unsigned char model[NMODELBITS];
+static int           modelused;
+
+/* returns bit 'n' of an array of words */
+static int getbit(const unsigned int *words, size_t n)
+{
+  return (words[n / 32] >> (n % 32)) & 1;
+}
+
+/* drive every operation at random, checking against the model */
+static result_t bitfifo_model_test(void)
+{
+  result_t     err;
+  bitfifo_t   *fifo;
+  unsigned int words[40];
+  int          i;
+
+  printf("test: model\n");
+
+  fifo = bitfifo_create(NMODELBITS);
+  if (fifo == NULL)
+    return result_OOM;
+
+  modelused = 0;
+
+  srand(1);
+  for (i = 0; i < 100000; i++)
+  {
+    int      op;
+    int      n;
+    int      off;
+    int      j;
+    uint64_t bits;
+
+    op  = rand() % 6;
+    n   = rand() % (op < 2 ? 1200 : BITFIFO_MAX_BITS + 1);
+    off = rand() % 32;
+
+    for (j = 0; j < (int) NELEMS(words); j++)
+      words[j] = ((unsigned int) rand() << 16) ^ (unsigned int) rand();
+    bits = ((uint64_t) words[0] << 32) | words[1];
+
+    switch (op)
+    {
+    case 0: /* enqueue */
+      err = bitfifo_enqueue(fifo, words, off, n);
+      if (modelused + n > NMODELBITS)
+      {
+        if (err != result_BITFIFO_FULL)
+          goto Failure;
+        break;
+      }
+      if (err)
+        goto Failure;
+      for (j = 0; j < n; j++)
+        model[modelused++] = getbit(words, off + j);
+      break;
+
+    case 1: /* dequeue or peek */
+    case 2:
+      if (op == 2)
+        n %= 100;
+      err = (rand() & 1) ? bitfifo_peek(fifo, words, n)
+                         : bitfifo_dequeue(fifo, words, n);
+      if (modelused == 0)
+      {
+        if (err != result_BITFIFO_EMPTY)
+          goto Failure;
+        break;
+      }
+      if (n > modelused)
+      {
+        if (err != result_BITFIFO_INSUFFICIENT)
+          goto Failure;
+        break;
+      }
+      if (err)
+        goto Failure;
+      for (j = 0; j < n; j++)
+        if (getbit(words, j) != model[j])
+        {
+          printf("bulk read: bit %d differs\n", j);
+          goto Failure;
+        }
+      if (bitfifo_used(fifo) != (size_t) modelused)
+      {
+        /* a dequeue: consume from the model too */
+        memmove(model, model + n, modelused - n);
+        modelused -= n;
+      }
+      break;
+
+    case 3: /* put */
+      err = bitfifo_put(fifo, bits, n);
+      if (modelused + n > NMODELBITS)
+      {
+        if (err != result_BITFIFO_FULL)
+          goto Failure;
+        break;
+      }
+      if (err)
+        goto Failure;
+      for (j = 0; j < n; j++)
+        model[modelused++] = (bits >> j) & 1;
+      break;
+
+    case 4: /* get or peek_bits */
+      err = (rand() & 1) ? bitfifo_peek_bits(fifo, n, &bits)
+                         : bitfifo_get(fifo, n, &bits);
+      if (n > modelused)
+      {
+        if (err != result_BITFIFO_INSUFFICIENT)
+          goto Failure;
+        break;
+      }
+      if (err)
+        goto Failure;
+      for (j = 0; j < n; j++)
+        if (((bits >> j) & 1) != model[j])
+        {
+          printf("get: bit %d differs\n", j);
+          goto Failure;
+        }
+      if (n < 64 && (bits >> n) != 0)
+      {
+        printf("get: bits beyond %d set\n", n);
+        goto Failure;
+      }
+      if (bitfifo_used(fifo) != (size_t) modelused)
+      {
+        memmove(model, model + n, modelused - n);
+        modelused -= n;
+      }
+      break;
+
+    case 5: /* skip */
+      err = bitfifo_skip(fifo, n);
+      if (n > modelused)
+      {
+        if (err != result_BITFIFO_INSUFFICIENT)
+          goto Failure;
+        break;
+      }
+      if (err)
+        goto Failure;
+      memmove(model, model + n, modelused - n);
+      modelused -= n;
+      break;
+    }
+
+    if (bitfifo_used(fifo) != (size_t) modelused ||
+        bitfifo_full(fifo) != (modelused == NMODELBITS) ||
+        bitfifo_empty(fifo) != (modelused == 0))
+    {
+      printf("op %d: used %zu, model %d\n", op, bitfifo_used(fifo), modelused);
+      goto Failure;
+    }
+  }
+
+  bitfifo_destroy(fifo);
+
+  return result_OK;
+
+
+Failure:
+
+  printf("model test failed at step %d\n", i);
+
+  bitfifo_destroy(fifo);
+
+  return result_TEST_FAILED;
+}
+
+/* report how fast symbols of various widths pass through the fifo */
+static result_t bitfifo_throughput_test(void)
+{
+  static const int widths[] = { 1, 8, 13, 32, 57 };
+
+  result_t   err;
+  bitfifo_t *fifo;
+  int        w;
+
+  printf("test: throughput\n");
+
+  fifo = bitfifo_create(4096);
+  if (fifo == NULL)
+    return result_OOM;
+
+  for (w = 0; w < (int) NELEMS(widths); w++)
+  {
+    int      width;
+    int      i;
+    int      j;
+    uint64_t sum;
+    uint64_t bits;
+    clock_t  start;
+    double   secs;
+
+    width = widths[w];
+    sum   = 0;
+
+    start = clock();
+    for (i = 0; i < NSYMBOLS; i += 64)
+    {
+      /* write a batch of symbols, then read them back */
+      for (j = 0; j < 64; j++)
+      {
+        err = bitfifo_put(fifo, (uint64_t) (i + j) * 0x9e3779b97f4a7c15ull, width);
+        if (err)
+          goto Failure;
+      }
+      for (j = 0; j < 64; j++)
+      {
+        err = bitfifo_get(fifo, width, &bits);
+        if (err)
+          goto Failure;
+        sum += bits;
+      }
+    }
+    secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    /* bytes written plus bytes read */
+    if (secs > 0.0)
+      printf("%2d-bit symbols: %.0f MB/s\n", width,
+             (double) NSYMBOLS * width / 8 * 2 / secs / 1e6);
+    else
+      printf("%2d-bit symbols: too fast to time\n", width);
+
+    NOT_USED(sum);
+  }
+
+  bitfifo_destroy(fifo);
+
+  return result_OK;
+
+
+Failure:
+
+  bitfifo_destroy(fifo);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+#define NSPSCSYMBOLS 4000000 /* symbols passed between threads */
+
+/* width and value of the n'th symbol of the test stream */
+#define SYMBOLWIDTH(n) (1 + (int) ((n) * 7 % BITFIFO_MAX_BITS))
+#define SYMBOLVALUE(n) ((uint64_t) (n) * 0x9e3779b97f4a7c15ull)
+
+static result_t spscbitfifo_basic_test(void)
+{
+  spscbitfifo_t *fifo;
+  unsigned int   words[3];
+  uint64_t       bits;
+
+  printf("test: spsc basics\n");
+
+  fifo = spscbitfifo_create(100);
+  if (fifo == NULL)
+    return result_OOM;
+
+  words[0] = 0x89abcdefu;
+  words[1] = 0x01234567u;
+  words[2] = 0;
+
+  if (spscbitfifo_get(fifo, 1, &bits) != result_BITFIFO_INSUFFICIENT ||
+      spscbitfifo_enqueue(fifo, words, 4, 60) != result_OK ||
+      spscbitfifo_put(fifo, 0x5, 3) != result_OK ||
+      spscbitfifo_put(fifo, 0, 38) != result_BITFIFO_FULL ||
+      spscbitfifo_used(fifo) != 63)
+    goto Failure;
+
+  if (spscbitfifo_peek_bits(fifo, 60, &bits) ||
+      bits != 0x0123456789abcdeull ||
+      spscbitfifo_skip(fifo, 28) ||
+      spscbitfifo_dequeue(fifo, words, 32) ||
+      words[0] != 0x01234567u ||
+      spscbitfifo_get(fifo, 3, &bits) ||
+      bits != 0x5 ||
+      spscbitfifo_used(fifo) != 0)
+    goto Failure;
+
+  spscbitfifo_destroy(fifo);
+
+  return result_OK;
+
+
+Failure:
+
+  printf("spsc basics failed\n");
+
+  spscbitfifo_destroy(fifo);
+
+  return result_TEST_FAILED;
+}
+
+#ifdef DPTLIB_THREADS
+
+static void *spsc_producer(void *arg)
+{
+  spscbitfifo_t *fifo = arg;
+  int            i;
+
+  for (i = 0; i < NSPSCSYMBOLS; i++)
+    while (spscbitfifo_put(fifo, SYMBOLVALUE(i), SYMBOLWIDTH(i)) ==
+           result_BITFIFO_FULL)
+      sched_yield();
+
+  return NULL;
+}
+
+/* a decoder thread produces symbols of varying width while the main thread
+ * consumes and checks them */
+static result_t spscbitfifo_threads_test(void)
+{
+  spscbitfifo_t   *fifo;
+  pthread_t        thread;
+  struct timespec  start, end;
+  double           secs;
+  double           nbytes;
+  int              nbad;
+  int              i;
+
+  printf("test: spsc two threads\n");
+
+  fifo = spscbitfifo_create(1 << 16);
+  if (fifo == NULL)
+    return result_OOM;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (pthread_create(&thread, NULL, spsc_producer, fifo) != 0)
+  {
+    spscbitfifo_destroy(fifo);
+    return result_TEST_FAILED;
+  }
+
+  nbad   = 0;
+  nbytes = 0;
+  for (i = 0; i < NSPSCSYMBOLS; i++)
+  {
+    int      width;
+    uint64_t bits;
+
+    width = SYMBOLWIDTH(i);
+    while (spscbitfifo_get(fifo, width, &bits) == result_BITFIFO_INSUFFICIENT)
+      sched_yield();
+
+    if (width < 64)
+      nbad += bits != (SYMBOLVALUE(i) & ((1ull << width) - 1));
+    else
+      nbad += bits != SYMBOLVALUE(i);
+
+    nbytes += width / 8.0;
+  }
+
+  pthread_join(thread, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  spscbitfifo_destroy(fifo);
+
+  if (nbad)
+  {
+    printf("%d symbols corrupted\n", nbad);
+    return result_TEST_FAILED;
+  }
+
+  secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  if (secs > 0.0)
+    printf("%d symbols in %.3fs: %.0f MB/s\n",
+           NSPSCSYMBOLS, secs, nbytes / secs / 1e6);
+
+  return result_OK;
+}
+
+#endif /* DPTLIB_THREADS */
+
+/* ----------------------------------------------------------------------- */
+
 result_t bitfifo_test(const char *resources)
 {
   const unsigned int all_ones = ~0;
@@ -139,6 +534,24 @@ result_t bitfifo_test(const char *resources)
 
   bitfifo_destroy(fifo);
 
+  err = bitfifo_model_test();
+  if (err)
+    goto Failure;
+
+  err = bitfifo_throughput_test();
+  if (err)
+    goto Failure;
+
+  err = spscbitfifo_basic_test();
+  if (err)
+    goto Failure;
+
+#ifdef DPTLIB_THREADS
+  err = spscbitfifo_threads_test();
+  if (err)
+    goto Failure;
+#endif
+
   return result_TEST_PASSED;
 
 
@@ -0,0 +1,23 @@
+/* and-into.c -- bit vectors */
+
+#include <string.h>
+
+#include "base/utils.h"
+#include "utils/barith.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+void bitvec_and_into(bitvec_t *a, const bitvec_t *b)
+{
+  unsigned int l;
+
+  l = MIN(a->length, b->length);
+
+  and_block(a->vec, a->vec, b->vec, l * BYTESPERWORD);
+
+  /* words of 'a' beyond the end of 'b' are ANDed with zero */
+  if (a->length > l)
+    memset(a->vec + l, 0, (a->length - l) * sizeof(*a->vec));
+}
@@ -0,0 +1,48 @@
+/* and-many.c -- bit vectors */
+
+#include <string.h>
+
+#include "base/result.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+result_t bitvec_and_many(bitvec_t *c, const bitvec_t *const *v, int n)
+{
+  result_t     err;
+  unsigned int l;
+  unsigned int i;
+  int          j;
+
+  if (n <= 0)
+    return result_BAD_ARG; /* the AND of nothing is all ones */
+
+  /* all set bits will be contained in the shortest input */
+  l = v[0]->length;
+  for (j = 1; j < n; j++)
+    if (v[j]->length < l)
+      l = v[j]->length;
+
+  err = bitvec_ensure(c, l);
+  if (err)
+    return err;
+
+  /* each output word depends only on the same input word so 'c' may also be
+   * one of the inputs */
+  for (i = 0; i < l; i++)
+  {
+    bitvec_T word;
+
+    word = v[0]->vec[i];
+    for (j = 1; j < n && word; j++)
+      word &= v[j]->vec[i];
+
+    c->vec[i] = word;
+  }
+
+  if (c->length > l)
+    memset(c->vec + l, 0, (c->length - l) * sizeof(*c->vec));
+
+  return result_OK;
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 
 #include "base/utils.h"
+#include "utils/barith.h"
 
 #include "datastruct/bitvec.h"
 
@@ -12,7 +13,6 @@ result_t bitvec_and(const bitvec_t *a, const bitvec_t *b, bitvec_t **c)
 {
   int       l;
   bitvec_t *v;
-  int       i;
 
   *c = NULL;
 
@@ -24,8 +24,7 @@ result_t bitvec_and(const bitvec_t *a, const bitvec_t *b, bitvec_t **c)
   if (v == NULL)
     return result_OOM;
 
-  for (i = 0; i < l; i++)
-    v->vec[i] = a->vec[i] & b->vec[i];
+  and_block(v->vec, a->vec, b->vec, l * BYTESPERWORD);
 
   *c = v;
 
@@ -7,12 +7,5 @@
 
 unsigned int bitvec_count(const bitvec_t *v)
 {
-  unsigned int c;
-  unsigned int i;
-
-  c = 0;
-  for (i = 0; i < v->length; i++)
-    c += bitvec_countbits(v->vec[i]);
-
-  return c;
+  return (unsigned int) countbits_block(v->vec, v->length * BYTESPERWORD);
 }
@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "base/utils.h"
+#include "utils/barith.h"
 
 #include "datastruct/bitvec.h"
 
@@ -53,9 +54,6 @@ int bitvec_eq(const bitvec_t *a, const bitvec_t *b)
 
   p = (al == l) ? b : a; /* pick the longer one */
 
-  for (; l < p->length; l++)
-    if (p->vec[l])
-      return 0; /* nonzero bits found - not equal */
-
-  return 1; /* all remaining words were zero - equal */
+  /* equal if all remaining words are zero */
+  return iszero_block(p->vec + l, (p->length - l) * BYTESPERWORD);
 }
@@ -26,6 +26,22 @@ struct bitvec
   bitvec_T     *vec;
 };
 
+/* Rank/select index. Set bits are counted per superblock of SUPERBITS bits,
+ * and the superblock holding every SELECTSAMPLE'th set bit is recorded. */
+
+#define SUPERBITS       512
+#define WORDSPERSUPER   (SUPERBITS >> LOG2BITSPERWORD)
+#define SELECTSAMPLE    512
+
+struct bitvecrank
+{
+  const bitvec_t *v;
+  unsigned int    nsuper;   /* number of superblocks */
+  unsigned int   *super;    /* set bits before each superblock, plus total */
+  unsigned int    nsamples;
+  unsigned int   *samples;  /* superblock holding set bit i*SELECTSAMPLE */
+};
+
 result_t bitvec_ensure(bitvec_t *v, unsigned int need);
 
 #endif /* DATASTRUCT_BITVEC_IMPL_H */
@@ -0,0 +1,21 @@
+/* intersects.c -- bit vectors */
+
+#include "base/utils.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+int bitvec_intersects(const bitvec_t *a, const bitvec_t *b)
+{
+  unsigned int l;
+  unsigned int i;
+
+  l = MIN(a->length, b->length);
+
+  for (i = 0; i < l; i++)
+    if (a->vec[i] & b->vec[i])
+      return 1;
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+/* is-subset.c -- bit vectors */
+
+#include "base/utils.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+int bitvec_is_subset(const bitvec_t *a, const bitvec_t *b)
+{
+  unsigned int l;
+  unsigned int i;
+
+  l = MIN(a->length, b->length);
+
+  for (i = 0; i < l; i++)
+    if (a->vec[i] & ~b->vec[i])
+      return 0; /* 'a' has a bit which 'b' lacks */
+
+  /* any remaining words of 'a' must be zero (see eq.c) */
+  for (; i < a->length; i++)
+    if (a->vec[i])
+      return 0;
+
+  return 1;
+}
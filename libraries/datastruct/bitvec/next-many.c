@@ -0,0 +1,51 @@
+/* next-many.c -- bit vectors */
+
+#include "utils/barith.h"
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+unsigned int bitvec_next_many(const bitvec_t *v,
+                              int             n,
+                              bitvec_index_t *indices,
+                              unsigned int    max)
+{
+  unsigned int hi;
+  unsigned int c;
+  bitvec_T     word;
+
+  if (max == 0)
+    return 0;
+
+  n++; /* first bit to consider */
+  if (n < 0)
+    n = 0; /* tolerate n < -1 */
+
+  hi = (unsigned int) n >> LOG2BITSPERWORD;
+  if (hi >= v->length)
+    return 0;
+
+  /* mask off the bits up to and including 'n' in the first word */
+  word = v->vec[hi] & ~((bitvec_1 << (n & WORDMASK)) - 1);
+
+  c = 0;
+  for (;;)
+  {
+    /* decode every set bit in the word, lowest first */
+    while (word)
+    {
+      indices[c++] = (hi << LOG2BITSPERWORD) + bitvec_ctz(word);
+      if (c == max)
+        return c;
+
+      word &= word - 1; /* clear the LSB */
+    }
+
+    if (++hi >= v->length)
+      break;
+
+    word = v->vec[hi];
+  }
+
+  return c;
+}
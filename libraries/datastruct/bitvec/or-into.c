@@ -0,0 +1,26 @@
+/* or-into.c -- bit vectors */
+
+#include "base/result.h"
+#include "utils/barith.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+result_t bitvec_or_into(bitvec_t *a, const bitvec_t *b)
+{
+  result_t     err;
+  unsigned int i;
+
+  /* skip the high zero words of 'b' so 'a' grows no more than necessary */
+  for (i = b->length; i > 0 && b->vec[i - 1] == 0; i--)
+    ;
+
+  err = bitvec_ensure(a, i);
+  if (err)
+    return err;
+
+  or_block(a->vec, a->vec, b->vec, i * BYTESPERWORD);
+
+  return result_OK;
+}
@@ -0,0 +1,46 @@
+/* or-many.c -- bit vectors */
+
+#include <string.h>
+
+#include "base/result.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+result_t bitvec_or_many(bitvec_t *c, const bitvec_t *const *v, int n)
+{
+  result_t     err;
+  unsigned int l;
+  unsigned int i;
+  int          j;
+
+  /* all set bits will be contained in the longest input */
+  l = 0;
+  for (j = 0; j < n; j++)
+    if (v[j]->length > l)
+      l = v[j]->length;
+
+  err = bitvec_ensure(c, l);
+  if (err)
+    return err;
+
+  /* each output word depends only on the same input word so 'c' may also be
+   * one of the inputs */
+  for (i = 0; i < l; i++)
+  {
+    bitvec_T word;
+
+    word = 0;
+    for (j = 0; j < n; j++)
+      if (i < v[j]->length)
+        word |= v[j]->vec[i];
+
+    c->vec[i] = word;
+  }
+
+  if (c->length > l)
+    memset(c->vec + l, 0, (c->length - l) * sizeof(*c->vec));
+
+  return result_OK;
+}
@@ -1,8 +1,10 @@
 /* or.c -- bit vectors */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "base/utils.h"
+#include "utils/barith.h"
 
 #include "datastruct/bitvec.h"
 
@@ -12,7 +14,6 @@ result_t bitvec_or(const bitvec_t *a, const bitvec_t *b, bitvec_t **c)
 {
   int             min, max;
   bitvec_t       *v;
-  int             i;
   const bitvec_t *longest;
 
   *c = NULL;
@@ -25,13 +26,11 @@ result_t bitvec_or(const bitvec_t *a, const bitvec_t *b, bitvec_t **c)
   if (v == NULL)
     return result_OOM;
 
-  for (i = 0; i < min; i++)
-    v->vec[i] = a->vec[i] | b->vec[i];
+  or_block(v->vec, a->vec, b->vec, min * BYTESPERWORD);
 
   longest = (a->length > b->length) ? a : b;
 
-  for (i = min; i < max; i++)
-    v->vec[i] = longest->vec[i];
+  memcpy(v->vec + min, longest->vec + min, (max - min) * BYTESPERWORD);
 
   *c = v;
 
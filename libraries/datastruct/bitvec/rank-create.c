@@ -0,0 +1,81 @@
+/* rank-create.c -- bit vectors */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "utils/barith.h"
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+result_t bitvec_rank_create(const bitvec_t *v, bitvecrank_t **new_rank)
+{
+  bitvecrank_t *r;
+  unsigned int  nsuper;
+  unsigned int  total;
+  unsigned int  i;
+  unsigned int  next;
+
+  *new_rank = NULL;
+
+  nsuper = (v->length + WORDSPERSUPER - 1) / WORDSPERSUPER;
+
+  r = malloc(sizeof(*r));
+  if (r == NULL)
+    return result_OOM;
+
+  r->v        = v;
+  r->nsuper   = nsuper;
+  r->super    = malloc((nsuper + 1) * sizeof(*r->super));
+  r->samples  = NULL;
+  r->nsamples = 0;
+  if (r->super == NULL)
+    goto Failure;
+
+  /* cumulative counts at the start of each superblock */
+  total = 0;
+  for (i = 0; i < nsuper; i++)
+  {
+    unsigned int nwords;
+
+    r->super[i] = total;
+
+    nwords = v->length - i * WORDSPERSUPER;
+    if (nwords > WORDSPERSUPER)
+      nwords = WORDSPERSUPER;
+
+    total += (unsigned int) countbits_block(v->vec + i * WORDSPERSUPER,
+                                            nwords * BYTESPERWORD);
+  }
+  r->super[nsuper] = total;
+
+  /* the superblock holding every SELECTSAMPLE'th set bit */
+  r->nsamples = (total + SELECTSAMPLE - 1) / SELECTSAMPLE;
+  if (r->nsamples > 0)
+  {
+    r->samples = malloc(r->nsamples * sizeof(*r->samples));
+    if (r->samples == NULL)
+      goto Failure;
+
+    next = 0;
+    for (i = 0; i < nsuper; i++)
+      while (next < r->nsamples && next * SELECTSAMPLE < r->super[i + 1])
+        r->samples[next++] = i;
+  }
+
+  *new_rank = r;
+
+  return result_OK;
+
+
+Failure:
+
+  bitvec_rank_destroy(r);
+
+  return result_OOM;
+}
@@ -0,0 +1,21 @@
+/* rank-destroy.c -- bit vectors */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+void bitvec_rank_destroy(bitvecrank_t *r)
+{
+  if (r == NULL)
+    return;
+
+  free(r->samples);
+  free(r->super);
+  free(r);
+}
@@ -0,0 +1,30 @@
+/* rank.c -- bit vectors */
+
+#include "utils/barith.h"
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+unsigned int bitvec_rank(const bitvecrank_t *r, bitvec_index_t bit)
+{
+  const bitvec_t *v = r->v;
+  unsigned int    word;
+  unsigned int    first;
+  unsigned int    c;
+
+  word = bit >> LOG2BITSPERWORD;
+  if (word >= v->length)
+    return r->super[r->nsuper]; /* beyond the end: every set bit */
+
+  /* count from the start of the superblock to the word holding 'bit', then
+   * the bits below 'bit' within that word */
+  first = word - word % WORDSPERSUPER;
+
+  c  = r->super[word / WORDSPERSUPER];
+  c += (unsigned int) countbits_block(v->vec + first,
+                                      (word - first) * BYTESPERWORD);
+  c += bitvec_countbits(v->vec[word] &
+                        ((bitvec_1 << (bit & WORDMASK)) - 1));
+
+  return c;
+}
@@ -0,0 +1,88 @@
+/* select.c -- bit vectors */
+
+#include "utils/barith.h"
+#include "datastruct/bitvec.h"
+
+#include "impl.h"
+
+/* Returns the index of the k'th lowest set bit of 'word'. */
+static unsigned int select_word(bitvec_T word, unsigned int k)
+{
+  unsigned int base;
+  unsigned int width;
+
+  /* narrow down by halves */
+  base = 0;
+  for (width = 1u << (LOG2BITSPERWORD - 1); width >= 8; width >>= 1)
+  {
+    bitvec_T     low;
+    unsigned int c;
+
+    low = word & ((bitvec_1 << width) - 1);
+    c   = bitvec_countbits(low);
+    if (k >= c)
+    {
+      k    -= c;
+      word >>= width;
+      base += width;
+    }
+    else
+    {
+      word = low;
+    }
+  }
+
+  /* at most eight bits remain */
+  while (k--)
+    word &= word - 1;
+
+  return base + bitvec_ctz(word);
+}
+
+int bitvec_select(const bitvecrank_t *r, unsigned int k)
+{
+  const bitvec_t *v = r->v;
+  unsigned int    lo;
+  unsigned int    hi;
+  unsigned int    i;
+  unsigned int    end;
+
+  if (k >= r->super[r->nsuper])
+    return -1; /* fewer than k+1 bits set */
+
+  /* the samples bracket the superblock holding the bit. find the last
+   * superblock whose starting count is <= k. */
+  lo = r->samples[k / SELECTSAMPLE];
+  hi = (k / SELECTSAMPLE + 1 < r->nsamples) ?
+        r->samples[k / SELECTSAMPLE + 1] : r->nsuper - 1;
+  while (lo < hi)
+  {
+    unsigned int mid;
+
+    mid = lo + (hi - lo + 1) / 2;
+    if (r->super[mid] <= k)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  k -= r->super[lo];
+
+  /* then walk the words of the superblock */
+  i   = lo * WORDSPERSUPER;
+  end = i + WORDSPERSUPER;
+  if (end > v->length)
+    end = v->length;
+  for (; i < end; i++)
+  {
+    unsigned int c;
+
+    c = bitvec_countbits(v->vec[i]);
+    if (k < c)
+      return (int) ((i << LOG2BITSPERWORD) + select_word(v->vec[i], k));
+
+    k -= c;
+  }
+
+  return -1; /* not reached */
+}
@@ -1,6 +1,8 @@
 
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 #ifdef FORTIFY
 #include "fortify/fortify.h"
@@ -14,6 +16,9 @@
 
 #define NBITS 97
 
+#define NBULKBITS  (1 << 20)  /* bits per vector in the throughput test */
+#define NBULKREPS  64         /* repetitions of each operation */
+
 static void dumpbits(bitvec_t *v)
 {
   unsigned int i;
@@ -23,6 +28,292 @@ static void dumpbits(bitvec_t *v)
   printf("\n");
 }
 
+/* fill a vector with pseudo-random bits */
+static result_t fill(bitvec_t *v, unsigned int nbits, unsigned int seed)
+{
+  result_t     err;
+  unsigned int i;
+
+  srand(seed);
+  for (i = 0; i < nbits; i++)
+    if (rand() & 1)
+    {
+      err = bitvec_set(v, i);
+      if (err)
+        return err;
+    }
+
+  return result_OK;
+}
+
+/* check the bulk operations against bit-at-a-time results, then report
+ * their throughput */
+static result_t bitvec_bulk_test(void)
+{
+  result_t      err;
+  bitvec_t     *v = NULL;
+  bitvec_t     *w = NULL;
+  bitvec_t     *x = NULL;
+  unsigned int  nbits;
+  unsigned int  i;
+  unsigned int  c;
+
+  printf("test: bulk operations\n");
+
+  /* odd lengths exercise the scalar tails of the vector kernels */
+  for (nbits = 1; nbits < 2000; nbits += 333)
+  {
+    v = bitvec_create(0);
+    w = bitvec_create(0);
+    if (v == NULL || w == NULL)
+      goto Failure;
+
+    err = fill(v, nbits, nbits);
+    if (!err)
+      err = fill(w, nbits + 100, nbits + 1);
+    if (err)
+      goto Failure;
+
+    c = 0;
+    for (i = 0; i < nbits; i++)
+      c += bitvec_get(v, i);
+    if (bitvec_count(v) != c)
+    {
+      printf("count: %u bits wrong: got %u, want %u\n",
+             nbits, bitvec_count(v), c);
+      goto Failure;
+    }
+
+    err = bitvec_and(v, w, &x);
+    if (err)
+      goto Failure;
+    for (i = 0; i < nbits + 100; i++)
+      if (bitvec_get(x, i) != (bitvec_get(v, i) && bitvec_get(w, i)))
+      {
+        printf("and: %u bits: bit %u wrong\n", nbits, i);
+        goto Failure;
+      }
+    bitvec_destroy(x);
+    x = NULL;
+
+    err = bitvec_or(v, w, &x);
+    if (err)
+      goto Failure;
+    for (i = 0; i < nbits + 100; i++)
+      if (bitvec_get(x, i) != (bitvec_get(v, i) || bitvec_get(w, i)))
+      {
+        printf("or: %u bits: bit %u wrong\n", nbits, i);
+        goto Failure;
+      }
+
+    if (bitvec_eq(x, w) != bitvec_is_subset(v, w))
+    {
+      printf("eq: %u bits: wrong result\n", nbits);
+      goto Failure;
+    }
+
+    bitvec_destroy(x);
+    bitvec_destroy(w);
+    bitvec_destroy(v);
+    x = w = v = NULL;
+  }
+
+  printf("test: throughput\n");
+
+  v = bitvec_create(0);
+  w = bitvec_create(0);
+  if (v == NULL || w == NULL)
+    goto Failure;
+
+  err = fill(v, NBULKBITS, 1);
+  if (!err)
+    err = fill(w, NBULKBITS, 2);
+  if (err)
+    goto Failure;
+
+  /* x starts as a copy of v so that eq has to scan the whole vector */
+  err = bitvec_or(v, v, &x);
+  if (err)
+    goto Failure;
+
+  {
+    static const char *names[] = { "eq", "count", "and", "or" };
+    int                op;
+    int                rep;
+    unsigned int       sink;
+
+    sink = 0;
+    for (op = 0; op < 4; op++)
+    {
+      clock_t start;
+      double  secs;
+
+      start = clock();
+      for (rep = 0; rep < NBULKREPS; rep++)
+      {
+        /* the in-place forms avoid timing the allocator */
+        switch (op)
+        {
+        case 0:
+          sink += bitvec_eq(v, x);
+          break;
+        case 1:
+          sink += bitvec_count(v);
+          break;
+        case 2:
+          bitvec_and_into(x, w);
+          break;
+        case 3:
+          err = bitvec_or_into(x, w);
+          break;
+        }
+        if (err)
+          goto Failure;
+      }
+      secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+      /* measured over the bytes of input read */
+      if (secs > 0.0)
+        printf("%-5s %6.2f GB/s\n", names[op],
+               (double) NBULKBITS / 8 * (op == 1 ? 1 : 2) * NBULKREPS /
+               secs / 1e9);
+      else
+        printf("%-5s too fast to time\n", names[op]);
+    }
+
+    NOT_USED(sink);
+  }
+
+  bitvec_destroy(x);
+  bitvec_destroy(w);
+  bitvec_destroy(v);
+
+  return result_OK;
+
+
+Failure:
+
+  bitvec_destroy(x);
+  bitvec_destroy(w);
+  bitvec_destroy(v);
+
+  return result_TEST_FAILED;
+}
+
+/* check batch extraction and rank/select against bitvec_next */
+static result_t bitvec_rank_test(void)
+{
+  static const int  spacings[] = { 1, 3, 97, 5000 };
+
+  result_t          err;
+  bitvec_t         *v    = NULL;
+  bitvecrank_t     *rank = NULL;
+  bitvec_index_t    batch[7];
+  int               s;
+
+  printf("test: next_many / rank / select\n");
+
+  for (s = 0; s < (int) NELEMS(spacings); s++)
+  {
+    unsigned int i;
+    unsigned int k;
+    unsigned int n;
+    int          next;
+    int          last;
+
+    v = bitvec_create(0);
+    if (v == NULL)
+      goto Failure;
+
+    /* bits set roughly every 'spacing' bits, with a long empty gap */
+    srand(s);
+    for (i = 0; i < 200000; i += 1 + rand() % spacings[s])
+    {
+      if (i >= 50000 && i < 120000)
+        continue;
+
+      err = bitvec_set(v, i);
+      if (err)
+        goto Failure;
+    }
+
+    err = bitvec_rank_create(v, &rank);
+    if (err)
+      goto Failure;
+
+    /* walk with bitvec_next and check everything else agrees */
+    k    = 0;
+    last = -1;
+    next = bitvec_next(v, -1);
+    for (;;)
+    {
+      int j;
+
+      n = bitvec_next_many(v, last, batch, NELEMS(batch));
+      if (n == 0)
+        break;
+
+      for (j = 0; j < (int) n; j++)
+      {
+        if ((int) batch[j] != next)
+        {
+          printf("next_many: got %u, want %d\n", batch[j], next);
+          goto Failure;
+        }
+
+        if (bitvec_rank(rank, batch[j]) != k ||
+            bitvec_rank(rank, batch[j] + 1) != k + 1)
+        {
+          printf("rank: bit %u wrong\n", batch[j]);
+          goto Failure;
+        }
+
+        if (bitvec_select(rank, k) != next)
+        {
+          printf("select: %u'th bit: got %d, want %d\n",
+                 k, bitvec_select(rank, k), next);
+          goto Failure;
+        }
+
+        k++;
+        next = bitvec_next(v, next);
+      }
+
+      last = batch[n - 1];
+    }
+
+    if (next != -1 || k != bitvec_count(v))
+    {
+      printf("next_many: stopped early\n");
+      goto Failure;
+    }
+
+    if (bitvec_select(rank, k) != -1 ||
+        bitvec_rank(rank, bitvec_length(v) + 1000) != k)
+    {
+      printf("rank/select: out of range wrong\n");
+      goto Failure;
+    }
+
+    printf("spacing %d: %u bits ok\n", spacings[s], k);
+
+    bitvec_rank_destroy(rank);
+    rank = NULL;
+    bitvec_destroy(v);
+    v = NULL;
+  }
+
+  return result_OK;
+
+
+Failure:
+
+  bitvec_rank_destroy(rank);
+  bitvec_destroy(v);
+
+  return result_TEST_FAILED;
+}
+
 result_t bitvec_test(const char *resources)
 {
   result_t  err;
@@ -228,6 +519,184 @@ result_t bitvec_test(const char *resources)
   bitvec_destroy(w);
   bitvec_destroy(v);
 
+  printf("test: and_into / or_into\n");
+
+  v = bitvec_create(0);
+  if (!v)
+    goto Failure;
+
+  w = bitvec_create(0);
+  if (!w)
+    goto Failure;
+
+  for (i = 0; i < NBITS; i += 3)
+  {
+    err = bitvec_set(v, i);
+    if (err)
+      goto Failure;
+  }
+
+  for (i = 0; i < NBITS / 2; i += 2)
+  {
+    err = bitvec_set(w, i);
+    if (err)
+      goto Failure;
+  }
+
+  bitvec_and_into(v, w);
+
+  /* multiples of six below NBITS / 2 survive */
+  for (i = 0; i < NBITS; i++)
+    if (bitvec_get(v, i) != (i % 6 == 0 && i < NBITS / 2))
+    {
+      printf("and_into: bit %d wrong\n", i);
+      goto Failure;
+    }
+
+  err = bitvec_set(w, 1000);
+  if (err)
+    goto Failure;
+
+  err = bitvec_or_into(v, w);
+  if (err)
+    goto Failure;
+
+  if (!bitvec_eq(v, w))
+  {
+    printf("or_into: result differs\n");
+    goto Failure;
+  }
+
+  bitvec_destroy(w);
+  bitvec_destroy(v);
+
+  printf("test: is_subset / intersects\n");
+
+  v = bitvec_create(0);
+  if (!v)
+    goto Failure;
+
+  w = bitvec_create(0);
+  if (!w)
+    goto Failure;
+
+  if (!bitvec_is_subset(v, w) || bitvec_intersects(v, w))
+  {
+    printf("empty vectors: wrong result\n");
+    goto Failure;
+  }
+
+  err = bitvec_set(v, 5);
+  if (!err)
+    err = bitvec_set(w, 5);
+  if (!err)
+    err = bitvec_set(w, 200);
+  if (err)
+    goto Failure;
+
+  if (!bitvec_is_subset(v, w) || bitvec_is_subset(w, v) ||
+      !bitvec_intersects(v, w))
+  {
+    printf("overlapping vectors: wrong result\n");
+    goto Failure;
+  }
+
+  /* a high bit set then cleared leaves zero words: still a subset */
+  err = bitvec_set(v, 500);
+  if (err)
+    goto Failure;
+
+  bitvec_clear(v, 500);
+  bitvec_clear(w, 5);
+
+  if (bitvec_is_subset(v, w) || bitvec_intersects(v, w))
+  {
+    printf("disjoint vectors: wrong result\n");
+    goto Failure;
+  }
+
+  bitvec_clear(v, 5);
+
+  if (!bitvec_is_subset(v, w))
+  {
+    printf("zero words: wrong result\n");
+    goto Failure;
+  }
+
+  bitvec_destroy(w);
+  bitvec_destroy(v);
+
+  printf("test: and_many / or_many\n");
+
+  {
+    bitvec_t       *vs[3];
+    const bitvec_t *cvs[3];
+    int             j;
+
+    for (j = 0; j < 3; j++)
+    {
+      vs[j] = bitvec_create(0);
+      if (!vs[j])
+        goto Failure;
+
+      cvs[j] = vs[j];
+
+      for (i = 0; i < NBITS * (j + 1); i += j + 2)
+      {
+        err = bitvec_set(vs[j], i);
+        if (err)
+          goto Failure;
+      }
+    }
+
+    x = bitvec_create(0);
+    if (!x)
+      goto Failure;
+
+    err = bitvec_and_many(x, cvs, 3);
+    if (err)
+      goto Failure;
+
+    for (i = 0; i < NBITS * 3; i++)
+      if (bitvec_get(x, i) != (i % 12 == 0 && i < NBITS))
+      {
+        printf("and_many: bit %d wrong\n", i);
+        goto Failure;
+      }
+
+    err = bitvec_or_many(x, cvs, 3);
+    if (err)
+      goto Failure;
+
+    for (i = 0; i < NBITS * 3; i++)
+      if (bitvec_get(x, i) != ((i % 2 == 0 && i < NBITS) ||
+                               (i % 3 == 0 && i < NBITS * 2) ||
+                               (i % 4 == 0 && i < NBITS * 3)))
+      {
+        printf("or_many: bit %d wrong\n", i);
+        goto Failure;
+      }
+
+    /* the output may be one of the inputs */
+    err = bitvec_and_many(vs[0], cvs, 3);
+    if (err)
+      goto Failure;
+
+    printf("and_many in place: %d bits set\n", bitvec_count(vs[0]));
+
+    bitvec_destroy(x);
+    for (j = 0; j < 3; j++)
+      bitvec_destroy(vs[j]);
+  }
+
+  err = bitvec_bulk_test();
+  if (err)
+    goto Failure;
+
+  err = bitvec_rank_test();
+  if (err)
+    goto Failure;
+
   return result_TEST_PASSED;
 
 
@@ -3,10 +3,20 @@
 #include <assert.h>
 #include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#ifndef __riscos
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "base/utils.h"
 #include "utils/barith.h"
 
 #include "datastruct/cache.h"
@@ -17,51 +27,105 @@
  * ------------
  * The cache is a single block of memory laid out like this:
  *
- * +--------+------+---------+-------------------------------------------+
- * | Header | Bins | Entries | Store                                     |
- * +--------+------+---------+-------------------------------------------+
+ * +--------+------+---------+------+----------------------------------+
+ * | Header | Bins | Entries | Maps | Store                            |
+ * +--------+------+---------+------+----------------------------------+
  *
  * - Header is a cache_t.
- * - Bins is an array of pointers to linked lists of entries, all of which
- *   hash to that bin.
+ * - Bins is an array of linked lists of entries, all of which hash to that
+ *   bin.
  *   The last + 1 hash bin is the complement of the earlier lists: a linked
  *   list of free entries (all the entries not linked from elsewhere).
- * - Entries are the items stored in the cache.
+ * - Entries are the items stored in the cache. Used entries are also
+ *   threaded onto one of up to four doubly linked queues, oldest at one end
+ *   and newest at the other, whose meaning depends on the replacement
+ *   policy (see below).
+ * - Maps are two bitmaps with a bit per granule of the store, marking the
+ *   first and last granules of each free block.
  * - Store is the actual stored data.
  *
+ * Store is handed out in granules of QUANTUM bytes. Free blocks carry a
+ * free_t header and a footer repeating their length. They're kept on
+ * segregated lists by size class, where class k holds blocks of 2^k up to
+ * 2^(k+1) - 1 granules, and a mask records which classes are non-empty.
+ * Allocation takes a block from the lowest class whose every block is big
+ * enough, found in constant time from the mask, then returns any excess to
+ * the lists. Releasing a block coalesces it with free neighbours: the maps
+ * show whether a neighbour is free and the footer on the left gives that
+ * neighbour's start. Neither allocation nor release depends on the number
+ * of free blocks, so put latency stays bounded as the store fragments.
+ *
  * Although entries and stored data could live as a single allocation within
  * the store I laid the cache out this way to get as much similar data as
  * possible into the store (to facilitate cache data sharing). The impact of
  * this is that there is a fixed pool of entries, which you can run out of,
  * just like you can run out of store space.
  *
+ * Links between entries, bins and free blocks are byte offsets from the
+ * start of the block rather than pointers. A cache is unlikely to exceed
+ * 2^32 bytes so offsets and lengths are 32-bit, which on 64-bit targets
+ * halves the size of an entry (56 bytes down to 28) and of a free block
+ * record. Define CACHE_LARGE to use size_t offsets for caches beyond that.
+ * Offset zero is the header so it can't be the offset of an entry or a free
+ * block: it serves as the null link.
+ *
  *
  * TODO
  * ----
- * On 64-bit targets the pointers in entry and free structures will gobble up
- * quite a bit of space. Given that the caches aren't likely to exceed 2^32
- * bytes (and the entries within will be aligned to a 8-byte boundary) we
- * could use 32-bit offsets at the cost of complicating the code. The length
- * values could similarly be reduced in line with the size of the cache.
- * (e.g. A 256K cache could survive using only 16-bit values for offsets,
- * instead of pointers, and lengths).
- *
- * cache_create and cache_construct are very similar - choose just one to
- * support.
+ * The length values could be reduced further in line with the size of the
+ * cache. (e.g. A 256K cache could survive using only 16-bit values for
+ * offsets and lengths).
  *
  *
  * References
  * ----------
- * See The Art of Computer Programming Vol.1 3rd ed. p440 "Liberation with
- * sorted list".
+ * See The Art of Computer Programming Vol.1 3rd ed. p441 "Boundary tag
+ * system", and "TLSF: a New Dynamic Memory Allocator for Real-Time Systems"
+ * (Masmano et al., 2004) for segregated fits with a class mask.
  *
  */
 
+/* Replacement policies
+ * --------------------
+ * LRU uses a single queue and moves an entry to its newest end on use.
+ *
+ * CLOCK uses a single queue as its clock face. A use sets the entry's
+ * reference bit. The hand is the oldest end: a referenced entry there has
+ * its bit cleared and is moved to the newest end (the hand advances past
+ * it), and the first unreferenced entry found is evicted.
+ *
+ * S3-FIFO (Yang et al., 2023) inserts new entries into a small FIFO holding
+ * around a tenth of the store. Entries used at least twice while there are
+ * promoted to the main FIFO when they reach its end, while the rest are
+ * evicted and their keys kept in a ghost queue. The main FIFO is a CLOCK
+ * with a two-bit use count. A put whose key is in the ghost queue goes
+ * straight to the main FIFO.
+ *
+ * ARC (Megiddo & Modha, 2003) keeps entries seen once (T1) apart from those
+ * seen more than once (T2). Keys evicted from each go into ghost queues B1
+ * and B2. A put hitting a ghost moves the target size of T1 towards the
+ * list which would have kept it. Our entries vary in size so the target and
+ * the list sizes are measured in bytes.
+ *
+ * Ghost entries are entries with no data. They live on the hash chains so
+ * that they can be found, but never satisfy cache_get. They're bounded in
+ * number by the number of resident entries, and are the first entries to
+ * be reclaimed when the pool of free entries runs dry.
+ *
+ * Pinned entries are taken off their queue, so no policy can choose them
+ * for eviction, and return to the newest end of it when the last pin goes.
+ * When only pinned entries remain, eviction has nothing to offer and a put
+ * which needs space fails.
+ */
+
 /* ----------------------------------------------------------------------- */
 
 /* Define to enable cache debugging and extended stats. */
 /* #define CACHE_DEBUG */
 
+/* Define to support caches of 4GiB and beyond. */
+/* #define CACHE_LARGE */
+
 /* Set to 1 to output slower, more advanced stats. */
 #define ADVANCED_STATS 1
 
@@ -70,66 +134,191 @@
 /* A type representing time within the cache. */
 typedef unsigned int cachetime_t;
 
+/* A byte offset from the start of the cache, or a length within it. */
+#ifdef CACHE_LARGE
+typedef size_t cacheoff_t;
+#define CACHEOFF_MAX SIZE_MAX
+#else
+typedef uint32_t cacheoff_t;
+#define CACHEOFF_MAX UINT32_MAX
+#endif
+
+/* The null offset. */
+#define NIL ((cacheoff_t) 0)
+
+/* Bytes needed for both bitmaps covering 'n' granules. */
+#define MAPBYTES(n) ((((n) + 31) / 32) * sizeof(uint32_t) * 2)
+
+#define MAP_SET(map, g)  ((map)[(g) >> 5] |=  (1u << ((g) & 31)))
+#define MAP_CLR(map, g)  ((map)[(g) >> 5] &= ~(1u << ((g) & 31)))
+#define MAP_TEST(map, g) (((map)[(g) >> 5] >> ((g) & 31)) & 1)
+
+/* The number of queues. */
+#define NQUEUES 4
+
+/* Identifies an initialised cache block. */
+#define CACHE_MAGIC 0x43545044 /* "DPTC" */
+
+/* The number of free block size classes. */
+#define NCLASSES 32
+
+/* Granularity of the store. Room for a free_t plus a footer. */
+#define QUANTUM (sizeof(free_t) + sizeof(cacheoff_t))
+
+/* The number of blocks to inspect in the class below the one where every
+ * block fits, before resorting to eviction. */
+#define MAXPROBES 4
+
+/* Queue indices for each policy. */
+enum
+{
+  Q_LRU     = 0,
+
+  Q_CLOCK   = 0,
+
+  Q_S3SMALL = 0,
+  Q_S3MAIN  = 1,
+  Q_S3GHOST = 2,
+
+  Q_ARCT1   = 0,
+  Q_ARCT2   = 1,
+  Q_ARCB1   = 2,
+  Q_ARCB2   = 3
+};
+
+/* A queue of entries. */
+typedef struct cachequeue
+{
+  cacheoff_t          oldest;       /* the end which is evicted first */
+  cacheoff_t          newest;       /* the end which is added to */
+  int                 count;        /* number of entries in the queue */
+  cacheoff_t          bytes;        /* total length of their stored data */
+}
+cachequeue_t;
+
 /* The cache itself. */
 struct cache
 {
+  uint32_t            magic;        /* CACHE_MAGIC once initialised */
+  uint32_t            checksum;     /* of the layout, see layout_checksum */
+  unsigned int        generation;   /* file backed: times opened */
+  int                 dirty;        /* file backed: open, or not closed
+                                       cleanly */
+  size_t              maplength;    /* file backed: length of the mapping,
+                                       otherwise zero */
+  int                 allocated;    /* made by cache_create */
+  cacheconfig_t       config;       /* configuration it was made with */
   cachetime_t         time;         /* a monotonic timer which is incremented
                                        on each operation */
   int                 nbins;        /* the number of hash bins */
-  struct cacheentry **bins;         /* pointer to array of linked list start
+  cacheoff_t         *bins;         /* pointer to array of linked list start
                                        entries (the final entry [nbins+1] is
                                        the free entry chain) */
   int                 nentries;     /* the number of entries */
   struct cacheentry  *entries;      /* pointer to array of entries */
-  struct free        *firstfree;    /* first free block within the cache */
+  cachequeue_t        queues[NQUEUES];
+  int                 nghosts;      /* number of ghost entries */
+  size_t              arctarget;    /* ARC: target size of T1, in bytes */
+  cacheoff_t          classes[NCLASSES]; /* free block lists by size */
+  uint32_t            classmask;    /* bit k set if classes[k] non-empty */
+  uint32_t           *freestart;    /* bitmap: granule starts a free block */
+  uint32_t           *freeend;      /* bitmap: granule ends a free block */
   size_t              storelength;  /* length (bytes) of storage memory
                                        block, excluding overheads */
   unsigned char      *store;        /* pointer to cache memory block */
+  size_t              storeused;    /* bytes used in store */
+  int                 usedentries;  /* number of resident entries */
+  int                 npinned;      /* number of pinned entries */
   struct
   {
-    int               hits;         /* number of cache hits */
-    int               misses;       /* number of cache misses */
-    int               evictions;    /* number of evictions */
+    unsigned long     hits;         /* number of cache hits */
+    unsigned long     misses;       /* number of cache misses */
+    unsigned long     evictions;    /* number of evictions */
+    size_t            hitbytes;     /* bytes returned by hits */
   }
   stats;
-#ifdef CACHE_DEBUG
-  struct
-  {
-    int               storeused;    /* bytes used in store */
-    int               usedentries;  /* number of used entries */
-  }
-  debug;
-#endif
+  struct cachelatency *latency;     /* sampled lookup times, or NULL */
 };
 
+/* Sampled lookup times. Allocated only while sampling so as not to crowd
+ * small caches. */
+typedef struct cachelatency
+{
+  unsigned int        interval;     /* time every Nth lookup */
+  unsigned int        countdown;    /* lookups until the next sample */
+  unsigned int        hits[CACHE_LATENCY_BUCKETS];
+  unsigned int        misses[CACHE_LATENCY_BUCKETS];
+}
+cachelatency_t;
+
 /* An entry stored within the cache. */
 /* Note: It should be 'struct entry' but that clashes with a definition in
  * <search.h>. */
 typedef struct cacheentry
 {
-  struct cacheentry *next;          /* linked list next pointer */
+  cacheoff_t         next;          /* linked list next link */
+  cacheoff_t         older;         /* queue: towards the oldest end */
+  cacheoff_t         newer;         /* queue: towards the newest end */
   cachekey_t         key;           /* the key to identify the entry */
-  void              *data;          /* pointer to data in the store */
-  size_t             length;        /* length in bytes of stored data */
-  cachetime_t        time;          /* time of last use */
+  cacheoff_t         data;          /* offset of data in the store, or NIL if
+                                       a ghost */
+  cacheoff_t         length;        /* length in bytes of stored data */
+  unsigned char      queue;         /* which queue the entry is on */
+  unsigned char      freq;          /* reference bit or use count */
+  unsigned short     pins;          /* number of pins held on the entry */
 }
 entry_t;
 
-/* A free block within the store. */
+/* A free block within the store. Its final cacheoff_t repeats 'length'. */
 typedef struct free
 {
-  struct free       *next;          /* linked list next pointer */
-  size_t             length;        /* length in bytes of the free block */
+  cacheoff_t         next;          /* size class list next link */
+  cacheoff_t         prev;          /* size class list previous link */
+  cacheoff_t         length;        /* length in bytes of the free block */
 }
 free_t;
 
 /* ----------------------------------------------------------------------- */
 
+/* convert offsets to pointers and back */
+
+static entry_t *entry_at(const cache_t *c, cacheoff_t off)
+{
+  return off ? (entry_t *) ((char *) c + off) : NULL;
+}
+
+static free_t *free_at(const cache_t *c, cacheoff_t off)
+{
+  return off ? (free_t *) ((char *) c + off) : NULL;
+}
+
+static cacheoff_t offset_of(const cache_t *c, const void *p)
+{
+  return p ? (cacheoff_t) ((const char *) p - (const char *) c) : NIL;
+}
+
+/* a monotonic time in nanoseconds, for sampling lookup latency. only
+ * differences are used so wrapping around is harmless. */
+static unsigned long now_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long) ts.tv_sec * 1000000000ul + (unsigned long) ts.tv_nsec;
+#else
+  return (unsigned long) (clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+/* ----------------------------------------------------------------------- */
+
 /* default configuration parameters */
 static const cacheconfig_t default_config =
 {
   .hash_chain_length   = 8,
-  .nentries_percentage = 20
+  .nentries_percentage = 20,
+  .policy              = cachepolicy_LRU
 };
 
 /* ----------------------------------------------------------------------- */
@@ -137,62 +326,98 @@ static const cacheconfig_t default_config =
 /* debug mode consistency check: walks all entries reachable from the bins to
  * ensure they're all accounted for */
 #ifdef CACHE_DEBUG
+static size_t granule(const cache_t *c, cacheoff_t off);
+static int size_class(size_t length);
+
 static void cache_check(cache_t *c, int nextra)
 {
   int      nentries;
   int      i;
   entry_t *e;
+  size_t   freebytes;
 
-  assert(c->debug.storeused >= 0);
-  assert(c->debug.storeused <= c->storelength);
-  assert(c->debug.usedentries >= 0);
-  assert(c->debug.usedentries <= c->nentries);
+  assert(c->storeused <= c->storelength);
+  assert(c->usedentries >= 0);
+  assert(c->usedentries <= c->nentries);
 
   /* walk all entries AND the free list chain */
   nentries = 0;
   for (i = 0; i < c->nbins + 1; i++)
-    for (e = c->bins[i]; e != NULL; e = e->next)
+    for (e = entry_at(c, c->bins[i]); e != NULL; e = entry_at(c, e->next))
       nentries++;
 
   assert(nentries == c->nentries + nextra);
+
+  /* walk the free lists: every block must be marked in the maps and be in
+   * the right class, and together with the used store they must account
+   * for all of the store */
+  freebytes = 0;
+  for (i = 0; i < NCLASSES; i++)
+  {
+    cacheoff_t off;
+
+    assert(((c->classmask >> i) & 1) == (c->classes[i] != NIL));
+
+    for (off = c->classes[i]; off != NIL; off = free_at(c, off)->next)
+    {
+      const free_t *f = free_at(c, off);
+
+      assert(size_class(f->length) == i);
+      assert(MAP_TEST(c->freestart, granule(c, off)));
+      assert(MAP_TEST(c->freeend, granule(c, off) + f->length / QUANTUM - 1));
+      freebytes += f->length;
+    }
+  }
+
+  assert(freebytes + c->storeused == c->storelength);
 }
 #else
 #define cache_check(c, nextra)
 #endif
 
-/* reset the stats */
-static void cache_reset_stats(cache_t *c)
+void cache_reset_stats(cache_t *c)
 {
+  assert(c != NULL);
+
+  if (c == NULL)
+    return;
+
   c->stats.hits      = 0;
   c->stats.misses    = 0;
   c->stats.evictions = 0;
+  c->stats.hitbytes  = 0;
+
+  if (c->latency)
+  {
+    memset(c->latency->hits,   0, sizeof(c->latency->hits));
+    memset(c->latency->misses, 0, sizeof(c->latency->misses));
+  }
 }
 
-result_t cache_create(const cacheconfig_t *config,
-                      size_t               length,
-                      cache_t            **new_cache)
+/* validate the configuration and work out where everything goes in a block
+ * of 'length' bytes. the block is then initialised by cache_init. */
+static result_t cache_layout(const cacheconfig_t *config,
+                             size_t               length,
+                             int                 *pnentries,
+                             int                 *pnbins,
+                             size_t              *pofstore,
+                             size_t              *pszstore)
 {
-  const size_t quantum = sizeof(free_t);
+  const size_t quantum = QUANTUM;
 
-  int      nentries;
-  int      nbins;
-  size_t   szheader;
-  size_t   ofbins;
-  size_t   szbins;
-  size_t   ofentries;
-  size_t   szentries;
-  size_t   ofstore;
-  size_t   szstore;
-  size_t   szcache;
-  cache_t *c;
+  int    nentries;
+  int    nbins;
+  size_t szheader;
+  size_t szbins;
+  size_t szentries;
+  size_t szmaps;
+  size_t ofstore;
+  size_t szstore;
 
-  /* validate arguments */
-  if (config == NULL)
-    config = &default_config; /* use default configuration if none specified */
   if (length < 512)
     return result_BAD_ARG;
-  if (new_cache == NULL)
-    return result_NULL_ARG;
+  if (length > CACHEOFF_MAX)
+    return result_TOO_BIG; /* offsets won't reach */
 
   /* validate the configuration values */
   if (config->hash_chain_length < 1)
@@ -200,12 +425,12 @@ result_t cache_create(const cacheconfig_t *config,
   /* 5..95% is the useful range, at a guess, for nentries */
   if (config->nentries_percentage < 5 || config->nentries_percentage > 95)
     return result_BAD_ARG;
-
-  *new_cache = NULL;
+  if (config->policy < cachepolicy_LRU || config->policy > cachepolicy_ARC)
+    return result_BAD_ARG;
 
   /* compute the number of entries to allocate based on the size of the cache
    * (and the user's configured value) */
-  nentries = (int)(length / sizeof(*c->entries) *
+  nentries = (int)(length / sizeof(entry_t) *
                    config->nentries_percentage / 100);
   if (nentries < 1)
     return result_BAD_ARG;
@@ -216,32 +441,102 @@ result_t cache_create(const cacheconfig_t *config,
   nbins = power2le(nentries / config->hash_chain_length);
 
   /* work out the block layout */
-  szheader  = sizeof(*c);
-  ofbins    = szheader;
-  szbins    = sizeof(*c->bins) * (nbins + 1);
-  ofentries = szheader + szbins;
-  szentries = sizeof(*c->entries) * nentries;
-  ofstore   = szheader + szbins + szentries;
+  szheader  = sizeof(cache_t);
+  szbins    = sizeof(cacheoff_t) * (nbins + 1);
+  szentries = sizeof(entry_t) * nentries;
+  szmaps    = MAPBYTES(length / quantum);
+  ofstore   = szheader + szbins + szentries + szmaps;
   /* align store to a free_t-friendly alignment */
   ofstore   = ((ofstore + quantum - 1) / quantum) * quantum;
+  if (ofstore + quantum > length)
+    return result_BAD_ARG; /* calculations didn't work */
   szstore   = length - ofstore;
-  /* round store to a multiple of free_t (otherwise risk putting a 8-byte
-   * free_t into a 4-byte spare block) */
+  /* round store to a multiple of the quantum (otherwise risk putting a
+   * free_t into a smaller spare block) */
   szstore   = (szstore / quantum) * quantum;
-  szcache   = ofstore + szstore;
 
-  if (szcache > length)
-    return result_BAD_ARG; /* calculations didn't work */
+  *pnentries = nentries;
+  *pnbins    = nbins;
+  *pofstore  = ofstore;
+  *pszstore  = szstore;
 
-  /* allocate the cache as a single block */
-  c = malloc(szcache);
-  if (c == NULL)
-    return result_OOM;
+  return result_OK;
+}
+
+/* set up the header of a block laid out by cache_layout */
+/* set up the pointers within a block laid out by cache_layout */
+static void cache_locate(cache_t *c,
+                         int      nentries,
+                         int      nbins,
+                         size_t   ofstore,
+                         size_t   szstore)
+{
+  size_t ngranules;
 
   /* work out structure locations */
-  c->bins    = (struct cacheentry **)((char *) c + ofbins);
-  c->entries =  (struct cacheentry *)((char *) c + ofentries);
-  c->store   =               (unsigned char *) c + ofstore;
+  c->bins      =       (cacheoff_t *)((char *) c + sizeof(*c));
+  c->entries   = (struct cacheentry *)((char *) c + sizeof(*c) +
+                                       sizeof(*c->bins) * (nbins + 1));
+  ngranules    = szstore / QUANTUM;
+  c->freestart =         (uint32_t *)(c->entries + nentries);
+  c->freeend   = c->freestart + MAPBYTES(ngranules) / 2 / sizeof(uint32_t);
+  c->store     =    (unsigned char *) c + ofstore;
+
+  c->latency   = NULL; /* sampling is off until asked for */
+}
+
+/* a checksum of everything which decides where things live in a block.
+ * a block whose checksum differs can't be reused. */
+static uint32_t layout_checksum(const cacheconfig_t *config,
+                                size_t               length,
+                                int                  nentries,
+                                int                  nbins,
+                                size_t               ofstore,
+                                size_t               szstore)
+{
+  size_t   values[10];
+  uint32_t h;
+  size_t   i;
+
+  values[0] = length;
+  values[1] = (size_t) nentries;
+  values[2] = (size_t) nbins;
+  values[3] = ofstore;
+  values[4] = szstore;
+  values[5] = (size_t) config->policy;
+  values[6] = sizeof(cache_t);
+  values[7] = sizeof(entry_t);
+  values[8] = QUANTUM;
+  values[9] = NCLASSES;
+
+  /* FNV-1a */
+  h = 0x811c9dc5u;
+  for (i = 0; i < sizeof(values); i++)
+  {
+    h ^= ((const unsigned char *) values)[i];
+    h *= 0x01000193u;
+  }
+
+  return h;
+}
+
+static void cache_init(cache_t             *c,
+                       const cacheconfig_t *config,
+                       size_t               length,
+                       int                  nentries,
+                       int                  nbins,
+                       size_t               ofstore,
+                       size_t               szstore)
+{
+  cache_locate(c, nentries, nbins, ofstore, szstore);
+
+  c->magic      = CACHE_MAGIC;
+  c->checksum   = layout_checksum(config, length, nentries, nbins, ofstore, szstore);
+  c->generation = 0;
+  c->dirty      = 0;
+  c->maplength  = 0;
+  c->allocated  = 0;
+  c->config     = *config;
 
   c->nbins    = nbins;
   c->nentries = nentries;
@@ -249,6 +544,38 @@ result_t cache_create(const cacheconfig_t *config,
   c->storelength = szstore;
 
   cache_empty(c);
+}
+
+result_t cache_create(const cacheconfig_t *config,
+                      size_t               length,
+                      cache_t            **new_cache)
+{
+  result_t err;
+  int      nentries;
+  int      nbins;
+  size_t   ofstore;
+  size_t   szstore;
+  cache_t *c;
+
+  /* validate arguments */
+  if (config == NULL)
+    config = &default_config; /* use default configuration if none specified */
+  if (new_cache == NULL)
+    return result_NULL_ARG;
+
+  *new_cache = NULL;
+
+  err = cache_layout(config, length, &nentries, &nbins, &ofstore, &szstore);
+  if (err)
+    return err;
+
+  /* allocate the cache as a single block */
+  c = malloc(ofstore + szstore);
+  if (c == NULL)
+    return result_OOM;
+
+  cache_init(c, config, length, nentries, nbins, ofstore, szstore);
+  c->allocated = 1;
 
   *new_cache = c;
 
@@ -257,332 +584,903 @@ result_t cache_create(const cacheconfig_t *config,
 
 void cache_destroy(cache_t *doomed)
 {
+  if (doomed == NULL)
+    return;
+
+  free(doomed->latency);
+  doomed->latency = NULL;
+
+#ifndef __riscos
+  if (doomed->maplength)
+  {
+    size_t maplength = doomed->maplength;
+
+    /* a clean close: the contents can be reused when next opened */
+    doomed->maplength = 0;
+    doomed->dirty     = 0;
+    msync(doomed, maplength, MS_SYNC);
+    munmap(doomed, maplength);
+    return;
+  }
+#endif
+
   free(doomed);
 }
 
+/* File backed caches
+ * ------------------
+ * The block is a shared mapping of the file. All links within the cache
+ * are offsets so the contents are valid wherever the file gets mapped and
+ * only the pointers in the header need setting up again.
+ *
+ * The header's checksum covers the layout. The dirty flag is set while the
+ * file is open and cleared by a clean close. An existing file is reused
+ * only if its magic and layout checksum match, it was closed cleanly and
+ * no entries were left pinned. Anything else is emptied, since its
+ * contents may have been caught mid-update.
+ */
+#ifndef __riscos
+result_t cache_open_file(const cacheconfig_t *config,
+                         const char          *filename,
+                         size_t               length,
+                         cache_t            **new_cache)
+{
+  result_t    err;
+  int         nentries;
+  int         nbins;
+  size_t      ofstore;
+  size_t      szstore;
+  int         fd;
+  struct stat st;
+  void       *block;
+  cache_t    *c;
+  uint32_t    checksum;
+  unsigned    generation;
+
+  if (config == NULL)
+    config = &default_config;
+  if (filename == NULL || new_cache == NULL)
+    return result_NULL_ARG;
+
+  *new_cache = NULL;
+
+  err = cache_layout(config, length, &nentries, &nbins, &ofstore, &szstore);
+  if (err)
+    return err;
+
+  fd = open(filename, O_RDWR | O_CREAT, 0666);
+  if (fd < 0)
+    return result_FOPEN_FAILED;
+
+  if (fstat(fd, &st) < 0)
+  {
+    err = result_FOPEN_FAILED;
+    goto Failure;
+  }
+
+  if ((size_t) st.st_size != length && ftruncate(fd, (off_t) length) < 0)
+  {
+    err = result_FOPEN_FAILED;
+    goto Failure;
+  }
+
+  block = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (block == MAP_FAILED)
+  {
+    err = result_OOM;
+    goto Failure;
+  }
+
+  close(fd); /* the mapping keeps the file */
+
+  c        = block;
+  checksum = layout_checksum(config, length, nentries, nbins, ofstore, szstore);
+
+  if ((size_t) st.st_size == length &&
+      c->magic    == CACHE_MAGIC &&
+      c->checksum == checksum &&
+      !c->dirty &&
+      c->npinned  == 0)
+  {
+    /* warm start: keep the contents */
+    cache_locate(c, nentries, nbins, ofstore, szstore);
+    generation = c->generation;
+  }
+  else
+  {
+    generation = (c->magic == CACHE_MAGIC) ? c->generation : 0;
+    cache_init(c, config, length, nentries, nbins, ofstore, szstore);
+  }
+
+  c->generation = generation + 1;
+  c->maplength  = length;
+  c->dirty      = 1;
+  msync(c, sizeof(*c), MS_SYNC); /* a crash from here on empties it */
+
+  cache_check(c, 0);
+
+  *new_cache = c;
+
+  return result_OK;
+
+
+Failure:
+
+  close(fd);
+
+  return err;
+}
+#else
+result_t cache_open_file(const cacheconfig_t *config,
+                         const char          *filename,
+                         size_t               length,
+                         cache_t            **new_cache)
+{
+  NOT_USED(config);
+  NOT_USED(filename);
+  NOT_USED(length);
+
+  if (new_cache)
+    *new_cache = NULL;
+
+  return result_NOT_SUPPORTED;
+}
+#endif
+
 result_t cache_construct(const cacheconfig_t *config,
                          void                *block,
                          size_t               length,
                          cache_t            **new_cache)
 {
-  const size_t quantum = sizeof(free_t);
-
+  result_t err;
   int      nentries;
   int      nbins;
-  size_t   szheader;
-  size_t   ofbins;
-  size_t   szbins;
-  size_t   ofentries;
-  size_t   szentries;
   size_t   ofstore;
   size_t   szstore;
-  size_t   szcache;
-  cache_t *c;
 
   /* validate arguments */
   if (config == NULL)
     config = &default_config; /* use default configuration if none specified */
   if (block == NULL || new_cache == NULL)
     return result_NULL_ARG;
-  if (length < 512)
-    return result_BAD_ARG;
-
-  /* validate the configuration values */
-  if (config->hash_chain_length < 1)
-    return result_BAD_ARG;
-  /* 5..95% is the useful range, at a guess, for nentries */
-  if (config->nentries_percentage < 5 || config->nentries_percentage > 95)
-    return result_BAD_ARG;
 
   *new_cache = NULL;
 
-  /* compute the number of entries to allocate based on the size of the cache
-   * (and the user's configured value) */
-  nentries = (int)(length / sizeof(*c->entries) *
-                   config->nentries_percentage / 100);
-  if (nentries < 1)
-    return result_BAD_ARG;
+  err = cache_layout(config, length, &nentries, &nbins, &ofstore, &szstore);
+  if (err)
+    return err;
 
-  /* calculate the number of hash bins using the number of entries and the
-   * user's desired average hash chain length. the result must be a power of
-   * two to match the hash function. */
-  nbins = power2le(nentries / config->hash_chain_length);
+  cache_init(block, config, length, nentries, nbins, ofstore, szstore);
 
-  /* work out the block layout */
-  szheader  = sizeof(*c);
-  ofbins    = szheader;
-  szbins    = sizeof(*c->bins) * (nbins + 1);
-  ofentries = szheader + szbins;
-  szentries = sizeof(*c->entries) * nentries;
-  ofstore   = szheader + szbins + szentries;
-  /* align store to a free_t-friendly alignment */
-  ofstore   = ((ofstore + quantum - 1) / quantum) * quantum;
-  szstore   = length - ofstore;
-  /* round store to a multiple of free_t (otherwise risk putting a 8-byte
-   * free_t into a 4-byte spare block) */
-  szstore   = (szstore / quantum) * quantum;
-  szcache   = szheader + szbins + szentries + szstore;
+  *new_cache = block;
+
+  return result_OK;
+}
+
+/* the granule index of a store offset */
+static size_t granule(const cache_t *c, cacheoff_t off)
+{
+  return (off - offset_of(c, c->store)) / QUANTUM;
+}
+
+/* the size class holding free blocks of 'length' bytes */
+static int size_class(size_t length)
+{
+  size_t n = length / QUANTUM;
+
+  if (n >> (NCLASSES - 1))
+    return NCLASSES - 1;
+
+  return 31 - clz_32((uint32_t) n);
+}
+
+/* the lowest size class in which every block holds 'length' bytes */
+static int fit_class(size_t length)
+{
+  size_t n = length / QUANTUM;
+
+  if (n <= 1)
+    return 0;
+  if ((n - 1) >> (NCLASSES - 1))
+    return NCLASSES;
+
+  return 32 - clz_32((uint32_t) (n - 1));
+}
+
+/* return a block to the free lists and mark it in the maps */
+static void freelist_insert(cache_t *c, cacheoff_t off, size_t length)
+{
+  free_t *f = free_at(c, off);
+  int     k = size_class(length);
+
+  f->length = (cacheoff_t) length;
+  f->prev   = NIL;
+  f->next   = c->classes[k];
+  if (f->next)
+    free_at(c, f->next)->prev = off;
+  c->classes[k] = off;
+  c->classmask |= 1u << k;
+
+  /* footer */
+  *(cacheoff_t *) ((char *) f + length - sizeof(cacheoff_t)) = f->length;
+
+  MAP_SET(c->freestart, granule(c, off));
+  MAP_SET(c->freeend,   granule(c, off) + length / QUANTUM - 1);
+}
+
+/* take a block off the free lists and unmark it */
+static void freelist_remove(cache_t *c, cacheoff_t off)
+{
+  free_t *f = free_at(c, off);
+  int     k = size_class(f->length);
+
+  if (f->prev)
+    free_at(c, f->prev)->next = f->next;
+  else if ((c->classes[k] = f->next) == NIL)
+    c->classmask &= ~(1u << k);
+
+  if (f->next)
+    free_at(c, f->next)->prev = f->prev;
+
+  MAP_CLR(c->freestart, granule(c, off));
+  MAP_CLR(c->freeend,   granule(c, off) + f->length / QUANTUM - 1);
+}
+
+/* shorten a free block from its end, keeping it listed where possible */
+static void freelist_shrink(cache_t *c, cacheoff_t off, size_t length)
+{
+  free_t *f = free_at(c, off);
+
+  if (size_class(length) != size_class(f->length))
+  {
+    freelist_remove(c, off);
+    freelist_insert(c, off, length);
+    return;
+  }
+
+  MAP_CLR(c->freeend, granule(c, off) + f->length / QUANTUM - 1);
+
+  f->length = (cacheoff_t) length;
+  *(cacheoff_t *) ((char *) f + length - sizeof(cacheoff_t)) = f->length;
+
+  MAP_SET(c->freeend, granule(c, off) + length / QUANTUM - 1);
+}
+
+/* find a free block of at least 'length' bytes, or NIL if there's none */
+static cacheoff_t freelist_find(cache_t *c, size_t length)
+{
+  int        k;
+  uint32_t   mask;
+  cacheoff_t off;
+  int        n;
+
+  /* any block in class 'k' or above will do */
+  k = fit_class(length);
+  if (k < NCLASSES)
+  {
+    mask = c->classmask & ~((1u << k) - 1);
+    if (mask)
+      return c->classes[ctz_32(mask)];
+  }
+
+  /* the class below may hold a big enough block */
+  k = size_class(length);
+  for (off = c->classes[k], n = 0; off && n < MAXPROBES; off = free_at(c, off)->next, n++)
+    if (free_at(c, off)->length >= length)
+      return off;
+
+  return NIL;
+}
+
+/* reset the cache */
+void cache_empty(cache_t *c)
+{
+  int    i;
+  size_t mapbytes;
+
+  assert(c);
+  assert(c->nbins    > 0 && c->nbins    < 100000); /* sanity check */
+  assert(c->nentries > 0 && c->nentries < 100000); /* sanity check */
+
+  c->time = 0;
+
+  /* empty the queues */
+  memset(c->queues, 0, sizeof(c->queues));
+  c->nghosts   = 0;
+  c->arctarget = 0;
+
+  /* empty all of the hash bins */
+  for (i = 0; i < c->nbins; i++)
+    c->bins[i] = NIL;
+
+  /* chain all of the entries together */
+  for (i = 0; i < c->nentries - 1; i++)
+  {
+    c->entries[i].next = offset_of(c, &c->entries[i + 1]);
+    c->entries[i].data = NIL;
+  }
+
+  /* terminate the final entry with a NIL */
+  c->entries[i].next = NIL;
+  c->entries[i].data = NIL;
+
+  /* point the final+1 hash bin to the chain */
+  c->bins[c->nbins] = offset_of(c, &c->entries[0]);
+
+  /* empty the free lists and the maps */
+  for (i = 0; i < NCLASSES; i++)
+    c->classes[i] = NIL;
+  c->classmask = 0;
+
+  mapbytes = MAPBYTES(c->storelength / QUANTUM);
+  memset(c->freestart, 0, mapbytes);
+
+  /* the as-yet unoccupied store becomes a single free block */
+  freelist_insert(c, offset_of(c, c->store), c->storelength);
+
+  c->storeused   = 0;
+  c->usedentries = 0;
+  c->npinned     = 0;
+
+  cache_check(c, 0);
+
+  /* reset statistics */
+  cache_reset_stats(c);
+}
+
+/* 0x9e3779b9 is the golden ratio in fixed point 1.31 format */
+#define HASH(i, nbins, key) \
+  do                        \
+  {                         \
+    i = key;                \
+    i ^= i >> 16;           \
+    i ^= i >> 8;            \
+    i *= 0x9e3779b9;        \
+    i &= nbins - 1;         \
+  }                         \
+  while (0)
+
+/* unlink an entry from its queue */
+static void queue_unlink(cache_t *c, entry_t *e)
+{
+  cachequeue_t *q = &c->queues[e->queue];
+
+  if (e->older)
+    entry_at(c, e->older)->newer = e->newer;
+  else
+    q->oldest = e->newer;
+
+  if (e->newer)
+    entry_at(c, e->newer)->older = e->older;
+  else
+    q->newest = e->older;
+
+  q->count--;
+  q->bytes -= e->length;
+}
+
+/* link an entry onto the newest end of a queue */
+static void queue_push(cache_t *c, entry_t *e, int queue)
+{
+  cachequeue_t *q = &c->queues[queue];
+  cacheoff_t    off = offset_of(c, e);
+
+  e->queue = (unsigned char) queue;
+  e->older = q->newest;
+  e->newer = NIL;
+
+  if (q->newest)
+    entry_at(c, q->newest)->newer = off;
+  else
+    q->oldest = off;
+
+  q->newest = off;
+
+  q->count++;
+  q->bytes += e->length;
+}
+
+/* move an entry to the newest end of a queue */
+static void queue_move(cache_t *c, entry_t *e, int queue)
+{
+  queue_unlink(c, e);
+  queue_push(c, e, queue);
+}
+
+/* find an entry which is resident (ghost false) or a ghost (ghost true) */
+static entry_t *lookup(cache_t *c, cachekey_t key, int ghost)
+{
+  int      i;
+  entry_t *e;
+
+  HASH(i, c->nbins, key);
+
+  for (e = entry_at(c, c->bins[i]); e != NULL; e = entry_at(c, e->next))
+    if (e->key == key && (e->data == NIL) == ghost)
+      break;
+
+  return e;
+}
+
+/* find a resident entry and record a use of it, or return NULL */
+static entry_t *use(cache_t *c, cachekey_t key)
+{
+  entry_t *e;
+
+  e = lookup(c, key, 0);
+  if (e == NULL)
+  {
+    c->stats.misses++;
+    return NULL;
+  }
+
+  c->time++;
+
+  c->stats.hits++;
+  c->stats.hitbytes += e->length;
+
+  if (e->pins)
+  {
+    /* off its queue: it'll rejoin at the newest end when unpinned */
+    if (c->config.policy == cachepolicy_ARC)
+      e->queue = Q_ARCT2;
+    return e;
+  }
+
+  switch (c->config.policy)
+  {
+  default:
+  case cachepolicy_LRU:
+    if (offset_of(c, e) != c->queues[Q_LRU].newest)
+      queue_move(c, e, Q_LRU);
+    break;
+
+  case cachepolicy_CLOCK:
+    e->freq = 1;
+    break;
+
+  case cachepolicy_S3FIFO:
+    if (e->freq < 3)
+      e->freq++;
+    break;
+
+  case cachepolicy_ARC:
+    queue_move(c, e, Q_ARCT2); /* seen more than once */
+    break;
+  }
+
+  return e;
+}
+
+/* as use, but time every Nth call when sampling is on */
+static entry_t *timed_use(cache_t *c, cachekey_t key)
+{
+  cachelatency_t *l = c->latency;
+  unsigned long   start;
+  entry_t        *e;
+  unsigned long   elapsed;
+  int             bucket;
+
+  if (l == NULL || --l->countdown > 0)
+    return use(c, key);
+
+  l->countdown = l->interval;
+
+  start   = now_ns();
+  e       = use(c, key);
+  elapsed = now_ns() - start;
+
+  /* bucket k holds times of 2^k ns up to 2^(k+1) - 1 ns */
+  if (elapsed > UINT32_MAX)
+    elapsed = UINT32_MAX;
+  bucket = (elapsed > 0) ? 31 - clz_32((uint32_t) elapsed) : 0;
+  if (bucket >= CACHE_LATENCY_BUCKETS)
+    bucket = CACHE_LATENCY_BUCKETS - 1;
+
+  if (e)
+    l->hits[bucket]++;
+  else
+    l->misses[bucket]++;
+
+  return e;
+}
+
+/* take a pin on an entry, removing it from eviction's reach */
+static void pin(cache_t *c, entry_t *e, cachepin_t *pinned)
+{
+  assert(e->data != NIL);
+
+  if (e->pins++ == 0)
+  {
+    queue_unlink(c, e);
+    c->npinned++;
+  }
+
+  assert(e->pins != 0); /* overflow */
+
+  *pinned = e;
+}
+
+void *cache_get(cache_t *c, cachekey_t key)
+{
+  entry_t *e;
+
+  assert(c);
+
+  if (c == NULL)
+    return NULL; /* no error return available here */
+
+  e = timed_use(c, key);
+
+  return e ? (char *) c + e->data : NULL;
+}
+
+void *cache_pin(cache_t *c, cachekey_t key, cachepin_t *pinned)
+{
+  entry_t *e;
+
+  assert(c);
+  assert(pinned);
+
+  if (c == NULL || pinned == NULL)
+    return NULL; /* no error return available here */
+
+  *pinned = NULL;
+
+  e = timed_use(c, key);
+  if (e == NULL)
+    return NULL;
+
+  pin(c, e, pinned);
+
+  return (char *) c + e->data;
+}
+
+void cache_unpin(cache_t *c, cachepin_t pinned)
+{
+  entry_t *e = pinned;
+
+  assert(c);
+  assert(e == NULL || e->pins > 0);
+
+  if (c == NULL || e == NULL)
+    return;
+
+  if (--e->pins == 0)
+  {
+    queue_push(c, e, e->queue);
+    c->npinned--;
+  }
 
-  if (szcache > length)
-    return result_BAD_ARG; /* calculations didn't work */
+  cache_check(c, 0);
+}
 
-  c = block;
+/* unlink the specified entry from its hash chain and return it to the free
+ * entries chain */
+static void unchain(cache_t *c, entry_t *e)
+{
+  int        entbin;
+  cacheoff_t off = offset_of(c, e);
 
-  /* work out structure locations */
-  c->bins    = (struct cacheentry **)((char *) c + ofbins);
-  c->entries =  (struct cacheentry *)((char *) c + ofentries);
-  c->store   =               (unsigned char *) c + ofstore;
+  HASH(entbin, c->nbins, e->key);
 
-  c->nbins    = nbins;
-  c->nentries = nentries;
+  /* unlink the entry from its chain */
+  if (c->bins[entbin] == off)
+  {
+    /* entry is at start of chain */
 
-  c->storelength = szstore;
+    c->bins[entbin] = e->next; /* unlink */
+  }
+  else
+  {
+    /* entry is later in the chain */
 
-  cache_empty(c);
+    entry_t *prev;
 
-  *new_cache = c;
+    /* find the entry that points to the entry to be removed */
+    for (prev = entry_at(c, c->bins[entbin]);
+         prev->next != off;
+         prev = entry_at(c, prev->next))
+      ;
 
-  return result_OK;
+    prev->next = e->next; /* unlink */
+  }
+
+  /* entry is now unlinked from its hash chain: link it into the free entries
+   * chain */
+  e->next = c->bins[c->nbins];
+  c->bins[c->nbins] = off;
 }
 
-/* reset the cache */
-void cache_empty(cache_t *c)
+/* return a store block to the free lists, coalescing it with any free
+ * neighbours */
+static void release_block(cache_t *c, cacheoff_t off, size_t length)
 {
-  int i;
+  size_t newlength; /* its size (gets adjusted) */
+  size_t g;         /* its first granule */
+  size_t ng;        /* its number of granules */
 
-  assert(c);
-  assert(c->nbins    > 0 && c->nbins    < 100000); /* sanity check */
-  assert(c->nentries > 0 && c->nentries < 100000); /* sanity check */
+  newlength = length;
 
-  c->time = 0;
+  assert(length >= QUANTUM);
 
-  /* empty all of the hash bins */
-  for (i = 0; i < c->nbins; i++)
-    c->bins[i] = NULL;
+  g  = granule(c, off);
+  ng = length / QUANTUM;
 
-  /* chain all of the entries together */
-  for (i = 0; i < c->nentries - 1; i++)
+  /* check upper bound */
+  if (g + ng < c->storelength / QUANTUM && MAP_TEST(c->freestart, g + ng))
+  {
+    /* a subsequent adjacent free block: absorb it */
+    cacheoff_t right = off + (cacheoff_t) length;
+
+    newlength += free_at(c, right)->length;
+    freelist_remove(c, right);
+  }
+
+  /* check lower bound */
+  if (g > 0 && MAP_TEST(c->freeend, g - 1))
   {
-    c->entries[i].next = &c->entries[i + 1];
-    c->entries[i].data = NULL;
+    /* a preceding adjacent free block: merge with it. its footer gives its
+     * length. */
+    cacheoff_t leftlength;
+
+    leftlength = *(cacheoff_t *) ((char *) c + off - sizeof(cacheoff_t));
+    off       -= leftlength;
+    newlength += leftlength;
+    freelist_remove(c, off);
   }
 
-  /* terminate the final entry with a NULL */
-  c->entries[i].next = NULL;
-  c->entries[i].data = NULL;
+  freelist_insert(c, off, newlength);
 
-  /* point the final+1 hash bin to the chain */
-  c->bins[c->nbins] = &c->entries[0];
+  c->storeused -= length;
+}
 
-  /* unused regions in the store become free list entries */
-  c->firstfree = (free_t *) &c->store[0];
+/* return the specified entry's store block to the free list */
+static void release_store(cache_t *c, entry_t *e)
+{
+  assert(c);
+  assert(e);
+  assert(e->data);
+  assert(e->pins == 0);
 
-  /* initialise the as-yet unoccupied store as a single free_t */
-  c->firstfree->next   = NULL;
-  c->firstfree->length = c->storelength;
+  release_block(c, e->data, e->length);
 
-#ifdef CACHE_DEBUG
-  /* reset debugging stats */
-  c->debug.storeused   = 0;
-  c->debug.usedentries = 0;
-#endif
+  c->usedentries--;
 
   cache_check(c, 0);
 
-  /* reset statistics */
-  cache_reset_stats(c);
+  e->data = NIL;
 }
 
-/* 0x9e3779b9 is the golden ratio in fixed point 1.31 format */
-#define HASH(i, nbins, key) \
-  do                        \
-  {                         \
-    i = key;                \
-    i ^= i >> 16;           \
-    i ^= i >> 8;            \
-    i *= 0x9e3779b9;        \
-    i &= nbins - 1;         \
-  }                         \
-  while (0)
-
-void *cache_get(cache_t *c, cachekey_t key)
+/* unlink the specified entry and remove its associated store block */
+static void purge(cache_t *c, entry_t *e)
 {
-  int      i;
-  entry_t *e;
+  queue_unlink(c, e);
+  release_store(c, e);
+  unchain(c, e);
 
-  assert(c);
+  cache_check(c, 0);
+}
 
-  if (c == NULL)
-    return NULL; /* no error return available here */
+/* forget a ghost entry */
+static void drop_ghost(cache_t *c, entry_t *e)
+{
+  assert(e->data == NIL);
 
-  HASH(i, c->nbins, key);
+  queue_unlink(c, e);
+  unchain(c, e);
 
-  for (e = c->bins[i]; e != NULL; e = e->next)
-    if (e->key == key)
-    {
-      e->time = c->time++;
-      c->stats.hits++;
-      return e->data;
-    }
+  c->nghosts--;
 
-  c->stats.misses++;
-  return NULL;
+  cache_check(c, 0);
 }
 
-/* unlink the specified entry and remove its associated store block */
-static void purge(cache_t *c, entry_t *purgeent, int entbin)
+/* the ghost to forget first, or NULL if there are none */
+static entry_t *oldest_ghost(cache_t *c)
 {
-  assert(c);
-  assert(purgeent);
-  assert(entbin >= 0 && entbin < c->nbins);
+  const cachequeue_t *b1, *b2;
 
-  /* unlink the entry from its chain */
-  if (c->bins[entbin] == purgeent)
-  {
-    /* entry is at start of chain */
+  if (c->nghosts == 0)
+    return NULL;
 
-    c->bins[entbin] = purgeent->next; /* unlink */
-  }
-  else
-  {
-    /* entry is later in the chain */
+  if (c->config.policy == cachepolicy_S3FIFO)
+    return entry_at(c, c->queues[Q_S3GHOST].oldest);
 
-    entry_t *e;
+  /* ARC: trim the longer ghost queue */
+  b1 = &c->queues[Q_ARCB1];
+  b2 = &c->queues[Q_ARCB2];
+  return entry_at(c, (b1->count >= b2->count) ? b1->oldest : b2->oldest);
+}
 
-    /* find the entry that points to the entry to be removed */
-    for (e = c->bins[entbin]; e->next != purgeent; e = e->next)
-      ;
+/* remove the specified entry's store block but remember its key */
+static void make_ghost(cache_t *c, entry_t *e, int queue)
+{
+  queue_unlink(c, e);
+  release_store(c, e);
 
-    e->next = purgeent->next; /* unlink */
-  }
+  e->length = 0;
+  e->freq   = 0;
+  queue_push(c, e, queue);
 
-  /* entry is now unlinked from its hash chain: link it into the free entries
-   * chain */
-  purgeent->next = c->bins[c->nbins];
-  c->bins[c->nbins] = purgeent;
+  c->nghosts++;
 
-  cache_check(c, 0);
+  /* keep no more ghosts than resident entries */
+  while (c->nghosts > c->queues[0].count + c->queues[1].count)
+    drop_ghost(c, oldest_ghost(c));
+}
 
-  /* free the store block */
-  {
-    free_t *free;      /* area to free */
-    size_t  length;    /* its size */
-    size_t  newlength; /* its size (gets adjusted) */
-    free_t *left, *right;
+/* evict an entry's data from the store, as chosen by the policy. returns
+ * zero if every resident entry is pinned. */
+static int evict(cache_t *c)
+{
+  entry_t      *e;
+  cachequeue_t *small;
+  cachequeue_t *t1;
 
-    assert(purgeent->length >= sizeof(*free));
+  assert(c);
 
-    free      = (free_t *) purgeent->data;
-    length    = purgeent->length;
-    newlength = length;
+  /* the resident entries which aren't pinned live on queues 0 and 1 */
+  if (c->queues[0].count + c->queues[1].count == 0)
+    return 0;
 
-    if (c->firstfree == NULL)
+  switch (c->config.policy)
+  {
+  default:
+  case cachepolicy_LRU:
+    e = entry_at(c, c->queues[Q_LRU].oldest);
+    assert(e != NULL);
+    purge(c, e);
+    break;
+
+  case cachepolicy_CLOCK:
+    /* advance the hand past referenced entries, clearing their bits */
+    while ((e = entry_at(c, c->queues[Q_CLOCK].oldest))->freq)
     {
-      /* if the cache is full then there's no free list */
-
-      free->next   = NULL;
-      free->length = newlength;
-
-      c->firstfree = free;
+      e->freq = 0;
+      queue_move(c, e, Q_CLOCK);
     }
-    else
-    {
-      /* move 'left' and 'right' until they straddle the free location */
-      for (left = (free_t *) &c->firstfree; (right = left->next) != NULL; left = right)
-        if (right > free)
-          break;
+    purge(c, e);
+    break;
 
-      /* check upper bound */
-      if (right != NULL && (char *) free + newlength == (char *) right)
+  case cachepolicy_S3FIFO:
+    small = &c->queues[Q_S3SMALL];
+    for (;;)
+    {
+      if (small->count > 0 &&
+          (small->bytes >= c->storelength / 10 ||
+           c->queues[Q_S3MAIN].count == 0))
       {
-        /* 'right' is a subsequent adjacent free block: absorb it */
-        newlength += right->length;
-        free->next = right->next;
+        e = entry_at(c, small->oldest);
+        if (e->freq > 1)
+        {
+          /* used again while on probation: promote */
+          e->freq = 0;
+          queue_move(c, e, Q_S3MAIN);
+          continue;
+        }
+
+        make_ghost(c, e, Q_S3GHOST);
+        break;
       }
       else
       {
-        /* subsequent allocated block, or nothing */
-        free->next = right;
+        e = entry_at(c, c->queues[Q_S3MAIN].oldest);
+        assert(e != NULL);
+        if (e->freq > 0)
+        {
+          e->freq--;
+          queue_move(c, e, Q_S3MAIN);
+          continue;
+        }
+
+        purge(c, e);
+        break;
       }
+    }
+    break;
 
-      /* check lower bound */
-      if (left != (free_t *) &c->firstfree &&
-          (char *) left + left->length == (char *) free)
-      {
-        /* 'left' is a preceding adjacent free block: merge with it */
-        left->length += newlength;
-        left->next    = free->next;
-      }
-      else
-      {
-        /* preceding allocated block, or nothing */
-        left->next   = free;
-        free->length = newlength;
-      }
+  case cachepolicy_ARC:
+    t1 = &c->queues[Q_ARCT1];
+    if (t1->count > 0 &&
+        (t1->bytes > c->arctarget || c->queues[Q_ARCT2].count == 0))
+      make_ghost(c, entry_at(c, t1->oldest), Q_ARCB1);
+    else
+      make_ghost(c, entry_at(c, c->queues[Q_ARCT2].oldest), Q_ARCB2);
+    break;
+  }
 
-      /* firstfree points to the lowest block */
-      if (free < c->firstfree)
-        c->firstfree = free;
-    }
+  c->stats.evictions++;
 
-    cache_check(c, 0);
+  return 1;
+}
 
-#ifdef CACHE_DEBUG
-    c->debug.storeused -= length;
-    c->debug.usedentries--;
-#endif
+/* take an entry from the free entries chain, evicting if there are none.
+ * returns NULL if every entry is pinned. */
+static entry_t *take_entry(cache_t *c)
+{
+  entry_t *entry;
+
+  while (c->bins[c->nbins] == NIL)
+  {
+    /* the free list is empty: forget a ghost or, failing that, evict */
+
+    entry = oldest_ghost(c);
+    if (entry)
+      drop_ghost(c, entry);
+    else if (!evict(c)) /* may leave a ghost behind, so loop */
+      return NULL;
+
+    cache_check(c, 0);
   }
 
-  cache_check(c, 0);
+  entry = entry_at(c, c->bins[c->nbins]);
+
+  /* unlink */
+  c->bins[c->nbins] = entry->next;
+
+  cache_check(c, -1);
+
+  return entry;
 }
 
-/* evict an entry */
-static entry_t *evict(cache_t *c)
+/* a put of 'key' found it as a ghost: forget the ghost and return the queue
+ * the new entry should join */
+static int ghost_hit(cache_t *c, entry_t *ghost, size_t length)
 {
-  entry_t     *evictee;
-  int          evicteebin;
-  unsigned int oldest;
-  int          i;
-
-  assert(c);
+  int    queue;
+  size_t nb1, nb2;
+  size_t delta;
 
-  evictee    = NULL;
-  evicteebin = -1;
-  oldest     = UINT_MAX;
+  queue = 0;
 
-  for (i = 0; i < c->nbins; i++)
+  switch (c->config.policy)
   {
-    entry_t *e;
-
-    e = c->bins[i];
-    if (e != NULL && e->time < oldest)
+  case cachepolicy_S3FIFO:
+    queue = Q_S3MAIN;
+    break;
+
+  case cachepolicy_ARC:
+    /* move the target towards the list which would have kept it */
+    nb1 = c->queues[Q_ARCB1].count;
+    nb2 = c->queues[Q_ARCB2].count;
+    if (ghost->queue == Q_ARCB1)
     {
-      evictee    = e;
-      evicteebin = i;
-      oldest     = e->time;
+      delta = length * ((nb2 > nb1) ? nb2 / nb1 : 1);
+      c->arctarget = (c->arctarget + delta < c->storelength) ?
+                     c->arctarget + delta : c->storelength;
     }
-  }
-
-  assert(evictee    != NULL);
-  assert(evicteebin != -1);
+    else
+    {
+      delta = length * ((nb1 > nb2) ? nb1 / nb2 : 1);
+      c->arctarget = (c->arctarget > delta) ? c->arctarget - delta : 0;
+    }
+    queue = Q_ARCT2;
+    break;
 
-  purge(c, evictee, evicteebin);
+  default:
+    break;
+  }
 
-  c->stats.evictions++;
+  drop_ghost(c, ghost);
 
-  return evictee;
+  return queue;
 }
 
-result_t cache_put(cache_t    *c,
-                   cachekey_t  key,
-                   void       *data,
-                   size_t      length,
-                   void      **inserted)
+/* insert an entry onto 'queue', or where the policy chooses if negative,
+ * pinning it if 'pinned' is non-NULL */
+static result_t put(cache_t    *c,
+                    cachekey_t  key,
+                    void       *data,
+                    size_t      length,
+                    int         queue,
+                    void      **inserted,
+                    cachepin_t *pinned)
 {
-  const size_t quantum = sizeof(free_t);
+  const size_t quantum = QUANTUM;
 
-  size_t  rounded_length;
-  void   *storeptr;
+  size_t   rounded_length;
+  void    *storeptr;
+  entry_t *ghost;
 
   assert(c    != NULL);
   assert(data != NULL);
@@ -595,9 +1493,11 @@ result_t cache_put(cache_t    *c,
 
   if (inserted)
     *inserted = NULL;
+  if (pinned)
+    *pinned = NULL;
 
-  /* round up the length to a multiple of free_t's length so that any gaps
-   * between blocks are no smaller than free_t. */
+  /* round up the length to a multiple of the quantum so that any gaps
+   * between blocks can hold a free_t and its footer. */
   rounded_length = ((length + quantum - 1) / quantum) * quantum;
   assert(rounded_length > 0);
 
@@ -606,50 +1506,54 @@ result_t cache_put(cache_t    *c,
 
   cache_check(c, 0);
 
+  /* the queue which new entries join. if the key was recently evicted then
+   * the policy may choose another. */
+  if (queue < 0)
+  {
+    queue = 0;
+    ghost = (c->nghosts > 0) ? lookup(c, key, 1) : NULL;
+    if (ghost)
+      queue = ghost_hit(c, ghost, rounded_length);
+  }
+
   {
-    free_t *left, *right;
+    cacheoff_t off;
+    size_t     blocklength;
 
     /* find a free block */
 
     /* If we can't find one of at least the size we need then evict and
-     * retry. This isn't great but ensures that we will eventually get a
-     * block of at least the right size. */
-    for (;;)
-    {
-      for (left = (free_t *) &c->firstfree; (right = left->next) != NULL; left = right)
-        if (right->length >= rounded_length)
-          break;
+     * retry. Eviction coalesces, so we will eventually get a block of at
+     * least the right size. */
+    while ((off = freelist_find(c, rounded_length)) == NIL)
+      if (!evict(c))
+        return result_CACHE_FULL;
 
-      if (right)
-        break;
-
-      (void) evict(c);
-    }
+    /* here free block 'off' is big enough */
 
-    /* here free block 'right' is big enough */
+    blocklength = free_at(c, off)->length;
 
-    assert(right->length > 0);
-    assert(right->length >= rounded_length);
-    assert(right->length <= c->storelength);
+    assert(blocklength > 0);
+    assert(blocklength >= rounded_length);
+    assert(blocklength <= c->storelength);
 
-    if (right->length > rounded_length)
+    if (blocklength > rounded_length)
     {
-      /* the free block is bigger than required: use the end of it */
-      right->length -= rounded_length;
-      storeptr = (char *) right + right->length;
+      /* the free block is bigger than required: use the end of it and
+       * leave the rest on the lists */
+      freelist_shrink(c, off, blocklength - rounded_length);
+      storeptr = (char *) c + off + blocklength - rounded_length;
     }
     else
     {
       /* the free block was exactly the right size: use it all */
-      left->next = right->next;
-      storeptr = right;
+      freelist_remove(c, off);
+      storeptr = (char *) c + off;
     }
 
     memcpy(storeptr, data, length);
 
-#ifdef CACHE_DEBUG
-    c->debug.storeused += rounded_length;
-#endif
+    c->storeused += rounded_length;
   }
 
   cache_check(c, 0);
@@ -661,63 +1565,168 @@ result_t cache_put(cache_t    *c,
     entry_t *entry;
     int      i;
 
-    if (c->bins[c->nbins] == NULL)
+    entry = take_entry(c);
+    if (entry == NULL)
     {
-      /* the free list is empty */
+      release_block(c, offset_of(c, storeptr), rounded_length);
+      return result_CACHE_FULL;
+    }
 
-      entry = evict(c);
+    /* insert entry at the start of the chain. eviction order is kept by the
+     * queues so the chain order doesn't matter, except that a newer entry
+     * for a duplicate key will be found first. */
 
-      /* the only freelist entry should be the freed entry after eviction */
-      assert(c->bins[c->nbins] == entry);
-      assert(entry->next == NULL);
+    HASH(i, c->nbins, key);
 
-      cache_check(c, 0);
-    }
-    else
-    {
-      entry = c->bins[c->nbins];
-    }
+    entry->next   = c->bins[i];
+    c->bins[i]    = offset_of(c, entry);
+
+    entry->key    = key;
+    entry->data   = offset_of(c, storeptr);
+    entry->length = (cacheoff_t) rounded_length;
+    entry->freq   = 0;
+    entry->pins   = 0;
 
-    /* unlink */
-    c->bins[c->nbins] = entry->next;
+    queue_push(c, entry, queue);
+    if (pinned)
+      pin(c, entry, pinned);
 
-    cache_check(c, -1);
+    c->time++;
 
-    /* append entry to the end of the chain */
+    c->usedentries++;
+  }
 
-    HASH(i, c->nbins, key);
+  cache_check(c, 0);
 
-    if (c->bins[i] == NULL)
-    {
-      /* an empty hash bin */
-      c->bins[i] = entry;
-    }
-    else
+  if (inserted)
+    *inserted = storeptr;
+
+  return result_OK;
+}
+
+result_t cache_put(cache_t    *c,
+                   cachekey_t  key,
+                   void       *data,
+                   size_t      length,
+                   void      **inserted)
+{
+  return put(c, key, data, length, -1, inserted, NULL);
+}
+
+result_t cache_put_pinned(cache_t    *c,
+                          cachekey_t  key,
+                          void       *data,
+                          size_t      length,
+                          void      **inserted,
+                          cachepin_t *pinned)
+{
+  assert(pinned);
+
+  if (pinned == NULL)
+    return result_NULL_ARG;
+
+  return put(c, key, data, length, -1, inserted, pinned);
+}
+
+/* the entry percentage which suits entries of the size seen so far */
+static int balanced_percentage(const cache_t *c)
+{
+  size_t mean;
+  size_t wanted;
+  int    percentage;
+
+  if (c->usedentries == 0)
+    return c->config.nentries_percentage; /* nothing to go on */
+
+  mean = c->storeused / c->usedentries;
+
+  /* each resident entry needs sizeof(entry_t) plus 'mean' bytes of store.
+   * the scan resistant policies may keep a ghost entry for each one. */
+  wanted = sizeof(entry_t);
+  if (c->config.policy == cachepolicy_S3FIFO || c->config.policy == cachepolicy_ARC)
+    wanted *= 2;
+
+  percentage = (int) (wanted * 100 / (wanted + mean));
+
+  return CLAMP(percentage, 5, 95);
+}
+
+result_t cache_resize(cache_t            **pcache,
+                      const cacheconfig_t *config,
+                      size_t               length)
+{
+  result_t      err;
+  cache_t      *old;
+  cacheconfig_t newconfig;
+  cache_t      *c;
+  int           samepolicy;
+  int           q;
+  entry_t      *e;
+
+  if (pcache == NULL || *pcache == NULL)
+    return result_NULL_ARG;
+
+  old = *pcache;
+
+  if (!old->allocated)
+    return result_NOT_SUPPORTED; /* we don't own the memory */
+  if (old->npinned > 0)
+    return result_CACHE_PINNED; /* pointers into it are held */
+
+  if (config)
+  {
+    newconfig = *config;
+  }
+  else
+  {
+    newconfig = old->config;
+    newconfig.nentries_percentage = balanced_percentage(old);
+  }
+
+  err = cache_create(&newconfig, length, &c);
+  if (err)
+    return err;
+
+  c->time  = old->time;
+  c->stats = old->stats; /* evictions made while moving count too */
+
+  /* move the resident entries across, oldest first so that the newest
+   * survive if the new cache is smaller. entries keep their queue unless
+   * the policy changed. ghosts are dropped. an entry too big for the new
+   * store is displaced like any other, so counts as an eviction. */
+  samepolicy = (c->config.policy == old->config.policy);
+  for (q = 1; q >= 0; q--)
+  {
+    for (e = entry_at(old, old->queues[q].oldest); e != NULL; e = entry_at(old, e->newer))
     {
-      /* insert at the end of the chain (so that we find older entries sooner
-       * when evicting) */
-      entry_t *entry2;
+      cachepin_t moved;
 
-      for (entry2 = c->bins[i]; entry2->next != NULL; entry2 = entry2->next)
-        ;
-      entry2->next = entry;
-    }
+      err = put(c, e->key, (char *) old + e->data, e->length,
+                samepolicy ? q : 0, NULL, &moved);
+      if (err == result_TOO_BIG)
+      {
+        c->stats.evictions++;
+        continue;
+      }
+      else if (err)
+      {
+        cache_destroy(c);
+        return err;
+      }
 
-    entry->next   = NULL;
-    entry->key    = key;
-    entry->data   = storeptr;
-    entry->length = rounded_length;
-    entry->time   = c->time++;
+      if (samepolicy)
+        moved->freq = e->freq;
 
-#ifdef CACHE_DEBUG
-    c->debug.usedentries++;
-#endif
+      cache_unpin(c, moved);
+    }
   }
 
-  cache_check(c, 0);
+  c->latency   = old->latency;
+  old->latency = NULL;
 
-  if (inserted)
-    *inserted = storeptr;
+  cache_destroy(old);
+
+  *pcache = c;
 
   return result_OK;
 }
@@ -749,22 +1758,23 @@ void cache_stats(cache_t *c, int reset)
   /* count the number of entries used */
   nentriesused = 0;
   for (i = 0; i < c->nbins; i++)
-    for (entry = c->bins[i]; entry != NULL; entry = entry->next)
-      nentriesused++;
+    for (entry = entry_at(c, c->bins[i]); entry != NULL; entry = entry_at(c, entry->next))
+      if (entry->data)
+        nentriesused++;
 
-  assert(nentriesused == c->debug.usedentries);
+  assert(nentriesused == c->usedentries);
 
   /* count the number of free entries */
   nfreeentries = 0;
-  for (entry = c->bins[c->nbins]; entry != NULL; entry = entry->next)
+  for (entry = entry_at(c, c->bins[c->nbins]); entry != NULL; entry = entry_at(c, entry->next))
     nfreeentries++;
 
-  assert(nfreeentries == c->nentries - c->debug.usedentries);
+  assert(nfreeentries == c->nentries - c->usedentries - c->nghosts);
 
-  mean = (double) c->debug.usedentries / c->nbins;
+  mean = (double) c->usedentries / c->nbins;
 
   printf("cache stats at time %d:\n"
-         "store used         = %d of %zu bytes (%zu%%)\n"
+         "store used         = %zu of %zu bytes (%zu%%)\n"
          "entries used       = %d of %d (%d%%) [%zu of %zu bytes @ %zu bytes each]\n"
          "hash bins used     = %d of %d (%d%%) [%zu of %zu bytes @ %zu bytes each]\n"
          "average hash chain = %.2f long\n"
@@ -772,14 +1782,14 @@ void cache_stats(cache_t *c, int reset)
 
          c->time,
 
-         c->debug.storeused,
+         c->storeused,
          c->storelength,
-         c->debug.storeused * 100 / c->storelength,
+         c->storeused * 100 / c->storelength,
 
-         c->debug.usedentries,
+         c->usedentries,
          c->nentries,
-         c->debug.usedentries * 100 / c->nentries,
-         c->debug.usedentries * sizeof(*c->entries),
+         c->usedentries * 100 / c->nentries,
+         c->usedentries * sizeof(*c->entries),
          c->nentries * sizeof(*c->entries),
          sizeof(*c->entries),
 
@@ -792,7 +1802,7 @@ void cache_stats(cache_t *c, int reset)
 
          mean,
 
-         (c->debug.usedentries > 0) ? (double) c->debug.storeused / c->debug.usedentries : 0.0);
+         (c->usedentries > 0) ? (double) c->storeused / c->usedentries : 0.0);
 
   if (ADVANCED_STATS)
   {
@@ -807,7 +1817,7 @@ void cache_stats(cache_t *c, int reset)
       double delta;
 
       len = 0;
-      for (entry = c->bins[i]; entry != NULL; entry = entry->next)
+      for (entry = entry_at(c, c->bins[i]); entry != NULL; entry = entry_at(c, entry->next))
         len++;
 
       delta = len - mean;
@@ -821,9 +1831,9 @@ void cache_stats(cache_t *c, int reset)
   }
 #endif
 
-  printf("hits               = %d\n"
-         "misses             = %d\n"
-         "evictions          = %d\n",
+  printf("hits               = %lu\n"
+         "misses             = %lu\n"
+         "evictions          = %lu\n",
          c->stats.hits,
          c->stats.misses,
          c->stats.evictions);
@@ -832,6 +1842,80 @@ void cache_stats(cache_t *c, int reset)
     cache_reset_stats(c);
 }
 
+void cache_get_stats(const cache_t *c, cachestats_t *stats)
+{
+  int        k;
+  cacheoff_t off;
+
+  assert(c     != NULL);
+  assert(stats != NULL);
+
+  if (c == NULL || stats == NULL)
+    return;
+
+  stats->hits         = c->stats.hits;
+  stats->misses       = c->stats.misses;
+  stats->evictions    = c->stats.evictions;
+  stats->hitbytes     = c->stats.hitbytes;
+
+  stats->storelength  = c->storelength;
+  stats->bytesstored  = c->storeused;
+
+  /* the largest free block is in the highest non-empty class */
+  stats->largestfree  = 0;
+  if (c->classmask)
+  {
+    k = 31 - clz_32(c->classmask);
+    for (off = c->classes[k]; off != NIL; off = free_at(c, off)->next)
+      if (free_at(c, off)->length > stats->largestfree)
+        stats->largestfree = free_at(c, off)->length;
+  }
+
+  stats->nentries     = c->nentries;
+  stats->nentriesused = c->usedentries;
+  stats->nghosts      = c->nghosts;
+  stats->npinned      = c->npinned;
+  stats->nbins        = c->nbins;
+
+  if (c->latency)
+  {
+    memcpy(stats->hitlatency,  c->latency->hits,   sizeof(stats->hitlatency));
+    memcpy(stats->misslatency, c->latency->misses, sizeof(stats->misslatency));
+  }
+  else
+  {
+    memset(stats->hitlatency,  0, sizeof(stats->hitlatency));
+    memset(stats->misslatency, 0, sizeof(stats->misslatency));
+  }
+}
+
+result_t cache_sample_latency(cache_t *c, unsigned int interval)
+{
+  assert(c != NULL);
+
+  if (c == NULL)
+    return result_NULL_ARG;
+
+  if (interval == 0)
+  {
+    free(c->latency);
+    c->latency = NULL;
+    return result_OK;
+  }
+
+  if (c->latency == NULL)
+  {
+    c->latency = calloc(1, sizeof(*c->latency));
+    if (c->latency == NULL)
+      return result_OOM;
+  }
+
+  c->latency->interval  = interval;
+  c->latency->countdown = interval;
+
+  return result_OK;
+}
+
 void cache_get_info(const cache_t *c, cacheinfo_t *info)
 {
   assert(c    != NULL);
@@ -840,5 +1924,6 @@ void cache_get_info(const cache_t *c, cacheinfo_t *info)
   if (c == NULL || info == NULL)
     return;
 
-  info->maxlength = c->storelength;
+  info->maxlength  = c->storelength;
+  info->generation = c->generation;
 }
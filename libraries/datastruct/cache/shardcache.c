@@ -0,0 +1,452 @@
+/* shardcache.c -- thread safe sharded cache */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "datastruct/cache.h"
+#include "datastruct/shardcache.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* Each shard is a complete cache_t with its own lock. Operations hash the
+ * key to choose a shard then call through to the cache with the lock held.
+ * Data is always handed out pinned so that it survives other threads'
+ * puts once the lock is dropped.
+ *
+ * Loads in progress are recorded on their shard. A thread which misses on
+ * a key which is already being loaded waits on the shard's condition
+ * variable for the load to finish rather than starting its own. The
+ * loader runs without the lock held. The record is freed by whichever of
+ * the loading thread and its waiters is last to finish with it.
+ */
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef DPTLIB_THREADS
+#define LOCK(s)   pthread_mutex_lock(&(s)->lock)
+#define UNLOCK(s) pthread_mutex_unlock(&(s)->lock)
+#else
+#define LOCK(s)
+#define UNLOCK(s)
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef DPTLIB_THREADS
+/* A load in progress. */
+typedef struct load
+{
+  struct load      *next;
+  cachekey_t        key;
+  int               nwaiters;     /* number of threads awaiting the result */
+  int               done;         /* set once 'err' is valid */
+  result_t          err;          /* result of the load */
+}
+load_t;
+#endif
+
+typedef struct shard
+{
+  cache_t          *cache;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_t   lock;
+  pthread_cond_t    loaded;       /* signalled when any load finishes */
+  load_t           *loads;        /* loads in progress */
+#endif
+}
+shard_t;
+
+struct shardcache
+{
+  int               nshards;      /* a power of two */
+  int               shift;        /* shift giving a shard index from a hash */
+  shard_t          *shards;
+};
+
+/* ----------------------------------------------------------------------- */
+
+/* choose a shard. uses the top bits of a multiplicative hash so that the
+ * choice is independent of the bin chosen within the shard's cache. */
+static int shard_of(const shardcache_t *c, cachekey_t key)
+{
+  uint32_t h;
+
+  if (c->nshards == 1)
+    return 0;
+
+  h = (uint32_t) key * 0x85ebca6bu;
+  return (int) (h >> c->shift);
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t shardcache_create(const cacheconfig_t *config,
+                           size_t               length,
+                           int                  nshards,
+                           shardcache_t       **new_cache)
+{
+  result_t      err;
+  shardcache_t *c;
+  int           n;
+  int           shift;
+  int           i;
+
+  if (new_cache == NULL)
+    return result_NULL_ARG;
+
+  *new_cache = NULL;
+
+  if (nshards <= 0 || nshards > 65536)
+    return result_BAD_ARG;
+
+  /* round up to a power of two */
+  for (n = 1, shift = 32; n < nshards; n <<= 1)
+    shift--;
+
+  c = malloc(sizeof(*c));
+  if (c == NULL)
+    return result_OOM;
+
+  c->nshards = n;
+  c->shift   = shift;
+  c->shards  = calloc(n, sizeof(*c->shards));
+  if (c->shards == NULL)
+  {
+    free(c);
+    return result_OOM;
+  }
+
+  for (i = 0; i < n; i++)
+  {
+    shard_t *s = &c->shards[i];
+
+    err = cache_create(config, length / n, &s->cache);
+    if (err)
+      goto Failure;
+
+#ifdef DPTLIB_THREADS
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->loaded, NULL);
+    s->loads = NULL;
+#endif
+  }
+
+  *new_cache = c;
+
+  return result_OK;
+
+
+Failure:
+
+  /* only shards before 'i' were set up */
+  c->nshards = i;
+  shardcache_destroy(c);
+
+  return err;
+}
+
+void shardcache_destroy(shardcache_t *doomed)
+{
+  int i;
+
+  if (doomed == NULL)
+    return;
+
+  for (i = 0; i < doomed->nshards; i++)
+  {
+    shard_t *s = &doomed->shards[i];
+
+#ifdef DPTLIB_THREADS
+    assert(s->loads == NULL);
+
+    pthread_cond_destroy(&s->loaded);
+    pthread_mutex_destroy(&s->lock);
+#endif
+    cache_destroy(s->cache);
+  }
+
+  free(doomed->shards);
+  free(doomed);
+}
+
+void *shardcache_get(shardcache_t    *c,
+                     cachekey_t       key,
+                     shardcachepin_t *pinned)
+{
+  shard_t *s;
+  void    *data;
+
+  assert(c);
+  assert(pinned);
+
+  if (c == NULL || pinned == NULL)
+    return NULL; /* no error return available here */
+
+  pinned->shard = shard_of(c, key);
+  s = &c->shards[pinned->shard];
+
+  LOCK(s);
+  data = cache_pin(s->cache, key, &pinned->pin);
+  UNLOCK(s);
+
+  return data;
+}
+
+result_t shardcache_put(shardcache_t    *c,
+                        cachekey_t       key,
+                        void            *data,
+                        size_t           length,
+                        void           **inserted,
+                        shardcachepin_t *pinned)
+{
+  result_t err;
+  shard_t *s;
+
+  assert(c);
+  assert((inserted == NULL) == (pinned == NULL));
+
+  if (c == NULL)
+    return result_NULL_ARG;
+  if ((inserted == NULL) != (pinned == NULL))
+    return result_BAD_ARG;
+
+  s = &c->shards[shard_of(c, key)];
+
+  LOCK(s);
+  if (pinned)
+  {
+    pinned->shard = shard_of(c, key);
+    err = cache_put_pinned(s->cache, key, data, length, inserted, &pinned->pin);
+  }
+  else
+  {
+    err = cache_put(s->cache, key, data, length, NULL);
+  }
+  UNLOCK(s);
+
+  return err;
+}
+
+result_t shardcache_get_or_load(shardcache_t        *c,
+                                cachekey_t           key,
+                                shardcache_loader_t *loader,
+                                void                *opaque,
+                                void               **data,
+                                shardcachepin_t     *pinned)
+{
+  result_t err;
+  int      i;
+  shard_t *s;
+  void    *found;
+  void    *loaded;
+  size_t   length;
+#ifdef DPTLIB_THREADS
+  load_t  *l;
+  load_t **pl;
+#endif
+
+  assert(c);
+  assert(loader);
+  assert(data);
+  assert(pinned);
+
+  if (c == NULL || loader == NULL || data == NULL || pinned == NULL)
+    return result_NULL_ARG;
+
+  *data = NULL;
+
+  i = shard_of(c, key);
+  s = &c->shards[i];
+
+  pinned->shard = i;
+
+  LOCK(s);
+
+#ifdef DPTLIB_THREADS
+  for (;;)
+  {
+    found = cache_pin(s->cache, key, &pinned->pin);
+    if (found)
+      break;
+
+    for (l = s->loads; l != NULL; l = l->next)
+      if (l->key == key)
+        break;
+
+    if (l == NULL)
+      break; /* nobody is loading it: we will */
+
+    /* another thread is loading this key: wait for it to finish */
+    l->nwaiters++;
+    while (!l->done)
+      pthread_cond_wait(&s->loaded, &s->lock);
+    err = l->err;
+    if (--l->nwaiters == 0)
+      free(l);
+
+    if (err)
+    {
+      UNLOCK(s);
+      return err;
+    }
+
+    /* the data was inserted: loop around to pin it. it may have been evicted
+     * already in which case we'll load it ourselves. */
+  }
+#else
+  found = cache_pin(s->cache, key, &pinned->pin);
+#endif
+
+  if (found)
+  {
+    UNLOCK(s);
+    *data = found;
+    return result_OK;
+  }
+
+#ifdef DPTLIB_THREADS
+  l = malloc(sizeof(*l));
+  if (l == NULL)
+  {
+    UNLOCK(s);
+    return result_OOM;
+  }
+
+  l->key      = key;
+  l->nwaiters = 0;
+  l->done     = 0;
+  l->err      = result_OK;
+  l->next     = s->loads;
+  s->loads    = l;
+#endif
+
+  UNLOCK(s);
+
+  loaded = NULL;
+  err = loader(key, opaque, &loaded, &length);
+
+  LOCK(s);
+
+  if (!err)
+    err = cache_put_pinned(s->cache, key, loaded, length, data, &pinned->pin);
+
+#ifdef DPTLIB_THREADS
+  /* retire the load, waking any waiters */
+  for (pl = &s->loads; *pl != l; pl = &(*pl)->next)
+    ;
+  *pl = l->next;
+
+  l->done = 1;
+  l->err  = err;
+  if (l->nwaiters > 0)
+    pthread_cond_broadcast(&s->loaded);
+  else
+    free(l);
+#endif
+
+  UNLOCK(s);
+
+  free(loaded);
+
+  return err;
+}
+
+void shardcache_release(shardcache_t *c, const shardcachepin_t *pinned)
+{
+  shard_t *s;
+
+  assert(c);
+  assert(pinned);
+
+  if (c == NULL || pinned == NULL)
+    return;
+
+  assert(pinned->shard >= 0 && pinned->shard < c->nshards);
+
+  s = &c->shards[pinned->shard];
+
+  LOCK(s);
+  cache_unpin(s->cache, pinned->pin);
+  UNLOCK(s);
+}
+
+void shardcache_get_stats(shardcache_t *c, cachestats_t *stats)
+{
+  int i;
+  int k;
+
+  assert(c);
+  assert(stats);
+
+  if (c == NULL || stats == NULL)
+    return;
+
+  memset(stats, 0, sizeof(*stats));
+
+  for (i = 0; i < c->nshards; i++)
+  {
+    shard_t     *s = &c->shards[i];
+    cachestats_t one;
+
+    LOCK(s);
+    cache_get_stats(s->cache, &one);
+    UNLOCK(s);
+
+    stats->hits         += one.hits;
+    stats->misses       += one.misses;
+    stats->evictions    += one.evictions;
+    stats->hitbytes     += one.hitbytes;
+    stats->storelength  += one.storelength;
+    stats->bytesstored  += one.bytesstored;
+    if (one.largestfree > stats->largestfree)
+      stats->largestfree = one.largestfree;
+    stats->nentries     += one.nentries;
+    stats->nentriesused += one.nentriesused;
+    stats->nghosts      += one.nghosts;
+    stats->npinned      += one.npinned;
+    stats->nbins        += one.nbins;
+
+    for (k = 0; k < CACHE_LATENCY_BUCKETS; k++)
+    {
+      stats->hitlatency[k]  += one.hitlatency[k];
+      stats->misslatency[k] += one.misslatency[k];
+    }
+  }
+}
+
+result_t shardcache_sample_latency(shardcache_t *c, unsigned int interval)
+{
+  result_t err;
+  int      i;
+
+  assert(c);
+
+  if (c == NULL)
+    return result_NULL_ARG;
+
+  for (i = 0; i < c->nshards; i++)
+  {
+    shard_t *s = &c->shards[i];
+
+    LOCK(s);
+    err = cache_sample_latency(s->cache, interval);
+    UNLOCK(s);
+
+    if (err)
+      return err;
+  }
+
+  return result_OK;
+}
@@ -4,6 +4,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #ifdef FORTIFY
 #include "fortify/fortify.h"
 #endif
@@ -11,6 +16,7 @@
 #include "base/result.h"
 #include "base/utils.h"
 #include "datastruct/cache.h"
+#include "datastruct/shardcache.h"
 
 #include "test/all-tests.h"
 
@@ -18,6 +24,17 @@ static int cache_test_outer(const cacheconfig_t *config,
                             size_t               length,
                             int                  maxkey);
 static int cache_test_put(cache_t *cache, int maxkey);
+static result_t cache_test_lru(void);
+static result_t cache_test_pin(void);
+static result_t cache_test_stats(void);
+static result_t cache_test_resize(void);
+#ifndef __riscos
+static result_t cache_test_file(void);
+#endif
+static result_t cache_test_sharded(void);
+static result_t cache_test_replay(void);
+
+static const char *policy_names[] = { "LRU", "CLOCK", "S3-FIFO", "ARC" };
 
 result_t cache_test(const char *resources)
 {
@@ -30,6 +47,7 @@ result_t cache_test(const char *resources)
 
   config.hash_chain_length   = 4;
   config.nentries_percentage = 25;
+  config.policy              = cachepolicy_LRU;
 
 #define MINLEN 512
 #define MAXLEN 1536
@@ -37,12 +55,16 @@ result_t cache_test(const char *resources)
 
   nfailures = 0;
   srand(0x060708aa);
-  for (i = 0; i < 10; i++)
+  for (i = 0; i < 12; i++)
   {
     size_t   length;
 
+    /* cycle through the policies */
+    config.policy = (cachepolicy_t) (i % NELEMS(policy_names));
+
     length = MINLEN + rand() / (RAND_MAX / (MAXLEN - MINLEN + 1) + 1);
-    printf("test: cache with length %zu\n", length);
+    printf("test: %s cache with length %zu\n",
+           policy_names[config.policy], length);
     err = cache_test_outer(&config, length, MAXKEY);
     if (err != result_TEST_PASSED)
     {
@@ -51,6 +73,57 @@ result_t cache_test(const char *resources)
     }
   }
 
+  err = cache_test_lru();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
+  err = cache_test_replay();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
+  err = cache_test_pin();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
+  err = cache_test_stats();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
+  err = cache_test_resize();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
+#ifndef __riscos
+  err = cache_test_file();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+#endif
+
+  err = cache_test_sharded();
+  if (err != result_TEST_PASSED)
+  {
+    printf("\n\n*** Error %x\n", err);
+    nfailures++;
+  }
+
   printf("\n");
 
   printf("cache: %d failure(s)\n", nfailures);
@@ -220,3 +293,951 @@ static result_t cache_test_put(cache_t *cache, int maxkey)
 
   return result_TEST_PASSED;
 }
+
+/* Keep touching key 0 while filling the cache: it must survive every
+ * eviction, while the untouched key 1 must go. */
+static result_t cache_test_lru(void)
+{
+  cache_t *cache;
+  result_t err;
+  char     data[32];
+  int      i;
+
+  printf("test: least recently used eviction\n");
+
+  err = cache_create(NULL, 4096, &cache);
+  if (err)
+    return err;
+
+  for (i = 0; i < 1000; i++)
+  {
+    memset(data, i, sizeof(data));
+
+    err = cache_put(cache, i, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+
+    if (cache_get(cache, 0) == NULL)
+    {
+      printf("key 0 was evicted after %d puts\n", i);
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+  }
+
+  if (cache_get(cache, 1) != NULL || cache_get(cache, 999) == NULL)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  cache_destroy(cache);
+
+  return result_TEST_PASSED;
+
+failure:
+
+  cache_destroy(cache);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* Trace replay: run the same access traces through each policy, filling
+ * the cache on every miss, and report the hit ratios. */
+
+#define REPLAY_CACHESZ  65536
+#define REPLAY_NACCESS  200000
+
+typedef enum
+{
+  Trace_Skewed, /* a few popular keys and a long tail */
+  Trace_Scan,   /* a hot working set interrupted by one-off scans */
+  Trace_Loop,   /* cycling through slightly more than fits */
+  Trace__Limit
+}
+trace_t;
+
+static const char *trace_names[] = { "skewed", "scan", "loop" };
+
+/* the i'th key of a trace. the generators are deterministic. */
+static cachekey_t trace_key(trace_t trace, int i, unsigned int *seed)
+{
+  unsigned int r;
+
+  *seed = *seed * 1103515245 + 12345;
+  r = (*seed >> 8) & 0xFFFF; /* 0..65535 */
+
+  switch (trace)
+  {
+  default:
+  case Trace_Skewed:
+    /* squaring a uniform value twice piles keys up near zero */
+    return (cachekey_t) ((unsigned long long) r * r / 65536 * r / 65536 *
+                         r / 65536 / 8);
+
+  case Trace_Scan:
+    /* for a quarter of the time, every other access is part of a scan of
+     * keys which are never seen again */
+    if (i % 20000 < 5000 && (i & 1))
+      return 1000000 + i;
+    return r % 200;
+
+  case Trace_Loop:
+    return i % 520;
+  }
+}
+
+/* entries vary in size */
+static size_t trace_length(cachekey_t key)
+{
+  return 16 + (key * 2654435761u >> 24) % 128;
+}
+
+static result_t cache_test_replay(void)
+{
+  cacheconfig_t config;
+  double        ratios[Trace__Limit][NELEMS(policy_names)];
+  int           trace;
+  int           policy;
+
+  printf("test: trace replay\n");
+
+  config.hash_chain_length   = 4;
+  config.nentries_percentage = 40; /* leave room for ghosts */
+
+  printf("%-8s", "trace");
+  for (policy = 0; policy < NELEMS(policy_names); policy++)
+    printf(" %8s", policy_names[policy]);
+  printf("\n");
+
+  for (trace = 0; trace < Trace__Limit; trace++)
+  {
+    printf("%-8s", trace_names[trace]);
+
+    for (policy = 0; policy < NELEMS(policy_names); policy++)
+    {
+      result_t     err;
+      cache_t     *cache;
+      unsigned int seed;
+      int          hits;
+      int          i;
+
+      config.policy = (cachepolicy_t) policy;
+
+      err = cache_create(&config, REPLAY_CACHESZ, &cache);
+      if (err)
+        return err;
+
+      seed = 1;
+      hits = 0;
+      for (i = 0; i < REPLAY_NACCESS; i++)
+      {
+        cachekey_t     key;
+        unsigned char *got;
+        unsigned char  data[160];
+        size_t         length;
+
+        key    = trace_key((trace_t) trace, i, &seed);
+        length = trace_length(key);
+
+        got = cache_get(cache, key);
+        if (got)
+        {
+          if (got[0] != (unsigned char) key ||
+              got[length - 1] != (unsigned char) key)
+          {
+            cache_destroy(cache);
+            return result_TEST_FAILED; /* wrong data */
+          }
+
+          hits++;
+          continue;
+        }
+
+        memset(data, (unsigned char) key, length);
+        err = cache_put(cache, key, data, length, NULL);
+        if (err)
+        {
+          cache_destroy(cache);
+          return err;
+        }
+      }
+
+      cache_destroy(cache);
+
+      ratios[trace][policy] = (double) hits / REPLAY_NACCESS;
+      printf(" %7.2f%%", ratios[trace][policy] * 100.0);
+    }
+
+    printf("\n");
+  }
+
+  /* the scan resistant policies must shrug off the scans better than LRU */
+  if (ratios[Trace_Scan][cachepolicy_S3FIFO] <= ratios[Trace_Scan][cachepolicy_LRU] ||
+      ratios[Trace_Scan][cachepolicy_ARC]    <= ratios[Trace_Scan][cachepolicy_LRU])
+    return result_TEST_FAILED;
+
+  return result_TEST_PASSED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t cache_test_pin(void)
+{
+  cacheconfig_t config;
+  int           policy;
+
+  printf("test: pinning\n");
+
+  config.hash_chain_length   = 4;
+  config.nentries_percentage = 25;
+
+  for (policy = 0; policy < NELEMS(policy_names); policy++)
+  {
+    result_t    err;
+    cache_t    *cache;
+    char        data[32];
+    char       *pinneddata;
+    cachepin_t  pin;
+    cachepin_t  pins[64];
+    int         npins;
+    int         i;
+
+    config.policy = (cachepolicy_t) policy;
+
+    err = cache_create(&config, 4096, &cache);
+    if (err)
+      return err;
+
+    /* a pinned entry survives any amount of churn */
+    memset(data, 0xA5, sizeof(data));
+    err = cache_put_pinned(cache, 0, data, sizeof(data), (void **) &pinneddata, &pin);
+    if (err)
+      goto failure;
+
+    for (i = 1; i < 1000; i++)
+    {
+      memset(data, i, sizeof(data));
+      err = cache_put(cache, i, data, sizeof(data), NULL);
+      if (err)
+        goto failure;
+    }
+
+    memset(data, 0xA5, sizeof(data));
+    if (memcmp(pinneddata, data, sizeof(data)) != 0 ||
+        cache_get(cache, 0) != pinneddata)
+    {
+      printf("%s: pinned entry was evicted\n", policy_names[policy]);
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+
+    /* once unpinned it's evictable again */
+    cache_unpin(cache, pin);
+
+    for (i = 1000; i < 2000; i++)
+    {
+      memset(data, i, sizeof(data));
+      err = cache_put(cache, i, data, sizeof(data), NULL);
+      if (err)
+        goto failure;
+    }
+
+    /* ARC keeps it: the get above moved it to T2, which a stream of one-off
+     * puts never displaces */
+    if (config.policy != cachepolicy_ARC && cache_get(cache, 0) != NULL)
+    {
+      printf("%s: unpinned entry was not evicted\n", policy_names[policy]);
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+
+    /* pin everything: puts must eventually fail rather than evict */
+    for (npins = 0; npins < NELEMS(pins); npins++)
+    {
+      err = cache_put_pinned(cache, 2000 + npins, data, sizeof(data), NULL, &pins[npins]);
+      if (err == result_CACHE_FULL)
+        break;
+      if (err)
+        goto failure;
+    }
+
+    if (npins == NELEMS(pins))
+    {
+      printf("%s: cache never filled\n", policy_names[policy]);
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+
+    for (i = 0; i < npins; i++)
+      if (cache_get(cache, 2000 + i) == NULL)
+      {
+        err = result_TEST_FAILED;
+        goto failure;
+      }
+
+    for (i = 0; i < npins; i++)
+      cache_unpin(cache, pins[i]);
+
+    err = cache_put(cache, 3000, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+
+    cache_destroy(cache);
+    continue;
+
+
+failure:
+
+    cache_destroy(cache);
+
+    return err;
+  }
+
+  return result_TEST_PASSED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static unsigned int histogram_total(const unsigned int *h)
+{
+  unsigned int total;
+  int          k;
+
+  total = 0;
+  for (k = 0; k < CACHE_LATENCY_BUCKETS; k++)
+    total += h[k];
+
+  return total;
+}
+
+static result_t cache_test_stats(void)
+{
+  result_t     err;
+  cache_t     *cache;
+  cachestats_t stats;
+  char         data[100];
+  int          i;
+
+  printf("test: statistics\n");
+
+  err = cache_create(NULL, 8192, &cache);
+  if (err)
+    return err;
+
+  memset(data, 0, sizeof(data));
+  for (i = 0; i < 10; i++)
+  {
+    err = cache_put(cache, i, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+  }
+
+  for (i = 0; i < 5; i++)
+    (void) cache_get(cache, i);
+  for (i = 100; i < 103; i++)
+    (void) cache_get(cache, i);
+
+  cache_get_stats(cache, &stats);
+
+  printf("%lu hits, %lu misses, %zu of %zu bytes stored, "
+         "largest free %zu, %d of %d entries\n",
+         stats.hits, stats.misses, stats.bytesstored, stats.storelength,
+         stats.largestfree, stats.nentriesused, stats.nentries);
+
+  if (stats.hits != 5 || stats.misses != 3 || stats.evictions != 0 ||
+      stats.nentriesused != 10 || stats.npinned != 0 ||
+      stats.bytesstored < 10 * sizeof(data) ||
+      stats.hitbytes != 5 * (stats.bytesstored / 10) ||
+      stats.largestfree == 0 ||
+      stats.largestfree > stats.storelength - stats.bytesstored ||
+      histogram_total(stats.hitlatency) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  /* sample every lookup */
+  err = cache_sample_latency(cache, 1);
+  if (err)
+    goto failure;
+
+  for (i = 0; i < 100; i++)
+    (void) cache_get(cache, i % 20);
+
+  cache_get_stats(cache, &stats);
+
+  if (histogram_total(stats.hitlatency)  != 50 ||
+      histogram_total(stats.misslatency) != 50)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  cache_reset_stats(cache);
+  cache_get_stats(cache, &stats);
+
+  if (stats.hits != 0 || stats.misses != 0 ||
+      histogram_total(stats.hitlatency) != 0 ||
+      stats.nentriesused != 10) /* occupancy isn't reset */
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  err = result_TEST_PASSED;
+
+  /* FALLTHROUGH */
+
+failure:
+
+  cache_destroy(cache);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+/* count the keys in [from, to) which are present with the right data */
+static int resize_count(cache_t *cache, int from, int to)
+{
+  int i;
+  int n;
+
+  n = 0;
+  for (i = from; i < to; i++)
+  {
+    const unsigned char *got;
+
+    got = cache_get(cache, i);
+    if (got && got[0] == (unsigned char) i && got[199] == (unsigned char) i)
+      n++;
+  }
+
+  return n;
+}
+
+static result_t cache_test_resize(void)
+{
+  result_t      err;
+  cacheconfig_t config;
+  cache_t      *cache;
+  cachestats_t  before, after;
+  cachepin_t    pin;
+  unsigned char data[200];
+  int           n;
+  int           i;
+
+  printf("test: resize\n");
+
+  config.hash_chain_length   = 4;
+  config.nentries_percentage = 50; /* far too many entries for 200 bytes */
+  config.policy              = cachepolicy_LRU;
+
+  err = cache_create(&config, 16384, &cache);
+  if (err)
+    return err;
+
+  for (i = 0; i < 40; i++)
+  {
+    memset(data, i, sizeof(data));
+    err = cache_put(cache, i, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+  }
+
+  n = resize_count(cache, 0, 40);
+  cache_get_stats(cache, &before);
+
+  /* grow, rebalancing the entries to suit */
+  err = cache_resize(&cache, NULL, 65536);
+  if (err)
+    goto failure;
+
+  cache_get_stats(cache, &after);
+
+  printf("grown: %d of %d keys kept, entries %d -> %d\n",
+         resize_count(cache, 0, 40), n, before.nentries, after.nentries);
+
+  if (resize_count(cache, 0, 40) != n ||
+      after.hits != before.hits || /* carried over */
+      (size_t) after.nentries * 200 > after.storelength)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  /* fill it, then shrink: the most recently used must survive */
+  for (i = 40; i < 200; i++)
+  {
+    memset(data, i, sizeof(data));
+    err = cache_put(cache, i, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+  }
+
+  err = cache_resize(&cache, NULL, 8192);
+  if (err)
+    goto failure;
+
+  n = resize_count(cache, 0, 200);
+  printf("shrunk: %d keys kept\n", n);
+
+  if (n == 0 || n == 200 || resize_count(cache, 200 - n, 200) != n)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  /* an entry too big for the new store is evicted rather than failing */
+  {
+    static unsigned char big[12000];
+
+    err = cache_resize(&cache, NULL, 65536);
+    if (!err)
+      err = cache_put(cache, 1000, big, sizeof(big), NULL);
+    if (err)
+      goto failure;
+
+    cache_get_stats(cache, &before);
+
+    err = cache_resize(&cache, NULL, 8192);
+    if (err)
+      goto failure;
+
+    cache_get_stats(cache, &after);
+
+    printf("shrunk below largest entry: evictions %lu -> %lu\n",
+           before.evictions, after.evictions);
+
+    if (cache_get(cache, 1000) != NULL ||
+        after.evictions <= before.evictions ||
+        resize_count(cache, 199, 200) != 1)
+    {
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+  }
+
+  /* it can't move while pinned */
+  if (cache_pin(cache, 199, &pin) == NULL)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  err = cache_resize(&cache, NULL, 16384);
+  cache_unpin(cache, pin);
+  if (err != result_CACHE_PINNED)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  err = result_TEST_PASSED;
+
+  /* FALLTHROUGH */
+
+failure:
+
+  cache_destroy(cache);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+#ifndef __riscos
+
+#define FILENAME     "test-cache-file"
+#define FILENAME2    "test-cache-file-copy"
+#define FILE_CACHESZ 65536
+#define FILE_NKEYS   200
+
+/* count how many of the keys are present with the right data */
+static int file_count(cache_t *cache)
+{
+  int i;
+  int n;
+
+  n = 0;
+  for (i = 0; i < FILE_NKEYS; i++)
+  {
+    const unsigned char *got;
+
+    got = cache_get(cache, i);
+    if (got && got[0] == (unsigned char) i && got[99] == (unsigned char) i)
+      n++;
+  }
+
+  return n;
+}
+
+/* copy a file byte for byte */
+static result_t file_copy(const char *from, const char *to)
+{
+  FILE *in, *out;
+  int   c;
+
+  in = fopen(from, "rb");
+  if (in == NULL)
+    return result_FOPEN_FAILED;
+
+  out = fopen(to, "wb");
+  if (out == NULL)
+  {
+    fclose(in);
+    return result_FOPEN_FAILED;
+  }
+
+  while ((c = getc(in)) != EOF)
+    putc(c, out);
+
+  fclose(out);
+  fclose(in);
+
+  return result_OK;
+}
+
+static result_t cache_test_file(void)
+{
+  result_t      err;
+  cacheconfig_t config;
+  cache_t      *cache;
+  cacheinfo_t   info;
+  unsigned char data[100];
+  int           n;
+  int           i;
+
+  printf("test: file backed\n");
+
+  remove(FILENAME);
+  remove(FILENAME2);
+
+  config.hash_chain_length   = 4;
+  config.nentries_percentage = 25;
+  config.policy              = cachepolicy_LRU;
+
+  err = cache_open_file(&config, FILENAME, FILE_CACHESZ, &cache);
+  if (err)
+    return err;
+
+  for (i = 0; i < FILE_NKEYS; i++)
+  {
+    memset(data, i, sizeof(data));
+    err = cache_put(cache, i, data, sizeof(data), NULL);
+    if (err)
+      goto failure;
+  }
+
+  n = file_count(cache);
+
+  /* a copy taken while open looks like the result of a crash */
+  err = file_copy(FILENAME, FILENAME2);
+  if (err)
+    goto failure;
+
+  cache_destroy(cache);
+
+  /* reopened after a clean close it's warm */
+  err = cache_open_file(&config, FILENAME, FILE_CACHESZ, &cache);
+  if (err)
+    goto cleanup;
+
+  cache_get_info(cache, &info);
+  printf("generation %u: %d of %d keys survived reopening, %d expected\n",
+         info.generation, file_count(cache), FILE_NKEYS, n);
+
+  if (n == 0 || file_count(cache) != n || info.generation != 2)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  cache_destroy(cache);
+
+  /* a different configuration changes the layout: it must start cold */
+  config.policy = cachepolicy_CLOCK;
+
+  err = cache_open_file(&config, FILENAME, FILE_CACHESZ, &cache);
+  if (err)
+    goto cleanup;
+
+  if (file_count(cache) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  cache_destroy(cache);
+
+  /* the crashed copy must start cold */
+  config.policy = cachepolicy_LRU;
+
+  err = cache_open_file(&config, FILENAME2, FILE_CACHESZ, &cache);
+  if (err)
+    goto cleanup;
+
+  if (file_count(cache) != 0)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  err = result_TEST_PASSED;
+
+  /* FALLTHROUGH */
+
+failure:
+
+  cache_destroy(cache);
+
+  /* FALLTHROUGH */
+
+cleanup:
+
+  remove(FILENAME);
+  remove(FILENAME2);
+
+  return err;
+}
+
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+/* Sharded cache: several threads ask for the same keys at once. Every key
+ * must be loaded exactly once, and pinned data must survive other threads'
+ * puts. */
+
+#define SHARD_NTHREADS 4
+#define SHARD_NKEYS    64
+#define SHARD_DATALEN  64
+
+typedef struct
+{
+  shardcache_t *cache;
+  int           nloads;
+  int           nbad;
+  int           seed;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_t lock;
+#endif
+}
+shardtest_t;
+
+static result_t shard_loader(cachekey_t key,
+                             void      *opaque,
+                             void     **data,
+                             size_t    *length)
+{
+  shardtest_t *t = opaque;
+  char        *buf;
+
+#ifdef DPTLIB_THREADS
+  pthread_mutex_lock(&t->lock);
+#endif
+  t->nloads++;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_unlock(&t->lock);
+
+  usleep(1000); /* widen the window for other threads to miss */
+#endif
+
+  buf = malloc(SHARD_DATALEN);
+  if (buf == NULL)
+    return result_OOM;
+
+  memset(buf, (int) key, SHARD_DATALEN);
+
+  *data   = buf;
+  *length = SHARD_DATALEN;
+
+  return result_OK;
+}
+
+static int shard_check(const unsigned char *data, cachekey_t key)
+{
+  int i;
+
+  for (i = 0; i < SHARD_DATALEN; i++)
+    if (data[i] != (unsigned char) key)
+      return 0;
+
+  return 1;
+}
+
+/* get every key a few times, in a different order for each thread */
+static void *shard_reader(void *arg)
+{
+  shardtest_t *t = arg;
+  int          start;
+  int          nbad;
+  int          round;
+  int          i;
+
+#ifdef DPTLIB_THREADS
+  pthread_mutex_lock(&t->lock);
+#endif
+  start = t->seed++ * 17;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_unlock(&t->lock);
+#endif
+
+  nbad = 0;
+  for (round = 0; round < 3; round++)
+    for (i = 0; i < SHARD_NKEYS; i++)
+    {
+      cachekey_t       key = (start + i) % SHARD_NKEYS;
+      void            *data;
+      shardcachepin_t  pin;
+
+      if (shardcache_get_or_load(t->cache, key, shard_loader, t, &data, &pin))
+      {
+        nbad++;
+        continue;
+      }
+
+      if (!shard_check(data, key))
+        nbad++;
+
+      shardcache_release(t->cache, &pin);
+    }
+
+#ifdef DPTLIB_THREADS
+  pthread_mutex_lock(&t->lock);
+#endif
+  t->nbad += nbad;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_unlock(&t->lock);
+#endif
+
+  return NULL;
+}
+
+/* put lots of other keys to force evictions */
+static void *shard_churner(void *arg)
+{
+  shardtest_t  *t = arg;
+  unsigned char data[SHARD_DATALEN];
+  int           i;
+
+  for (i = 0; i < 4000; i++)
+  {
+    memset(data, i, sizeof(data));
+    shardcache_put(t->cache, SHARD_NKEYS + i, data, sizeof(data), NULL, NULL);
+  }
+
+  return NULL;
+}
+
+static void shard_run(void *(*fn)(void *), shardtest_t *t)
+{
+#ifdef DPTLIB_THREADS
+  pthread_t threads[SHARD_NTHREADS];
+  int       spawned[SHARD_NTHREADS];
+  int       i;
+
+  for (i = 0; i < SHARD_NTHREADS; i++)
+    spawned[i] = pthread_create(&threads[i], NULL, fn, t) == 0;
+
+  for (i = 0; i < SHARD_NTHREADS; i++)
+  {
+    if (spawned[i])
+      pthread_join(threads[i], NULL);
+    else
+      fn(t); /* couldn't spawn: do it here */
+  }
+#else
+  fn(t);
+#endif
+}
+
+static result_t cache_test_sharded(void)
+{
+  result_t        err;
+  shardtest_t     t;
+  void           *data[8];
+  shardcachepin_t pins[8];
+  int             i;
+
+  printf("test: sharded cache\n");
+
+  t.nloads = 0;
+  t.nbad   = 0;
+  t.seed   = 0;
+#ifdef DPTLIB_THREADS
+  pthread_mutex_init(&t.lock, NULL);
+#endif
+
+  err = shardcache_create(NULL, 4 * 16384, 4, &t.cache);
+  if (err)
+    goto failure;
+
+  /* every key fits, so each is loaded exactly once however many threads
+   * miss on it together */
+  shard_run(shard_reader, &t);
+
+  printf("%d loads for %d keys\n", t.nloads, SHARD_NKEYS);
+
+  if (t.nbad > 0 || t.nloads != SHARD_NKEYS)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  /* pinned data must survive churn */
+  for (i = 0; i < NELEMS(pins); i++)
+  {
+    data[i] = shardcache_get(t.cache, i, &pins[i]);
+    if (data[i] == NULL)
+    {
+      err = result_TEST_FAILED;
+      goto failure;
+    }
+  }
+
+  shard_run(shard_churner, &t);
+
+  for (i = 0; i < NELEMS(pins); i++)
+  {
+    if (!shard_check(data[i], i))
+      t.nbad++;
+
+    shardcache_release(t.cache, &pins[i]);
+  }
+
+  if (t.nbad > 0)
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  /* the churn evicted every key which wasn't pinned. those must be loaded
+   * again, once each. */
+  t.nloads = 0;
+  shard_run(shard_reader, &t);
+
+  printf("%d loads after churn\n", t.nloads);
+
+  if (t.nbad > 0 || t.nloads != SHARD_NKEYS - NELEMS(pins))
+  {
+    err = result_TEST_FAILED;
+    goto failure;
+  }
+
+  err = result_TEST_PASSED;
+
+  /* FALLTHROUGH */
+
+failure:
+
+  shardcache_destroy(t.cache);
+#ifdef DPTLIB_THREADS
+  pthread_mutex_destroy(&t.lock);
+#endif
+
+  return err;
+}
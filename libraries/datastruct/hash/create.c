@@ -10,6 +10,7 @@
 #include "base/utils.h"
 
 #include "base/result.h"
+#include "utils/arena.h"
 #include "utils/primes.h"
 
 #include "datastruct/hash.h"
@@ -81,20 +82,43 @@ result_t hash_create(const void            *default_value,
                      hash_destroy_key_t    *destroy_key,
                      hash_destroy_value_t  *destroy_value,
                      hash_t               **ph)
+{
+  return hash_create_in_arena(NULL,
+                              default_value,
+                              nbins,
+                              fn,
+                              compare,
+                              destroy_key,
+                              destroy_value,
+                              ph);
+}
+
+result_t hash_create_in_arena(arena_t               *arena,
+                              const void            *default_value,
+                              int                    nbins,
+                              hash_fn_t             *fn,
+                              hash_compare_t        *compare,
+                              hash_destroy_key_t    *destroy_key,
+                              hash_destroy_value_t  *destroy_value,
+                              hash_t               **ph)
 {
   hash_t       *h;
   hash_node_t **bins;
 
-  h = malloc(sizeof(*h));
+  h = arena ? arena_alloc(arena, sizeof(*h)) : malloc(sizeof(*h));
   if (h == NULL)
     return result_OOM;
 
   nbins = prime_nearest(nbins);
 
-  bins = calloc(nbins, sizeof(*h->bins));
+  if (arena)
+    bins = arena_calloc(arena, nbins, sizeof(*h->bins));
+  else
+    bins = calloc(nbins, sizeof(*h->bins));
   if (bins == NULL)
   {
-    free(h);
+    if (arena == NULL)
+      free(h);
     return result_OOM;
   }
 
@@ -112,6 +136,9 @@ result_t hash_create(const void            *default_value,
   h->destroy_key   = destroy_key   ? destroy_key   : string_destroy;
   h->destroy_value = destroy_value ? destroy_value : string_destroy;
 
+  h->arena         = arena;
+  h->freenodes     = NULL;
+
   *ph = h;
 
   return result_OK;
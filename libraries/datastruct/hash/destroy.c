@@ -18,6 +18,10 @@ void hash_destroy(hash_t *h)
     while (h->bins[i])
       hash_remove_node(h, &h->bins[i]);
 
+  /* in an arena the memory is released along with the arena */
+  if (h->arena)
+    return;
+
   free(h->bins);
 
   free(h);
@@ -3,6 +3,8 @@
 #ifndef DATASTRUCT_HASH_IMPL_H
 #define DATASTRUCT_HASH_IMPL_H
 
+#include "utils/arena.h"
+
 #include "datastruct/hash.h"
 
 /* ----------------------------------------------------------------------- */
@@ -29,6 +31,9 @@ struct hash
   hash_compare_t        *compare;
   hash_destroy_key_t    *destroy_key;
   hash_destroy_value_t  *destroy_value;
+
+  arena_t               *arena;     /* or NULL to use the heap */
+  hash_node_t           *freenodes; /* removed nodes kept for reuse */
 };
 
 /* ----------------------------------------------------------------------- */
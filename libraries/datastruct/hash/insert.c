@@ -7,6 +7,7 @@
 #endif
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 #include "datastruct/hash.h"
 
@@ -33,9 +34,17 @@ result_t hash_insert(hash_t *h, const void *key, const void *value)
 
     /* not found: create new node */
 
-    m = malloc(sizeof(*m));
-    if (m == NULL)
-      return result_OOM;
+    if (h->freenodes)
+    {
+      m = h->freenodes;
+      h->freenodes = m->next;
+    }
+    else
+    {
+      m = h->arena ? arena_alloc(h->arena, sizeof(*m)) : malloc(sizeof(*m));
+      if (m == NULL)
+        return result_OOM;
+    }
 
     m->next  = NULL;
     m->key   = key;
@@ -21,7 +21,16 @@ void hash_remove_node(hash_t *h, hash_node_t **n)
   h->destroy_key((void *) doomed->key);
   h->destroy_value((void *) doomed->value);
 
-  free(doomed);
+  if (h->arena)
+  {
+    /* arena memory can't be freed individually so keep it for reuse */
+    doomed->next = h->freenodes;
+    h->freenodes = doomed;
+  }
+  else
+  {
+    free(doomed);
+  }
 
   h->count--;
 }
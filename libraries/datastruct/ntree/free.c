@@ -24,6 +24,7 @@ void ntree_free(ntree_t *t)
     if (t->children)
       ntree_free(t->children);
 
-    free(t);
+    if (t->arena == NULL)
+      free(t);
   }
 }
@@ -5,6 +5,8 @@
 
 #include <stdlib.h>
 
+#include "utils/arena.h"
+
 #include "datastruct/ntree.h"
 
 struct ntree
@@ -14,6 +16,7 @@ struct ntree
   ntree_t *parent;
   ntree_t *children;
   void    *data;
+  arena_t *arena; /* or NULL to use the heap */
 };
 
 #define IS_ROOT(t) ((t)->parent == NULL && \
@@ -7,19 +7,27 @@
 #endif
 
 #include "base/result.h"
+#include "utils/arena.h"
 
 #include "datastruct/ntree.h"
 
 #include "impl.h"
 
 result_t ntree_new(ntree_t **t)
+{
+  return ntree_new_in_arena(NULL, t);
+}
+
+result_t ntree_new_in_arena(arena_t *arena, ntree_t **t)
 {
   ntree_t *n;
 
-  n = calloc(1, sizeof(*n));
+  n = arena ? arena_calloc(arena, 1, sizeof(*n)) : calloc(1, sizeof(*n));
   if (n == NULL)
     return result_OOM;
 
+  n->arena = arena;
+
   *t = n;
 
   return result_OK;
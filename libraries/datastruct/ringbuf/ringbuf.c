@@ -0,0 +1,160 @@
+/* ringbuf.c -- lock-free single-producer single-consumer byte ring */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/atomic.h"
+#include "base/utils.h"
+
+#include "datastruct/ringbuf.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* 'head' and 'tail' count the bytes ever written and read. Only the
+ * producer stores to 'head' and only the consumer stores to 'tail'. Each
+ * publishes its counter with a release store after touching the data, and
+ * the other side reads it with an acquire load before touching the data.
+ *
+ * Each side also keeps a private copy of the other side's counter and only
+ * reloads it when the copy suggests the ring is full (or empty). The
+ * groups of fields owned by each side are padded so that they never share
+ * a cache line.
+ */
+
+struct ringbuf
+{
+  /* read-only after creation */
+  size_t         size;         /* capacity in bytes */
+  size_t         mask;         /* storage size less one: a power of two */
+  unsigned char *data;
+  char           pad0[CACHELINE_SIZE];
+
+  /* producer's */
+  size_t         head;
+  size_t         cachedtail;
+  char           pad1[CACHELINE_SIZE];
+
+  /* consumer's */
+  size_t         tail;
+  size_t         cachedhead;
+  char           pad2[CACHELINE_SIZE];
+};
+
+/* ----------------------------------------------------------------------- */
+
+ringbuf_t *ringbuf_create(size_t size)
+{
+  ringbuf_t *ring;
+  size_t     storage;
+
+  storage = 1;
+  while (storage < size)
+    storage <<= 1;
+
+  ring = malloc(sizeof(*ring));
+  if (ring == NULL)
+    return NULL;
+
+  ring->data = malloc(storage);
+  if (ring->data == NULL)
+  {
+    free(ring);
+    return NULL;
+  }
+
+  ring->size       = size;
+  ring->mask       = storage - 1;
+  ring->head       = 0;
+  ring->cachedtail = 0;
+  ring->tail       = 0;
+  ring->cachedhead = 0;
+
+  return ring;
+}
+
+void ringbuf_destroy(ringbuf_t *doomed)
+{
+  if (doomed == NULL)
+    return;
+
+  free(doomed->data);
+  free(doomed);
+}
+
+/* ----------------------------------------------------------------------- */
+
+size_t ringbuf_write(ringbuf_t *ring, const void *data, size_t length)
+{
+  size_t head;
+  size_t space;
+  size_t off;
+  size_t first;
+
+  head = ring->head; /* ours */
+
+  space = ring->size - (head - ring->cachedtail);
+  if (space < length)
+  {
+    ring->cachedtail = ATOMIC_LOAD_ACQUIRE(&ring->tail);
+    space = ring->size - (head - ring->cachedtail);
+  }
+
+  length = MIN(length, space);
+  if (length == 0)
+    return 0;
+
+  /* copy in up to two parts: to the end of storage then from the start */
+  off   = head & ring->mask;
+  first = MIN(length, ring->mask + 1 - off);
+  memcpy(ring->data + off, data, first);
+  memcpy(ring->data, (const unsigned char *) data + first, length - first);
+
+  ATOMIC_STORE_RELEASE(&ring->head, head + length);
+
+  return length;
+}
+
+size_t ringbuf_read(ringbuf_t *ring, void *data, size_t length)
+{
+  size_t tail;
+  size_t avail;
+  size_t off;
+  size_t first;
+
+  tail = ring->tail; /* ours */
+
+  avail = ring->cachedhead - tail;
+  if (avail < length)
+  {
+    ring->cachedhead = ATOMIC_LOAD_ACQUIRE(&ring->head);
+    avail = ring->cachedhead - tail;
+  }
+
+  length = MIN(length, avail);
+  if (length == 0)
+    return 0;
+
+  off   = tail & ring->mask;
+  first = MIN(length, ring->mask + 1 - off);
+  memcpy(data, ring->data + off, first);
+  memcpy((unsigned char *) data + first, ring->data, length - first);
+
+  ATOMIC_STORE_RELEASE(&ring->tail, tail + length);
+
+  return length;
+}
+
+size_t ringbuf_used(const ringbuf_t *ring)
+{
+  size_t tail;
+
+  /* load tail first: head can only move further ahead of it */
+  tail = ATOMIC_LOAD_ACQUIRE(&ring->tail);
+
+  return ATOMIC_LOAD_ACQUIRE(&ring->head) - tail;
+}
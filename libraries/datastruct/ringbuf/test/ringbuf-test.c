@@ -0,0 +1,227 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef DPTLIB_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+#include "datastruct/ringbuf.h"
+
+#include "test/all-tests.h"
+
+#define RINGSIZE   100
+#define NSTREAM    (64 << 20) /* bytes passed between threads */
+#define STREAMRING 65536
+#define MAXCHUNK   4096
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef DPTLIB_THREADS
+
+/* the n'th byte of the test stream */
+#define STREAMBYTE(n) ((unsigned char) ((n) * 7 + ((n) >> 11)))
+
+typedef struct
+{
+  ringbuf_t *ring;
+  int        nbad; /* set by the consumer */
+}
+streamtest_t;
+
+static void *producer(void *arg)
+{
+  streamtest_t *t = arg;
+  unsigned char buf[MAXCHUNK];
+  size_t        sent;
+  unsigned int  seed;
+
+  seed = 1;
+  for (sent = 0; sent < NSTREAM; )
+  {
+    size_t n;
+    size_t i;
+    size_t wrote;
+
+    seed = seed * 1103515245 + 12345;
+    n = MIN(1 + (seed >> 8) % MAXCHUNK, NSTREAM - sent);
+
+    for (i = 0; i < n; i++)
+      buf[i] = STREAMBYTE(sent + i);
+
+    /* retry until the whole chunk is in */
+    for (i = 0; i < n; i += wrote)
+    {
+      wrote = ringbuf_write(t->ring, buf + i, n - i);
+      if (wrote == 0)
+        sched_yield();
+    }
+
+    sent += n;
+  }
+
+  return NULL;
+}
+
+static void consume(streamtest_t *t, size_t *received)
+{
+  unsigned char buf[MAXCHUNK];
+  size_t        n;
+  size_t        i;
+
+  n = ringbuf_read(t->ring, buf, sizeof(buf));
+  for (i = 0; i < n; i++)
+    if (buf[i] != STREAMBYTE(*received + i))
+      t->nbad++;
+
+  *received += n;
+
+  if (n == 0)
+    sched_yield();
+}
+
+#endif /* DPTLIB_THREADS */
+
+/* ----------------------------------------------------------------------- */
+
+result_t ringbuf_test(const char *resources)
+{
+  ringbuf_t     *ring;
+  unsigned char  in[RINGSIZE * 2];
+  unsigned char  out[RINGSIZE * 2];
+  size_t         n;
+  int            i;
+  int            j;
+
+  NOT_USED(resources);
+
+  printf("test: create\n");
+
+  ring = ringbuf_create(RINGSIZE);
+  if (ring == NULL)
+    return result_OOM;
+
+  for (i = 0; i < (int) sizeof(in); i++)
+    in[i] = (unsigned char) i;
+
+  printf("test: overfill\n");
+
+  n = ringbuf_write(ring, in, sizeof(in));
+  if (n != RINGSIZE || ringbuf_used(ring) != RINGSIZE)
+  {
+    printf("wrote %zu, used %zu\n", n, ringbuf_used(ring));
+    goto Failure;
+  }
+
+  printf("test: wrap around\n");
+
+  /* move the counters around the ring a few times with odd sizes. byte k
+   * of the stream is (unsigned char) k. */
+  {
+    int nextread;
+    int nextwrite;
+
+    nextread  = 0;
+    nextwrite = RINGSIZE;
+
+    for (i = 0; i < 50; i++)
+    {
+      size_t want;
+
+      want = 1 + (i * 37) % RINGSIZE;
+
+      n = ringbuf_read(ring, out, want);
+      if (n != want)
+        goto Failure;
+      for (j = 0; j < (int) n; j++)
+        if (out[j] != (unsigned char) (nextread + j))
+        {
+          printf("byte %d wrong after %d rounds\n", j, i);
+          goto Failure;
+        }
+      nextread += n;
+
+      for (j = 0; j < (int) want; j++)
+        in[j] = (unsigned char) (nextwrite + j);
+      n = ringbuf_write(ring, in, want);
+      if (n != want || ringbuf_used(ring) != RINGSIZE)
+        goto Failure;
+      nextwrite += n;
+    }
+  }
+
+  printf("test: drain\n");
+
+  n = ringbuf_read(ring, out, sizeof(out));
+  if (n != RINGSIZE || ringbuf_used(ring) != 0 ||
+      ringbuf_read(ring, out, 1) != 0)
+    goto Failure;
+
+  ringbuf_destroy(ring);
+  ring = NULL;
+
+#ifdef DPTLIB_THREADS
+  printf("test: two threads\n");
+
+  {
+    streamtest_t    t;
+    size_t          received;
+    pthread_t       thread;
+    struct timespec start, end;
+    double          secs;
+
+    t.ring = ringbuf_create(STREAMRING);
+    t.nbad = 0;
+    if (t.ring == NULL)
+      return result_OOM;
+
+    received = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (pthread_create(&thread, NULL, producer, &t) != 0)
+    {
+      ringbuf_destroy(t.ring);
+      return result_TEST_FAILED;
+    }
+
+    while (received < NSTREAM)
+      consume(&t, &received);
+
+    pthread_join(thread, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ringbuf_destroy(t.ring);
+
+    if (t.nbad)
+    {
+      printf("%d bytes corrupted\n", t.nbad);
+      return result_TEST_FAILED;
+    }
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (secs > 0.0)
+      printf("%d MiB in %.3fs: %.0f MB/s\n",
+             NSTREAM >> 20, secs, NSTREAM / secs / 1e6);
+  }
+#endif
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  ringbuf_destroy(ring);
+
+  return result_TEST_FAILED;
+}
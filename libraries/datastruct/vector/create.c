@@ -6,19 +6,27 @@
 #include "fortify/fortify.h"
 #endif
 
+#include "utils/arena.h"
+
 #include "datastruct/vector.h"
 
 #include "impl.h"
 
 vector_t *vector_create(size_t width)
+{
+  return vector_create_in_arena(NULL, width);
+}
+
+vector_t *vector_create_in_arena(arena_t *arena, size_t width)
 {
   vector_t *v;
 
-  v = calloc(1, sizeof(*v));
+  v = arena ? arena_calloc(arena, 1, sizeof(*v)) : calloc(1, sizeof(*v));
   if (v == NULL)
     return NULL;
 
   v->width = width;
+  v->arena = arena;
 
   return v;
 }
@@ -15,6 +15,10 @@ void vector_destroy(vector_t *doomed)
   if (doomed == NULL)
     return;
 
+  /* in an arena the memory is released along with the arena */
+  if (doomed->arena)
+    return;
+
   free(doomed->base);
   free(doomed);
 }
@@ -19,7 +19,11 @@ result_t vector_ensure(vector_t *v, unsigned int need)
 
     required = need;
 
-    newbase = realloc(v->base, required * v->width);
+    /* an arena can't reclaim outgrown blocks so grow geometrically */
+    if (v->arena && required < v->allocated * 2)
+      required = v->allocated * 2;
+
+    newbase = vector__realloc(v, required * v->width);
     if (newbase == NULL)
       return result_OOM;
 
@@ -5,15 +5,21 @@
 
 #include <stddef.h>
 
+#include "utils/arena.h"
+
 struct vector
 {
   size_t       width;     /* width of an element */
   unsigned int used;      /* entries used */
   unsigned int allocated; /* entries allocated */
   void        *base;      /* vector itself */
+  arena_t     *arena;     /* or NULL to use the heap */
 };
 
 /* Calculate address of element 'i'. */
 #define VECTOR_INDEX(v, i) ((char *) v->base + (i) * v->width)
 
+/* Resize the vector's block to 'newsize' bytes. Returns NULL on failure. */
+void *vector__realloc(vector_t *v, size_t newsize);
+
 #endif /* IMPL_H */
@@ -0,0 +1,24 @@
+/* realloc.c -- vector - flexible array */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "utils/arena.h"
+
+#include "datastruct/vector.h"
+
+#include "impl.h"
+
+void *vector__realloc(vector_t *v, size_t newsize)
+{
+  if (v->arena)
+    return arena_realloc(v->arena,
+                         v->base,
+                         v->allocated * v->width,
+                         newsize);
+  else
+    return realloc(v->base, newsize);
+}
@@ -14,7 +14,7 @@ result_t vector_set_length(vector_t *v, unsigned int length)
 {
   void *newbase;
 
-  newbase = realloc(v->base, length * v->width);
+  newbase = vector__realloc(v, length * v->width);
   if (newbase == NULL)
     return result_OOM;
 
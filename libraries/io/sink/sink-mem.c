@@ -0,0 +1,109 @@
+/* sink-mem.c -- growable memory block sink implementation */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "io/sink.h"
+
+#include "io/sink-mem.h"
+
+/* Default initial block size. */
+#define DEFAULTSIZE 4096
+
+typedef struct sink_mem
+{
+  sink_t         base;
+
+  unsigned char *block;
+  size_t         size;
+}
+sink_mem_t;
+
+static result_t sink_mem_flush(sink_t *s, size_t need)
+{
+  sink_mem_t    *sm = (sink_mem_t *) s;
+  size_t         used;
+  size_t         size;
+  unsigned char *block;
+
+  /* nothing to drain: the block is the destination */
+
+  if (sink_remaining(s) >= need)
+    return result_OK;
+
+  used = sm->base.buf - sm->block;
+
+  size = sm->size * 2;
+  if (size < used + need)
+    size = used + need;
+
+  block = realloc(sm->block, size);
+  if (block == NULL)
+    return result_OOM;
+
+  sm->block    = block;
+  sm->size     = size;
+  sm->base.buf = block + used;
+  sm->base.end = block + size;
+
+  return result_OK;
+}
+
+static void sink_mem_destroy(sink_t *doomed)
+{
+  sink_mem_t *sm = (sink_mem_t *) doomed;
+
+  free(sm->block);
+}
+
+result_t sink_mem_create(size_t initial, sink_t **s)
+{
+  sink_mem_t *sm;
+
+  if (initial == 0)
+    initial = DEFAULTSIZE;
+
+  sm = malloc(sizeof(*sm));
+  if (!sm)
+    return result_OOM;
+
+  sm->block = malloc(initial);
+  if (!sm->block)
+  {
+    free(sm);
+    return result_OOM;
+  }
+
+  sm->size         = initial;
+
+  sm->base.buf     = sm->block;
+  sm->base.end     = sm->block + initial;
+
+  sm->base.last    = result_OK;
+
+  sm->base.flush   = sink_mem_flush;
+  sm->base.destroy = sink_mem_destroy;
+
+  *s = &sm->base;
+
+  return result_OK;
+}
+
+const unsigned char *sink_mem_get(sink_t *s, size_t *length)
+{
+  sink_mem_t *sm = (sink_mem_t *) s;
+
+  assert(s);
+
+  if (length)
+    *length = sm->base.buf - sm->block;
+
+  return sm->block;
+}
@@ -0,0 +1,109 @@
+/* sink-stdio.c -- C standard IO sink implementation */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "io/sink.h"
+
+#include "io/sink-stdio.h"
+
+/* Default buffer size. Large so that output goes out in big writes. */
+#define DEFAULTBUFSZ 65536
+
+typedef struct sink_file
+{
+  sink_t         base;
+  FILE          *file;
+
+  unsigned char *buffer;
+  size_t         bufsz;
+}
+sink_file_t;
+
+static result_t sink_stdio_flush(sink_t *s, size_t need)
+{
+  sink_file_t *sf = (sink_file_t *) s;
+  size_t       used;
+
+  used = sf->base.buf - sf->buffer;
+  if (used && fwrite(sf->buffer, 1, used, sf->file) != used)
+    return result_SINK_WRITE_FAILED;
+
+  /* the data is away: forget it now so that a retry after a failure below
+   * doesn't write it again */
+  sf->base.buf = sf->buffer;
+
+  if (need == 0 && fflush(sf->file) != 0)
+    return result_SINK_WRITE_FAILED;
+
+  if (need > sf->bufsz)
+  {
+    unsigned char *buffer;
+
+    /* a single item is larger than the buffer - enlarge it */
+
+    buffer = realloc(sf->buffer, need);
+    if (buffer == NULL)
+      return result_OOM;
+
+    sf->buffer = buffer;
+    sf->bufsz  = need;
+  }
+
+  sf->base.buf = sf->buffer;
+  sf->base.end = sf->buffer + sf->bufsz;
+
+  return result_OK;
+}
+
+static void sink_stdio_destroy(sink_t *doomed)
+{
+  sink_file_t *sf = (sink_file_t *) doomed;
+
+  free(sf->buffer);
+  fclose(sf->file);
+}
+
+result_t sink_stdio_create(FILE *f, size_t bufsz, sink_t **s)
+{
+  sink_file_t *sf;
+
+  assert(f);
+
+  if (bufsz == 0)
+    bufsz = DEFAULTBUFSZ;
+
+  sf = malloc(sizeof(*sf));
+  if (!sf)
+    return result_OOM;
+
+  sf->buffer = malloc(bufsz);
+  if (!sf->buffer)
+  {
+    free(sf);
+    return result_OOM;
+  }
+
+  sf->base.buf     = sf->buffer;
+  sf->base.end     = sf->buffer + bufsz;
+
+  sf->base.last    = result_OK;
+
+  sf->base.flush   = sink_stdio_flush;
+  sf->base.destroy = sink_stdio_destroy;
+
+  sf->file  = f;
+  sf->bufsz = bufsz;
+
+  *s = &sf->base;
+
+  return result_OK;
+}
@@ -0,0 +1,71 @@
+/* sink.c -- sink system support functions */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "io/sink.h"
+
+result_t sink_reserve(sink_t *s, size_t need)
+{
+  if (sink_remaining(s) >= need)
+    return result_OK;
+
+  s->last = s->flush(s, need);
+
+  return s->last;
+}
+
+result_t sink_write(sink_t *s, const void *block, size_t length)
+{
+  const unsigned char *p = block;
+
+  while (length > 0)
+  {
+    size_t n;
+
+    if (sink_remaining(s) == 0)
+    {
+      result_t err;
+
+      err = sink_reserve(s, 1);
+      if (err)
+        return err;
+    }
+
+    n = sink_remaining(s);
+    if (n > length)
+      n = length;
+
+    memcpy(s->buf, p, n);
+    s->buf += n;
+    p      += n;
+    length -= n;
+  }
+
+  return result_OK;
+}
+
+result_t sink_flush(sink_t *s)
+{
+  s->last = s->flush(s, 0);
+
+  return s->last;
+}
+
+void sink_destroy(sink_t *doomed)
+{
+  if (!doomed)
+    return;
+
+  if (doomed->destroy)
+    doomed->destroy(doomed);
+
+  free(doomed);
+}
@@ -0,0 +1,261 @@
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+
+#include "io/sink.h"
+#include "io/sink-mem.h"
+#include "io/sink-stdio.h"
+
+#include "test/all-tests.h"
+
+#define FILENAME "test-sink"
+
+#define NBYTES 100000
+
+/* ----------------------------------------------------------------------- */
+
+static unsigned char pattern(size_t i)
+{
+  return (unsigned char) ((i * 7) ^ (i >> 8));
+}
+
+/* write NBYTES in a mix of single bytes, blocks and reserved runs */
+static result_t fill(sink_t *s)
+{
+  unsigned char block[1000];
+  size_t        i;
+  size_t        j;
+  result_t      err;
+
+  i = 0;
+  while (i < NBYTES)
+  {
+    switch ((i / 1000) % 3)
+    {
+    case 0:
+      for (j = 0; j < 1000 && i < NBYTES; j++, i++)
+        if (!sink_putc(s, pattern(i)))
+          return result_TEST_FAILED;
+      break;
+
+    case 1:
+      for (j = 0; j < 1000 && i + j < NBYTES; j++)
+        block[j] = pattern(i + j);
+
+      err = sink_write(s, block, j);
+      if (err)
+        return err;
+
+      i += j;
+      break;
+
+    case 2:
+      /* direct formatting into the buffer */
+      err = sink_reserve(s, 1000);
+      if (err)
+        return err;
+
+      if (sink_remaining(s) < 1000)
+        return result_TEST_FAILED;
+
+      for (j = 0; j < 1000 && i < NBYTES; j++, i++)
+        *s->buf++ = pattern(i);
+      break;
+    }
+  }
+
+  return result_OK;
+}
+
+static result_t check(const unsigned char *got, size_t length)
+{
+  size_t i;
+
+  if (length != NBYTES)
+  {
+    printf("expected %d bytes, got %lu\n", NBYTES, (unsigned long) length);
+    return result_TEST_FAILED;
+  }
+
+  for (i = 0; i < length; i++)
+    if (got[i] != pattern(i))
+    {
+      printf("difference at %lu\n", (unsigned long) i);
+      return result_TEST_FAILED;
+    }
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t test_mem(void)
+{
+  result_t             err;
+  sink_t              *s;
+  const unsigned char *got;
+  size_t               length;
+
+  printf("test: memory sink\n");
+
+  err = sink_mem_create(1, &s);
+  if (err)
+    return err;
+
+  err = fill(s);
+  if (err)
+    goto Failure;
+
+  err = sink_flush(s);
+  if (err)
+    goto Failure;
+
+  got = sink_mem_get(s, &length);
+
+  err = check(got, length);
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  sink_destroy(s);
+
+  return err;
+}
+
+static result_t test_stdio(void)
+{
+  result_t       err;
+  FILE          *f;
+  sink_t        *s;
+  unsigned char *got;
+  size_t         length;
+
+  printf("test: stdio sink\n");
+
+  f = fopen(FILENAME, "wb");
+  if (f == NULL)
+    return result_TEST_FAILED;
+
+  /* a buffer smaller than some of the reservations forces it to grow */
+  err = sink_stdio_create(f, 100, &s);
+  if (err)
+  {
+    fclose(f);
+    return err;
+  }
+
+  err = fill(s);
+  if (err == result_OK)
+    err = sink_flush(s);
+
+  sink_destroy(s); /* closes the file */
+
+  if (err)
+    goto Failure;
+
+  got = malloc(NBYTES + 1);
+  if (got == NULL)
+  {
+    err = result_OOM;
+    goto Failure;
+  }
+
+  f = fopen(FILENAME, "rb");
+  if (f == NULL)
+  {
+    free(got);
+    err = result_TEST_FAILED;
+    goto Failure;
+  }
+
+  length = fread(got, 1, NBYTES + 1, f);
+  fclose(f);
+
+  err = check(got, length);
+
+  free(got);
+
+  /* FALLTHROUGH */
+
+Failure:
+
+  remove(FILENAME);
+
+  return err;
+}
+
+/* A failed flush must not leave written bytes to be written again. */
+static result_t test_stdio_failure(void)
+{
+  result_t err;
+  FILE    *f;
+  sink_t  *s;
+
+  printf("test: stdio sink failure\n");
+
+  /* writes to /dev/full are buffered by stdio then fail when flushed */
+  f = fopen("/dev/full", "wb");
+  if (f == NULL)
+  {
+    printf("skipped: no /dev/full\n");
+    return result_OK;
+  }
+
+  err = sink_stdio_create(f, 100, &s);
+  if (err)
+  {
+    fclose(f);
+    return err;
+  }
+
+  err = sink_write(s, "abcdefgh", 8);
+  if (err == result_OK)
+    err = sink_flush(s);
+
+  if (err != result_SINK_WRITE_FAILED || sink_remaining(s) != 100)
+    err = result_TEST_FAILED;
+  else
+    err = result_OK;
+
+  sink_destroy(s);
+
+  return err;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t sink_test(const char *resources)
+{
+  result_t rc;
+
+  NOT_USED(resources);
+
+  rc = test_mem();
+  if (rc)
+    goto Failure;
+
+  rc = test_stdio();
+  if (rc)
+    goto Failure;
+
+  rc = test_stdio_failure();
+  if (rc)
+    goto Failure;
+
+  return result_TEST_PASSED;
+
+
+Failure:
+  printf("\n\n*** result=%x\n", rc);
+  return result_TEST_FAILED;
+}
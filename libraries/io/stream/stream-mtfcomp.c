@@ -87,7 +87,20 @@ static int compress(MTFState_t *s, int (*cb)(void *opaque), void *opaque)
     if (c == EOF)
     {
       DBUG(("compress EOF\n"));
-      return EOF; // fix termination case
+
+      if (used == 0)
+        return EOF;
+
+      /* flush the final nibble, padded with an escape. the decompressor
+       * stops when it finds the escaped byte missing. */
+      assert(used == 4);
+
+      c = (buf & 0xF) | (ESCAPE << 4);
+
+      s->buf  = 0;
+      s->used = 0;
+
+      return c;
     }
 
     pos = index_of(s, c);
@@ -137,7 +150,7 @@ static int decompress(MTFState_t *s, int (*cb)(void *opaque), void *opaque)
     if (c == EOF)
     {
       DBUG(("decompress EOF case 1\n"));
-      return EOF; // fix termination case
+      return EOF;
     }
 
     DBUG(("{=%d}", c));
@@ -167,7 +180,7 @@ static int decompress(MTFState_t *s, int (*cb)(void *opaque), void *opaque)
       if (c == EOF)
       {
         DBUG(("decompress EOF case 2\n"));
-        return EOF; // fix termination case
+        return EOF; /* an escape with no byte following is padding */
       }
 
       DBUG(("{=%d}", c));
@@ -343,7 +356,7 @@ result_t stream_mtfdecomp_create(stream_t *input, int bufsz, stream_t **s)
 
   assert(input);
 
-  sm = malloc(offsetof(stream_mtfcomp_t, buffer) + bufsz);
+  sm = malloc(offsetof(stream_mtfdecomp_t, buffer) + bufsz);
   if (!sm)
     return result_OOM;
 
@@ -69,11 +69,11 @@ static stream_size_t stream_packbitscomp_fill(stream_t *s)
   int                    n;
   int                    first;
 
-  orig_p = p = (unsigned char *) sm->base.buf; // cur buf ptr
-  end = sm->buffer + sm->bufsz; // abs buf end
+  /* we're only called once the buffer is exhausted, so start over */
+  sm->base.buf = sm->base.end = sm->buffer;
 
-  if (p == end)
-    return stream_remaining(s); // already full
+  orig_p = p = sm->buffer; // cur buf ptr
+  end = sm->buffer + sm->bufsz; // abs buf end
 
   // assert(stream_remaining(s) < need);
 
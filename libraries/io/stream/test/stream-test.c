@@ -199,6 +199,102 @@ Failure:
   return result_TEST_FAILED;
 }
 
+/* Compress then decompress inputs of awkward lengths through each codec
+ * alone, so that the buffer refill and end of stream cases are exercised. */
+static result_t test_round_trip(void)
+{
+  static const int lengths[] = { 1, 2, 3, 127, 128, 129, 130, 255, 256, 1000,
+                                 5000 };
+
+  result_t       rc;
+  unsigned char *data;
+  unsigned char *comp;
+  stream_t      *stream[4] = { NULL, NULL, NULL, NULL };
+  int            codec;
+  int            i;
+  int            j;
+
+  printf("Test - Round Trip\n");
+
+  data = malloc(5000);
+  comp = malloc(5000 * 2);
+  if (data == NULL || comp == NULL)
+  {
+    rc = result_OOM;
+    goto Failure;
+  }
+
+  /* a mixture of runs and literals */
+  for (i = 0; i < 5000; i++)
+    data[i] = (i % 300 < 150) ? 'x' : (unsigned char) (i * 7 + i / 3);
+
+  for (codec = 0; codec < 2; codec++)
+  {
+    for (i = 0; i < NELEMS(lengths); i++)
+    {
+      int ncomp;
+      int n;
+      int c;
+      int trailing;
+
+      rc = stream_mem_create(data, lengths[i], &stream[0]);
+      if (rc == result_OK)
+        rc = (codec == 0) ?
+             stream_packbitscomp_create(stream[0], BUFSZ, &stream[1]) :
+             stream_mtfcomp_create(stream[0], BUFSZ, &stream[1]);
+      if (rc)
+        goto Failure;
+
+      for (ncomp = 0; (c = stream_getc(stream[1])) != EOF; ncomp++)
+        comp[ncomp] = (unsigned char) c;
+
+      rc = stream_mem_create(comp, ncomp, &stream[2]);
+      if (rc == result_OK)
+        rc = (codec == 0) ?
+             stream_packbitsdecomp_create(stream[2], BUFSZ, &stream[3]) :
+             stream_mtfdecomp_create(stream[2], BUFSZ, &stream[3]);
+      if (rc)
+        goto Failure;
+
+      for (n = 0; n < lengths[i]; n++)
+      {
+        c = stream_getc(stream[3]);
+        if (c == EOF || c != data[n])
+          break;
+      }
+
+      /* the decoder must stop exactly at the end of the input */
+      trailing = (n == lengths[i]) && stream_getc(stream[3]) != EOF;
+
+      for (j = 0; j < NELEMS(stream); j++)
+      {
+        stream_destroy(stream[j]);
+        stream[j] = NULL;
+      }
+
+      if (n != lengths[i] || trailing)
+      {
+        printf("%s: %d bytes in, %d bytes matched%s\n",
+               (codec == 0) ? "packbits" : "mtf", lengths[i], n,
+               trailing ? ", then trailing bytes" : "");
+        rc = result_TEST_FAILED;
+        goto Failure;
+      }
+    }
+  }
+
+  rc = result_OK;
+
+  /* FALLTHROUGH */
+
+Failure:
+  for (j = 0; j < NELEMS(stream); j++)
+    stream_destroy(stream[j]);
+  free(comp);
+  free(data);
+  return rc;
+}
+
 static result_t test_block(void)
 {
   result_t             rc = result_TEST_PASSED;
@@ -305,6 +401,10 @@ result_t stream_test(const char *resources)
   if (rc)
     goto Failure;
 
+  rc = test_round_trip();
+  if (rc)
+    goto Failure;
+
   return result_TEST_PASSED;
 
 
@@ -0,0 +1,90 @@
+/* alloc.c -- region allocator */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+  unsigned char *block;
+  arena_chunk_t *c;
+  size_t         chunksize;
+
+  if (size > SIZE_MAX - CHUNKHDR - ARENA_ALIGN)
+    return NULL;
+
+  /* a zero sized request still needs a distinct non-NULL block: on a fresh
+   * arena ptr and end are both NULL so the fast path would return NULL */
+  if (size == 0)
+    size = ARENA_ALIGN;
+
+  size = ARENA_ROUNDUP(size);
+
+  /* fast path: bump through the head chunk */
+
+  if (size <= (size_t) (arena->end - arena->ptr))
+  {
+    block = arena->ptr;
+    arena->ptr += size;
+    arena->last = block;
+    return block;
+  }
+
+  /* blocks over a quarter of a chunk get a chunk to themselves */
+
+  if (size > (arena->chunksize - CHUNKHDR) / 4)
+  {
+    chunksize = CHUNKHDR + size;
+
+    c = malloc(chunksize);
+    if (c == NULL)
+      return NULL;
+
+    c->size = chunksize;
+
+    if (arena->chunks)
+    {
+      c->next = arena->chunks->next;
+      arena->chunks->next = c;
+    }
+    else
+    {
+      /* no head chunk: the next small block will start one */
+      c->next = NULL;
+      arena->chunks = c;
+    }
+
+    arena->footprint += chunksize;
+    arena->last = NULL; /* can't be grown in place */
+
+    return CHUNKDATA(c);
+  }
+
+  /* otherwise start a new head chunk, abandoning the tail of the last */
+
+  chunksize = arena->chunksize;
+
+  c = malloc(chunksize);
+  if (c == NULL)
+    return NULL;
+
+  c->next = arena->chunks;
+  c->size = chunksize;
+
+  arena->chunks     = c;
+  arena->footprint += chunksize;
+
+  block = CHUNKDATA(c);
+  arena->ptr  = block + size;
+  arena->end  = (unsigned char *) c + chunksize;
+  arena->last = block;
+
+  return block;
+}
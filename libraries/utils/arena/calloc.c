@@ -0,0 +1,25 @@
+/* calloc.c -- region allocator */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+void *arena_calloc(arena_t *arena, size_t nelems, size_t size)
+{
+  void *block;
+
+  if (size != 0 && nelems > SIZE_MAX / size)
+    return NULL;
+
+  block = arena_alloc(arena, nelems * size);
+  if (block == NULL)
+    return NULL;
+
+  /* chunks are recycled by arena_reset so can't be assumed clean */
+  memset(block, 0, nelems * size);
+
+  return block;
+}
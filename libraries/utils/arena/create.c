@@ -0,0 +1,37 @@
+/* create.c -- region allocator */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+result_t arena_create(size_t chunksize, arena_t **parena)
+{
+  arena_t *arena;
+
+  if (chunksize == 0)
+    chunksize = DEFAULT_CHUNKSIZE;
+  else if (chunksize < MIN_CHUNKSIZE)
+    chunksize = MIN_CHUNKSIZE;
+  else
+    chunksize = ARENA_ROUNDUP(chunksize);
+
+  arena = calloc(1, sizeof(*arena));
+  if (arena == NULL)
+    return result_OOM;
+
+  /* chunks are allocated on demand */
+
+  arena->chunksize = chunksize;
+
+  *parena = arena;
+
+  return result_OK;
+}
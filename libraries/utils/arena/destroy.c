@@ -0,0 +1,28 @@
+/* destroy.c -- region allocator */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+void arena_destroy(arena_t *doomed)
+{
+  arena_chunk_t *c;
+  arena_chunk_t *next;
+
+  if (doomed == NULL)
+    return;
+
+  for (c = doomed->chunks; c; c = next)
+  {
+    next = c->next;
+    free(c);
+  }
+
+  free(doomed);
+}
@@ -0,0 +1,10 @@
+/* footprint.c -- region allocator */
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+size_t arena_footprint(const arena_t *arena)
+{
+  return arena->footprint;
+}
@@ -0,0 +1,50 @@
+/* impl.h -- region allocator */
+
+#ifndef UTILS_ARENA_IMPL_H
+#define UTILS_ARENA_IMPL_H
+
+#include <stddef.h>
+
+#include "utils/arena.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* Chunks are kept on a singly linked list, most recent first. The head of
+ * the list is the chunk being bumped through. Blocks too large to share a
+ * chunk are given a dedicated chunk which is linked in behind the head so
+ * that the free space in the head is not abandoned.
+ */
+
+#define DEFAULT_CHUNKSIZE 65536
+#define MIN_CHUNKSIZE     256
+
+/* round 'n' up to a multiple of the arena alignment */
+#define ARENA_ROUNDUP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+typedef struct arena_chunk
+{
+  struct arena_chunk *next;
+  size_t              size; /* including this header */
+}
+arena_chunk_t;
+
+/* size of a chunk header once padded to the arena alignment */
+#define CHUNKHDR ARENA_ROUNDUP(sizeof(arena_chunk_t))
+
+/* the first usable byte of a chunk */
+#define CHUNKDATA(c) ((unsigned char *) (c) + CHUNKHDR)
+
+struct arena
+{
+  unsigned char      *ptr;       /* next free byte in head chunk */
+  unsigned char      *end;       /* end of head chunk */
+  unsigned char      *last;      /* most recent block, or NULL */
+
+  arena_chunk_t      *chunks;    /* list of chunks */
+  size_t              chunksize; /* size of a standard chunk */
+  size_t              footprint; /* total size of all chunks */
+};
+
+/* ----------------------------------------------------------------------- */
+
+#endif /* UTILS_ARENA_IMPL_H */
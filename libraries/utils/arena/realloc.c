@@ -0,0 +1,40 @@
+/* realloc.c -- region allocator */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+void *arena_realloc(arena_t *arena,
+                    void    *block,
+                    size_t   oldsize,
+                    size_t   newsize)
+{
+  void *newblock;
+
+  if (block == NULL)
+    return arena_alloc(arena, newsize);
+
+  /* the most recent block can be resized in place if it still fits */
+
+  if (block == arena->last &&
+      newsize <= SIZE_MAX - ARENA_ALIGN &&
+      ARENA_ROUNDUP(newsize) <= (size_t) (arena->end - arena->last))
+  {
+    arena->ptr = arena->last + ARENA_ROUNDUP(newsize);
+    return block;
+  }
+
+  if (newsize <= oldsize)
+    return block;
+
+  newblock = arena_alloc(arena, newsize);
+  if (newblock == NULL)
+    return NULL;
+
+  memcpy(newblock, block, oldsize);
+
+  return newblock;
+}
@@ -0,0 +1,47 @@
+/* reset.c -- region allocator */
+
+#include <stdlib.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "utils/arena.h"
+
+#include "impl.h"
+
+void arena_reset(arena_t *arena)
+{
+  arena_chunk_t *keep;
+  arena_chunk_t *c;
+  arena_chunk_t *next;
+
+  /* retain one standard sized chunk, free the rest */
+
+  keep = NULL;
+  for (c = arena->chunks; c; c = next)
+  {
+    next = c->next;
+    if (keep == NULL && c->size == arena->chunksize)
+      keep = c;
+    else
+      free(c);
+  }
+
+  arena->chunks = keep;
+  arena->last   = NULL;
+
+  if (keep)
+  {
+    keep->next       = NULL;
+    arena->ptr       = CHUNKDATA(keep);
+    arena->end       = (unsigned char *) keep + keep->size;
+    arena->footprint = keep->size;
+  }
+  else
+  {
+    arena->ptr       = NULL;
+    arena->end       = NULL;
+    arena->footprint = 0;
+  }
+}
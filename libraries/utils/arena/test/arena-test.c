@@ -0,0 +1,462 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef FORTIFY
+#include "fortify/fortify.h"
+#endif
+
+#include "base/result.h"
+#include "base/utils.h"
+#include "utils/arena.h"
+
+#include "datastruct/atom.h"
+#include "datastruct/hash.h"
+#include "datastruct/ntree.h"
+#include "datastruct/vector.h"
+
+#include "test/all-tests.h"
+
+#define CHUNKSIZE 4096
+#define NSMALL    10000
+#define NKEYS     1000
+#define NBENCH    (1 << 20) /* tree nodes built and torn down */
+
+/* ----------------------------------------------------------------------- */
+
+/* Keys are small integers stored directly in the key pointer. */
+
+#define KEY(i) ((const void *) (uintptr_t) ((i) + 1))
+
+static unsigned int int_hash(const void *a)
+{
+  return (unsigned int) (uintptr_t) a * 2654435761u;
+}
+
+static int int_compare(const void *a, const void *b)
+{
+  uintptr_t ia = (uintptr_t) a;
+  uintptr_t ib = (uintptr_t) b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t arena_basic_test(void)
+{
+  result_t       err;
+  arena_t       *arena;
+  unsigned char *blocks[NSMALL];
+  unsigned char *p, *q;
+  int            i;
+  size_t         j;
+
+  printf("test: basic allocation\n");
+
+  err = arena_create(CHUNKSIZE, &arena);
+  if (err)
+    return err;
+
+  /* a zero sized block on a fresh arena is not mistaken for exhaustion */
+
+  if (arena_alloc(arena, 0) == NULL)
+  {
+    printf("zero sized block on fresh arena failed\n");
+    goto Failure;
+  }
+
+  /* fill many odd sized blocks with a pattern then check none overlap */
+
+  for (i = 0; i < NSMALL; i++)
+  {
+    size_t size = 1 + i % 37;
+
+    blocks[i] = arena_alloc(arena, size);
+    if (blocks[i] == NULL)
+      goto Failure;
+
+    if ((uintptr_t) blocks[i] % ARENA_ALIGN)
+    {
+      printf("block %d misaligned\n", i);
+      goto Failure;
+    }
+
+    memset(blocks[i], i & 0xff, size);
+  }
+
+  for (i = 0; i < NSMALL; i++)
+    for (j = 0; j < (size_t) (1 + i % 37); j++)
+      if (blocks[i][j] != (i & 0xff))
+      {
+        printf("block %d corrupted\n", i);
+        goto Failure;
+      }
+
+  printf("footprint after %d blocks: %lu bytes\n",
+         NSMALL, (unsigned long) arena_footprint(arena));
+
+  /* the most recent block grows in place */
+
+  p = arena_alloc(arena, 16);
+  if (p == NULL)
+    goto Failure;
+  memset(p, 0x5a, 16);
+  q = arena_realloc(arena, p, 16, 64);
+  if (q != p)
+  {
+    printf("realloc of most recent block moved\n");
+    goto Failure;
+  }
+
+  /* an earlier block must move, preserving its contents */
+
+  q = arena_realloc(arena, blocks[0], 1, 100);
+  if (q == NULL)
+    goto Failure;
+  if (q == blocks[0] || q[0] != 0)
+  {
+    printf("realloc of earlier block wrong\n");
+    goto Failure;
+  }
+
+  /* a block larger than a chunk gets its own */
+
+  p = arena_alloc(arena, CHUNKSIZE * 4);
+  if (p == NULL)
+    goto Failure;
+  memset(p, 0xff, CHUNKSIZE * 4);
+
+  /* after a reset a single chunk remains and calloc still zeroes */
+
+  arena_reset(arena);
+
+  if (arena_footprint(arena) != CHUNKSIZE)
+  {
+    printf("footprint after reset: %lu bytes\n",
+           (unsigned long) arena_footprint(arena));
+    goto Failure;
+  }
+
+  p = arena_calloc(arena, 100, 8);
+  if (p == NULL)
+    goto Failure;
+  for (j = 0; j < 800; j++)
+    if (p[j])
+    {
+      printf("calloc not zeroed\n");
+      goto Failure;
+    }
+
+  if (arena_calloc(arena, SIZE_MAX / 2, 4) != NULL)
+  {
+    printf("calloc overflow not caught\n");
+    goto Failure;
+  }
+
+  arena_destroy(arena);
+
+  return result_OK;
+
+
+Failure:
+
+  arena_destroy(arena);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t copy_data(void *data, void *opaque, void **newdata)
+{
+  NOT_USED(opaque);
+
+  *newdata = data;
+
+  return result_OK;
+}
+
+static result_t arena_containers_test(void)
+{
+  result_t    err;
+  arena_t    *arena;
+  hash_t     *hash;
+  ntree_t    *root;
+  ntree_t    *copy;
+  vector_t   *vec;
+  atom_set_t *atoms;
+  int         i;
+
+  printf("test: containers in an arena\n");
+
+  err = arena_create(0, &arena);
+  if (err)
+    return err;
+
+  /* hash: removed nodes are recycled */
+
+  err = hash_create_in_arena(arena,
+                             NULL,
+                             97,
+                             int_hash,
+                             int_compare,
+                             hash_no_destroy_key,
+                             hash_no_destroy_value,
+                             &hash);
+  if (err)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+  {
+    err = hash_insert(hash, KEY(i), KEY(i * 2));
+    if (err)
+      goto Failure;
+  }
+
+  for (i = 0; i < NKEYS; i += 2)
+    hash_remove(hash, KEY(i));
+
+  {
+    size_t footprint = arena_footprint(arena);
+
+    for (i = 0; i < NKEYS; i += 2)
+    {
+      err = hash_insert(hash, KEY(i), KEY(i * 2));
+      if (err)
+        goto Failure;
+    }
+
+    if (arena_footprint(arena) != footprint)
+    {
+      printf("hash: removed nodes not reused\n");
+      goto Failure;
+    }
+  }
+
+  if (hash_count(hash) != NKEYS)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+    if (hash_lookup(hash, KEY(i)) != KEY(i * 2))
+    {
+      printf("hash: key %d wrong\n", i);
+      goto Failure;
+    }
+
+  /* ntree: copies land in the same arena */
+
+  err = ntree_new_in_arena(arena, &root);
+  if (err)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+  {
+    ntree_t *node;
+
+    err = ntree_new_in_arena(arena, &node);
+    if (err)
+      goto Failure;
+
+    ntree_set_data(node, (void *) KEY(i));
+
+    err = ntree_insert(i < 10 ? root : ntree_nth_child(root, i % 10),
+                       ntree_INSERT_AT_END,
+                       node);
+    if (err)
+      goto Failure;
+  }
+
+  err = ntree_copy(root, copy_data, NULL, &copy);
+  if (err)
+    goto Failure;
+
+  if (ntree_n_nodes(copy) != NKEYS + 1)
+  {
+    printf("ntree: copy has %d nodes\n", ntree_n_nodes(copy));
+    goto Failure;
+  }
+
+  ntree_delete(ntree_nth_child(copy, 3));
+
+  /* vector: an empty vector can be truncated and rewidened */
+
+  vec = vector_create_in_arena(arena, sizeof(int));
+  if (vec == NULL)
+    goto Failure;
+
+  err = vector_set_length(vec, 0);
+  if (!err)
+    err = vector_set_width(vec, sizeof(int) * 2);
+  if (err)
+  {
+    printf("vector: empty resize failed\n");
+    goto Failure;
+  }
+
+  /* vector: grows in place while it is the most recent block */
+
+  vec = vector_create_in_arena(arena, sizeof(int));
+  if (vec == NULL)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+  {
+    err = vector_insert(vec, &i);
+    if (err)
+      goto Failure;
+  }
+
+  err = vector_set_width(vec, sizeof(int) * 2);
+  if (err)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+    if (*(int *) vector_get(vec, i) != i)
+    {
+      printf("vector: element %d wrong\n", i);
+      goto Failure;
+    }
+
+  /* atom */
+
+  atoms = atom_create_in_arena(arena, 0, 0);
+  if (atoms == NULL)
+    goto Failure;
+
+  for (i = 0; i < NKEYS; i++)
+  {
+    unsigned char        block[8];
+    atom_t               atom;
+    const unsigned char *got;
+    size_t               length;
+
+    /* atoms must be distinct so lead with the index */
+    memset(block, i, sizeof(block));
+    block[0] = (unsigned char) (i >> 8);
+
+    err = atom_new(atoms, block, 2 + i % 7, &atom);
+    if (err)
+      goto Failure;
+
+    got = atom_get(atoms, atom, &length);
+    if (length != (size_t) (2 + i % 7) || memcmp(got, block, length))
+    {
+      printf("atom: %d wrong\n", i);
+      goto Failure;
+    }
+  }
+
+  /* nothing above is destroyed individually: it all goes with the arena */
+
+  arena_destroy(arena);
+
+  return result_OK;
+
+
+Failure:
+
+  arena_destroy(arena);
+
+  return result_TEST_FAILED;
+}
+
+/* ----------------------------------------------------------------------- */
+
+static result_t arena_bench_test(void)
+{
+  result_t err;
+  int      pass;
+
+  printf("test: build and tear down a %d node tree\n", NBENCH);
+
+  for (pass = 0; pass < 2; pass++)
+  {
+    arena_t *arena;
+    ntree_t *root;
+    clock_t  start;
+    double   secs;
+    int      i;
+
+    arena = NULL;
+    root  = NULL;
+    if (pass == 1)
+    {
+      err = arena_create(0, &arena);
+      if (err)
+        return err;
+    }
+
+    start = clock();
+
+    err = ntree_new_in_arena(arena, &root);
+    if (err)
+      goto Failure;
+
+    for (i = 0; i < NBENCH; i++)
+    {
+      ntree_t *node;
+
+      err = ntree_new_in_arena(arena, &node);
+      if (err)
+        goto Failure;
+
+      err = ntree_prepend(root, node);
+      if (err)
+        goto Failure;
+    }
+
+    if (arena)
+      arena_destroy(arena);
+    else
+      ntree_delete(root);
+
+    secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%-5s %.3f s\n", arena ? "arena" : "heap", secs);
+
+    continue;
+
+
+Failure:
+
+    if (arena)
+      arena_destroy(arena);
+    else if (root)
+      ntree_delete(root);
+    return result_TEST_FAILED;
+  }
+
+  return result_OK;
+}
+
+/* ----------------------------------------------------------------------- */
+
+result_t arena_test(const char *resources)
+{
+  result_t err;
+
+  NOT_USED(resources);
+
+  err = arena_basic_test();
+  if (err)
+    goto Failure;
+
+  err = arena_containers_test();
+  if (err)
+    goto Failure;
+
+  err = arena_bench_test();
+  if (err)
+    goto Failure;
+
+  return result_TEST_PASSED;
+
+
+Failure:
+
+  return result_TEST_FAILED;
+}
@@ -0,0 +1,370 @@
+/* block.c -- binary arithmetic on blocks of words */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils/barith.h"
+
+/* ----------------------------------------------------------------------- */
+
+/* On x86 the kernels have AVX2 and SSE2/POPCNT variants which are compiled
+ * using per-function target attributes and chosen at run time. Elsewhere,
+ * or with other compilers, only the portable word-at-a-time loops exist.
+ *
+ * Each kernel processes as many whole vectors as it can then hands the
+ * remainder to the portable loop.
+ */
+
+#if defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define BLOCK_X86
+#include <immintrin.h>
+#endif
+
+/* ----------------------------------------------------------------------- */
+
+#ifdef BLOCK_X86
+
+static int have_avx2(void)
+{
+  __builtin_cpu_init(); /* cheap once initialised */
+  return __builtin_cpu_supports("avx2");
+}
+
+static int have_sse2(void)
+{
+#ifdef __SSE2__
+  return 1; /* baseline on x86-64 */
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int have_popcnt(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("popcnt");
+}
+
+/* Count using a nibble lookup table held in a vector register. Byte counts
+ * are summed into 64-bit lanes by vpsadbw.
+ * Mula, Kurz, Lemire: "Faster Population Counts Using AVX2 Instructions". */
+__attribute__((target("avx2")))
+static size_t countbits_avx2(const unsigned char *p, size_t nvecs)
+{
+  const __m256i lut  = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                        1, 2, 2, 3, 2, 3, 3, 4,
+                                        0, 1, 1, 2, 1, 2, 2, 3,
+                                        1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low  = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i       acc;
+  size_t        i;
+
+  acc = zero;
+  for (i = 0; i < nvecs; i++)
+  {
+    __m256i v, lo, hi, c;
+
+    v  = _mm256_loadu_si256((const __m256i *) p + i);
+    lo = _mm256_and_si256(v, low);
+    hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    c  = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                         _mm256_shuffle_epi8(lut, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, zero));
+  }
+
+  {
+    uint64_t lanes[4];
+
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+
+    return (size_t) (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+  }
+}
+
+/* Count using the POPCNT instruction, a 64-bit word at a time. */
+__attribute__((target("popcnt")))
+static size_t countbits_popcnt(const unsigned char *p, size_t nwords)
+{
+  size_t c;
+  size_t i;
+
+  c = 0;
+  for (i = 0; i < nwords; i++)
+  {
+    uint64_t w;
+
+    memcpy(&w, p + i * 8, 8);
+    c += (size_t) __builtin_popcountll(w);
+  }
+
+  return c;
+}
+
+__attribute__((target("avx2")))
+static void and_avx2(unsigned char       *dst,
+                     const unsigned char *a,
+                     const unsigned char *b,
+                     size_t               nvecs)
+{
+  size_t i;
+
+  for (i = 0; i < nvecs; i++)
+  {
+    __m256i x, y;
+
+    x = _mm256_loadu_si256((const __m256i *) a + i);
+    y = _mm256_loadu_si256((const __m256i *) b + i);
+    _mm256_storeu_si256((__m256i *) dst + i, _mm256_and_si256(x, y));
+  }
+}
+
+__attribute__((target("avx2")))
+static void or_avx2(unsigned char       *dst,
+                    const unsigned char *a,
+                    const unsigned char *b,
+                    size_t               nvecs)
+{
+  size_t i;
+
+  for (i = 0; i < nvecs; i++)
+  {
+    __m256i x, y;
+
+    x = _mm256_loadu_si256((const __m256i *) a + i);
+    y = _mm256_loadu_si256((const __m256i *) b + i);
+    _mm256_storeu_si256((__m256i *) dst + i, _mm256_or_si256(x, y));
+  }
+}
+
+__attribute__((target("sse2")))
+static void and_sse2(unsigned char       *dst,
+                     const unsigned char *a,
+                     const unsigned char *b,
+                     size_t               nvecs)
+{
+  size_t i;
+
+  for (i = 0; i < nvecs; i++)
+  {
+    __m128i x, y;
+
+    x = _mm_loadu_si128((const __m128i *) a + i);
+    y = _mm_loadu_si128((const __m128i *) b + i);
+    _mm_storeu_si128((__m128i *) dst + i, _mm_and_si128(x, y));
+  }
+}
+
+__attribute__((target("sse2")))
+static void or_sse2(unsigned char       *dst,
+                    const unsigned char *a,
+                    const unsigned char *b,
+                    size_t               nvecs)
+{
+  size_t i;
+
+  for (i = 0; i < nvecs; i++)
+  {
+    __m128i x, y;
+
+    x = _mm_loadu_si128((const __m128i *) a + i);
+    y = _mm_loadu_si128((const __m128i *) b + i);
+    _mm_storeu_si128((__m128i *) dst + i, _mm_or_si128(x, y));
+  }
+}
+
+__attribute__((target("avx2")))
+static int iszero_avx2(const unsigned char *p, size_t nvecs)
+{
+  size_t i;
+
+  for (i = 0; i < nvecs; i++)
+  {
+    __m256i v;
+
+    v = _mm256_loadu_si256((const __m256i *) p + i);
+    if (!_mm256_testz_si256(v, v))
+      return 0;
+  }
+
+  return 1;
+}
+
+#endif /* BLOCK_X86 */
+
+/* ----------------------------------------------------------------------- */
+
+size_t countbits_block(const void *block, size_t nbytes)
+{
+  const unsigned char *p = block;
+  size_t               c;
+  size_t               n;
+
+  c = 0;
+
+#ifdef BLOCK_X86
+  if (have_avx2())
+  {
+    n = nbytes >> 5;
+    c += countbits_avx2(p, n);
+    p      += n << 5;
+    nbytes -= n << 5;
+  }
+  if (have_popcnt())
+  {
+    n = nbytes >> 3;
+    c += countbits_popcnt(p, n);
+    p      += n << 3;
+    nbytes -= n << 3;
+  }
+#endif
+
+  for (n = nbytes >> 2; n > 0; n--)
+  {
+    uint32_t w;
+
+    memcpy(&w, p, 4);
+    c += countbits_32(w);
+    p += 4;
+  }
+
+  for (n = nbytes & 3; n > 0; n--)
+    c += countbits_32(*p++);
+
+  return c;
+}
+
+void and_block(void *dst, const void *a, const void *b, size_t nbytes)
+{
+  unsigned char       *d = dst;
+  const unsigned char *x = a;
+  const unsigned char *y = b;
+  size_t               i;
+
+#ifdef BLOCK_X86
+  {
+    size_t n;
+
+    if (have_avx2())
+    {
+      n = nbytes >> 5;
+      and_avx2(d, x, y, n);
+      n <<= 5;
+    }
+    else if (have_sse2())
+    {
+      n = nbytes >> 4;
+      and_sse2(d, x, y, n);
+      n <<= 4;
+    }
+    else
+    {
+      n = 0;
+    }
+
+    d += n;
+    x += n;
+    y += n;
+    nbytes -= n;
+  }
+#endif
+
+  for (i = 0; i + 4 <= nbytes; i += 4)
+  {
+    uint32_t p, q;
+
+    memcpy(&p, x + i, 4);
+    memcpy(&q, y + i, 4);
+    p &= q;
+    memcpy(d + i, &p, 4);
+  }
+
+  for (; i < nbytes; i++)
+    d[i] = x[i] & y[i];
+}
+
+void or_block(void *dst, const void *a, const void *b, size_t nbytes)
+{
+  unsigned char       *d = dst;
+  const unsigned char *x = a;
+  const unsigned char *y = b;
+  size_t               i;
+
+#ifdef BLOCK_X86
+  {
+    size_t n;
+
+    if (have_avx2())
+    {
+      n = nbytes >> 5;
+      or_avx2(d, x, y, n);
+      n <<= 5;
+    }
+    else if (have_sse2())
+    {
+      n = nbytes >> 4;
+      or_sse2(d, x, y, n);
+      n <<= 4;
+    }
+    else
+    {
+      n = 0;
+    }
+
+    d += n;
+    x += n;
+    y += n;
+    nbytes -= n;
+  }
+#endif
+
+  for (i = 0; i + 4 <= nbytes; i += 4)
+  {
+    uint32_t p, q;
+
+    memcpy(&p, x + i, 4);
+    memcpy(&q, y + i, 4);
+    p |= q;
+    memcpy(d + i, &p, 4);
+  }
+
+  for (; i < nbytes; i++)
+    d[i] = x[i] | y[i];
+}
+
+int iszero_block(const void *block, size_t nbytes)
+{
+  const unsigned char *p = block;
+  size_t               i;
+
+#ifdef BLOCK_X86
+  if (have_avx2())
+  {
+    size_t n;
+
+    n = nbytes >> 5;
+    if (!iszero_avx2(p, n))
+      return 0;
+    p      += n << 5;
+    nbytes -= n << 5;
+  }
+#endif
+
+  for (i = 0; i + 4 <= nbytes; i += 4)
+  {
+    uint32_t w;
+
+    memcpy(&w, p + i, 4);
+    if (w)
+      return 0;
+  }
+
+  for (; i < nbytes; i++)
+    if (p[i])
+      return 0;
+
+  return 1;
+}